@@ -1,8 +1,33 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <math.h>
 #include <locale.h>
+#include <time.h>
+#include <limits.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #include "struct.h"
 
 
@@ -14,485 +39,7536 @@
 #define CATEGORIA 1
 #define RAIZ 0
 
-// ========================================
-// FUNCOES DO LUIS
-// ========================================
-
-// Funcao para criar um no novo
-No* criar_no(const char* nome, int tipo, float percentual_alvo, float valor_investido) {
-    No* novo = (No*) malloc(sizeof(No));
-
-    strncpy(novo->nome, nome, 63);
-    novo->nome[63] = '\0';
+// Contador de alocacoes da thread (so conta com OTIMIZADOR_CONTAR_ALOCACOES, ver struct.h)
+__thread long long alocacoes_feitas = 0;
 
-    novo->tipo = tipo;
-    novo->percentual_alvo = percentual_alvo;
-    novo->valor_investido = valor_investido;
-    novo->valor_total = 0.0;
-    novo->esquerda = NULL;
-    novo->direita = NULL;
+#if OTIMIZADOR_CONTAR_ALOCACOES
+// O linker manda as chamadas deste arquivo para __wrap_* (-Wl,--wrap=malloc,...); __real_* e o da libc
+void* __real_malloc(size_t tamanho);
+void* __real_calloc(size_t quantidade, size_t tamanho);
+void* __real_realloc(void* antigo, size_t tamanho);
 
-    return novo;
+void* __wrap_malloc(size_t tamanho) {
+    alocacoes_feitas++;
+    return __real_malloc(tamanho);
 }
 
-// Funcao para buscar um no pelo nome
-No* buscar_no(No* raiz, const char* nome) {
-    if(raiz == NULL) {
-        return NULL;
-    }
+void* __wrap_calloc(size_t quantidade, size_t tamanho) {
+    alocacoes_feitas++;
+    return __real_calloc(quantidade, tamanho);
+}
 
-    if(strcmp(raiz->nome, nome) == 0) {
-        return raiz;
-    }
+void* __wrap_realloc(void* antigo, size_t tamanho) {
+    alocacoes_feitas++;
+    return __real_realloc(antigo, tamanho);
+}
+#endif
 
-    No* resultado = buscar_no(raiz->esquerda, nome);
-    if(resultado != NULL) {
-        return resultado;
-    }
+// ========================================
+// RELATORIOS (TEXTO, CSV E JSON)
+// ========================================
 
-    return buscar_no(raiz->direita, nome);
+// Funcao para iniciar um relatorio vazio no formato escolhido
+void relatorio_iniciar(Relatorio* relatorio, int formato) {
+    relatorio->texto = NULL;
+    relatorio->tamanho = 0;
+    relatorio->capacidade = 0;
+    relatorio->formato = formato;
 }
 
-// Funcao para calcular o total de um no
-float calcular_total_no(No* no) {
-    if(no == NULL) {
-        return 0.0;
+// Funcao para garantir espaco para mais extra bytes (e o '\0')
+void relatorio_reservar(Relatorio* relatorio, size_t extra) {
+    if(relatorio->tamanho + extra + 1 <= relatorio->capacidade) {
+        return;
     }
 
-    if(no->esquerda == NULL && no->direita == NULL) {
-        no->valor_total = no->valor_investido;
-        return no->valor_total;
+    size_t capacidade = relatorio->capacidade > 0 ? relatorio->capacidade : 4096;
+    while(capacidade < relatorio->tamanho + extra + 1) {
+        capacidade = capacidade * 2;
     }
 
-    float soma = 0.0;
-    soma = soma + calcular_total_no(no->esquerda);
-    soma = soma + calcular_total_no(no->direita);
-    soma = soma + no->valor_investido;
-
-    no->valor_total = soma;
-    return soma;
+    relatorio->texto = (char*) realloc(relatorio->texto, capacidade);
+    relatorio->capacidade = capacidade;
 }
 
-// Funcao para criar carteira por perfil
-Arvore* criar_carteira_perfil(float valor_inicial, const char* perfil) {
-    Arvore* carteira = (Arvore*) malloc(sizeof(Arvore));
-
-    carteira->raiz = criar_no("Carteira", RAIZ, 0.0, 0.0);
+// Funcao para acrescentar texto formatado no relatorio (como o printf, mas sem I/O)
+void relatorio_printf(Relatorio* relatorio, const char* formato, ...) {
+    va_list argumentos;
 
-    float perc_rf, perc_rv;
+    relatorio_reservar(relatorio, 256);
+    va_start(argumentos, formato);
+    int escrito = vsnprintf(relatorio->texto + relatorio->tamanho,
+                            relatorio->capacidade - relatorio->tamanho, formato, argumentos);
+    va_end(argumentos);
 
-    if(strcmp(perfil, "CONSERVADOR") == 0) {
-        perc_rf = 70.0;
-        perc_rv = 30.0;
-        printf("\nCriando carteira CONSERVADORA...\n");
-    }
-    else if(strcmp(perfil, "MODERADO") == 0) {
-        perc_rf = 50.0;
-        perc_rv = 50.0;
-        printf("\nCriando carteira MODERADA...\n");
-    }
-    else if(strcmp(perfil, "ARROJADO") == 0) {
-        perc_rf = 30.0;
-        perc_rv = 70.0;
-        printf("\nCriando carteira ARROJADA...\n");
+    if(escrito < 0) {
+        return;
     }
-    else {
-        perc_rf = 50.0;
-        perc_rv = 50.0;
-        printf("\nPerfil desconhecido. Usando MODERADO...\n");
+
+    if(relatorio->tamanho + escrito + 1 > relatorio->capacidade) {
+        relatorio_reservar(relatorio, escrito);
+        va_start(argumentos, formato);
+        vsnprintf(relatorio->texto + relatorio->tamanho,
+                  relatorio->capacidade - relatorio->tamanho, formato, argumentos);
+        va_end(argumentos);
     }
 
-    No* renda_fixa = criar_no("Renda Fixa", CATEGORIA, perc_rf, 0.0);
-    No* acoes = criar_no("Acoes", CATEGORIA, perc_rv, 0.0);
+    relatorio->tamanho += escrito;
+}
 
-    carteira->raiz->esquerda = renda_fixa;
-    carteira->raiz->direita = acoes;
+// Funcao para acrescentar uma string JSON entre aspas (escapa aspas, barras e controles)
+void relatorio_json_texto(Relatorio* relatorio, const char* texto) {
+    relatorio_reservar(relatorio, strlen(texto) * 6 + 2);
 
-    float valor_rf = valor_inicial * (perc_rf / 100.0);
-    float valor_rv = valor_inicial * (perc_rv / 100.0);
+    char* destino = relatorio->texto + relatorio->tamanho;
+    *destino++ = '"';
+    for(const unsigned char* c = (const unsigned char*) texto; *c != '\0'; c++) {
+        if(*c == '"' || *c == '\\') {
+            *destino++ = '\\';
+            *destino++ = *c;
+        } else if(*c < 0x20) {
+            destino += sprintf(destino, "\\u%04x", *c);
+        } else {
+            *destino++ = *c;
+        }
+    }
+    *destino++ = '"';
+    *destino = '\0';
 
-    No* tesouro = criar_no("Tesouro Selic", ATIVO, 0.0, valor_rf / 2);
-    No* cdb = criar_no("CDB XP", ATIVO, 0.0, valor_rf / 2);
-    renda_fixa->esquerda = tesouro;
-    renda_fixa->direita = cdb;
+    relatorio->tamanho = destino - relatorio->texto;
+}
 
-    No* petr4 = criar_no("PETR4", ATIVO, 0.0, valor_rv / 2);
-    No* itub4 = criar_no("ITUB4", ATIVO, 0.0, valor_rv / 2);
-    acoes->esquerda = petr4;
-    acoes->direita = itub4;
+// Funcao para acrescentar um campo de CSV (entre aspas so se tiver virgula, aspas ou quebra de linha)
+void relatorio_csv_texto(Relatorio* relatorio, const char* texto) {
+    if(strpbrk(texto, ",\"\r\n") == NULL) {
+        relatorio_printf(relatorio, "%s", texto);
+        return;
+    }
 
-    calcular_total_no(carteira->raiz);
-    carteira->valor_total = carteira->raiz->valor_total;
+    relatorio_reservar(relatorio, strlen(texto) * 2 + 2);
 
-    printf("Carteira criada! Valor total: R$ %.2f\n", carteira->valor_total);
+    char* destino = relatorio->texto + relatorio->tamanho;
+    *destino++ = '"';
+    for(const char* c = texto; *c != '\0'; c++) {
+        if(*c == '"') {
+            *destino++ = '"';
+        }
+        *destino++ = *c;
+    }
+    *destino++ = '"';
+    *destino = '\0';
 
-    return carteira;
+    relatorio->tamanho = destino - relatorio->texto;
 }
 
-// Funcao para remover um ativo
-void remover_ativo(Arvore* arvore, const char* nome) {
-    if(arvore == NULL || arvore->raiz == NULL) {
-        printf("Carteira vazia!\n");
+// Funcao para escrever tudo o que foi acumulado com uma unica escrita e esvaziar o relatorio
+void relatorio_escrever(Relatorio* relatorio, FILE* saida) {
+    if(relatorio->tamanho == 0) {
         return;
     }
 
-    No* ativo = buscar_no(arvore->raiz, nome);
+    fwrite(relatorio->texto, 1, relatorio->tamanho, saida);
+    relatorio->tamanho = 0;
+}
 
-    if(ativo == NULL) {
-        printf("Ativo nao encontrado!\n");
-        return;
+void relatorio_liberar(Relatorio* relatorio) {
+    free(relatorio->texto);
+    relatorio_iniciar(relatorio, relatorio->formato);
+}
+
+// Funcao para converter o nome de um formato ("texto", "csv" ou "json"); -1 se nao conhecer
+int formato_relatorio(const char* nome) {
+    if(strcmp(nome, "texto") == 0) return FORMATO_TEXTO;
+    if(strcmp(nome, "csv") == 0) return FORMATO_CSV;
+    if(strcmp(nome, "json") == 0) return FORMATO_JSON;
+    return -1;
+}
+
+// Funcao para descrever um erro de analise (usada no CSV e no JSON)
+const char* descricao_erro_relatorio(int erro) {
+    switch(erro) {
+        case RELATORIO_CARTEIRA_VAZIA: return "carteira vazia";
+        case RELATORIO_NAO_ENCONTRADO: return "nao encontrado";
+        case RELATORIO_NAO_E_CATEGORIA: return "nao e uma categoria";
+        case RELATORIO_VALOR_INVALIDO: return "valor invalido";
+        default: return "ok";
     }
+}
 
-    if(ativo->tipo != ATIVO) {
-        printf("Nao e um ativo!\n");
-        return;
+// Funcao para escrever o erro de uma analise em CSV ou JSON (no texto cada analise tem sua mensagem)
+void formatar_erro_relatorio(Relatorio* relatorio, const char* nome, int erro) {
+    if(relatorio->formato == FORMATO_JSON) {
+        relatorio_printf(relatorio, "{\"relatorio\":\"%s\",\"erro\":\"%s\"}\n", nome, descricao_erro_relatorio(erro));
+    } else {
+        relatorio_printf(relatorio, "relatorio,erro\n%s,%s\n", nome, descricao_erro_relatorio(erro));
     }
+}
+
+// ========================================
+// ESTATISTICAS INTERNAS
+// ========================================
 
-    ativo->valor_investido = 0.0;
+EstatisticasOtimizador estatisticas;
 
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
+const char* nomes_operacoes[OPERACOES_MEDIDAS] = {
+    "criar", "percentuais", "listar", "atualizar", "remover", "adicionar", "detectar",
+    "rebalancear", "aporte", "salvar", "carregar", "feed", "montecarlo"
+};
 
-    printf("Ativo removido com sucesso!\n");
+// Funcao para medir tempo em nanossegundos (relogio monotonico)
+long long agora_ns() {
+    #ifdef _WIN32
+        return (long long) clock() * (1000000000LL / CLOCKS_PER_SEC);
+    #else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    #endif
 }
 
-// Funcao para atualizar percentuais
-void atualizar_percentuais(Arvore* arvore) {
-    if(arvore == NULL || arvore->raiz == NULL) {
-        printf("Carteira vazia!\n");
+// Funcao para achar a operacao de um comando do script (-1 se nao for medida)
+int operacao_por_nome(const char* nome) {
+    for(int i = 0; i < OPERACOES_MEDIDAS; i++) {
+        if(strcmp(nomes_operacoes[i], nome) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Funcao para registrar a duracao de uma operacao no seu histograma
+void registrar_latencia(int operacao, long long ns) {
+    if(operacao < 0 || operacao >= OPERACOES_MEDIDAS) {
         return;
     }
 
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
+    HistogramaLatencia* h = &estatisticas.operacoes[operacao];
+    if(ns < 0) {
+        ns = 0;
+    }
+
+    int balde = 0;
+    while(balde < ESTATISTICAS_BALDES - 1 && (ns >> balde) != 0) {
+        balde++;
+    }
 
-    printf("\n=== PERCENTUAIS DA CARTEIRA ===\n");
-    printf("Valor total: R$ %.2f\n\n", arvore->valor_total);
+    __atomic_add_fetch(&h->chamadas, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->baldes[balde], 1, __ATOMIC_RELAXED);
 
-    if(arvore->raiz->esquerda != NULL) {
-        No* rf = arvore->raiz->esquerda;
-        float percentual_atual = (rf->valor_total / arvore->valor_total) * 100.0;
+    long long maximo = __atomic_load_n(&h->maximo_ns, __ATOMIC_RELAXED);
+    while(ns > maximo &&
+          !__atomic_compare_exchange_n(&h->maximo_ns, &maximo, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
 
-        printf("%s:\n", rf->nome);
-        printf("  Meta: %.1f%%\n", rf->percentual_alvo);
-        printf("  Atual: %.1f%%\n", percentual_atual);
-        printf("  Valor: R$ %.2f\n", rf->valor_total);
+// Funcao para estimar um percentil pelo histograma (limite superior do balde, em ns)
+long long percentil_histograma(const HistogramaLatencia* h, double p) {
+    long long alvo = (long long) ceil(h->chamadas * p);
+    long long acumulado = 0;
 
-        float diferenca = percentual_atual - rf->percentual_alvo;
-        if(diferenca > 1.0) {
-            printf("  Status: Acima do alvo (+%.1f%%)\n", diferenca);
-        } else if(diferenca < -1.0) {
-            printf("  Status: Abaixo do alvo (%.1f%%)\n", diferenca);
-        } else {
-            printf("  Status: OK\n");
+    for(int i = 0; i < ESTATISTICAS_BALDES; i++) {
+        acumulado += h->baldes[i];
+        if(acumulado >= alvo && acumulado > 0) {
+            long long limite = i == 0 ? 0 : (1LL << i) - 1;
+            return limite < h->maximo_ns ? limite : h->maximo_ns;
         }
-        printf("\n");
     }
+    return h->maximo_ns;
+}
 
-    if(arvore->raiz->direita != NULL) {
-        No* acoes = arvore->raiz->direita;
-        float percentual_atual = (acoes->valor_total / arvore->valor_total) * 100.0;
+void zerar_estatisticas() {
+    int ativas = estatisticas.ativas;
+    memset(&estatisticas, 0, sizeof(estatisticas));
+    estatisticas.ativas = ativas;
+}
 
-        printf("%s:\n", acoes->nome);
-        printf("  Meta: %.1f%%\n", acoes->percentual_alvo);
-        printf("  Atual: %.1f%%\n", percentual_atual);
-        printf("  Valor: R$ %.2f\n", acoes->valor_total);
+// Funcao para escrever as estatisticas no relatorio (texto ou JSON; o CSV traz so as operacoes)
+void formatar_estatisticas(Relatorio* relatorio) {
+    const EstatisticasOtimizador* e = &estatisticas;
 
-        float diferenca = percentual_atual - acoes->percentual_alvo;
-        if(diferenca > 1.0) {
-            printf("  Status: Acima do alvo (+%.1f%%)\n", diferenca);
-        } else if(diferenca < -1.0) {
-            printf("  Status: Abaixo do alvo (%.1f%%)\n", diferenca);
+    if(relatorio->formato == FORMATO_JSON) {
+        relatorio_printf(relatorio, "{\"relatorio\":\"estatisticas\",\"ativas\":%d,"
+                         "\"buscas\":%lld,\"buscas_encontradas\":%lld,\"slots_visitados\":%lld,"
+                         "\"passes_total\":%lld,\"nos_somados\":%lld,\"ns_total\":%lld,"
+                         "\"nos_criados\":%lld,\"alocacoes_criar_no\":",
+                         e->ativas, e->buscas, e->buscas_encontradas, e->slots_visitados,
+                         e->passes_total, e->nos_somados, e->ns_total, e->nos_criados);
+        if(OTIMIZADOR_CONTAR_ALOCACOES) {
+            relatorio_printf(relatorio, "%lld,\"operacoes\":[", e->alocacoes_criar_no);
         } else {
-            printf("  Status: OK\n");
+            relatorio_printf(relatorio, "null,\"operacoes\":[");
         }
-        printf("\n");
+        int primeira = 1;
+        for(int i = 0; i < OPERACOES_MEDIDAS; i++) {
+            const HistogramaLatencia* h = &e->operacoes[i];
+            if(h->chamadas == 0) continue;
+            relatorio_printf(relatorio, "%s{\"nome\":\"%s\",\"chamadas\":%lld,\"total_ns\":%lld,\"maximo_ns\":%lld,"
+                             "\"p50_ns\":%lld,\"p99_ns\":%lld,\"baldes\":[",
+                             primeira ? "" : ",", nomes_operacoes[i], h->chamadas, h->total_ns, h->maximo_ns,
+                             percentil_histograma(h, 0.50), percentil_histograma(h, 0.99));
+            for(int b = 0; b < ESTATISTICAS_BALDES; b++) {
+                relatorio_printf(relatorio, "%s%lld", b > 0 ? "," : "", h->baldes[b]);
+            }
+            relatorio_printf(relatorio, "]}");
+            primeira = 0;
+        }
+        relatorio_printf(relatorio, "]}\n");
+        return;
     }
-}
 
-// Funcao para listar ativos de uma categoria
-void listar_ativos(Arvore* arvore, const char* nome_categoria) {
-    if(arvore == NULL || arvore->raiz == NULL) {
-        printf("Carteira vazia!\n");
+    if(relatorio->formato == FORMATO_CSV) {
+        relatorio_printf(relatorio, "operacao,chamadas,media_us,p50_us,p99_us,maximo_us\n");
+        for(int i = 0; i < OPERACOES_MEDIDAS; i++) {
+            const HistogramaLatencia* h = &e->operacoes[i];
+            if(h->chamadas == 0) continue;
+            relatorio_printf(relatorio, "%s,%lld,%.3f,%.3f,%.3f,%.3f\n", nomes_operacoes[i], h->chamadas,
+                             h->total_ns / 1e3 / h->chamadas, percentil_histograma(h, 0.50) / 1e3,
+                             percentil_histograma(h, 0.99) / 1e3, h->maximo_ns / 1e3);
+        }
         return;
     }
 
-    No* categoria = buscar_no(arvore->raiz, nome_categoria);
-
-    if(categoria == NULL) {
-        printf("Categoria nao encontrada!\n");
-        return;
+    relatorio_printf(relatorio, "\n========================================\n");
+    relatorio_printf(relatorio, "ESTATISTICAS\n");
+    relatorio_printf(relatorio, "========================================\n");
+    if(!e->ativas) {
+        relatorio_printf(relatorio, "(desligadas: rode com ./Main --stats ...)\n");
+    }
+    relatorio_printf(relatorio, "buscar_no: %lld buscas (%lld encontradas), %.2f slots por busca\n",
+                     e->buscas, e->buscas_encontradas, e->buscas > 0 ? (double) e->slots_visitados / e->buscas : 0.0);
+    relatorio_printf(relatorio, "calcular_total_no: %lld passes, %lld nos somados, %.3f ms no total\n",
+                     e->passes_total, e->nos_somados, e->ns_total / 1e6);
+    if(OTIMIZADOR_CONTAR_ALOCACOES) {
+        relatorio_printf(relatorio, "criar_no: %lld nos, %lld alocacoes (%.3f por no)\n",
+                         e->nos_criados, e->alocacoes_criar_no,
+                         e->nos_criados > 0 ? (double) e->alocacoes_criar_no / e->nos_criados : 0.0);
+    } else {
+        relatorio_printf(relatorio, "criar_no: %lld nos (alocacoes nao contadas)\n", e->nos_criados);
     }
 
-    if(categoria->tipo != CATEGORIA) {
-        printf("Nao e uma categoria!\n");
-        return;
+    relatorio_printf(relatorio, "\n%-12s %10s %12s %12s %12s %12s\n", "operacao", "chamadas", "media (us)", "p50 (us)", "p99 (us)", "max (us)");
+    for(int i = 0; i < OPERACOES_MEDIDAS; i++) {
+        const HistogramaLatencia* h = &e->operacoes[i];
+        if(h->chamadas == 0) continue;
+        relatorio_printf(relatorio, "%-12s %10lld %12.3f %12.3f %12.3f %12.3f\n", nomes_operacoes[i], h->chamadas,
+                         h->total_ns / 1e3 / h->chamadas, percentil_histograma(h, 0.50) / 1e3,
+                         percentil_histograma(h, 0.99) / 1e3, h->maximo_ns / 1e3);
     }
+    relatorio_printf(relatorio, "========================================\n");
+}
+
+// Funcao para escrever as estatisticas em texto em um arquivo
+void escrever_estatisticas(FILE* saida) {
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_estatisticas(&relatorio);
+    relatorio_escrever(&relatorio, saida);
+    relatorio_liberar(&relatorio);
+}
 
-    printf("\n=== ATIVOS EM %s ===\n", categoria->nome);
+void mostrar_estatisticas() {
+    escrever_estatisticas(stdout);
+}
+
+// Funcao registrada com atexit pelo --stats (no stderr, para nao misturar com CSV/JSON do stdout)
+void mostrar_estatisticas_saida() {
+    fflush(stdout);
+    escrever_estatisticas(stderr);
+}
 
-    int count = 0;
+// ========================================
+// INDICE DE ALERTAS DE DESVIO
+// ========================================
 
-    if(categoria->esquerda != NULL) {
-        count++;
-        printf("%d. %s - R$ %.2f\n", count, categoria->esquerda->nome, categoria->esquerda->valor_investido);
+// Funcao para calcular a meta efetiva de um no em % do total do pai, como no calcular_alvos_grupo:
+// as metas dos irmaos sao normalizadas e, se todas forem zero, o grupo e dividido em partes iguais
+// Custo: O(irmaos); o indice guarda o resultado em cada entrada
+double meta_efetiva(const No* no) {
+    double soma_metas = 0.0;
+    for(int i = 0; i < no->pai->num_filhos; i++) {
+        soma_metas += no->pai->filhos[i]->percentual_alvo;
     }
 
-    if(categoria->direita != NULL) {
-        count++;
-        printf("%d. %s - R$ %.2f\n", count, categoria->direita->nome, categoria->direita->valor_investido);
+    return soma_metas > 0.0 ? no->percentual_alvo / soma_metas * 100.0 : 100.0 / no->pai->num_filhos;
+}
+
+// Funcao para calcular as chaves de um no (comparadas com o total do pai, sem dividir por ele)
+// acima:  valor / total * 100 - meta > tolerancia  <=>  valor * 100 / (meta + tolerancia) > total
+// abaixo: meta - valor / total * 100 > tolerancia  <=>  valor * 100 / (meta - tolerancia) < total
+void alerta_calcular_chaves(double tolerancia, double meta, const No* no, double* chave_acima, double* chave_abaixo) {
+    double valor = (double) no->valor_total * 100.0;
+
+    *chave_acima = valor / (meta + tolerancia);
+    *chave_abaixo = meta - tolerancia > 0.0 ? valor / (meta - tolerancia) : HUGE_VAL;
+}
+
+// Funcao para dizer se um no esta dentro, acima ou abaixo da faixa de meta efetiva meta (mesma conta do indice)
+int estado_alerta(const No* no, double meta, double tolerancia) {
+    double chave_acima;
+    double chave_abaixo;
+    double total = (double) no->pai->valor_total;
+
+    alerta_calcular_chaves(tolerancia, meta, no, &chave_acima, &chave_abaixo);
+    if(chave_acima > total) return ALERTA_ACIMA;
+    if(chave_abaixo < total) return ALERTA_ABAIXO;
+    return ALERTA_DENTRO;
+}
+
+// Funcoes do heap indexado (cada entrada guarda a sua posicao no heap de cada lado)
+double heap_chave(const IndiceAlertas* indice, const HeapAlerta* heap, int item) {
+    return heap->lado == 0 ? indice->entradas[item].chave_acima : indice->entradas[item].chave_abaixo;
+}
+
+int heap_posicao(const IndiceAlertas* indice, const HeapAlerta* heap, int item) {
+    return heap->lado == 0 ? indice->entradas[item].pos_acima : indice->entradas[item].pos_abaixo;
+}
+
+void heap_colocar(IndiceAlertas* indice, HeapAlerta* heap, int posicao, int item) {
+    heap->itens[posicao] = item;
+    if(heap->lado == 0) {
+        indice->entradas[item].pos_acima = posicao;
+    } else {
+        indice->entradas[item].pos_abaixo = posicao;
     }
+}
+
+// Funcao para dizer se o item a fica mais perto do topo que o item b
+int heap_antes(const IndiceAlertas* indice, const HeapAlerta* heap, int a, int b) {
+    double chave_a = heap_chave(indice, heap, a);
+    double chave_b = heap_chave(indice, heap, b);
+    return heap->maximo ? chave_a > chave_b : chave_a < chave_b;
+}
+
+void heap_subir(IndiceAlertas* indice, HeapAlerta* heap, int posicao) {
+    int item = heap->itens[posicao];
 
-    if(count == 0) {
-        printf("Nenhum ativo nesta categoria.\n");
+    while(posicao > 0) {
+        int pai = (posicao - 1) / 2;
+        if(!heap_antes(indice, heap, item, heap->itens[pai])) {
+            break;
+        }
+        heap_colocar(indice, heap, posicao, heap->itens[pai]);
+        posicao = pai;
     }
 
-    printf("Total: R$ %.2f\n", categoria->valor_total);
+    heap_colocar(indice, heap, posicao, item);
 }
 
-// Funcao para liberar memoria
-void liberar_no(No* no) {
-    if(no == NULL) return;
+void heap_descer(IndiceAlertas* indice, HeapAlerta* heap, int posicao) {
+    int item = heap->itens[posicao];
 
-    liberar_no(no->esquerda);
-    liberar_no(no->direita);
+    while(1) {
+        int filho = 2 * posicao + 1;
+        if(filho >= heap->quantidade) {
+            break;
+        }
+        if(filho + 1 < heap->quantidade && heap_antes(indice, heap, heap->itens[filho + 1], heap->itens[filho])) {
+            filho++;
+        }
+        if(!heap_antes(indice, heap, heap->itens[filho], item)) {
+            break;
+        }
+        heap_colocar(indice, heap, posicao, heap->itens[filho]);
+        posicao = filho;
+    }
 
-    free(no);
+    heap_colocar(indice, heap, posicao, item);
 }
 
-void liberar_arvore(Arvore* arvore) {
-    if(arvore == NULL) return;
+// Funcao para reposicionar um item depois que a chave dele mudou
+void heap_corrigir(IndiceAlertas* indice, HeapAlerta* heap, int posicao) {
+    int item = heap->itens[posicao];
 
-    liberar_no(arvore->raiz);
-    free(arvore);
+    heap_subir(indice, heap, posicao);
+    heap_descer(indice, heap, heap_posicao(indice, heap, item));
 }
 
-// ========================================
-// FUNCOES DO GABRIEL
-// ========================================
+void heap_inserir(IndiceAlertas* indice, HeapAlerta* heap, int item) {
+    heap->quantidade++;
+    heap_colocar(indice, heap, heap->quantidade - 1, item);
+    heap_subir(indice, heap, heap->quantidade - 1);
+}
 
-void detectar_desbalanceamento(Arvore* arvore) {
-    if(arvore == NULL || arvore->raiz == NULL) {
-        printf("\nCarteira vazia!\n");
+// Funcao para tirar o item de uma posicao (o ultimo item ocupa o lugar dele)
+void heap_remover(IndiceAlertas* indice, HeapAlerta* heap, int posicao) {
+    heap->quantidade--;
+    if(posicao == heap->quantidade) {
         return;
     }
 
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
+    heap_colocar(indice, heap, posicao, heap->itens[heap->quantidade]);
+    heap_corrigir(indice, heap, posicao);
+}
 
-    printf("\n========================================\n");
-    printf("ANALISE DE BALANCEAMENTO\n");
-    printf("========================================\n");
+void heap_iniciar(HeapAlerta* heap, int* itens, int maximo, int lado) {
+    heap->itens = itens;
+    heap->quantidade = 0;
+    heap->maximo = maximo;
+    heap->lado = lado;
+}
 
-    int desbalanceado = 0;
-    float tolerancia = 2.0;
+// Funcao para marcar uma entrada para o aviso no fim da atualizacao
+void marcar_pendente(IndiceAlertas* indice, int item) {
+    if(!indice->entradas[item].pendente) {
+        indice->entradas[item].pendente = 1;
+        indice->pendentes[indice->num_pendentes++] = item;
+    }
+}
 
-    if(arvore->raiz->esquerda != NULL) {
-        No* renda_fixa = arvore->raiz->esquerda;
-        float percentual_atual = (renda_fixa->valor_total / arvore->valor_total) * 100.0;
-        float diferenca = percentual_atual - renda_fixa->percentual_alvo;
+// Funcao para passar o topo de um heap para outro
+void mover_topo_heap(IndiceAlertas* indice, HeapAlerta* de, HeapAlerta* para) {
+    int item = de->itens[0];
 
-        printf("\n%s:\n", renda_fixa->nome);
-        printf("  Meta:  %.1f%%\n", renda_fixa->percentual_alvo);
-        printf("  Atual: %.1f%%\n", percentual_atual);
-        printf("  Diferenca: %+.1f%%\n", diferenca);
+    heap_remover(indice, de, 0);
+    heap_inserir(indice, para, item);
+    marcar_pendente(indice, item);
+}
 
-        if(fabs(diferenca) > tolerancia) {
-            if(diferenca > 0) {
-                printf("    ACIMA do alvo (sobra %.1f%%)\n", diferenca);
-            } else {
-                printf("    ABAIXO do alvo (falta %.1f%%)\n", -diferenca);
-            }
-            desbalanceado = 1;
-        } else {
-            printf("   Dentro do alvo\n");
-        }
+// Funcao para reavaliar um grupo depois que o total do pai (ou a chave de um filho) mudou
+// So os topos sao olhados: cada troca de faixa custa O(log k)
+void reavaliar_grupo(IndiceAlertas* indice, GrupoAlerta* grupo) {
+    double total = (double) grupo->pai->valor_total;
+
+    while(grupo->dentro_acima.quantidade > 0 && heap_chave(indice, &grupo->dentro_acima, grupo->dentro_acima.itens[0]) > total) {
+        indice->entradas[grupo->dentro_acima.itens[0]].acima = 1;
+        mover_topo_heap(indice, &grupo->dentro_acima, &grupo->acima);
+    }
+    while(grupo->acima.quantidade > 0 && heap_chave(indice, &grupo->acima, grupo->acima.itens[0]) <= total) {
+        indice->entradas[grupo->acima.itens[0]].acima = 0;
+        mover_topo_heap(indice, &grupo->acima, &grupo->dentro_acima);
+    }
+    while(grupo->dentro_abaixo.quantidade > 0 && heap_chave(indice, &grupo->dentro_abaixo, grupo->dentro_abaixo.itens[0]) < total) {
+        indice->entradas[grupo->dentro_abaixo.itens[0]].abaixo = 1;
+        mover_topo_heap(indice, &grupo->dentro_abaixo, &grupo->abaixo);
+    }
+    while(grupo->abaixo.quantidade > 0 && heap_chave(indice, &grupo->abaixo, grupo->abaixo.itens[0]) >= total) {
+        indice->entradas[grupo->abaixo.itens[0]].abaixo = 0;
+        mover_topo_heap(indice, &grupo->abaixo, &grupo->dentro_abaixo);
     }
+}
 
-    if(arvore->raiz->direita != NULL) {
-        No* acoes = arvore->raiz->direita;
-        float percentual_atual = (acoes->valor_total / arvore->valor_total) * 100.0;
-        float diferenca = percentual_atual - acoes->percentual_alvo;
+// Funcao para avisar as entradas pendentes cujo estado mudou desde o ultimo aviso
+void disparar_alertas_pendentes(IndiceAlertas* indice) {
+    for(int i = 0; i < indice->num_pendentes; i++) {
+        EntradaAlerta* entrada = &indice->entradas[indice->pendentes[i]];
+        int novo = entrada->acima ? ALERTA_ACIMA : (entrada->abaixo ? ALERTA_ABAIXO : ALERTA_DENTRO);
 
-        printf("\n%s:\n", acoes->nome);
-        printf("  Meta:  %.1f%%\n", acoes->percentual_alvo);
-        printf("  Atual: %.1f%%\n", percentual_atual);
-        printf("  Diferenca: %+.1f%%\n", diferenca);
+        entrada->pendente = 0;
+        if(novo == entrada->estado) {
+            continue;
+        }
 
-        if(fabs(diferenca) > tolerancia) {
-            if(diferenca > 0) {
-                printf("    ACIMA do alvo (sobra %.1f%%)\n", diferenca);
-            } else {
-                printf("    ABAIXO do alvo (falta %.1f%%)\n", -diferenca);
-            }
-            desbalanceado = 1;
-        } else {
-            printf("   Dentro do alvo\n");
+        AlertaDrift alerta;
+        Centavos total = entrada->no->pai->valor_total;
+        alerta.no = entrada->no;
+        alerta.estado_anterior = entrada->estado;
+        alerta.estado = novo;
+        alerta.percentual_atual = total > 0 ? (double) entrada->no->valor_total / total * 100.0 : 0.0;
+        alerta.meta = entrada->meta;
+        alerta.diferenca = alerta.percentual_atual - entrada->meta;
+
+        indice->fora_da_faixa += (novo != ALERTA_DENTRO) - (entrada->estado != ALERTA_DENTRO);
+        indice->alertas_disparados++;
+        entrada->estado = novo;
+
+        if(indice->callback != NULL) {
+            indice->callback(&alerta, indice->contexto);
         }
     }
 
-    printf("\n========================================\n");
-    if(desbalanceado) {
-        printf("CARTEIRA DESBALANCEADA\n");
-        printf("Sugestao: Use a opcao para ver como rebalancear\n");
-    } else {
-        printf("CARTEIRA BALANCEADA\n");
-    }
-    printf("========================================\n");
+    indice->num_pendentes = 0;
 }
 
-void sugerir_rebalanceamento(Arvore* arvore) {
-    if(arvore == NULL || arvore->raiz == NULL) {
-        printf("\nCarteira vazia!\n");
-        return;
+// Funcao para contar os nos e os nos com filhos de uma subarvore
+void contar_nos_alerta(const No* no, int* nos, int* internos) {
+    (*nos)++;
+    if(no->num_filhos > 0) {
+        (*internos)++;
+    }
+    for(int i = 0; i < no->num_filhos; i++) {
+        contar_nos_alerta(no->filhos[i], nos, internos);
     }
+}
 
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
+// Funcao para montar o grupo dos filhos de um no (e os grupos abaixo dele)
+// Se houver um indice anterior, cada no continua com o estado ja avisado e a diferenca fica pendente
+void montar_grupo_alerta(IndiceAlertas* indice, No* pai, const IndiceAlertas* anterior, int** memoria) {
+    int g = indice->num_grupos++;
+    GrupoAlerta* grupo = &indice->grupos[g];
 
-    printf("\n========================================\n");
-    printf("SUGESTOES DE REBALANCEAMENTO\n");
-    printf("========================================\n");
+    grupo->pai = pai;
+    heap_iniciar(&grupo->dentro_acima, *memoria, 1, 0);
+    heap_iniciar(&grupo->acima, *memoria + pai->num_filhos, 0, 0);
+    heap_iniciar(&grupo->dentro_abaixo, *memoria + 2 * pai->num_filhos, 0, 1);
+    heap_iniciar(&grupo->abaixo, *memoria + 3 * pai->num_filhos, 1, 1);
+    *memoria += 4 * pai->num_filhos;
 
-    float tolerancia = 2.0;
-    int precisa_rebalancear = 0;
+    for(int i = 0; i < pai->num_filhos; i++) {
+        No* filho = pai->filhos[i];
+        int e = indice->num_entradas++;
+        EntradaAlerta* entrada = &indice->entradas[e];
+        double meta = meta_efetiva(filho);
+        int atual = estado_alerta(filho, meta, indice->tolerancia);
 
-    printf("\nAcoes necessarias:\n\n");
+        entrada->no = filho;
+        entrada->meta = meta;
+        entrada->grupo = g;
+        entrada->pendente = 0;
+        alerta_calcular_chaves(indice->tolerancia, meta, filho, &entrada->chave_acima, &entrada->chave_abaixo);
+        entrada->acima = atual == ALERTA_ACIMA;
+        entrada->abaixo = atual == ALERTA_ABAIXO;
 
-    if(arvore->raiz->esquerda != NULL) {
-        No* renda_fixa = arvore->raiz->esquerda;
-        float valor_alvo = arvore->valor_total * (renda_fixa->percentual_alvo / 100.0);
-        float diferenca = renda_fixa->valor_total - valor_alvo;
+        entrada->estado = atual;
+        if(anterior != NULL && filho->alerta >= 0 && filho->alerta < anterior->num_entradas &&
+           anterior->entradas[filho->alerta].no == filho) {
+            entrada->estado = anterior->entradas[filho->alerta].estado;
+        }
+        if(entrada->estado != ALERTA_DENTRO) {
+            indice->fora_da_faixa++;
+        }
+        filho->alerta = e;
 
-        if(diferenca > (arvore->valor_total * tolerancia / 100.0)) {
-            printf("* VENDER R$ %.2f de %s\n", diferenca, renda_fixa->nome);
-            precisa_rebalancear = 1;
-        } else if(diferenca < -(arvore->valor_total * tolerancia / 100.0)) {
-            printf("* COMPRAR R$ %.2f em %s\n", -diferenca, renda_fixa->nome);
-            precisa_rebalancear = 1;
+        heap_inserir(indice, entrada->acima ? &grupo->acima : &grupo->dentro_acima, e);
+        heap_inserir(indice, entrada->abaixo ? &grupo->abaixo : &grupo->dentro_abaixo, e);
+        if(entrada->estado != atual) {
+            marcar_pendente(indice, e);
         }
     }
 
-    if(arvore->raiz->direita != NULL) {
-        No* acoes = arvore->raiz->direita;
-        float valor_alvo = arvore->valor_total * (acoes->percentual_alvo / 100.0);
-        float diferenca = acoes->valor_total - valor_alvo;
-
-        if(diferenca > (arvore->valor_total * tolerancia / 100.0)) {
-            printf("* VENDER R$ %.2f de %s\n", diferenca, acoes->nome);
-            precisa_rebalancear = 1;
-        } else if(diferenca < -(arvore->valor_total * tolerancia / 100.0)) {
-            printf("* COMPRAR R$ %.2f em %s\n", -diferenca, acoes->nome);
-            precisa_rebalancear = 1;
+    for(int i = 0; i < pai->num_filhos; i++) {
+        if(pai->filhos[i]->num_filhos > 0) {
+            montar_grupo_alerta(indice, pai->filhos[i], anterior, memoria);
         }
     }
+}
+
+// Funcao para criar o indice de alertas de uma arvore (os totais precisam estar em dia)
+// Nenhum alerta e disparado: o estado de cada no na criacao e o ponto de partida
+IndiceAlertas* criar_indice_alertas(Arvore* arvore, double tolerancia, CallbackAlerta callback, void* contexto,
+                                    const IndiceAlertas* anterior) {
+    IndiceAlertas* indice = (IndiceAlertas*) calloc(1, sizeof(IndiceAlertas));
+    int nos = 0;
+    int internos = 0;
 
-    if(!precisa_rebalancear) {
-        printf("Carteira ja esta balanceada!\n");
+    indice->tolerancia = tolerancia;
+    indice->callback = callback;
+    indice->contexto = contexto;
+    if(anterior != NULL) {
+        indice->alertas_disparados = anterior->alertas_disparados;
     }
 
-    printf("\n========================================\n");
+    if(arvore->raiz == NULL) {
+        return indice;
+    }
+
+    contar_nos_alerta(arvore->raiz, &nos, &internos);
+    indice->entradas = (EntradaAlerta*) malloc((nos - 1 > 0 ? nos - 1 : 1) * sizeof(EntradaAlerta));
+    indice->pendentes = (int*) malloc((nos - 1 > 0 ? nos - 1 : 1) * sizeof(int));
+    indice->memoria_heaps = (int*) malloc((4 * (nos - 1) > 0 ? 4 * (nos - 1) : 1) * sizeof(int));
+    indice->grupos = (GrupoAlerta*) malloc((internos > 0 ? internos : 1) * sizeof(GrupoAlerta));
+
+    if(arvore->raiz->num_filhos > 0) {
+        int* memoria = indice->memoria_heaps;
+        montar_grupo_alerta(indice, arvore->raiz, anterior, &memoria);
+    }
+
+    return indice;
 }
 
-void simular_aporte(Arvore* arvore, float valor_aporte) {
-    if(arvore == NULL || arvore->raiz == NULL) {
-        printf("\nCarteira vazia!\n");
+void liberar_indice_alertas(IndiceAlertas* indice) {
+    if(indice == NULL) return;
+
+    free(indice->entradas);
+    free(indice->pendentes);
+    free(indice->memoria_heaps);
+    free(indice->grupos);
+    free(indice);
+}
+
+// Funcao para refazer o indice depois de uma mudanca na estrutura da arvore
+// (avisa so os nos cujo estado mudou desde o ultimo aviso)
+void reconstruir_indice_alertas(Arvore* arvore) {
+    IndiceAlertas* anterior = arvore->alertas;
+    IndiceAlertas* novo = criar_indice_alertas(arvore, anterior->tolerancia, anterior->callback, anterior->contexto, anterior);
+
+    liberar_indice_alertas(anterior);
+    arvore->alertas = novo;
+    disparar_alertas_pendentes(novo);
+}
+
+const char* nomes_estados_alerta[] = { "dentro", "acima", "abaixo" };
+
+// Funcao para escrever um alerta no relatorio (texto, CSV ou JSON)
+void formatar_alerta(Relatorio* relatorio, const AlertaDrift* alerta) {
+    const No* no = alerta->no;
+
+    if(relatorio->formato == FORMATO_TEXTO) {
+        const char* situacao = alerta->estado == ALERTA_ACIMA ? "saiu da faixa para cima" :
+                               alerta->estado == ALERTA_ABAIXO ? "saiu da faixa para baixo" : "voltou para a faixa";
+        relatorio_printf(relatorio, "ALERTA: %s (%s) %s: atual %.2f%%, meta %.2f%% (%+.2f)\n",
+                         no->nome, no->pai->nome, situacao, alerta->percentual_atual, alerta->meta, alerta->diferenca);
         return;
     }
 
-    if(valor_aporte <= 0) {
-        printf("\nValor de aporte invalido!\n");
+    if(relatorio->formato == FORMATO_CSV) {
+        relatorio_printf(relatorio, "alerta,grupo,estado_anterior,estado,atual,meta,diferenca\n");
+        relatorio_csv_texto(relatorio, no->nome);
+        relatorio_printf(relatorio, ",");
+        relatorio_csv_texto(relatorio, no->pai->nome);
+        relatorio_printf(relatorio, ",%s,%s,%.4f,%.4f,%.4f\n", nomes_estados_alerta[alerta->estado_anterior],
+                         nomes_estados_alerta[alerta->estado], alerta->percentual_atual, alerta->meta, alerta->diferenca);
         return;
     }
 
-    printf("\n========================================\n");
-    printf("SIMULACAO DE APORTE\n");
-    printf("========================================\n");
-    printf("Valor do aporte: R$ %.2f\n\n", valor_aporte);
+    relatorio_printf(relatorio, "{\"relatorio\":\"alerta\",\"no\":");
+    relatorio_json_texto(relatorio, no->nome);
+    relatorio_printf(relatorio, ",\"grupo\":");
+    relatorio_json_texto(relatorio, no->pai->nome);
+    relatorio_printf(relatorio, ",\"estado_anterior\":\"%s\",\"estado\":\"%s\",\"atual\":%.4f,\"meta\":%.4f,\"diferenca\":%.4f}\n",
+                     nomes_estados_alerta[alerta->estado_anterior], nomes_estados_alerta[alerta->estado],
+                     alerta->percentual_atual, alerta->meta, alerta->diferenca);
+}
+
+// Funcao para atualizar o indice depois que o total de um no mudou (ele e os ancestrais)
+// Custo: O(profundidade * log k) mais O(log k) por no que trocou de faixa
+void alertas_no_mudou(IndiceAlertas* indice, No* no) {
+    // os filhos do proprio no comparam com o total dele
+    if(no->num_filhos > 0 && no->filhos[0]->alerta >= 0) {
+        reavaliar_grupo(indice, &indice->grupos[indice->entradas[no->filhos[0]->alerta].grupo]);
+    }
+
+    for(No* atual = no; atual->pai != NULL && atual->alerta >= 0; atual = atual->pai) {
+        EntradaAlerta* entrada = &indice->entradas[atual->alerta];
+        GrupoAlerta* grupo = &indice->grupos[entrada->grupo];
+
+        alerta_calcular_chaves(indice->tolerancia, entrada->meta, atual, &entrada->chave_acima, &entrada->chave_abaixo);
+        if(entrada->acima) {
+            heap_corrigir(indice, &grupo->acima, entrada->pos_acima);
+        } else {
+            heap_corrigir(indice, &grupo->dentro_acima, entrada->pos_acima);
+        }
+        if(entrada->abaixo) {
+            heap_corrigir(indice, &grupo->abaixo, entrada->pos_abaixo);
+        } else {
+            heap_corrigir(indice, &grupo->dentro_abaixo, entrada->pos_abaixo);
+        }
+
+        reavaliar_grupo(indice, grupo);
+    }
+
+    disparar_alertas_pendentes(indice);
+}
+
+// ========================================
+// DIARIO DE OPERACOES (WRITE-AHEAD)
+// ========================================
+
+// fd = -1: diario fechado (o diario_registrar nao faz nada)
+Diario diario = { -1, NULL, NULL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0.0 };
+
+// Thread que confirma o grupo quando a espera vence mesmo sem novos registros
+// (o programa pode ficar parado esperando entrada); a trava protege os pendentes
+#ifndef _WIN32
+static pthread_mutex_t diario_trava = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t diario_sinal;
+static pthread_t diario_thread;
+static int diario_thread_ativa = 0;
+#endif
+
+// Tabelas do CRC-32C (polinomio de Castagnoli, refletido), montadas no primeiro uso
+// tabela[k][b] = crc do byte b seguido de k bytes zero: o laco principal consome 8 bytes por vez
+unsigned int tabela_crc32c[8][256];
+int tabela_crc32c_pronta = 0;
 
-    printf("Distribuicao proporcional:\n\n");
+// Funcao para calcular o CRC-32C de um bloco (com SSE4.2 usa a instrucao crc32 do processador)
+unsigned int crc32c(const void* dados, size_t tamanho) {
+    const unsigned char* p = (const unsigned char*) dados;
+    unsigned int crc = 0xFFFFFFFFu;
+
+    #if defined(__SSE4_2__)
+    unsigned long long crc64 = crc;
+    while(tamanho >= 8) {
+        unsigned long long bloco;
+        memcpy(&bloco, p, 8);
+        crc64 = _mm_crc32_u64(crc64, bloco);
+        p += 8;
+        tamanho -= 8;
+    }
+    crc = (unsigned int) crc64;
+    while(tamanho > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+        tamanho--;
+    }
+    #else
+    if(!tabela_crc32c_pronta) {
+        for(unsigned int i = 0; i < 256; i++) {
+            unsigned int valor = i;
+            for(int bit = 0; bit < 8; bit++) {
+                valor = (valor & 1) ? (valor >> 1) ^ 0x82F63B78u : valor >> 1;
+            }
+            tabela_crc32c[0][i] = valor;
+        }
+        for(int k = 1; k < 8; k++) {
+            for(int i = 0; i < 256; i++) {
+                unsigned int anterior = tabela_crc32c[k - 1][i];
+                tabela_crc32c[k][i] = (anterior >> 8) ^ tabela_crc32c[0][anterior & 0xFF];
+            }
+        }
+        tabela_crc32c_pronta = 1;
+    }
+    while(tamanho >= 8) {
+        unsigned int baixo = crc ^ ((unsigned int) p[0] | (unsigned int) p[1] << 8 |
+                                    (unsigned int) p[2] << 16 | (unsigned int) p[3] << 24);
+        crc = tabela_crc32c[7][baixo & 0xFF] ^ tabela_crc32c[6][(baixo >> 8) & 0xFF] ^
+              tabela_crc32c[5][(baixo >> 16) & 0xFF] ^ tabela_crc32c[4][baixo >> 24] ^
+              tabela_crc32c[3][p[4]] ^ tabela_crc32c[2][p[5]] ^ tabela_crc32c[1][p[6]] ^ tabela_crc32c[0][p[7]];
+        p += 8;
+        tamanho -= 8;
+    }
+    while(tamanho > 0) {
+        crc = tabela_crc32c[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        tamanho--;
+    }
+    #endif
 
-    if(arvore->raiz->esquerda != NULL) {
-        No* renda_fixa = arvore->raiz->esquerda;
-        float valor_rf = valor_aporte * (renda_fixa->percentual_alvo / 100.0);
+    return ~crc;
+}
+
+// Funcao para calcular o crc de um registro (tudo depois do proprio campo crc)
+unsigned int crc_registro_diario(const RegistroDiario* registro) {
+    return crc32c((const char*) registro + sizeof(registro->crc), sizeof(RegistroDiario) - sizeof(registro->crc));
+}
+
+// Funcao para gravar os registros pendentes e esperar o disco (um fdatasync por grupo)
+// Quem chama ja segura a trava do diario
+// Devolve 0 se a gravacao falhou (o diario e fechado e o erro aparece no stderr)
+int diario_gravar_pendentes() {
+    if(diario.fd < 0 || diario.num_pendentes == 0) {
+        return diario.fd >= 0;
+    }
+
+    #ifndef _WIN32
+    const char* dados = (const char*) diario.pendentes;
+    size_t restante = diario.num_pendentes * sizeof(RegistroDiario);
+    while(restante > 0) {
+        ssize_t escritos = write(diario.fd, dados, restante);
+        if(escritos < 0 && errno == EINTR) {
+            continue;
+        }
+        if(escritos <= 0) {
+            break;
+        }
+        dados += escritos;
+        restante -= escritos;
+    }
+
+    if(restante > 0 || fdatasync(diario.fd) != 0) {
+        fprintf(stderr, "Falha ao gravar o diario %s: %s (diario fechado)\n", diario.caminho, strerror(errno));
+        close(diario.fd);
+        diario.fd = -1;
+        diario.num_pendentes = 0;
+        return 0;
+    }
+    #endif
+
+    diario.num_pendentes = 0;
+    diario.confirmacoes++;
+    return 1;
+}
+
+// Funcao para confirmar agora o que estiver pendente no diario
+int diario_confirmar() {
+    #ifndef _WIN32
+    pthread_mutex_lock(&diario_trava);
+    #endif
+    int ok = diario_gravar_pendentes();
+    #ifndef _WIN32
+    pthread_mutex_unlock(&diario_trava);
+    #endif
+    return ok;
+}
+
+#ifndef _WIN32
+// Funcao da thread do diario: dorme ate o registro mais antigo completar DIARIO_ESPERA_MS e confirma o grupo
+void* confirmador_diario(void* argumento) {
+    (void) argumento;
+    pthread_mutex_lock(&diario_trava);
+    while(diario_thread_ativa) {
+        if(diario.num_pendentes == 0) {
+            pthread_cond_wait(&diario_sinal, &diario_trava);
+            continue;
+        }
+
+        long long prazo = diario.primeiro_pendente_ns + diario.espera_ns;
+        if(agora_ns() >= prazo) {
+            diario_gravar_pendentes();
+            continue;
+        }
+        struct timespec ate;
+        ate.tv_sec = prazo / 1000000000LL;
+        ate.tv_nsec = prazo % 1000000000LL;
+        pthread_cond_timedwait(&diario_sinal, &diario_trava, &ate);
+    }
+    pthread_mutex_unlock(&diario_trava);
+    return NULL;
+}
+
+// Funcao para ligar a thread do diario (o relogio da espera e o mesmo do agora_ns)
+void iniciar_confirmador_diario() {
+    pthread_condattr_t atributos;
+    pthread_condattr_init(&atributos);
+    pthread_condattr_setclock(&atributos, CLOCK_MONOTONIC);
+    pthread_cond_init(&diario_sinal, &atributos);
+    pthread_condattr_destroy(&atributos);
+
+    diario_thread_ativa = 1;
+    pthread_create(&diario_thread, NULL, confirmador_diario, NULL);
+}
+
+// Funcao para desligar a thread do diario (o que ficou pendente e confirmado por quem fecha)
+void parar_confirmador_diario() {
+    if(!diario_thread_ativa) {
+        return;
+    }
+    pthread_mutex_lock(&diario_trava);
+    diario_thread_ativa = 0;
+    pthread_cond_signal(&diario_sinal);
+    pthread_mutex_unlock(&diario_trava);
+    pthread_join(diario_thread, NULL);
+    pthread_cond_destroy(&diario_sinal);
+}
+#endif
+
+// Funcao para acrescentar uma operacao ao diario (nada acontece com o diario fechado)
+// O registro so fica duravel quando o grupo dele for confirmado: grupo cheio, espera vencida
+// (aqui ou na thread do diario) ou fechamento
+void diario_registrar(int operacao, int modo, Centavos valor, double quantidade, const char* nome,
+                      const char* categoria) {
+    if(diario.fd < 0) {
+        return;
+    }
+
+    #ifndef _WIN32
+    pthread_mutex_lock(&diario_trava);
+    #endif
+
+    RegistroDiario* registro = &diario.pendentes[diario.num_pendentes];
+    memset(registro, 0, sizeof(RegistroDiario));
+    registro->operacao = operacao;
+    registro->lsn = ++diario.lsn;
+    registro->valor = valor;
+    registro->quantidade = quantidade;
+    registro->modo = modo;
+    if(nome != NULL) {
+        strncpy(registro->nome, nome, 63);
+    }
+    if(categoria != NULL) {
+        strncpy(registro->categoria, categoria, 63);
+    }
+    registro->crc = crc_registro_diario(registro);
+
+    long long agora = agora_ns();
+    if(diario.num_pendentes == 0) {
+        diario.primeiro_pendente_ns = agora;
+        #ifndef _WIN32
+        pthread_cond_signal(&diario_sinal);
+        #endif
+    }
+    diario.num_pendentes++;
+    diario.registros++;
+
+    if(diario.num_pendentes >= diario.grupo || agora - diario.primeiro_pendente_ns >= diario.espera_ns) {
+        diario_gravar_pendentes();
+    }
+
+    #ifndef _WIN32
+    pthread_mutex_unlock(&diario_trava);
+    #endif
+}
+
+// ========================================
+// FUNCOES DO LUIS
+// ========================================
+
+// Marcador de slot removido no indice
+static No indice_lapide;
+#define INDICE_LAPIDE (&indice_lapide)
+
+// Funcao para calcular o hash de um nome (FNV-1a)
+unsigned int hash_nome(const char* nome) {
+    unsigned int hash = 2166136261u;
+
+    while(*nome != '\0') {
+        hash = hash ^ (unsigned char) *nome;
+        hash = hash * 16777619u;
+        nome++;
+    }
+
+    return hash;
+}
+
+// Funcao para calcular o hash dos primeiros tamanho caracteres de um nome
+unsigned int hash_nome_n(const char* nome, int tamanho) {
+    unsigned int hash = 2166136261u;
+
+    for(int i = 0; i < tamanho; i++) {
+        hash = hash ^ (unsigned char) nome[i];
+        hash = hash * 16777619u;
+    }
+
+    return hash;
+}
+
+// Funcao para iniciar o indice de nomes
+void indice_iniciar(IndiceNomes* indice, int capacidade) {
+    int cap = 16;
+    while(cap < capacidade * 2) {
+        cap = cap * 2;
+    }
+
+    indice->slots = (No**) calloc(cap, sizeof(No*));
+    indice->capacidade = cap;
+    indice->quantidade = 0;
+    indice->ocupados = 0;
+}
+
+// Funcao para buscar um no no indice por um nome que nao termina em '\0'
+No* indice_buscar_n(const IndiceNomes* indice, const char* nome, int tamanho) {
+    if(indice->slots == NULL || tamanho > 63) {
+        return NULL;
+    }
+
+    unsigned int hash = hash_nome_n(nome, tamanho);
+    unsigned int mascara = indice->capacidade - 1;
+    unsigned int i = hash & mascara;
+    long long visitados = 1;
+
+    ESTATISTICA_SOMAR(buscas, 1);
+
+    while(indice->slots[i] != NULL) {
+        No* no = indice->slots[i];
+        if(no != INDICE_LAPIDE && no->hash == hash &&
+           memcmp(no->nome, nome, tamanho) == 0 && no->nome[tamanho] == '\0') {
+            ESTATISTICA_SOMAR(slots_visitados, visitados);
+            ESTATISTICA_SOMAR(buscas_encontradas, 1);
+            return no;
+        }
+        i = (i + 1) & mascara;
+        visitados++;
+    }
+
+    ESTATISTICA_SOMAR(slots_visitados, visitados);
+    return NULL;
+}
+
+// Funcao para buscar um no no indice
+No* indice_buscar(const IndiceNomes* indice, const char* nome) {
+    return indice_buscar_n(indice, nome, strlen(nome));
+}
+
+// Funcao para redimensionar o indice (descarta as lapides)
+void indice_redimensionar(IndiceNomes* indice, int nova_capacidade) {
+    No** antigos = indice->slots;
+    int capacidade_antiga = indice->capacidade;
+
+    indice->slots = (No**) calloc(nova_capacidade, sizeof(No*));
+    indice->capacidade = nova_capacidade;
+    indice->ocupados = indice->quantidade;
+
+    unsigned int mascara = nova_capacidade - 1;
+    for(int j = 0; j < capacidade_antiga; j++) {
+        No* no = antigos[j];
+        if(no == NULL || no == INDICE_LAPIDE) {
+            continue;
+        }
+
+        unsigned int i = no->hash & mascara;
+        while(indice->slots[i] != NULL) {
+            i = (i + 1) & mascara;
+        }
+        indice->slots[i] = no;
+    }
+
+    free(antigos);
+}
+
+// Funcao para inserir um no no indice (nomes repetidos mantem o primeiro)
+void indice_inserir(IndiceNomes* indice, No* no) {
+    if((indice->ocupados + 1) * 4 > indice->capacidade * 3) {
+        int nova_capacidade = indice->capacidade;
+        if((indice->quantidade + 1) * 2 > indice->capacidade) {
+            nova_capacidade = indice->capacidade * 2;
+        }
+        indice_redimensionar(indice, nova_capacidade);
+    }
+
+    unsigned int mascara = indice->capacidade - 1;
+    unsigned int i = no->hash & mascara;
+    int lapide = -1;
+
+    while(indice->slots[i] != NULL) {
+        No* atual = indice->slots[i];
+        if(atual == INDICE_LAPIDE) {
+            if(lapide < 0) {
+                lapide = i;
+            }
+        } else if(atual->hash == no->hash && strcmp(atual->nome, no->nome) == 0) {
+            return;
+        }
+        i = (i + 1) & mascara;
+    }
+
+    if(lapide >= 0) {
+        indice->slots[lapide] = no;
+    } else {
+        indice->slots[i] = no;
+        indice->ocupados++;
+    }
+    indice->quantidade++;
+}
+
+// Funcao para remover um no do indice
+void indice_remover(IndiceNomes* indice, No* no) {
+    if(indice->slots == NULL) {
+        return;
+    }
+
+    unsigned int mascara = indice->capacidade - 1;
+    unsigned int i = no->hash & mascara;
+
+    while(indice->slots[i] != NULL) {
+        if(indice->slots[i] == no) {
+            indice->slots[i] = INDICE_LAPIDE;
+            indice->quantidade--;
+            return;
+        }
+        i = (i + 1) & mascara;
+    }
+}
+
+void indice_liberar(IndiceNomes* indice) {
+    free(indice->slots);
+    indice->slots = NULL;
+    indice->capacidade = 0;
+    indice->quantidade = 0;
+    indice->ocupados = 0;
+}
+
+// Tabela de precos do processo (compartilhada por todas as carteiras)
+TabelaPrecos tabela_precos;
+
+// Funcao para buscar o id de um ticker na tabela de precos (-1 se nao existir)
+int precos_buscar(const char* ticker) {
+    if(tabela_precos.slots == NULL) {
+        return -1;
+    }
+
+    unsigned int hash = hash_nome(ticker);
+    unsigned int mascara = tabela_precos.capacidade_slots - 1;
+    unsigned int i = hash & mascara;
+
+    while(tabela_precos.slots[i] != 0) {
+        int id = tabela_precos.slots[i] - 1;
+        if(tabela_precos.hashes[id] == hash && strcmp(tabela_precos.tickers[id], ticker) == 0) {
+            return id;
+        }
+        i = (i + 1) & mascara;
+    }
+
+    return -1;
+}
+
+// Funcao para dobrar os slots da tabela de precos (os slots guardam id + 1; 0 = vazio)
+void precos_redimensionar_slots(int nova_capacidade) {
+    free(tabela_precos.slots);
+    tabela_precos.slots = (int*) calloc(nova_capacidade, sizeof(int));
+    tabela_precos.capacidade_slots = nova_capacidade;
+
+    unsigned int mascara = nova_capacidade - 1;
+    for(int id = 0; id < tabela_precos.quantidade; id++) {
+        unsigned int i = tabela_precos.hashes[id] & mascara;
+        while(tabela_precos.slots[i] != 0) {
+            i = (i + 1) & mascara;
+        }
+        tabela_precos.slots[i] = id + 1;
+    }
+}
+
+// Funcao para registrar um ticker com um preco inicial (se ja existir, so devolve o id)
+// O registro nao muda a epoca: so mudancas de preco fazem as carteiras se reavaliarem
+int precos_registrar(const char* ticker, Centavos preco) {
+    int id = precos_buscar(ticker);
+    if(id >= 0) {
+        return id;
+    }
+
+    if(tabela_precos.quantidade == tabela_precos.capacidade) {
+        int nova = tabela_precos.capacidade == 0 ? 64 : tabela_precos.capacidade * 2;
+        tabela_precos.tickers = (char (*)[64]) realloc(tabela_precos.tickers, nova * sizeof(*tabela_precos.tickers));
+        tabela_precos.hashes = (unsigned int*) realloc(tabela_precos.hashes, nova * sizeof(unsigned int));
+        tabela_precos.precos = (Centavos*) realloc(tabela_precos.precos, nova * sizeof(Centavos));
+        tabela_precos.epocas = (unsigned long long*) realloc(tabela_precos.epocas, nova * sizeof(unsigned long long));
+        tabela_precos.capacidade = nova;
+    }
+    if((tabela_precos.quantidade + 1) * 2 > tabela_precos.capacidade_slots) {
+        precos_redimensionar_slots(tabela_precos.capacidade_slots == 0 ? 128 : tabela_precos.capacidade_slots * 2);
+    }
+
+    id = tabela_precos.quantidade++;
+    strncpy(tabela_precos.tickers[id], ticker, 63);
+    tabela_precos.tickers[id][63] = '\0';
+    tabela_precos.hashes[id] = hash_nome(tabela_precos.tickers[id]);
+    tabela_precos.precos[id] = preco;
+    tabela_precos.epocas[id] = 0;
+
+    unsigned int mascara = tabela_precos.capacidade_slots - 1;
+    unsigned int i = tabela_precos.hashes[id] & mascara;
+    while(tabela_precos.slots[i] != 0) {
+        i = (i + 1) & mascara;
+    }
+    tabela_precos.slots[i] = id + 1;
+
+    return id;
+}
+
+// Funcao para trocar o preco de um ticker: O(1), nenhuma carteira e tocada aqui
+void precos_atualizar(int id, Centavos preco) {
+    if(tabela_precos.precos[id] == preco) {
+        return;
+    }
+
+    tabela_precos.precos[id] = preco;
+    tabela_precos.epoca++;
+    tabela_precos.epocas[id] = tabela_precos.epoca;
+}
+
+// Funcao para trocar o preco de um ticker pelo nome (registra se ainda nao existir)
+int atualizar_preco(const char* ticker, Centavos preco) {
+    int id = precos_buscar(ticker);
+    if(id < 0) {
+        id = precos_registrar(ticker, preco);
+    } else {
+        precos_atualizar(id, preco);
+    }
+
+    diario_registrar(DIARIO_PRECO, 0, preco, 0.0, ticker, NULL);
+    return id;
+}
+
+void liberar_tabela_precos() {
+    free(tabela_precos.tickers);
+    free(tabela_precos.hashes);
+    free(tabela_precos.precos);
+    free(tabela_precos.epocas);
+    free(tabela_precos.slots);
+    memset(&tabela_precos, 0, sizeof(tabela_precos));
+}
+
+// Funcao para iniciar a arena (capacidade_nos pre-dimensiona o primeiro bloco)
+void arena_iniciar(ArenaNos* arena, int capacidade_nos) {
+    arena->blocos_nos = NULL;
+    arena->blocos_filhos = NULL;
+    arena->nos_livres = NULL;
+    for(int i = 0; i < ARENA_CLASSES; i++) {
+        arena->filhos_livres[i] = NULL;
+    }
+    arena->nos_em_uso = 0;
+    arena->num_livres = 0;
+
+    if(capacidade_nos > 0) {
+        BlocoNos* bloco = (BlocoNos*) malloc(sizeof(BlocoNos) + capacidade_nos * sizeof(No));
+        bloco->proximo = NULL;
+        bloco->capacidade = capacidade_nos;
+        bloco->usados = 0;
+        arena->blocos_nos = bloco;
+
+        int ponteiros = capacidade_nos * 2;
+        BlocoFilhos* filhos = (BlocoFilhos*) malloc(sizeof(BlocoFilhos) + ponteiros * sizeof(No*));
+        filhos->proximo = NULL;
+        filhos->capacidade = ponteiros;
+        filhos->usados = 0;
+        arena->blocos_filhos = filhos;
+    }
+}
+
+// Funcao para pegar um no da arena (reaproveita nos devolvidos)
+No* arena_alocar_no(ArenaNos* arena) {
+    arena->nos_em_uso++;
+
+    if(arena->nos_livres != NULL) {
+        No* no = arena->nos_livres;
+        arena->nos_livres = no->pai;
+        arena->num_livres--;
+        return no;
+    }
+
+    BlocoNos* bloco = arena->blocos_nos;
+    if(bloco == NULL || bloco->usados == bloco->capacidade) {
+        int capacidade = bloco == NULL ? 64 : bloco->capacidade * 2;
+        BlocoNos* novo = (BlocoNos*) malloc(sizeof(BlocoNos) + capacidade * sizeof(No));
+        novo->proximo = bloco;
+        novo->capacidade = capacidade;
+        novo->usados = 0;
+        arena->blocos_nos = novo;
+        bloco = novo;
+    }
+
+    No* no = &bloco->nos[bloco->usados];
+    bloco->usados++;
+    return no;
+}
+
+// Funcao para pegar quantidade nos contiguos da arena (sem passar pela lista de livres)
+No* arena_alocar_nos(ArenaNos* arena, int quantidade) {
+    BlocoNos* bloco = arena->blocos_nos;
+    if(bloco == NULL || bloco->capacidade - bloco->usados < quantidade) {
+        int capacidade = bloco == NULL ? 64 : bloco->capacidade * 2;
+        while(capacidade < quantidade) {
+            capacidade = capacidade * 2;
+        }
+
+        BlocoNos* novo = (BlocoNos*) malloc(sizeof(BlocoNos) + capacidade * sizeof(No));
+        novo->proximo = bloco;
+        novo->capacidade = capacidade;
+        novo->usados = 0;
+        arena->blocos_nos = novo;
+        bloco = novo;
+    }
+
+    No* nos = &bloco->nos[bloco->usados];
+    bloco->usados += quantidade;
+    arena->nos_em_uso += quantidade;
+    return nos;
+}
+
+// Funcao para devolver um no para a arena (o slot e reaproveitado)
+void arena_devolver_no(ArenaNos* arena, No* no) {
+    no->pai = arena->nos_livres;
+    arena->nos_livres = no;
+    arena->nos_em_uso--;
+    arena->num_livres++;
+}
+
+// Funcao para achar a classe de tamanho de um vetor de filhos (capacidade = 2^classe)
+int arena_classe(int capacidade) {
+    int classe = 0;
+    while((1 << classe) < capacidade) {
+        classe++;
+    }
+    return classe;
+}
+
+// Funcao para pegar um vetor de filhos da arena (capacidade potencia de 2)
+No** arena_alocar_filhos(ArenaNos* arena, int capacidade) {
+    int classe = arena_classe(capacidade);
+
+    if(arena->filhos_livres[classe] != NULL) {
+        No** vetor = arena->filhos_livres[classe];
+        arena->filhos_livres[classe] = (No**) vetor[0];
+        return vetor;
+    }
+
+    BlocoFilhos* bloco = arena->blocos_filhos;
+    if(bloco == NULL || bloco->capacidade - bloco->usados < capacidade) {
+        int tamanho = bloco == NULL ? 256 : bloco->capacidade * 2;
+        while(tamanho < capacidade) {
+            tamanho = tamanho * 2;
+        }
+
+        BlocoFilhos* novo = (BlocoFilhos*) malloc(sizeof(BlocoFilhos) + tamanho * sizeof(No*));
+        novo->proximo = bloco;
+        novo->capacidade = tamanho;
+        novo->usados = 0;
+        arena->blocos_filhos = novo;
+        bloco = novo;
+    }
+
+    No** vetor = &bloco->ponteiros[bloco->usados];
+    bloco->usados += capacidade;
+    return vetor;
+}
+
+// Funcao para devolver um vetor de filhos para a lista da sua classe
+void arena_devolver_filhos(ArenaNos* arena, No** vetor, int capacidade) {
+    if(vetor == NULL) {
+        return;
+    }
+
+    int classe = arena_classe(capacidade);
+    vetor[0] = (No*) arena->filhos_livres[classe];
+    arena->filhos_livres[classe] = vetor;
+}
+
+// Funcao para liberar todos os blocos da arena de uma vez
+void arena_liberar(ArenaNos* arena) {
+    while(arena->blocos_nos != NULL) {
+        BlocoNos* proximo = arena->blocos_nos->proximo;
+        free(arena->blocos_nos);
+        arena->blocos_nos = proximo;
+    }
+
+    while(arena->blocos_filhos != NULL) {
+        BlocoFilhos* proximo = arena->blocos_filhos->proximo;
+        free(arena->blocos_filhos);
+        arena->blocos_filhos = proximo;
+    }
+
+    arena->nos_livres = NULL;
+    for(int i = 0; i < ARENA_CLASSES; i++) {
+        arena->filhos_livres[i] = NULL;
+    }
+    arena->nos_em_uso = 0;
+    arena->num_livres = 0;
+}
+
+// Funcao para criar uma arvore vazia (capacidade_nos = numero esperado de nos, 0 se nao souber)
+Arvore* criar_arvore(int capacidade_nos) {
+    Arvore* arvore = (Arvore*) malloc(sizeof(Arvore));
+
+    arvore->raiz = NULL;
+    arvore->valor_total = 0.0;
+    arvore->totais_sujos = 1;
+    indice_iniciar(&arvore->indice, capacidade_nos);
+    arena_iniciar(&arvore->arena, capacidade_nos);
+    arvore->alertas = NULL;
+    arvore->cotados = NULL;
+    arvore->num_cotados = 0;
+    arvore->cap_cotados = 0;
+    arvore->epoca_precos = 0;
+
+    return arvore;
+}
+
+// Funcao para criar um no novo (alocado na arena e registrado no indice da arvore)
+No* criar_no(Arvore* arvore, const char* nome, int tipo, double percentual_alvo, Centavos valor_investido) {
+    long long alocacoes_antes = estatisticas.ativas ? alocacoes_feitas : 0;
+    No* novo = arena_alocar_no(&arvore->arena);
+
+    strncpy(novo->nome, nome, 63);
+    novo->nome[63] = '\0';
+    novo->hash = hash_nome(novo->nome);
+
+    novo->tipo = tipo;
+    novo->percentual_alvo = percentual_alvo;
+    novo->valor_investido = valor_investido;
+    novo->valor_total = 0;
+    novo->pai = NULL;
+    novo->filhos = NULL;
+    novo->num_filhos = 0;
+    novo->cap_filhos = 0;
+    novo->alerta = -1;
+    novo->id_preco = -1;
+    novo->quantidade = 0.0;
+
+    indice_inserir(&arvore->indice, novo);
+
+    ESTATISTICA_SOMAR(nos_criados, 1);
+    ESTATISTICA_SOMAR(alocacoes_criar_no, alocacoes_feitas - alocacoes_antes);
+
+    return novo;
+}
+
+// Funcao para buscar um no pelo nome
+No* buscar_no(Arvore* arvore, const char* nome) {
+    if(arvore == NULL) {
+        return NULL;
+    }
+
+    return indice_buscar(&arvore->indice, nome);
+}
+
+// Funcao para adicionar um filho no fim do vetor de filhos
+void adicionar_filho(Arvore* arvore, No* pai, No* filho) {
+    if(pai->num_filhos == pai->cap_filhos) {
+        int nova_cap = pai->cap_filhos == 0 ? 2 : pai->cap_filhos * 2;
+        No** novos = arena_alocar_filhos(&arvore->arena, nova_cap);
+
+        if(pai->num_filhos > 0) {
+            memcpy(novos, pai->filhos, pai->num_filhos * sizeof(No*));
+        }
+        arena_devolver_filhos(&arvore->arena, pai->filhos, pai->cap_filhos);
+
+        pai->filhos = novos;
+        pai->cap_filhos = nova_cap;
+    }
+
+    pai->filhos[pai->num_filhos] = filho;
+    pai->num_filhos++;
+    filho->pai = pai;
+
+    // a estrutura mudou: o indice de alertas e refeito (o novo filho ainda nao esta nos totais)
+    if(arvore->alertas != NULL) {
+        reconstruir_indice_alertas(arvore);
+    }
+}
+
+// Funcao para calcular o total de um no
+Centavos calcular_total_no(No* no) {
+    if(no == NULL) {
+        return 0;
+    }
+
+    if(no->num_filhos == 0) {
+        no->valor_total = no->valor_investido;
+        return no->valor_total;
+    }
+
+    Centavos soma = 0;
+    for(int i = 0; i < no->num_filhos; i++) {
+        soma = soma + calcular_total_no(no->filhos[i]);
+    }
+    soma = soma + no->valor_investido;
+
+    no->valor_total = soma;
+    return soma;
+}
+
+// Funcao para somar uma variacao no no e em todos os seus ancestrais
+void propagar_delta(Arvore* arvore, No* no, Centavos delta) {
+    if(arvore->totais_sujos) {
+        return;
+    }
+
+    No* origem = no;
+    while(no != NULL) {
+        no->valor_total += delta;
+        no = no->pai;
+    }
+
+    arvore->valor_total += delta;
+
+    if(arvore->alertas != NULL) {
+        alertas_no_mudou(arvore->alertas, origem);
+    }
+}
+
+// Funcao para trocar o valor de um no sem mexer nos totais
+// (numa posicao cotada o valor novo vira quantidade: comprar R$ X e comprar X / preco cotas)
+void definir_valor_no(No* no, Centavos novo_valor) {
+    if(no->id_preco >= 0) {
+        Centavos preco = tabela_precos.precos[no->id_preco];
+        no->quantidade = preco > 0 ? (double) novo_valor / preco : 0.0;
+    }
+
+    no->valor_investido = novo_valor;
+}
+
+// Funcao para trocar o valor investido de um no sem recalcular a arvore toda
+void alterar_valor_investido(Arvore* arvore, No* no, Centavos novo_valor) {
+    Centavos delta = novo_valor - no->valor_investido;
+
+    definir_valor_no(no, novo_valor);
+    propagar_delta(arvore, no, delta);
+}
+
+// Funcao para reavaliar as posicoes cotadas cujo preco mudou desde a ultima leitura
+// Custo: O(posicoes cotadas da carteira), pago so quando a carteira e lida
+void reavaliar_posicoes(Arvore* arvore) {
+    for(int i = 0; i < arvore->num_cotados; i++) {
+        No* no = arvore->cotados[i];
+        if(tabela_precos.epocas[no->id_preco] <= arvore->epoca_precos) {
+            continue;
+        }
+
+        Centavos novo_valor = llround(no->quantidade * tabela_precos.precos[no->id_preco]);
+        Centavos delta = novo_valor - no->valor_investido;
+
+        no->valor_investido = novo_valor;
+        propagar_delta(arvore, no, delta);
+    }
+
+    arvore->epoca_precos = tabela_precos.epoca;
+}
+
+// Funcao para ligar um no a tabela de precos pelo nome dele, sem mexer no valor
+// (se o ticker ainda nao existir, ele entra com o preco que faz quantidade * preco = valor atual)
+void vincular_posicao(Arvore* arvore, No* no, double quantidade) {
+    if(no->id_preco < 0) {
+        if(arvore->num_cotados == arvore->cap_cotados) {
+            arvore->cap_cotados = arvore->cap_cotados == 0 ? 16 : arvore->cap_cotados * 2;
+            arvore->cotados = (No**) realloc(arvore->cotados, arvore->cap_cotados * sizeof(No*));
+        }
+        arvore->cotados[arvore->num_cotados++] = no;
+    }
+
+    Centavos preco = quantidade > 0.0 ? llround(no->valor_investido / quantidade) : 0;
+    no->id_preco = precos_registrar(no->nome, preco);
+    no->quantidade = quantidade;
+}
+
+// Funcao para tirar um no da lista de posicoes cotadas da carteira (o ticker continua na tabela)
+void desvincular_posicao(Arvore* arvore, No* no) {
+    for(int i = 0; i < arvore->num_cotados; i++) {
+        if(arvore->cotados[i] == no) {
+            arvore->cotados[i] = arvore->cotados[--arvore->num_cotados];
+            break;
+        }
+    }
+
+    no->id_preco = -1;
+    no->quantidade = 0.0;
+}
+
+// Funcao para transformar um ativo em posicao cotada: quantidade cotas do ticker com o nome dele
+void definir_posicao(Arvore* arvore, No* no, double quantidade) {
+    int novo_ticker = precos_buscar(no->nome) < 0;
+
+    vincular_posicao(arvore, no, quantidade);
+    if(!novo_ticker) {
+        Centavos novo_valor = llround(quantidade * tabela_precos.precos[no->id_preco]);
+        Centavos delta = novo_valor - no->valor_investido;
+
+        no->valor_investido = novo_valor;
+        propagar_delta(arvore, no, delta);
+    }
+}
+
+// Funcao para garantir os totais (so recalcula tudo se estiverem sujos)
+void garantir_totais(Arvore* arvore) {
+    // precos que mudaram desde a ultima leitura (com os totais limpos, so o caminho de cada posicao muda)
+    if(arvore->num_cotados > 0 && arvore->epoca_precos != tabela_precos.epoca) {
+        reavaliar_posicoes(arvore);
+    }
+
+    if(!arvore->totais_sujos) {
+        return;
+    }
+
+    ESTATISTICA_INICIO(inicio);
+    calcular_total_no(arvore->raiz);
+    arvore->valor_total = arvore->raiz->valor_total;
+    arvore->totais_sujos = 0;
+
+    ESTATISTICA_SOMAR(passes_total, 1);
+    ESTATISTICA_SOMAR(nos_somados, arvore->arena.nos_em_uso);
+    ESTATISTICA_SOMAR(ns_total, agora_ns() - inicio);
+
+    // os totais mudaram sem passar pelo indice: refaz e avisa o que mudou
+    if(arvore->alertas != NULL) {
+        reconstruir_indice_alertas(arvore);
+    }
+}
+
+// Funcao para converter reais em centavos (arredonda para o centavo mais proximo)
+Centavos reais_para_centavos(double reais) {
+    return llround(reais * 100.0);
+}
+
+// Funcao para converter centavos em reais (so para mostrar e para calcular percentuais)
+double centavos_para_reais(Centavos centavos) {
+    return centavos / 100.0;
+}
+
+// Perfis conhecidos: os padrao entram na primeira busca, os de arquivo substituem os de mesmo nome
+CatalogoPerfis catalogo_perfis;
+
+// Perfis padrao no mesmo formato do arquivo de configuracao
+// [perfil NOME] abre um perfil; categoria NOME;PESO e ativo NOME[;PESO] (o ativo fica na ultima categoria)
+// Sem peso os ativos dividem a categoria em partes iguais e ficam sem meta propria
+const char* perfis_padrao =
+    "[perfil CONSERVADOR]\n"
+    "categoria Renda Fixa;70\n" "ativo Tesouro Selic\n" "ativo CDB XP\n"
+    "categoria Acoes;30\n" "ativo PETR4\n" "ativo ITUB4\n"
+    "[perfil MODERADO]\n"
+    "categoria Renda Fixa;50\n" "ativo Tesouro Selic\n" "ativo CDB XP\n"
+    "categoria Acoes;50\n" "ativo PETR4\n" "ativo ITUB4\n"
+    "[perfil ARROJADO]\n"
+    "categoria Renda Fixa;30\n" "ativo Tesouro Selic\n" "ativo CDB XP\n"
+    "categoria Acoes;70\n" "ativo PETR4\n" "ativo ITUB4\n";
+
+// Funcao para preencher um no de modelo (o resto dos campos fica como o criar_no deixaria)
+void preencher_prototipo(No* no, const char* nome, int tipo, double percentual_alvo) {
+    memset(no, 0, sizeof(No));
+    strncpy(no->nome, nome, 63);
+    no->nome[63] = '\0';
+    no->hash = hash_nome(no->nome);
+    no->tipo = tipo;
+    no->percentual_alvo = percentual_alvo;
+    no->alerta = -1;
+    no->id_preco = -1;
+}
+
+// Funcao para montar o layout plano de um perfil a partir das linhas lidas
+// Devolve NULL se estiver tudo certo, ou a mensagem de erro (e em linha_erro a linha do item culpado;
+// erros do perfil inteiro deixam linha_erro como veio, a linha do [perfil NOME])
+const char* montar_modelo_perfil(ModeloPerfil* modelo, const char* nome, const ItemPerfil* itens, int num_itens,
+                                 int* linha_erro) {
+    int num_categorias = 0;
+    double peso_categorias = 0.0;
+
+    if(num_itens == 0 || itens[0].tipo != CATEGORIA) {
+        if(num_itens > 0) {
+            *linha_erro = itens[0].linha;
+        }
+        return "o perfil precisa comecar com uma categoria";
+    }
+    for(int i = 0; i < num_itens; i++) {
+        for(int j = 0; j < i; j++) {
+            if(strcmp(itens[i].nome, itens[j].nome) == 0) {
+                *linha_erro = itens[i].linha;
+                return "nome repetido no perfil";
+            }
+        }
+        if(itens[i].tipo == CATEGORIA) {
+            num_categorias++;
+            peso_categorias += itens[i].peso;
+        }
+    }
+    if(!(peso_categorias > 0.0)) {
+        return "a soma dos pesos das categorias tem que ser positiva";
+    }
+
+    strncpy(modelo->nome, nome, 63);
+    modelo->nome[63] = '\0';
+    modelo->num_nos = 1 + num_itens;
+    modelo->prototipos = (No*) malloc(modelo->num_nos * sizeof(No));
+    modelo->ligacoes = (NoModelo*) calloc(modelo->num_nos, sizeof(NoModelo));
+
+    preencher_prototipo(&modelo->prototipos[0], "Carteira", RAIZ, 0.0);
+    modelo->ligacoes[0].pai = -1;
+    modelo->ligacoes[0].primeiro_filho = 1;
+    modelo->ligacoes[0].num_filhos = num_categorias;
+    modelo->ligacoes[0].fracao = 1.0;
+
+    // em largura: primeiro as categorias, depois os ativos de cada categoria em sequencia
+    int categoria = 0;
+    int proximo_ativo = 1 + num_categorias;
+    double acumulado_categorias = 0.0;
+
+    for(int i = 0; i < num_itens; i++) {
+        if(itens[i].tipo != CATEGORIA) {
+            continue;
+        }
+
+        int fim = i + 1;
+        int com_peso = 0;
+        double peso_ativos = 0.0;
+        while(fim < num_itens && itens[fim].tipo == ATIVO) {
+            com_peso += itens[fim].tem_peso;
+            peso_ativos += itens[fim].tem_peso ? itens[fim].peso : 1.0;
+            fim++;
+        }
+        int num_ativos = fim - i - 1;
+        if(com_peso != 0 && com_peso != num_ativos) {
+            // a culpa e do primeiro ativo que nao segue o primeiro da categoria
+            int j = i + 2;
+            while(itens[j].tem_peso == itens[i + 1].tem_peso) j++;
+            *linha_erro = itens[j].linha;
+            free(modelo->prototipos);
+            free(modelo->ligacoes);
+            return "os ativos de uma categoria tem que ter todos peso ou nenhum";
+        }
+        if(num_ativos > 0 && !(peso_ativos > 0.0)) {
+            *linha_erro = itens[i].linha;
+            free(modelo->prototipos);
+            free(modelo->ligacoes);
+            return "a soma dos pesos dos ativos de uma categoria tem que ser positiva";
+        }
+
+        int c = 1 + categoria;
+        preencher_prototipo(&modelo->prototipos[c], itens[i].nome, CATEGORIA, itens[i].peso / peso_categorias * 100.0);
+        modelo->ligacoes[c].pai = 0;
+        modelo->ligacoes[c].primeiro_filho = proximo_ativo;
+        modelo->ligacoes[c].num_filhos = num_ativos;
+        modelo->ligacoes[c].fracao_antes = acumulado_categorias / peso_categorias;
+        acumulado_categorias += itens[i].peso;
+        modelo->ligacoes[c].fracao = acumulado_categorias / peso_categorias;
+
+        double acumulado_ativos = 0.0;
+        for(int j = i + 1; j < fim; j++) {
+            int a = proximo_ativo++;
+            double peso = itens[j].tem_peso ? itens[j].peso : 1.0;
+            preencher_prototipo(&modelo->prototipos[a], itens[j].nome, ATIVO,
+                                itens[j].tem_peso ? peso / peso_ativos * 100.0 : 0.0);
+            modelo->ligacoes[a].pai = c;
+            modelo->ligacoes[a].primeiro_filho = 0;
+            modelo->ligacoes[a].num_filhos = 0;
+            modelo->ligacoes[a].fracao_antes = acumulado_ativos / peso_ativos;
+            acumulado_ativos += peso;
+            modelo->ligacoes[a].fracao = acumulado_ativos / peso_ativos;
+        }
+
+        categoria++;
+    }
+
+    return NULL;
+}
+
+void liberar_modelo_perfil(ModeloPerfil* modelo) {
+    free(modelo->prototipos);
+    free(modelo->ligacoes);
+    modelo->prototipos = NULL;
+    modelo->ligacoes = NULL;
+    modelo->num_nos = 0;
+}
+
+// Funcao para guardar um modelo no catalogo (substitui o de mesmo nome)
+void catalogo_adicionar(const ModeloPerfil* modelo) {
+    for(int i = 0; i < catalogo_perfis.quantidade; i++) {
+        if(strcmp(catalogo_perfis.perfis[i].nome, modelo->nome) == 0) {
+            liberar_modelo_perfil(&catalogo_perfis.perfis[i]);
+            catalogo_perfis.perfis[i] = *modelo;
+            return;
+        }
+    }
+
+    if(catalogo_perfis.quantidade == catalogo_perfis.capacidade) {
+        catalogo_perfis.capacidade = catalogo_perfis.capacidade == 0 ? 8 : catalogo_perfis.capacidade * 2;
+        catalogo_perfis.perfis = (ModeloPerfil*) realloc(catalogo_perfis.perfis, catalogo_perfis.capacidade * sizeof(ModeloPerfil));
+    }
+    catalogo_perfis.perfis[catalogo_perfis.quantidade++] = *modelo;
+}
+
+// Funcao para ler perfis de um texto no formato do arquivo de configuracao
+// Se alguma linha estiver errada nenhum perfil e guardado; devolve quantos perfis entraram (-1 = erro)
+int carregar_perfis_texto(const char* texto, const char* origem) {
+    ModeloPerfil* lidos = NULL;
+    int num_lidos = 0;
+    ItemPerfil* itens = NULL;
+    int num_itens = 0;
+    int cap_itens = 0;
+    char perfil[64] = "";
+    char linha[256];
+    int numero = 0;
+    int linha_perfil = 0;
+    const char* erro = NULL;
+    const char* p = texto;
+
+    while(erro == NULL) {
+        int fim_do_texto = *p == '\0';
+
+        // um perfil termina no proximo [perfil] ou no fim do texto
+        int novo_perfil = 0;
+        if(!fim_do_texto) {
+            const char* fim_linha = strchr(p, '\n');
+            size_t tamanho = fim_linha != NULL ? (size_t) (fim_linha - p) : strlen(p);
+            numero++;
+            if(tamanho >= sizeof(linha)) {
+                erro = "linha muito longa";
+                break;
+            }
+            memcpy(linha, p, tamanho);
+            linha[tamanho] = '\0';
+            p = fim_linha != NULL ? fim_linha + 1 : p + tamanho;
+
+            linha[strcspn(linha, "\r")] = '\0';
+            char* conteudo = linha;
+            while(*conteudo == ' ' || *conteudo == '\t') conteudo++;
+            char* fim = conteudo + strlen(conteudo);
+            while(fim > conteudo && (fim[-1] == ' ' || fim[-1] == '\t')) fim--;
+            *fim = '\0';
+
+            if(*conteudo == '\0' || *conteudo == '#') {
+                continue;
+            }
+
+            if(strncmp(conteudo, "[perfil ", 8) == 0 && fim[-1] == ']') {
+                novo_perfil = 1;
+                fim[-1] = '\0';
+                char* nome = conteudo + 8;
+                while(*nome == ' ') nome++;
+                if(*nome == '\0' || strlen(nome) > 63) {
+                    erro = "nome de perfil invalido";
+                    break;
+                }
+                // o perfil anterior e fechado abaixo; o nome novo so entra depois
+                memmove(linha, nome, strlen(nome) + 1);
+            } else {
+                int tipo;
+                char* resto;
+                if(strncmp(conteudo, "categoria ", 10) == 0) {
+                    tipo = CATEGORIA;
+                    resto = conteudo + 10;
+                } else if(strncmp(conteudo, "ativo ", 6) == 0) {
+                    tipo = ATIVO;
+                    resto = conteudo + 6;
+                } else {
+                    erro = "esperava [perfil NOME], categoria NOME;PESO ou ativo NOME[;PESO]";
+                    break;
+                }
+                if(perfil[0] == '\0') {
+                    erro = "categoria ou ativo antes do primeiro [perfil NOME]";
+                    break;
+                }
+
+                while(*resto == ' ') resto++;
+                char* separador = strchr(resto, ';');
+                double peso = 0.0;
+                int tem_peso = separador != NULL;
+                if(tem_peso) {
+                    char* fim_peso;
+                    *separador = '\0';
+                    peso = strtod(separador + 1, &fim_peso);
+                    if(fim_peso == separador + 1 || *fim_peso != '\0' || peso < 0.0) {
+                        erro = "peso invalido";
+                        break;
+                    }
+                    char* fim_nome = separador;
+                    while(fim_nome > resto && fim_nome[-1] == ' ') fim_nome--;
+                    *fim_nome = '\0';
+                }
+                if(tipo == CATEGORIA && !tem_peso) {
+                    erro = "categoria sem peso (categoria NOME;PESO)";
+                    break;
+                }
+                if(*resto == '\0' || strlen(resto) > 63) {
+                    erro = "nome invalido";
+                    break;
+                }
+
+                if(num_itens == cap_itens) {
+                    cap_itens = cap_itens == 0 ? 16 : cap_itens * 2;
+                    itens = (ItemPerfil*) realloc(itens, cap_itens * sizeof(ItemPerfil));
+                }
+                itens[num_itens].tipo = tipo;
+                strcpy(itens[num_itens].nome, resto);
+                itens[num_itens].peso = peso;
+                itens[num_itens].tem_peso = tem_peso;
+                itens[num_itens].linha = numero;
+                num_itens++;
+                continue;
+            }
+        }
+
+        if(perfil[0] != '\0') {
+            lidos = (ModeloPerfil*) realloc(lidos, (num_lidos + 1) * sizeof(ModeloPerfil));
+            // o erro de montagem aponta a linha do item culpado, nao a que fechou o perfil
+            int linha_erro = linha_perfil;
+            erro = montar_modelo_perfil(&lidos[num_lidos], perfil, itens, num_itens, &linha_erro);
+            if(erro != NULL) {
+                numero = linha_erro;
+                break;
+            }
+            num_lidos++;
+        }
+
+        if(fim_do_texto) {
+            break;
+        }
+        if(novo_perfil) {
+            strcpy(perfil, linha);
+            linha_perfil = numero;
+            num_itens = 0;
+        }
+    }
+
+    free(itens);
+
+    if(erro != NULL) {
+        fprintf(stderr, "Perfis (%s): linha %d: %s\n", origem, numero, erro);
+        for(int i = 0; i < num_lidos; i++) {
+            liberar_modelo_perfil(&lidos[i]);
+        }
+        free(lidos);
+        return -1;
+    }
+
+    for(int i = 0; i < num_lidos; i++) {
+        catalogo_adicionar(&lidos[i]);
+    }
+    free(lidos);
+
+    return num_lidos;
+}
+
+// Funcao para garantir os perfis padrao no catalogo (chamada antes de qualquer thread)
+void carregar_perfis_padrao() {
+    if(catalogo_perfis.quantidade == 0) {
+        carregar_perfis_texto(perfis_padrao, "padrao");
+    }
+}
+
+// Funcao para ler um arquivo de perfis (devolve quantos perfis entraram, -1 = erro)
+int carregar_perfis(const char* caminho) {
+    FILE* arquivo = fopen(caminho, "rb");
+    if(arquivo == NULL) {
+        fprintf(stderr, "Perfis: nao foi possivel abrir %s\n", caminho);
+        return -1;
+    }
+
+    // le em blocos ate o fim: funciona tambem com pipes e /dev/stdin, que nao tem tamanho
+    size_t capacidade = 4096;
+    size_t tamanho = 0;
+    char* texto = (char*) malloc(capacidade);
+    size_t lidos;
+    while((lidos = fread(texto + tamanho, 1, capacidade - tamanho - 1, arquivo)) > 0) {
+        tamanho += lidos;
+        if(tamanho + 1 == capacidade) {
+            capacidade *= 2;
+            texto = (char*) realloc(texto, capacidade);
+        }
+    }
+    texto[tamanho] = '\0';
+
+    if(ferror(arquivo)) {
+        fprintf(stderr, "Perfis: erro ao ler %s\n", caminho);
+        fclose(arquivo);
+        free(texto);
+        return -1;
+    }
+    fclose(arquivo);
+
+    carregar_perfis_padrao();
+    int quantidade = carregar_perfis_texto(texto, caminho);
+    free(texto);
+
+    return quantidade;
+}
+
+// Funcao para buscar um perfil pelo nome (NULL se nao existir)
+const ModeloPerfil* buscar_perfil(const char* nome) {
+    carregar_perfis_padrao();
+
+    for(int i = 0; i < catalogo_perfis.quantidade; i++) {
+        if(strcmp(catalogo_perfis.perfis[i].nome, nome) == 0) {
+            return &catalogo_perfis.perfis[i];
+        }
+    }
+    return NULL;
+}
+
+// Funcao para criar uma carteira a partir de um modelo: uma copia dos nos e a divisao do valor
+// (sem imprimir nada e sem alocar no a no; os totais ja saem prontos)
+Arvore* instanciar_perfil(const ModeloPerfil* modelo, Centavos valor_inicial) {
+    Arvore* arvore = criar_arvore(modelo->num_nos);
+    No* nos = arena_alocar_nos(&arvore->arena, modelo->num_nos);
+
+    memcpy(nos, modelo->prototipos, modelo->num_nos * sizeof(No));
+
+    for(int i = 0; i < modelo->num_nos; i++) {
+        const NoModelo* ligacao = &modelo->ligacoes[i];
+        No* no = &nos[i];
+
+        if(ligacao->pai < 0) {
+            no->valor_total = valor_inicial;
+        } else {
+            no->pai = &nos[ligacao->pai];
+            Centavos base = no->pai->valor_total;
+            no->valor_total = llround(base * ligacao->fracao) - llround(base * ligacao->fracao_antes);
+        }
+
+        if(ligacao->num_filhos > 0) {
+            int cap = 1 << arena_classe(ligacao->num_filhos < 2 ? 2 : ligacao->num_filhos);
+            no->filhos = arena_alocar_filhos(&arvore->arena, cap);
+            no->cap_filhos = cap;
+            no->num_filhos = ligacao->num_filhos;
+            for(int j = 0; j < ligacao->num_filhos; j++) {
+                no->filhos[j] = &nos[ligacao->primeiro_filho + j];
+            }
+        } else if(ligacao->pai >= 0) {
+            no->valor_investido = no->valor_total;
+        }
+
+        indice_inserir(&arvore->indice, no);
+    }
+
+    arvore->raiz = &nos[0];
+    arvore->valor_total = valor_inicial;
+    arvore->totais_sujos = 0;
+
+    ESTATISTICA_SOMAR(nos_criados, modelo->num_nos);
+
+    return arvore;
+}
+
+// Funcao para montar a carteira de um perfil (sem imprimir nada; perfil desconhecido vira MODERADO)
+Arvore* montar_carteira_perfil(Centavos valor_inicial, const char* perfil) {
+    const ModeloPerfil* modelo = buscar_perfil(perfil);
+    if(modelo == NULL) {
+        modelo = buscar_perfil("MODERADO");
+    }
+
+    return instanciar_perfil(modelo, valor_inicial);
+}
+
+// Funcao para criar carteira por perfil
+Arvore* criar_carteira_perfil(Centavos valor_inicial, const char* perfil) {
+    if(strcmp(perfil, "CONSERVADOR") == 0) {
+        printf("\nCriando carteira CONSERVADORA...\n");
+    }
+    else if(strcmp(perfil, "MODERADO") == 0) {
+        printf("\nCriando carteira MODERADA...\n");
+    }
+    else if(strcmp(perfil, "ARROJADO") == 0) {
+        printf("\nCriando carteira ARROJADA...\n");
+    }
+    else if(buscar_perfil(perfil) != NULL) {
+        printf("\nCriando carteira %s...\n", perfil);
+    }
+    else {
+        printf("\nPerfil desconhecido. Usando MODERADO...\n");
+    }
+
+    Arvore* carteira = montar_carteira_perfil(valor_inicial, perfil);
+    diario_registrar(DIARIO_CRIAR, 0, valor_inicial, 0.0, perfil, NULL);
+
+    printf("Carteira criada! Valor total: R$ %.2f\n", centavos_para_reais(carteira->valor_total));
+
+    return carteira;
+}
+
+// Funcao para devolver uma subarvore para a arena (os slots sao reaproveitados)
+void liberar_no(Arvore* arvore, No* no) {
+    if(no == NULL) return;
+
+    for(int i = 0; i < no->num_filhos; i++) {
+        liberar_no(arvore, no->filhos[i]);
+    }
+
+    if(no->id_preco >= 0) {
+        desvincular_posicao(arvore, no);
+    }
+    indice_remover(&arvore->indice, no);
+    arena_devolver_filhos(&arvore->arena, no->filhos, no->cap_filhos);
+    arena_devolver_no(&arvore->arena, no);
+}
+
+// Funcao para tirar um filho do vetor do pai (os irmaos seguintes andam uma posicao)
+void desligar_filho(No* pai, No* filho) {
+    for(int i = 0; i < pai->num_filhos; i++) {
+        if(pai->filhos[i] == filho) {
+            memmove(&pai->filhos[i], &pai->filhos[i + 1], (pai->num_filhos - i - 1) * sizeof(No*));
+            pai->num_filhos--;
+            break;
+        }
+    }
+
+    filho->pai = NULL;
+}
+
+// Funcao para compactar a arvore: os nos vivos sao copiados para um bloco so, em ordem de largura
+// (irmaos contiguos, como no snapshot), com vetores de filhos justos e um indice de nomes sem lapides
+// Os alertas e as posicoes cotadas passam a apontar para as copias; ponteiros No* guardados fora
+// da arvore deixam de valer
+void compactar_arvore(Arvore* arvore) {
+    if(arvore->raiz == NULL) {
+        return;
+    }
+
+    int num_nos = 0;
+    int internos = 0;
+    contar_nos_alerta(arvore->raiz, &num_nos, &internos);
+
+    ArenaNos arena;
+    IndiceNomes indice;
+    arena_iniciar(&arena, num_nos);
+    indice_iniciar(&indice, num_nos);
+    No* novos = arena_alocar_nos(&arena, num_nos);
+    No** antigos = (No**) malloc(num_nos * sizeof(No*));
+    int* primeiro_filho = (int*) malloc(num_nos * sizeof(int));
+    IndiceAlertas* alertas = arvore->alertas;
+
+    // primeira passada: copia em largura (a fila e o proprio vetor de nos antigos)
+    int fim = 1;
+    antigos[0] = arvore->raiz;
+    arvore->num_cotados = 0;
+    for(int i = 0; i < num_nos; i++) {
+        No* antigo = antigos[i];
+        No* novo = &novos[i];
+
+        *novo = *antigo;
+        novo->filhos = NULL;
+        novo->cap_filhos = 0;
+        primeiro_filho[i] = fim;
+        for(int j = 0; j < antigo->num_filhos; j++) {
+            antigos[fim++] = antigo->filhos[j];
+        }
+
+        indice_inserir(&indice, novo);
+        if(novo->id_preco >= 0) {
+            arvore->cotados[arvore->num_cotados++] = novo;
+        }
+        if(alertas != NULL && novo->alerta >= 0) {
+            alertas->entradas[novo->alerta].no = novo;
+        }
+    }
+
+    // segunda passada: liga pais e filhos nas copias
+    novos[0].pai = NULL;
+    for(int i = 0; i < num_nos; i++) {
+        No* novo = &novos[i];
+        if(novo->num_filhos == 0) {
+            continue;
+        }
+
+        int cap = 1 << arena_classe(novo->num_filhos < 2 ? 2 : novo->num_filhos);
+        novo->filhos = arena_alocar_filhos(&arena, cap);
+        novo->cap_filhos = cap;
+        for(int j = 0; j < novo->num_filhos; j++) {
+            novo->filhos[j] = &novos[primeiro_filho[i] + j];
+            novo->filhos[j]->pai = novo;
+        }
+
+        if(alertas != NULL) {
+            alertas->grupos[alertas->entradas[novo->filhos[0]->alerta].grupo].pai = novo;
+        }
+    }
+
+    free(primeiro_filho);
+    free(antigos);
+
+    arena_liberar(&arvore->arena);
+    indice_liberar(&arvore->indice);
+    arvore->arena = arena;
+    arvore->indice = indice;
+    arvore->raiz = &novos[0];
+}
+
+// Funcao para tirar um no (e a subarvore dele) da carteira de verdade: sai do vetor do pai,
+// do indice e das posicoes cotadas, e os slots voltam para a arena para o proximo criar_no
+// Com muitos slots livres a arvore e compactada (ponteiros No* de fora deixam de valer)
+void remover_no(Arvore* arvore, No* no) {
+    No* pai = no->pai;
+    if(pai == NULL) {
+        return;
+    }
+
+    // o indice de alertas ainda tem o no: fica desligado ate ser refeito sem ele
+    IndiceAlertas* alertas = arvore->alertas;
+    arvore->alertas = NULL;
+
+    desligar_filho(pai, no);
+    propagar_delta(arvore, pai, -no->valor_total);
+    liberar_no(arvore, no);
+
+    arvore->alertas = alertas;
+    if(alertas != NULL) {
+        reconstruir_indice_alertas(arvore);
+    }
+
+    ArenaNos* arena = &arvore->arena;
+    if(arena->num_livres >= COMPACTAR_MINIMO_LIVRES && arena->num_livres * COMPACTAR_PROPORCAO >= arena->nos_em_uso) {
+        compactar_arvore(arvore);
+    }
+}
+
+// Funcao para remover um ativo
+void remover_ativo(Arvore* arvore, const char* nome) {
+    if(arvore == NULL || arvore->raiz == NULL) {
+        printf("Carteira vazia!\n");
+        return;
+    }
+
+    No* ativo = buscar_no(arvore, nome);
+
+    if(ativo == NULL) {
+        printf("Ativo nao encontrado!\n");
+        return;
+    }
+
+    if(ativo->tipo != ATIVO) {
+        printf("Nao e um ativo!\n");
+        return;
+    }
+
+    // o no (e o nome dele) volta para a arena: o diario recebe uma copia do nome
+    char removido[64];
+    memcpy(removido, ativo->nome, sizeof(removido));
+    remover_no(arvore, ativo);
+    diario_registrar(DIARIO_REMOVER, 0, 0, 0.0, removido, NULL);
+
+    printf("Ativo removido com sucesso!\n");
+}
+
+// Funcao para adicionar um ativo em uma categoria
+void adicionar_ativo(Arvore* arvore, const char* nome_categoria, const char* nome, Centavos valor) {
+    if(arvore == NULL || arvore->raiz == NULL) {
+        printf("Carteira vazia!\n");
+        return;
+    }
+
+    No* categoria = buscar_no(arvore, nome_categoria);
+
+    if(categoria == NULL) {
+        printf("Categoria nao encontrada!\n");
+        return;
+    }
+
+    if(categoria->tipo != CATEGORIA) {
+        printf("Nao e uma categoria!\n");
+        return;
+    }
+
+    if(buscar_no(arvore, nome) != NULL) {
+        printf("Ja existe um ativo com esse nome!\n");
+        return;
+    }
+
+    No* ativo = criar_no(arvore, nome, ATIVO, 0.0, valor);
+    adicionar_filho(arvore, categoria, ativo);
+    propagar_delta(arvore, ativo, valor);
+    diario_registrar(DIARIO_ADICIONAR, 0, valor, 0.0, ativo->nome, categoria->nome);
+
+    printf("Ativo adicionado com sucesso!\n");
+}
+
+// Funcao para transformar um ativo em posicao cotada (quantidade cotas ao preco da tabela compartilhada)
+void definir_posicao_ativo(Arvore* arvore, const char* nome, double quantidade) {
+    if(arvore == NULL || arvore->raiz == NULL) {
+        printf("Carteira vazia!\n");
+        return;
+    }
+
+    No* ativo = buscar_no(arvore, nome);
+
+    if(ativo == NULL) {
+        printf("Ativo nao encontrado!\n");
+        return;
+    }
+
+    if(ativo->tipo != ATIVO) {
+        printf("Nao e um ativo!\n");
+        return;
+    }
+
+    if(!(quantidade > 0.0)) {
+        printf("Quantidade invalida!\n");
+        return;
+    }
+
+    definir_posicao(arvore, ativo, quantidade);
+    diario_registrar(DIARIO_POSICAO, 0, 0, quantidade, ativo->nome, NULL);
+
+    printf("Posicao de %s: %.4f cotas a R$ %.2f = R$ %.2f\n", ativo->nome, ativo->quantidade,
+           centavos_para_reais(tabela_precos.precos[ativo->id_preco]), centavos_para_reais(ativo->valor_investido));
+}
+
+// Funcao para escrever a situacao das categorias em CSV ou JSON (percentuais e desbalanceamento)
+void formatar_situacao_categorias(Relatorio* relatorio, const char* nome, const ResultadoBalanceamento* resultado) {
+    if(resultado->erro != RELATORIO_OK) {
+        formatar_erro_relatorio(relatorio, nome, resultado->erro);
+        return;
+    }
+
+    if(relatorio->formato == FORMATO_CSV) {
+        relatorio_printf(relatorio, "categoria,meta,atual,diferenca,valor,fora_da_tolerancia\n");
+        for(int i = 0; i < resultado->num_categorias; i++) {
+            const SituacaoCategoria* s = &resultado->categorias[i];
+            relatorio_csv_texto(relatorio, s->categoria->nome);
+            relatorio_printf(relatorio, ",%.4f,%.4f,%.4f,%.2f,%d\n", s->meta, s->atual, s->diferenca,
+                             centavos_para_reais(s->valor), fabs(s->diferenca) > resultado->tolerancia);
+        }
+        return;
+    }
+
+    relatorio_printf(relatorio, "{\"relatorio\":\"%s\",\"valor_total\":%.2f,\"tolerancia\":%.4f,\"fora_da_tolerancia\":%d,\"categorias\":[",
+                     nome, centavos_para_reais(resultado->valor_total), resultado->tolerancia, resultado->fora_da_tolerancia);
+    for(int i = 0; i < resultado->num_categorias; i++) {
+        const SituacaoCategoria* s = &resultado->categorias[i];
+        relatorio_printf(relatorio, "%s{\"nome\":", i > 0 ? "," : "");
+        relatorio_json_texto(relatorio, s->categoria->nome);
+        relatorio_printf(relatorio, ",\"meta\":%.4f,\"atual\":%.4f,\"diferenca\":%.4f,\"valor\":%.2f}",
+                         s->meta, s->atual, s->diferenca, centavos_para_reais(s->valor));
+    }
+    relatorio_printf(relatorio, "]}\n");
+}
+
+void liberar_resultado_balanceamento(ResultadoBalanceamento* resultado) {
+    free(resultado->categorias);
+    resultado->categorias = NULL;
+    resultado->num_categorias = 0;
+}
+
+// Funcao para calcular os percentuais das categorias da carteira (nada e impresso)
+ResultadoBalanceamento calcular_percentuais(Arvore* arvore) {
+    ResultadoBalanceamento resultado;
+    memset(&resultado, 0, sizeof(resultado));
+    resultado.tolerancia = 1.0;
+
+    if(arvore == NULL || arvore->raiz == NULL) {
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
+    }
+
+    garantir_totais(arvore);
+
+    resultado.valor_total = arvore->valor_total;
+    resultado.num_categorias = arvore->raiz->num_filhos;
+    resultado.categorias = (SituacaoCategoria*) malloc((resultado.num_categorias + 1) * sizeof(SituacaoCategoria));
+
+    for(int i = 0; i < arvore->raiz->num_filhos; i++) {
+        No* categoria = arvore->raiz->filhos[i];
+        SituacaoCategoria* s = &resultado.categorias[i];
+
+        s->categoria = categoria;
+        s->meta = categoria->percentual_alvo;
+        s->atual = ((double) categoria->valor_total / arvore->valor_total) * 100.0;
+        s->diferenca = s->atual - s->meta;
+        s->valor = categoria->valor_total;
+
+        if(fabs(s->diferenca) > resultado.tolerancia) {
+            resultado.fora_da_tolerancia++;
+        }
+    }
+
+    return resultado;
+}
+
+// Funcao para escrever os percentuais no relatorio
+void formatar_percentuais(Relatorio* relatorio, const ResultadoBalanceamento* resultado) {
+    if(relatorio->formato != FORMATO_TEXTO) {
+        formatar_situacao_categorias(relatorio, "percentuais", resultado);
+        return;
+    }
+
+    if(resultado->erro != RELATORIO_OK) {
+        relatorio_printf(relatorio, "Carteira vazia!\n");
+        return;
+    }
+
+    relatorio_printf(relatorio, "\n=== PERCENTUAIS DA CARTEIRA ===\n");
+    relatorio_printf(relatorio, "Valor total: R$ %.2f\n\n", centavos_para_reais(resultado->valor_total));
+
+    for(int i = 0; i < resultado->num_categorias; i++) {
+        const SituacaoCategoria* s = &resultado->categorias[i];
+
+        relatorio_printf(relatorio, "%s:\n", s->categoria->nome);
+        relatorio_printf(relatorio, "  Meta: %.1f%%\n", s->meta);
+        relatorio_printf(relatorio, "  Atual: %.1f%%\n", s->atual);
+        relatorio_printf(relatorio, "  Valor: R$ %.2f\n", centavos_para_reais(s->valor));
+
+        if(s->diferenca > resultado->tolerancia) {
+            relatorio_printf(relatorio, "  Status: Acima do alvo (+%.1f%%)\n", s->diferenca);
+        } else if(s->diferenca < -resultado->tolerancia) {
+            relatorio_printf(relatorio, "  Status: Abaixo do alvo (%.1f%%)\n", s->diferenca);
+        } else {
+            relatorio_printf(relatorio, "  Status: OK\n");
+        }
+        relatorio_printf(relatorio, "\n");
+    }
+}
+
+// Funcao para atualizar percentuais
+void atualizar_percentuais(Arvore* arvore) {
+    ResultadoBalanceamento resultado = calcular_percentuais(arvore);
+
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_percentuais(&relatorio, &resultado);
+    relatorio_escrever(&relatorio, stdout);
+
+    relatorio_liberar(&relatorio);
+    liberar_resultado_balanceamento(&resultado);
+}
+
+// Funcao para juntar os ativos de uma categoria (nada e impresso)
+ResultadoListagem calcular_listagem(Arvore* arvore, const char* nome_categoria) {
+    ResultadoListagem resultado;
+    memset(&resultado, 0, sizeof(resultado));
+
+    if(arvore == NULL || arvore->raiz == NULL) {
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
+    }
+
+    No* categoria = buscar_no(arvore, nome_categoria);
+
+    if(categoria == NULL) {
+        resultado.erro = RELATORIO_NAO_ENCONTRADO;
+        return resultado;
+    }
+
+    if(categoria->tipo != CATEGORIA) {
+        resultado.erro = RELATORIO_NAO_E_CATEGORIA;
+        return resultado;
+    }
+
+    garantir_totais(arvore);
+
+    resultado.categoria = categoria;
+    resultado.num_ativos = categoria->num_filhos;
+    resultado.ativos = (No**) malloc((categoria->num_filhos + 1) * sizeof(No*));
+    memcpy(resultado.ativos, categoria->filhos, categoria->num_filhos * sizeof(No*));
+    resultado.total = categoria->valor_total;
+
+    return resultado;
+}
+
+// Funcao para escrever a lista de ativos no relatorio
+void formatar_listagem(Relatorio* relatorio, const ResultadoListagem* resultado) {
+    if(relatorio->formato == FORMATO_TEXTO) {
+        if(resultado->erro == RELATORIO_CARTEIRA_VAZIA) {
+            relatorio_printf(relatorio, "Carteira vazia!\n");
+            return;
+        }
+        if(resultado->erro == RELATORIO_NAO_ENCONTRADO) {
+            relatorio_printf(relatorio, "Categoria nao encontrada!\n");
+            return;
+        }
+        if(resultado->erro == RELATORIO_NAO_E_CATEGORIA) {
+            relatorio_printf(relatorio, "Nao e uma categoria!\n");
+            return;
+        }
+
+        relatorio_printf(relatorio, "\n=== ATIVOS EM %s ===\n", resultado->categoria->nome);
+
+        for(int i = 0; i < resultado->num_ativos; i++) {
+            No* ativo = resultado->ativos[i];
+            relatorio_printf(relatorio, "%d. %s - R$ %.2f\n", i + 1, ativo->nome, centavos_para_reais(ativo->valor_investido));
+        }
+
+        if(resultado->num_ativos == 0) {
+            relatorio_printf(relatorio, "Nenhum ativo nesta categoria.\n");
+        }
+
+        relatorio_printf(relatorio, "Total: R$ %.2f\n", centavos_para_reais(resultado->total));
+        return;
+    }
+
+    if(resultado->erro != RELATORIO_OK) {
+        formatar_erro_relatorio(relatorio, "ativos", resultado->erro);
+        return;
+    }
+
+    if(relatorio->formato == FORMATO_CSV) {
+        relatorio_printf(relatorio, "categoria,ativo,valor\n");
+        for(int i = 0; i < resultado->num_ativos; i++) {
+            relatorio_csv_texto(relatorio, resultado->categoria->nome);
+            relatorio_printf(relatorio, ",");
+            relatorio_csv_texto(relatorio, resultado->ativos[i]->nome);
+            relatorio_printf(relatorio, ",%.2f\n", centavos_para_reais(resultado->ativos[i]->valor_investido));
+        }
+        return;
+    }
+
+    relatorio_printf(relatorio, "{\"relatorio\":\"ativos\",\"categoria\":");
+    relatorio_json_texto(relatorio, resultado->categoria->nome);
+    relatorio_printf(relatorio, ",\"total\":%.2f,\"ativos\":[", centavos_para_reais(resultado->total));
+    for(int i = 0; i < resultado->num_ativos; i++) {
+        relatorio_printf(relatorio, "%s{\"nome\":", i > 0 ? "," : "");
+        relatorio_json_texto(relatorio, resultado->ativos[i]->nome);
+        relatorio_printf(relatorio, ",\"valor\":%.2f}", centavos_para_reais(resultado->ativos[i]->valor_investido));
+    }
+    relatorio_printf(relatorio, "]}\n");
+}
+
+void liberar_resultado_listagem(ResultadoListagem* resultado) {
+    free(resultado->ativos);
+    resultado->ativos = NULL;
+    resultado->num_ativos = 0;
+}
+
+// Funcao para listar ativos de uma categoria
+void listar_ativos(Arvore* arvore, const char* nome_categoria) {
+    ResultadoListagem resultado = calcular_listagem(arvore, nome_categoria);
+
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_listagem(&relatorio, &resultado);
+    relatorio_escrever(&relatorio, stdout);
+
+    relatorio_liberar(&relatorio);
+    liberar_resultado_listagem(&resultado);
+}
+
+// Funcao para liberar memoria (a arena solta todos os nos de uma vez)
+void liberar_arvore(Arvore* arvore) {
+    if(arvore == NULL) return;
+
+    liberar_indice_alertas(arvore->alertas);
+    free(arvore->cotados);
+    arena_liberar(&arvore->arena);
+    indice_liberar(&arvore->indice);
+    free(arvore);
+}
+
+// ========================================
+// VISAO PLANA E KERNELS VETORIZADOS
+// ========================================
+
+void visao_iniciar(VisaoPlana* visao) {
+    memset(visao, 0, sizeof(*visao));
+}
+
+// Funcao para garantir espaco para mais linhas na visao
+void visao_reservar(VisaoPlana* visao, int quantidade) {
+    if(visao->quantidade + quantidade <= visao->capacidade) {
+        return;
+    }
+
+    int capacidade = visao->capacidade == 0 ? 16 : visao->capacidade;
+    while(capacidade < visao->quantidade + quantidade) {
+        capacidade = capacidade * 2;
+    }
+
+    visao->nos = (No**) realloc(visao->nos, capacidade * sizeof(No*));
+    visao->grupos = (int*) realloc(visao->grupos, capacidade * sizeof(int));
+    visao->valores = (double*) realloc(visao->valores, capacidade * sizeof(double));
+    visao->totais = (double*) realloc(visao->totais, capacidade * sizeof(double));
+    visao->alvos = (double*) realloc(visao->alvos, capacidade * sizeof(double));
+    visao->diferencas = (double*) realloc(visao->diferencas, capacidade * sizeof(double));
+    visao->capacidade = capacidade;
+}
+
+// Funcao para saber se um no pode receber dinheiro: e um ativo ou tem algum ativo abaixo dele
+// (uma categoria vazia, por remocao ou por perfil sem ativos, nao vira ordem)
+int no_investivel(const No* no) {
+    if(no->tipo == ATIVO) {
+        return 1;
+    }
+
+    for(int i = 0; i < no->num_filhos; i++) {
+        if(no_investivel(no->filhos[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Funcao para copiar os filhos de um no para o fim da visao
+// Como no planejador, grupos sem ativos ficam de fora e as metas dos outros filhos sao normalizadas
+// (divididas em partes iguais se forem todas zero)
+void achatar_filhos(VisaoPlana* visao, No* pai, int grupo) {
+    visao_reservar(visao, pai->num_filhos);
+
+    int n = 0;
+    double soma_metas = 0.0;
+    Centavos fora = 0;
+    for(int i = 0; i < pai->num_filhos; i++) {
+        if(no_investivel(pai->filhos[i])) {
+            n++;
+            soma_metas += pai->filhos[i]->percentual_alvo;
+        } else {
+            fora += pai->filhos[i]->valor_total;
+        }
+    }
+
+    int k = visao->quantidade;
+    for(int i = 0; i < pai->num_filhos; i++) {
+        No* filho = pai->filhos[i];
+        if(!no_investivel(filho)) {
+            continue;
+        }
+        visao->nos[k] = filho;
+        visao->grupos[k] = grupo;
+        visao->valores[k] = filho->valor_total;
+        visao->totais[k] = pai->valor_total - fora;
+        visao->alvos[k] = soma_metas > 0.0 ? filho->percentual_alvo / soma_metas * 100.0 : 100.0 / n;
+        k++;
+    }
+    visao->quantidade = k;
+}
+
+void visao_liberar(VisaoPlana* visao) {
+    free(visao->nos);
+    free(visao->grupos);
+    free(visao->valores);
+    free(visao->totais);
+    free(visao->alvos);
+    free(visao->diferencas);
+    visao_iniciar(visao);
+}
+
+// Kernel: diferencas[i] = valores[i] / totais[i] * 100 - alvos[i] (pontos percentuais)
+// (as versoes vetoriais fazem as mesmas operacoes na mesma ordem da escalar)
+void kernel_drift(const double* valores, const double* totais, const double* alvos, double* diferencas, int n) {
+    int i = 0;
+
+    #if defined(__AVX__)
+    __m256d cem = _mm256_set1_pd(100.0);
+    for(; i + 4 <= n; i += 4) {
+        __m256d percentual = _mm256_mul_pd(_mm256_div_pd(_mm256_loadu_pd(valores + i), _mm256_loadu_pd(totais + i)), cem);
+        _mm256_storeu_pd(diferencas + i, _mm256_sub_pd(percentual, _mm256_loadu_pd(alvos + i)));
+    }
+    #elif defined(__SSE2__)
+    __m128d cem = _mm_set1_pd(100.0);
+    for(; i + 2 <= n; i += 2) {
+        __m128d percentual = _mm_mul_pd(_mm_div_pd(_mm_loadu_pd(valores + i), _mm_loadu_pd(totais + i)), cem);
+        _mm_storeu_pd(diferencas + i, _mm_sub_pd(percentual, _mm_loadu_pd(alvos + i)));
+    }
+    #elif defined(__aarch64__)
+    float64x2_t cem = vdupq_n_f64(100.0);
+    for(; i + 2 <= n; i += 2) {
+        float64x2_t percentual = vmulq_f64(vdivq_f64(vld1q_f64(valores + i), vld1q_f64(totais + i)), cem);
+        vst1q_f64(diferencas + i, vsubq_f64(percentual, vld1q_f64(alvos + i)));
+    }
+    #endif
+
+    for(; i < n; i++) {
+        diferencas[i] = valores[i] / totais[i] * 100.0 - alvos[i];
+    }
+}
+
+// Kernel: conta quantas diferencas estao fora da faixa [-tolerancia, +tolerancia]
+int kernel_contar_fora(const double* diferencas, double tolerancia, int n) {
+    int i = 0;
+    int fora = 0;
+
+    #if defined(__AVX__)
+    __m256d limite = _mm256_set1_pd(tolerancia);
+    __m256d sem_sinal = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+    for(; i + 4 <= n; i += 4) {
+        __m256d absoluto = _mm256_and_pd(_mm256_loadu_pd(diferencas + i), sem_sinal);
+        fora += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(absoluto, limite, _CMP_GT_OQ)));
+    }
+    #elif defined(__SSE2__)
+    __m128d limite = _mm_set1_pd(tolerancia);
+    __m128d sem_sinal = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+    for(; i + 2 <= n; i += 2) {
+        __m128d absoluto = _mm_and_pd(_mm_loadu_pd(diferencas + i), sem_sinal);
+        int mascara = _mm_movemask_pd(_mm_cmpgt_pd(absoluto, limite));
+        fora += (mascara & 1) + ((mascara >> 1) & 1);
+    }
+    #elif defined(__aarch64__)
+    float64x2_t limite = vdupq_n_f64(tolerancia);
+    for(; i + 2 <= n; i += 2) {
+        uint64x2_t mascara = vcagtq_f64(vld1q_f64(diferencas + i), limite);
+        fora += (int) (vgetq_lane_u64(mascara, 0) & 1) + (int) (vgetq_lane_u64(mascara, 1) & 1);
+    }
+    #endif
+
+    for(; i < n; i++) {
+        if(fabs(diferencas[i]) > tolerancia) {
+            fora++;
+        }
+    }
+
+    return fora;
+}
+
+// ========================================
+// REBALANCEAMENTO POR ATIVO (GIRO MINIMO)
+// ========================================
+
+int comparar_desvios(const void* a, const void* b) {
+    const DesvioPosicao* x = (const DesvioPosicao*) a;
+    const DesvioPosicao* y = (const DesvioPosicao*) b;
+    if(x->desvio != y->desvio) {
+        return (x->desvio > y->desvio) - (x->desvio < y->desvio);
+    }
+    return x->indice - y->indice;
+}
+
+// Funcao para dividir arredondando para baixo (tambem com numeros negativos)
+Centavos dividir_para_baixo(Centavos a, Centavos b) {
+    Centavos q = a / b;
+    if(a % b != 0 && (a < 0) != (b < 0)) {
+        q--;
+    }
+    return q;
+}
+
+// Funcao para somar quantia nas posicoes com menor desvio, nivelando-as por baixo
+// (desvios[] ordenados do menor para o maior; os centavos que sobram vao para os primeiros)
+void nivelar_por_baixo(DesvioPosicao* desvios, int n, Centavos quantia) {
+    Centavos soma = 0;
+    int k = 0;
+
+    while(k < n) {
+        soma += desvios[k].desvio;
+        k++;
+        // para quando levar os k primeiros ate o desvio do proximo ja gasta a quantia
+        if(k == n || (Centavos) k * desvios[k].desvio - soma >= quantia) {
+            break;
+        }
+    }
+
+    Centavos alvo = soma + quantia;
+    Centavos nivel = dividir_para_baixo(alvo, k);
+    Centavos resto = alvo - nivel * k;
+
+    for(int i = 0; i < k; i++) {
+        desvios[i].desvio = nivel + (i < resto ? 1 : 0);
+    }
+}
+
+// Funcao para escolher novos valores para n posicoes que somem total_novo com o menor giro:
+// cada posicao vai para a borda mais proxima da faixa alvo +- faixa, e o que sobrar (ou faltar)
+// e nivelado nas posicoes mais acima (ou mais abaixo) do alvo; O(n log n)
+void distribuir_giro_minimo(const Centavos* valores, const Centavos* alvos, Centavos faixa, int n,
+                            Centavos total_novo, Centavos* novos, DesvioPosicao* desvios) {
+    Centavos soma = 0;
+
+    for(int i = 0; i < n; i++) {
+        Centavos minimo = alvos[i] - faixa > 0 ? alvos[i] - faixa : 0;
+        Centavos maximo = alvos[i] + faixa;
+
+        novos[i] = valores[i];
+        if(novos[i] < minimo) {
+            novos[i] = minimo;
+        } else if(novos[i] > maximo) {
+            novos[i] = maximo;
+        }
+        soma += novos[i];
+    }
+
+    Centavos residuo = total_novo - soma;
+    if(residuo == 0) {
+        return;
+    }
+
+    // com sinal -1 os mais acima do alvo viram os de menor desvio: nivelar por baixo = vender deles
+    int sinal = residuo > 0 ? 1 : -1;
+    for(int i = 0; i < n; i++) {
+        desvios[i].desvio = sinal * (novos[i] - alvos[i]);
+        desvios[i].indice = i;
+    }
+
+    qsort(desvios, n, sizeof(DesvioPosicao), comparar_desvios);
+    nivelar_por_baixo(desvios, n, sinal * residuo);
+
+    for(int i = 0; i < n; i++) {
+        novos[desvios[i].indice] = alvos[desvios[i].indice] + sinal * desvios[i].desvio;
+    }
+}
+
+// Funcao para colocar uma ordem no fim do plano
+void adicionar_ordem(PlanoRebalanceamento* plano, No* ativo, Centavos valor_novo) {
+    if(plano->num_ordens == plano->capacidade) {
+        plano->capacidade = plano->capacidade == 0 ? 16 : plano->capacidade * 2;
+        plano->ordens = (OrdemRebalanceamento*) realloc(plano->ordens, plano->capacidade * sizeof(OrdemRebalanceamento));
+    }
+
+    OrdemRebalanceamento* ordem = &plano->ordens[plano->num_ordens];
+    ordem->ativo = ativo;
+    ordem->valor_atual = ativo->valor_total;
+    ordem->valor_novo = valor_novo;
+    ordem->quantia = valor_novo - ativo->valor_total;
+    plano->num_ordens++;
+
+    if(ordem->quantia > 0) {
+        plano->total_compras += ordem->quantia;
+    } else {
+        plano->total_vendas -= ordem->quantia;
+    }
+}
+
+// Funcao para separar os filhos investiveis de um no (devolve quantos sao e, em fora,
+// quanto vale o que ficou de fora: essas metas voltam para os grupos irmaos)
+int filhos_investiveis(No* pai, No** filhos, Centavos* fora) {
+    int n = 0;
+
+    *fora = 0;
+    for(int i = 0; i < pai->num_filhos; i++) {
+        if(no_investivel(pai->filhos[i])) {
+            filhos[n++] = pai->filhos[i];
+        } else {
+            *fora += pai->filhos[i]->valor_total;
+        }
+    }
+    return n;
+}
+
+// Funcao para calcular o valor alvo de cada um de n filhos de um grupo que vale total
+// (as metas dos filhos sao relativas ao pai; se todas forem zero o grupo e dividido em partes iguais)
+void calcular_alvos_grupo(No* const* filhos, int n, Centavos total, Centavos* alvos) {
+    double soma_metas = 0.0;
+    for(int i = 0; i < n; i++) {
+        soma_metas += filhos[i]->percentual_alvo;
+    }
+
+    // arredonda a fracao acumulada, assim os alvos somam exatamente total
+    double acumulado = 0.0;
+    Centavos distribuido = 0;
+    for(int i = 0; i < n; i++) {
+        acumulado += soma_metas > 0.0 ? filhos[i]->percentual_alvo / soma_metas : 1.0 / n;
+        alvos[i] = (i == n - 1 ? total : llround(total * acumulado)) - distribuido;
+        distribuido += alvos[i];
+    }
+}
+
+// Funcao para planejar os filhos de um no que deve terminar valendo total_novo
+// (grupos sem ativos ficam como estao e a meta deles e dividida entre os outros filhos)
+void planejar_grupo(No* pai, Centavos total_novo, double tolerancia, PlanoRebalanceamento* plano) {
+    if(pai->num_filhos == 0) {
+        return;
+    }
+
+    No** filhos = (No**) malloc(pai->num_filhos * sizeof(No*));
+    Centavos fora;
+    int n = filhos_investiveis(pai, filhos, &fora);
+    if(n == 0) {
+        free(filhos);
+        return;
+    }
+    total_novo -= fora;
+
+    Centavos* valores = (Centavos*) malloc(3 * n * sizeof(Centavos));
+    Centavos* alvos = valores + n;
+    Centavos* novos = alvos + n;
+    DesvioPosicao* desvios = (DesvioPosicao*) malloc(n * sizeof(DesvioPosicao));
+
+    for(int i = 0; i < n; i++) {
+        valores[i] = filhos[i]->valor_total;
+    }
+    calcular_alvos_grupo(filhos, n, total_novo, alvos);
+
+    Centavos faixa = llround(total_novo * tolerancia / 100.0);
+    distribuir_giro_minimo(valores, alvos, faixa, n, total_novo, novos, desvios);
+
+    for(int i = 0; i < n; i++) {
+        No* filho = filhos[i];
+        if(filho->tipo == ATIVO) {
+            if(novos[i] != valores[i]) {
+                adicionar_ordem(plano, filho, novos[i]);
+            }
+        } else {
+            planejar_grupo(filho, novos[i] - filho->valor_investido, tolerancia, plano);
+        }
+    }
+
+    free(desvios);
+    free(valores);
+    free(filhos);
+}
+
+// Funcao para calcular as ordens que trazem cada categoria e cada ativo para dentro da tolerancia
+// (tolerancia em pontos percentuais do pai; compras e vendas se compensam, nada e impresso)
+PlanoRebalanceamento planejar_rebalanceamento(Arvore* arvore, double tolerancia) {
+    PlanoRebalanceamento plano;
+    memset(&plano, 0, sizeof(plano));
+
+    if(arvore == NULL || arvore->raiz == NULL) {
+        return plano;
+    }
+
+    garantir_totais(arvore);
+    planejar_grupo(arvore->raiz, arvore->raiz->valor_total - arvore->raiz->valor_investido, tolerancia, &plano);
+
+    return plano;
+}
+
+// Funcao para distribuir um aporte entre os filhos de um no mandando o dinheiro primeiro para
+// os que estao mais abaixo da meta (nivelamento por baixo, so compras; desce nas categorias)
+void distribuir_aporte_nivelado(No* pai, Centavos quantia, PlanoRebalanceamento* plano) {
+    if(pai->num_filhos == 0 || quantia <= 0) {
+        return;
+    }
+
+    No** filhos = (No**) malloc(pai->num_filhos * sizeof(No*));
+    Centavos fora;
+    int n = filhos_investiveis(pai, filhos, &fora);
+    if(n == 0) {
+        free(filhos);
+        return;
+    }
+
+    Centavos* alvos = (Centavos*) malloc(n * sizeof(Centavos));
+    DesvioPosicao* desvios = (DesvioPosicao*) malloc(n * sizeof(DesvioPosicao));
+
+    // as metas ja contam com o aporte: a soma dos desvios e -quantia
+    calcular_alvos_grupo(filhos, n, pai->valor_total - pai->valor_investido - fora + quantia, alvos);
+    for(int i = 0; i < n; i++) {
+        desvios[i].desvio = filhos[i]->valor_total - alvos[i];
+        desvios[i].indice = i;
+    }
+
+    qsort(desvios, n, sizeof(DesvioPosicao), comparar_desvios);
+    nivelar_por_baixo(desvios, n, quantia);
+
+    for(int i = 0; i < n; i++) {
+        No* filho = filhos[desvios[i].indice];
+        Centavos compra = alvos[desvios[i].indice] + desvios[i].desvio - filho->valor_total;
+        if(compra <= 0) {
+            continue;
+        }
+
+        if(filho->tipo == ATIVO) {
+            adicionar_ordem(plano, filho, filho->valor_total + compra);
+        } else {
+            distribuir_aporte_nivelado(filho, compra, plano);
+        }
+    }
+
+    free(desvios);
+    free(alvos);
+    free(filhos);
+}
+
+// Funcao para calcular as compras de um aporte por nivelamento (nada e impresso)
+PlanoRebalanceamento planejar_aporte_nivelado(Arvore* arvore, Centavos valor_aporte) {
+    PlanoRebalanceamento plano;
+    memset(&plano, 0, sizeof(plano));
+
+    if(arvore == NULL || arvore->raiz == NULL) {
+        return plano;
+    }
+
+    garantir_totais(arvore);
+    distribuir_aporte_nivelado(arvore->raiz, valor_aporte, &plano);
+
+    return plano;
+}
+
+// Funcao para executar as ordens de um plano na carteira
+void aplicar_plano_rebalanceamento(Arvore* arvore, const PlanoRebalanceamento* plano) {
+    for(int i = 0; i < plano->num_ordens; i++) {
+        No* ativo = plano->ordens[i].ativo;
+        alterar_valor_investido(arvore, ativo, ativo->valor_investido + plano->ordens[i].quantia);
+    }
+}
+
+void liberar_plano(PlanoRebalanceamento* plano) {
+    free(plano->ordens);
+    memset(plano, 0, sizeof(*plano));
+}
+
+// ========================================
+// FUNCOES DO GABRIEL
+// ========================================
+
+// Funcao para comparar cada categoria com a meta usando os kernels (nada e impresso)
+ResultadoBalanceamento calcular_desbalanceamento(Arvore* arvore, double tolerancia) {
+    ResultadoBalanceamento resultado;
+    memset(&resultado, 0, sizeof(resultado));
+    resultado.tolerancia = tolerancia;
+
+    if(arvore == NULL || arvore->raiz == NULL) {
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
+    }
+
+    garantir_totais(arvore);
+
+    VisaoPlana visao;
+    visao_iniciar(&visao);
+    achatar_filhos(&visao, arvore->raiz, 0);
+    kernel_drift(visao.valores, visao.totais, visao.alvos, visao.diferencas, visao.quantidade);
+
+    resultado.valor_total = arvore->valor_total;
+    resultado.fora_da_tolerancia = kernel_contar_fora(visao.diferencas, tolerancia, visao.quantidade);
+    resultado.num_categorias = visao.quantidade;
+    resultado.categorias = (SituacaoCategoria*) malloc((visao.quantidade + 1) * sizeof(SituacaoCategoria));
+
+    for(int i = 0; i < visao.quantidade; i++) {
+        SituacaoCategoria* s = &resultado.categorias[i];
+        s->categoria = visao.nos[i];
+        s->meta = visao.alvos[i];
+        s->diferenca = visao.diferencas[i];
+        s->atual = s->diferenca + s->meta;
+        s->valor = visao.nos[i]->valor_total;
+    }
+
+    visao_liberar(&visao);
+
+    return resultado;
+}
+
+// Funcao para escrever a analise de balanceamento no relatorio
+void formatar_desbalanceamento(Relatorio* relatorio, const ResultadoBalanceamento* resultado) {
+    if(relatorio->formato != FORMATO_TEXTO) {
+        formatar_situacao_categorias(relatorio, "desbalanceamento", resultado);
+        return;
+    }
+
+    if(resultado->erro != RELATORIO_OK) {
+        relatorio_printf(relatorio, "\nCarteira vazia!\n");
+        return;
+    }
+
+    relatorio_printf(relatorio, "\n========================================\n");
+    relatorio_printf(relatorio, "ANALISE DE BALANCEAMENTO\n");
+    relatorio_printf(relatorio, "========================================\n");
+
+    for(int i = 0; i < resultado->num_categorias; i++) {
+        const SituacaoCategoria* s = &resultado->categorias[i];
+
+        relatorio_printf(relatorio, "\n%s:\n", s->categoria->nome);
+        relatorio_printf(relatorio, "  Meta:  %.1f%%\n", s->meta);
+        relatorio_printf(relatorio, "  Atual: %.1f%%\n", s->atual);
+        relatorio_printf(relatorio, "  Diferenca: %+.1f%%\n", s->diferenca);
+
+        if(fabs(s->diferenca) > resultado->tolerancia) {
+            if(s->diferenca > 0) {
+                relatorio_printf(relatorio, "    ACIMA do alvo (sobra %.1f%%)\n", s->diferenca);
+            } else {
+                relatorio_printf(relatorio, "    ABAIXO do alvo (falta %.1f%%)\n", -s->diferenca);
+            }
+        } else {
+            relatorio_printf(relatorio, "   Dentro do alvo\n");
+        }
+    }
+
+    // categorias sem ativos ficam fora da conta, como no rebalanceamento e no aporte
+    if(resultado->num_categorias > 0) {
+        const No* raiz = resultado->categorias[0].categoria->pai;
+        for(int i = 0; i < raiz->num_filhos; i++) {
+            if(!no_investivel(raiz->filhos[i])) {
+                relatorio_printf(relatorio, "\n%s:\n   Sem ativos: nada a negociar\n", raiz->filhos[i]->nome);
+            }
+        }
+    }
+
+    relatorio_printf(relatorio, "\n========================================\n");
+    if(resultado->fora_da_tolerancia > 0) {
+        relatorio_printf(relatorio, "CARTEIRA DESBALANCEADA\n");
+        relatorio_printf(relatorio, "Sugestao: Use a opcao para ver como rebalancear\n");
+    } else {
+        relatorio_printf(relatorio, "CARTEIRA BALANCEADA\n");
+    }
+    relatorio_printf(relatorio, "========================================\n");
+}
+
+void detectar_desbalanceamento(Arvore* arvore) {
+    ResultadoBalanceamento resultado = calcular_desbalanceamento(arvore, 2.0);
+
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_desbalanceamento(&relatorio, &resultado);
+    relatorio_escrever(&relatorio, stdout);
+
+    relatorio_liberar(&relatorio);
+    liberar_resultado_balanceamento(&resultado);
+}
+
+// Funcao para calcular as ordens de rebalanceamento da carteira (nada e impresso)
+ResultadoRebalanceamento calcular_rebalanceamento(Arvore* arvore, double tolerancia) {
+    ResultadoRebalanceamento resultado;
+    memset(&resultado, 0, sizeof(resultado));
+    resultado.tolerancia = tolerancia;
+
+    if(arvore == NULL || arvore->raiz == NULL) {
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
+    }
+
+    resultado.plano = planejar_rebalanceamento(arvore, tolerancia);
+
+    return resultado;
+}
+
+// Funcao para escrever as ordens de rebalanceamento no relatorio
+void formatar_rebalanceamento(Relatorio* relatorio, const ResultadoRebalanceamento* resultado) {
+    const PlanoRebalanceamento* plano = &resultado->plano;
+
+    if(relatorio->formato == FORMATO_TEXTO) {
+        if(resultado->erro != RELATORIO_OK) {
+            relatorio_printf(relatorio, "\nCarteira vazia!\n");
+            return;
+        }
+
+        relatorio_printf(relatorio, "\n========================================\n");
+        relatorio_printf(relatorio, "SUGESTOES DE REBALANCEAMENTO\n");
+        relatorio_printf(relatorio, "========================================\n");
+        relatorio_printf(relatorio, "\nAcoes necessarias:\n\n");
+
+        for(int i = 0; i < plano->num_ordens; i++) {
+            const OrdemRebalanceamento* ordem = &plano->ordens[i];
+            const char* categoria = ordem->ativo->pai != NULL ? ordem->ativo->pai->nome : "";
+
+            if(ordem->quantia < 0) {
+                relatorio_printf(relatorio, "* VENDER R$ %.2f de %s (%s)\n",
+                                 centavos_para_reais(-ordem->quantia), ordem->ativo->nome, categoria);
+            } else {
+                relatorio_printf(relatorio, "* COMPRAR R$ %.2f em %s (%s)\n",
+                                 centavos_para_reais(ordem->quantia), ordem->ativo->nome, categoria);
+            }
+        }
+
+        if(plano->num_ordens == 0) {
+            relatorio_printf(relatorio, "Carteira ja esta balanceada!\n");
+        } else {
+            relatorio_printf(relatorio, "\nTotal a comprar: R$ %.2f\n", centavos_para_reais(plano->total_compras));
+            relatorio_printf(relatorio, "Total a vender: R$ %.2f\n", centavos_para_reais(plano->total_vendas));
+        }
+
+        relatorio_printf(relatorio, "\n========================================\n");
+        return;
+    }
+
+    if(resultado->erro != RELATORIO_OK) {
+        formatar_erro_relatorio(relatorio, "rebalanceamento", resultado->erro);
+        return;
+    }
+
+    if(relatorio->formato == FORMATO_CSV) {
+        relatorio_printf(relatorio, "ativo,categoria,operacao,valor_atual,valor_novo,quantia\n");
+        for(int i = 0; i < plano->num_ordens; i++) {
+            const OrdemRebalanceamento* ordem = &plano->ordens[i];
+            relatorio_csv_texto(relatorio, ordem->ativo->nome);
+            relatorio_printf(relatorio, ",");
+            relatorio_csv_texto(relatorio, ordem->ativo->pai != NULL ? ordem->ativo->pai->nome : "");
+            relatorio_printf(relatorio, ",%s,%.2f,%.2f,%.2f\n", ordem->quantia < 0 ? "vender" : "comprar",
+                             centavos_para_reais(ordem->valor_atual), centavos_para_reais(ordem->valor_novo),
+                             centavos_para_reais(ordem->quantia));
+        }
+        return;
+    }
+
+    relatorio_printf(relatorio, "{\"relatorio\":\"rebalanceamento\",\"tolerancia\":%.4f,\"total_compras\":%.2f,\"total_vendas\":%.2f,\"ordens\":[",
+                     resultado->tolerancia, centavos_para_reais(plano->total_compras), centavos_para_reais(plano->total_vendas));
+    for(int i = 0; i < plano->num_ordens; i++) {
+        const OrdemRebalanceamento* ordem = &plano->ordens[i];
+        relatorio_printf(relatorio, "%s{\"ativo\":", i > 0 ? "," : "");
+        relatorio_json_texto(relatorio, ordem->ativo->nome);
+        relatorio_printf(relatorio, ",\"categoria\":");
+        relatorio_json_texto(relatorio, ordem->ativo->pai != NULL ? ordem->ativo->pai->nome : "");
+        relatorio_printf(relatorio, ",\"valor_atual\":%.2f,\"valor_novo\":%.2f,\"quantia\":%.2f}",
+                         centavos_para_reais(ordem->valor_atual), centavos_para_reais(ordem->valor_novo),
+                         centavos_para_reais(ordem->quantia));
+    }
+    relatorio_printf(relatorio, "]}\n");
+}
+
+void liberar_resultado_rebalanceamento(ResultadoRebalanceamento* resultado) {
+    liberar_plano(&resultado->plano);
+}
+
+void sugerir_rebalanceamento(Arvore* arvore) {
+    ResultadoRebalanceamento resultado = calcular_rebalanceamento(arvore, 2.0);
+
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_rebalanceamento(&relatorio, &resultado);
+    relatorio_escrever(&relatorio, stdout);
+
+    relatorio_liberar(&relatorio);
+    liberar_resultado_rebalanceamento(&resultado);
+}
+
+// Funcao para dividir uma quantia em partes iguais entre os filhos investiveis de um grupo
+// (subcategorias dividem a parte delas do mesmo jeito; os centavos que sobram vao para os primeiros)
+// Devolve quantos ativos receberam alguma coisa
+int distribuir_aporte_igual(Arvore* arvore, No* grupo, Centavos quantia) {
+    No** filhos = (No**) malloc(grupo->num_filhos * sizeof(No*));
+    Centavos fora;
+    int n = filhos_investiveis(grupo, filhos, &fora);
+    int ativos_com_aporte = 0;
+
+    for(int i = 0; i < n; i++) {
+        No* filho = filhos[i];
+        Centavos parte = quantia / n + (i < quantia % n ? 1 : 0);
+        if(filho->tipo == ATIVO) {
+            alterar_valor_investido(arvore, filho, filho->valor_investido + parte);
+            if(parte > 0) {
+                ativos_com_aporte++;
+            }
+        } else {
+            ativos_com_aporte += distribuir_aporte_igual(arvore, filho, parte);
+        }
+    }
+
+    free(filhos);
+    return ativos_com_aporte;
+}
+
+// Funcao para aplicar um aporte na carteira e guardar o que cada categoria recebeu (nada e impresso)
+ResultadoAporte calcular_aporte(Arvore* arvore, Centavos valor_aporte, int modo) {
+    ResultadoAporte resultado;
+    memset(&resultado, 0, sizeof(resultado));
+    resultado.modo = modo;
+    resultado.valor_aporte = valor_aporte;
+
+    if(arvore == NULL || arvore->raiz == NULL) {
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
+    }
+
+    if(valor_aporte <= 0) {
+        resultado.erro = RELATORIO_VALOR_INVALIDO;
+        return resultado;
+    }
+
+    // so recebem as categorias com algum ativo; as metas das outras sao divididas entre elas
+    // (sem nenhuma, o dinheiro nao teria para onde ir)
+    double soma_metas = 0.0;
+    int recebem = 0;
+    int ultima = -1;
+    for(int i = 0; i < arvore->raiz->num_filhos; i++) {
+        No* categoria = arvore->raiz->filhos[i];
+        if(no_investivel(categoria)) {
+            soma_metas += categoria->percentual_alvo;
+            recebem++;
+            ultima = i;
+        }
+    }
+
+    if(recebem == 0) {
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
+    }
+
+    garantir_totais(arvore);
+
+    resultado.num_categorias = arvore->raiz->num_filhos;
+    resultado.categorias = (AporteCategoria*) malloc((resultado.num_categorias + 1) * sizeof(AporteCategoria));
+
+    if(modo == APORTE_NIVELADO) {
+        // guarda os totais das categorias para saber quanto cada uma recebeu
+        for(int i = 0; i < arvore->raiz->num_filhos; i++) {
+            resultado.categorias[i].categoria = arvore->raiz->filhos[i];
+            resultado.categorias[i].antes = arvore->raiz->filhos[i]->valor_total;
+        }
+
+        PlanoRebalanceamento plano = planejar_aporte_nivelado(arvore, valor_aporte);
+        aplicar_plano_rebalanceamento(arvore, &plano);
+
+        for(int i = 0; i < arvore->raiz->num_filhos; i++) {
+            resultado.categorias[i].recebido = arvore->raiz->filhos[i]->valor_total - resultado.categorias[i].antes;
+        }
+        resultado.ativos_com_aporte = plano.num_ordens;
+
+        liberar_plano(&plano);
+    } else {
+        // arredonda o percentual acumulado, assim a soma das partes fecha com o aporte
+        // (metas todas zero: as categorias com ativos recebem partes iguais)
+        double percentual_acumulado = 0.0;
+        Centavos distribuido = 0;
+
+        for(int i = 0; i < arvore->raiz->num_filhos; i++) {
+            No* categoria = arvore->raiz->filhos[i];
+
+            resultado.categorias[i].categoria = categoria;
+            resultado.categorias[i].antes = categoria->valor_total;
+            resultado.categorias[i].recebido = 0;
+            if(!no_investivel(categoria)) {
+                continue;
+            }
+
+            percentual_acumulado += soma_metas > 0.0 ? categoria->percentual_alvo / soma_metas : 1.0 / recebem;
+            Centavos valor_categoria = i == ultima ? valor_aporte - distribuido :
+                                       llround(valor_aporte * percentual_acumulado) - distribuido;
+            distribuido += valor_categoria;
+            resultado.categorias[i].recebido = valor_categoria;
+
+            // divide em partes iguais; um ativo direto na raiz recebe a parte inteira
+            if(categoria->tipo == ATIVO) {
+                alterar_valor_investido(arvore, categoria, categoria->valor_investido + valor_categoria);
+                resultado.ativos_com_aporte += valor_categoria > 0;
+            } else {
+                resultado.ativos_com_aporte += distribuir_aporte_igual(arvore, categoria, valor_categoria);
+            }
+        }
+    }
+
+    // desvio que sobra depois do aporte e se ainda sera preciso vender
+    resultado.depois = calcular_desbalanceamento(arvore, 2.0);
+
+    PlanoRebalanceamento pendente = planejar_rebalanceamento(arvore, 2.0);
+    resultado.ordens_pendentes = pendente.num_ordens;
+    resultado.vendas_pendentes = pendente.total_vendas;
+    liberar_plano(&pendente);
+
+    resultado.valor_total_novo = arvore->valor_total;
+
+    return resultado;
+}
+
+// Funcao para escrever a simulacao de aporte no relatorio
+void formatar_aporte(Relatorio* relatorio, const ResultadoAporte* resultado) {
+    if(relatorio->formato == FORMATO_TEXTO) {
+        if(resultado->erro == RELATORIO_CARTEIRA_VAZIA) {
+            relatorio_printf(relatorio, "\nCarteira vazia!\n");
+            return;
+        }
+        if(resultado->erro == RELATORIO_VALOR_INVALIDO) {
+            relatorio_printf(relatorio, "\nValor de aporte invalido!\n");
+            return;
+        }
+
+        relatorio_printf(relatorio, "\n========================================\n");
+        relatorio_printf(relatorio, "SIMULACAO DE APORTE\n");
+        relatorio_printf(relatorio, "========================================\n");
+        relatorio_printf(relatorio, "Valor do aporte: R$ %.2f\n\n", centavos_para_reais(resultado->valor_aporte));
+
+        if(resultado->modo == APORTE_NIVELADO) {
+            relatorio_printf(relatorio, "Distribuicao por nivelamento (primeiro o que esta mais abaixo da meta):\n\n");
+        } else {
+            relatorio_printf(relatorio, "Distribuicao proporcional:\n\n");
+        }
+
+        for(int i = 0; i < resultado->num_categorias; i++) {
+            const AporteCategoria* c = &resultado->categorias[i];
+            if(!no_investivel(c->categoria)) {
+                relatorio_printf(relatorio, "* %s (%.0f%%): sem ativos, nada a receber\n\n",
+                                 c->categoria->nome, c->categoria->percentual_alvo);
+                continue;
+            }
+            relatorio_printf(relatorio, "* %s (%.0f%%): + R$ %.2f\n",
+                             c->categoria->nome, c->categoria->percentual_alvo, centavos_para_reais(c->recebido));
+            relatorio_printf(relatorio, "  Novo total: R$ %.2f -> R$ %.2f\n\n",
+                             centavos_para_reais(c->antes), centavos_para_reais(c->antes + c->recebido));
+        }
+
+        if(resultado->modo == APORTE_NIVELADO) {
+            relatorio_printf(relatorio, "Ativos que receberam aporte: %d\n\n", resultado->ativos_com_aporte);
+        }
+
+        relatorio_printf(relatorio, "Desvio depois do aporte:\n");
+        for(int i = 0; i < resultado->depois.num_categorias; i++) {
+            relatorio_printf(relatorio, "  %s: %+.1f%%\n",
+                             resultado->depois.categorias[i].categoria->nome, resultado->depois.categorias[i].diferenca);
+        }
+
+        if(resultado->ordens_pendentes == 0) {
+            relatorio_printf(relatorio, "Carteira dentro da tolerancia: nenhuma venda necessaria\n\n");
+        } else {
+            relatorio_printf(relatorio, "Ainda fora da tolerancia: %d ordens de rebalanceamento (R$ %.2f em vendas)\n\n",
+                             resultado->ordens_pendentes, centavos_para_reais(resultado->vendas_pendentes));
+        }
+
+        relatorio_printf(relatorio, "========================================\n");
+        relatorio_printf(relatorio, "Novo valor total da carteira: R$ %.2f\n", centavos_para_reais(resultado->valor_total_novo));
+        relatorio_printf(relatorio, "Carteira atualizada com aporte!\n");
+        relatorio_printf(relatorio, "========================================\n");
+        return;
+    }
+
+    if(resultado->erro != RELATORIO_OK) {
+        formatar_erro_relatorio(relatorio, "aporte", resultado->erro);
+        return;
+    }
+
+    const char* modo = resultado->modo == APORTE_NIVELADO ? "nivelado" : "proporcional";
+
+    if(relatorio->formato == FORMATO_CSV) {
+        relatorio_printf(relatorio, "categoria,modo,meta,antes,recebido,depois,diferenca_depois\n");
+        for(int i = 0; i < resultado->num_categorias; i++) {
+            const AporteCategoria* c = &resultado->categorias[i];
+            relatorio_csv_texto(relatorio, c->categoria->nome);
+            relatorio_printf(relatorio, ",%s,%.4f,%.2f,%.2f,%.2f,%.4f\n", modo, c->categoria->percentual_alvo,
+                             centavos_para_reais(c->antes), centavos_para_reais(c->recebido),
+                             centavos_para_reais(c->antes + c->recebido), resultado->depois.categorias[i].diferenca);
+        }
+        return;
+    }
+
+    relatorio_printf(relatorio, "{\"relatorio\":\"aporte\",\"modo\":\"%s\",\"valor_aporte\":%.2f,\"ativos_com_aporte\":%d,"
+                     "\"ordens_pendentes\":%d,\"vendas_pendentes\":%.2f,\"valor_total\":%.2f,\"categorias\":[",
+                     modo, centavos_para_reais(resultado->valor_aporte), resultado->ativos_com_aporte,
+                     resultado->ordens_pendentes, centavos_para_reais(resultado->vendas_pendentes),
+                     centavos_para_reais(resultado->valor_total_novo));
+    for(int i = 0; i < resultado->num_categorias; i++) {
+        const AporteCategoria* c = &resultado->categorias[i];
+        relatorio_printf(relatorio, "%s{\"nome\":", i > 0 ? "," : "");
+        relatorio_json_texto(relatorio, c->categoria->nome);
+        relatorio_printf(relatorio, ",\"meta\":%.4f,\"antes\":%.2f,\"recebido\":%.2f,\"diferenca_depois\":%.4f}",
+                         c->categoria->percentual_alvo, centavos_para_reais(c->antes), centavos_para_reais(c->recebido),
+                         resultado->depois.categorias[i].diferenca);
+    }
+    relatorio_printf(relatorio, "]}\n");
+}
+
+void liberar_resultado_aporte(ResultadoAporte* resultado) {
+    free(resultado->categorias);
+    resultado->categorias = NULL;
+    resultado->num_categorias = 0;
+    liberar_resultado_balanceamento(&resultado->depois);
+}
+
+void simular_aporte(Arvore* arvore, Centavos valor_aporte, int modo) {
+    ResultadoAporte resultado = calcular_aporte(arvore, valor_aporte, modo);
+    if(resultado.erro == RELATORIO_OK) {
+        diario_registrar(DIARIO_APORTE, modo, valor_aporte, 0.0, NULL, NULL);
+    }
+
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_aporte(&relatorio, &resultado);
+    relatorio_escrever(&relatorio, stdout);
+
+    relatorio_liberar(&relatorio);
+    liberar_resultado_aporte(&resultado);
+}
+
+void atualizar_valores_mercado(Arvore* arvore, char* nome_ativo, Centavos novo_valor) {
+    if(arvore == NULL || arvore->raiz == NULL) {
+        printf("\nCarteira vazia!\n");
+        return;
+    }
+
+    No* ativo = buscar_no(arvore, nome_ativo);
+
+    if(ativo == NULL) {
+        printf("\nAtivo nao encontrado!\n");
+        return;
+    }
+
+    if(ativo->tipo != ATIVO) {
+        printf("\nNao e um ativo!\n");
+        return;
+    }
+
+    Centavos valor_anterior = ativo->valor_investido;
+    double variacao = 0.0;
+    if(valor_anterior != 0) {
+        variacao = ((double) (novo_valor - valor_anterior) / valor_anterior) * 100.0;
+    }
+
+    alterar_valor_investido(arvore, ativo, novo_valor);
+    diario_registrar(DIARIO_ATUALIZAR, 0, novo_valor, 0.0, ativo->nome, NULL);
+
+    printf("\n========================================\n");
+    printf("ATUALIZACAO DE MERCADO\n");
+    printf("========================================\n");
+    printf("Ativo: %s\n", nome_ativo);
+    printf("Valor anterior: R$ %.2f\n", centavos_para_reais(valor_anterior));
+    printf("Novo valor: R$ %.2f\n", centavos_para_reais(novo_valor));
+    printf("Variacao: %+.2f%%\n", variacao);
+    printf("========================================\n");
+    printf("\nDica: Use detectar_desbalanceamento() para verificar.\n");
+}
+
+// Funcao para aplicar varias atualizacoes de mercado de uma vez (sem imprimir)
+ResumoLoteMercado atualizar_valores_mercado_lote(Arvore* arvore, const AtualizacaoMercado* atualizacoes, int quantidade) {
+    ResumoLoteMercado resumo;
+    memset(&resumo, 0, sizeof(resumo));
+
+    if(arvore == NULL || arvore->raiz == NULL) {
+        resumo.nao_encontradas = quantidade;
+        return resumo;
+    }
+
+    garantir_totais(arvore);
+    resumo.valor_total_anterior = arvore->valor_total;
+
+    for(int i = 0; i < quantidade; i++) {
+        No* ativo = buscar_no(arvore, atualizacoes[i].nome_ativo);
+
+        if(ativo == NULL || ativo->tipo != ATIVO) {
+            resumo.nao_encontradas++;
+            continue;
+        }
+
+        Centavos valor_anterior = ativo->valor_investido;
+        Centavos novo_valor = atualizacoes[i].novo_valor;
+        double variacao = 0.0;
+        if(valor_anterior != 0) {
+            variacao = ((double) (novo_valor - valor_anterior) / valor_anterior) * 100.0;
+        }
+
+        if(resumo.maior_alta == NULL || variacao > resumo.variacao_maior_alta) {
+            resumo.maior_alta = ativo;
+            resumo.variacao_maior_alta = variacao;
+        }
+        if(resumo.maior_baixa == NULL || variacao < resumo.variacao_maior_baixa) {
+            resumo.maior_baixa = ativo;
+            resumo.variacao_maior_baixa = variacao;
+        }
+
+        // os totais sao refeitos uma vez so no fim do lote
+        definir_valor_no(ativo, novo_valor);
+        diario_registrar(DIARIO_ATUALIZAR, 0, novo_valor, 0.0, ativo->nome, NULL);
+        resumo.aplicadas++;
+    }
+
+    if(resumo.aplicadas > 0) {
+        arvore->totais_sujos = 1;
+        garantir_totais(arvore);
+    }
+
+    resumo.valor_total_novo = arvore->valor_total;
+    if(resumo.valor_total_anterior != 0) {
+        resumo.variacao_total = ((double) (resumo.valor_total_novo - resumo.valor_total_anterior) / resumo.valor_total_anterior) * 100.0;
+    }
+
+    return resumo;
+}
+
+// Funcao para desligar os alertas de desvio
+void desligar_alertas(Arvore* arvore) {
+    if(arvore == NULL || arvore->alertas == NULL) {
+        return;
+    }
+
+    IndiceAlertas* indice = arvore->alertas;
+    for(int i = 0; i < indice->num_entradas; i++) {
+        indice->entradas[i].no->alerta = -1;
+    }
+
+    liberar_indice_alertas(indice);
+    arvore->alertas = NULL;
+}
+
+// Funcao para ligar os alertas de desvio (o callback e chamado quando um no entra ou sai da faixa)
+// O callback nao pode mexer na carteira; se os alertas ja estavam ligados, a tolerancia e o callback sao trocados
+void ligar_alertas(Arvore* arvore, double tolerancia, CallbackAlerta callback, void* contexto) {
+    if(arvore == NULL) {
+        return;
+    }
+
+    desligar_alertas(arvore);
+    if(arvore->raiz != NULL) {
+        garantir_totais(arvore);
+    }
+    arvore->alertas = criar_indice_alertas(arvore, tolerancia, callback, contexto, NULL);
+}
+
+// ========================================
+// FEED DE PRECOS
+// ========================================
+
+#define FEED_TAMANHO_BUFFER (1 << 20)
+
+// Funcao para medir tempo em segundos (relogio monotonico)
+double agora_segundos() {
+    #ifdef _WIN32
+        return (double) clock() / CLOCKS_PER_SEC;
+    #else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    #endif
+}
+
+// Funcao para converter um numero do feed em centavos (aceita '.' ou ',' como decimal)
+// A conversao e feita so com inteiros: casas alem da segunda apenas arredondam
+int ler_valor_feed(const char* p, const char* fim, Centavos* valor) {
+    while(p < fim && *p == ' ') p++;
+    while(fim > p && (fim[-1] == ' ' || fim[-1] == '\r')) fim--;
+
+    int negativo = 0;
+    if(p < fim && (*p == '-' || *p == '+')) {
+        negativo = (*p == '-');
+        p++;
+    }
+
+    Centavos inteiro = 0;
+    Centavos fracao = 0;
+    int casas = 0;
+    int arredondar = 0;
+    int digitos = 0;
+
+    while(p < fim && *p >= '0' && *p <= '9') {
+        if(inteiro > (LLONG_MAX / 100 - 9) / 10) {
+            return 0;
+        }
+        inteiro = inteiro * 10 + (*p - '0');
+        digitos++;
+        p++;
+    }
+
+    if(p < fim && (*p == '.' || *p == ',')) {
+        p++;
+        while(p < fim && *p >= '0' && *p <= '9') {
+            if(casas < 2) {
+                fracao = fracao * 10 + (*p - '0');
+            } else if(casas == 2) {
+                arredondar = (*p >= '5');
+            }
+            casas++;
+            digitos++;
+            p++;
+        }
+    }
+
+    if(digitos == 0 || p != fim) {
+        return 0;
+    }
+
+    while(casas < 2) {
+        fracao = fracao * 10;
+        casas++;
+    }
+
+    Centavos resultado = inteiro * 100 + fracao + arredondar;
+    *valor = negativo ? -resultado : resultado;
+    return 1;
+}
+
+// Funcao para processar as linhas completas de um trecho do feed
+// (linha: NOME;VALOR ou NOME,VALOR; devolve onde comeca a linha incompleta)
+const char* processar_linhas_feed(Arvore* arvore, const char* inicio, const char* fim, ResumoFeed* resumo) {
+    const char* p = inicio;
+
+    while(p < fim) {
+        const char* fim_linha = memchr(p, '\n', fim - p);
+        if(fim_linha == NULL) {
+            return p;
+        }
+
+        const char* linha = p;
+        p = fim_linha + 1;
+        resumo->linhas++;
+
+        while(linha < fim_linha && (*linha == ' ' || *linha == '\t')) linha++;
+        if(linha == fim_linha || *linha == '\r' || *linha == '#') {
+            continue;
+        }
+
+        const char* separador = NULL;
+        for(const char* c = fim_linha - 1; c >= linha; c--) {
+            if(*c == ';') {
+                separador = c;
+                break;
+            }
+        }
+        if(separador == NULL) {
+            for(const char* c = fim_linha - 1; c >= linha; c--) {
+                if(*c == ',') {
+                    separador = c;
+                    break;
+                }
+            }
+        }
+
+        // valor negativo nao e preco: conta como linha invalida (como no servico)
+        Centavos valor;
+        if(separador == NULL || !ler_valor_feed(separador + 1, fim_linha, &valor) || valor < 0) {
+            resumo->invalidas++;
+            continue;
+        }
+
+        const char* fim_nome = separador;
+        while(fim_nome > linha && fim_nome[-1] == ' ') fim_nome--;
+
+        No* ativo = indice_buscar_n(&arvore->indice, linha, fim_nome - linha);
+        if(ativo == NULL || ativo->tipo != ATIVO) {
+            resumo->nao_encontrados++;
+            continue;
+        }
+
+        // os totais sao refeitos uma vez so no fim do feed (com alertas ligados, tick a tick)
+        if(arvore->alertas != NULL) {
+            alterar_valor_investido(arvore, ativo, valor);
+        } else {
+            definir_valor_no(ativo, valor);
+        }
+        diario_registrar(DIARIO_ATUALIZAR, 0, valor, 0.0, ativo->nome, NULL);
+        resumo->ticks++;
+    }
+
+    return p;
+}
+
+// Funcao para ler um arquivo de precos (ou stdin com "-") e aplicar na carteira
+ResumoFeed ler_feed_precos(Arvore* arvore, const char* caminho) {
+    ResumoFeed resumo;
+    memset(&resumo, 0, sizeof(resumo));
+
+    if(arvore == NULL || arvore->raiz == NULL) {
+        return resumo;
+    }
+
+    double inicio = agora_segundos();
+    garantir_totais(arvore);
+
+    #ifndef _WIN32
+    if(strcmp(caminho, "-") != 0) {
+        // arquivo comum: mapeia tudo e le direto da memoria
+        int fd = open(caminho, O_RDONLY);
+        if(fd < 0) {
+            resumo.invalidas = -1;
+            return resumo;
+        }
+
+        struct stat info;
+        if(fstat(fd, &info) == 0 && info.st_size > 0) {
+            char* dados = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(dados != MAP_FAILED) {
+                posix_madvise(dados, info.st_size, POSIX_MADV_SEQUENTIAL);
+
+                const char* fim = dados + info.st_size;
+                const char* resto = processar_linhas_feed(arvore, dados, fim, &resumo);
+                if(resto < fim) {
+                    // ultima linha sem '\n'
+                    char ultima[128];
+                    int tamanho = fim - resto;
+                    if(tamanho < (int) sizeof(ultima)) {
+                        memcpy(ultima, resto, tamanho);
+                        ultima[tamanho] = '\n';
+                        processar_linhas_feed(arvore, ultima, ultima + tamanho + 1, &resumo);
+                    } else {
+                        resumo.linhas++;
+                        resumo.invalidas++;
+                    }
+                }
+
+                munmap(dados, info.st_size);
+                close(fd);
+
+                if(arvore->alertas == NULL) {
+                    arvore->totais_sujos = 1;
+                }
+                garantir_totais(arvore);
+                resumo.segundos = agora_segundos() - inicio;
+                return resumo;
+            }
+        }
+        close(fd);
+    }
+    #endif
+
+    FILE* arquivo = strcmp(caminho, "-") == 0 ? stdin : fopen(caminho, "rb");
+    if(arquivo == NULL) {
+        resumo.invalidas = -1;
+        return resumo;
+    }
+
+    // um buffer so para o feed inteiro; a linha incompleta vai para o inicio
+    char* buffer = (char*) malloc(FEED_TAMANHO_BUFFER + 1);
+    size_t pendente = 0;
+
+    while(1) {
+        size_t lidos = fread(buffer + pendente, 1, FEED_TAMANHO_BUFFER - pendente, arquivo);
+        size_t usados = pendente + lidos;
+
+        if(lidos == 0) {
+            if(pendente > 0) {
+                buffer[pendente] = '\n';
+                processar_linhas_feed(arvore, buffer, buffer + pendente + 1, &resumo);
+            }
+            break;
+        }
+
+        const char* resto = processar_linhas_feed(arvore, buffer, buffer + usados, &resumo);
+        pendente = buffer + usados - resto;
+
+        if(pendente == FEED_TAMANHO_BUFFER) {
+            // linha maior que o buffer: descarta
+            resumo.linhas++;
+            resumo.invalidas++;
+            pendente = 0;
+        } else if(pendente > 0) {
+            memmove(buffer, resto, pendente);
+        }
+    }
+
+    free(buffer);
+    if(arquivo != stdin) {
+        fclose(arquivo);
+    }
+
+    if(arvore->alertas == NULL) {
+        arvore->totais_sujos = 1;
+    }
+    garantir_totais(arvore);
+    resumo.segundos = agora_segundos() - inicio;
+    return resumo;
+}
+
+// Funcao para mostrar o resumo da leitura do feed
+void mostrar_resumo_feed(Arvore* arvore, const ResumoFeed* resumo) {
+    printf("\n========================================\n");
+    printf("LEITURA DE FEED DE PRECOS\n");
+    printf("========================================\n");
+    printf("Linhas lidas: %ld\n", resumo->linhas);
+    printf("Ticks aplicados: %ld\n", resumo->ticks);
+    printf("Ativos nao encontrados: %ld\n", resumo->nao_encontrados);
+    printf("Linhas invalidas: %ld\n", resumo->invalidas);
+    printf("Tempo: %.3f s\n", resumo->segundos);
+    if(resumo->segundos > 0.0) {
+        printf("Vazao: %.0f ticks/s\n", resumo->ticks / resumo->segundos);
+    }
+    printf("========================================\n");
+    printf("Novo valor total da carteira: R$ %.2f\n", centavos_para_reais(arvore->valor_total));
+    printf("========================================\n");
+}
+
+// ========================================
+// SNAPSHOT BINARIO
+// ========================================
+
+// Funcao para contar os nos de uma subarvore
+int contar_nos(No* no) {
+    if(no == NULL) {
+        return 0;
+    }
+
+    int total = 1;
+    for(int i = 0; i < no->num_filhos; i++) {
+        total += contar_nos(no->filhos[i]);
+    }
+    return total;
+}
+
+// Funcao para salvar a carteira em um arquivo binario (1 = ok, 0 = erro)
+int salvar_carteira(Arvore* arvore, const char* caminho) {
+    if(arvore == NULL || arvore->raiz == NULL) {
+        return 0;
+    }
+
+    garantir_totais(arvore);
+
+    int num_nos = contar_nos(arvore->raiz);
+    size_t tamanho = sizeof(CabecalhoSnapshot) + num_nos * sizeof(NoSnapshot);
+    char* buffer = (char*) calloc(1, tamanho);
+
+    CabecalhoSnapshot* cabecalho = (CabecalhoSnapshot*) buffer;
+    memcpy(cabecalho->magico, SNAPSHOT_MAGICO, 8);
+    cabecalho->versao = SNAPSHOT_VERSAO;
+    cabecalho->num_nos = num_nos;
+    cabecalho->valor_total = arvore->valor_total;
+    cabecalho->lsn = diario.lsn;
+
+    // percorre em largura: a fila e o proprio vetor de nos gravados
+    NoSnapshot* registros = (NoSnapshot*) (buffer + sizeof(CabecalhoSnapshot));
+    No** fila = (No**) malloc(num_nos * sizeof(No*));
+    int inicio = 0;
+    int fim = 0;
+
+    fila[fim] = arvore->raiz;
+    registros[fim].pai = -1;
+    fim++;
+
+    while(inicio < fim) {
+        No* no = fila[inicio];
+        NoSnapshot* registro = &registros[inicio];
+
+        memcpy(registro->nome, no->nome, 64);
+        registro->hash = no->hash;
+        registro->tipo = no->tipo;
+        registro->percentual_alvo = no->percentual_alvo;
+        registro->valor_investido = no->valor_investido;
+        registro->valor_total = no->valor_total;
+        registro->cotado = no->id_preco >= 0;
+        registro->quantidade = no->quantidade;
+        registro->primeiro_filho = fim;
+        registro->num_filhos = no->num_filhos;
+
+        for(int i = 0; i < no->num_filhos; i++) {
+            fila[fim] = no->filhos[i];
+            registros[fim].pai = inicio;
+            fim++;
+        }
+        inicio++;
+    }
+
+    free(fila);
+
+    FILE* arquivo = fopen(caminho, "wb");
+    if(arquivo == NULL) {
+        free(buffer);
+        return 0;
+    }
+
+    int ok = fwrite(buffer, 1, tamanho, arquivo) == tamanho;
+    ok = (fclose(arquivo) == 0) && ok;
+    free(buffer);
+
+    return ok;
+}
+
+// Funcao para mapear um arquivo inteiro em memoria so para leitura (no Windows ele e lido)
+// Devolve 0 se nao abrir ou se for menor que minimo bytes
+int mapear_arquivo(const char* caminho, size_t minimo, void** base, size_t* tamanho) {
+    #ifdef _WIN32
+        FILE* arquivo = fopen(caminho, "rb");
+        if(arquivo == NULL) {
+            return 0;
+        }
+        fseek(arquivo, 0, SEEK_END);
+        long bytes = ftell(arquivo);
+        fseek(arquivo, 0, SEEK_SET);
+        if(bytes < (long) minimo) {
+            fclose(arquivo);
+            return 0;
+        }
+        void* dados = malloc(bytes);
+        if(fread(dados, 1, bytes, arquivo) != (size_t) bytes) {
+            free(dados);
+            fclose(arquivo);
+            return 0;
+        }
+        fclose(arquivo);
+    #else
+        int fd = open(caminho, O_RDONLY);
+        if(fd < 0) {
+            return 0;
+        }
+        struct stat info;
+        if(fstat(fd, &info) != 0 || info.st_size < (off_t) minimo) {
+            close(fd);
+            return 0;
+        }
+        size_t bytes = info.st_size;
+        void* dados = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(dados == MAP_FAILED) {
+            return 0;
+        }
+    #endif
+
+    *base = dados;
+    *tamanho = bytes;
+    return 1;
+}
+
+void desmapear_arquivo(void* base, size_t tamanho) {
+    #ifdef _WIN32
+        (void) tamanho;
+        free(base);
+    #else
+        munmap(base, tamanho);
+    #endif
+}
+
+// Funcao para soltar o mapeamento de um snapshot
+void fechar_snapshot(SnapshotCarteira* snapshot) {
+    if(snapshot->base == NULL) {
+        return;
+    }
+
+    desmapear_arquivo(snapshot->base, snapshot->tamanho);
+    snapshot->base = NULL;
+}
+
+// Funcao para abrir um snapshot (mapeado em memoria, sem ler no por no)
+int abrir_snapshot(const char* caminho, SnapshotCarteira* snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    void* base;
+    size_t tamanho;
+    if(!mapear_arquivo(caminho, sizeof(CabecalhoSnapshot), &base, &tamanho)) {
+        return 0;
+    }
+
+    snapshot->base = base;
+    snapshot->tamanho = tamanho;
+    snapshot->cabecalho = (const CabecalhoSnapshot*) base;
+    snapshot->nos = (const NoSnapshot*) ((const char*) base + sizeof(CabecalhoSnapshot));
+
+    const CabecalhoSnapshot* cabecalho = snapshot->cabecalho;
+    if(memcmp(cabecalho->magico, SNAPSHOT_MAGICO, 8) != 0 ||
+       cabecalho->versao != SNAPSHOT_VERSAO ||
+       cabecalho->num_nos == 0 ||
+       tamanho != sizeof(CabecalhoSnapshot) + (size_t) cabecalho->num_nos * sizeof(NoSnapshot)) {
+        fechar_snapshot(snapshot);
+        return 0;
+    }
+
+    return 1;
+}
+
+// Funcao para montar uma arvore a partir de um snapshot aberto
+// (a arena e o indice ja nascem com o tamanho certo: nenhum malloc por no)
+Arvore* snapshot_para_arvore(const SnapshotCarteira* snapshot) {
+    int num_nos = snapshot->cabecalho->num_nos;
+    const NoSnapshot* registros = snapshot->nos;
+    if(num_nos < 1) {
+        return NULL;
+    }
+
+    // confere tipos e ligacoes antes de montar: cada filho aponta de volta
+    // para o pai que o lista e todo no fora a raiz aparece em exatamente uma lista
+    long long soma_filhos = 0;
+    for(int i = 0; i < num_nos; i++) {
+        const NoSnapshot* registro = &registros[i];
+        if((i == 0) != (registro->tipo == RAIZ) ||
+           (registro->tipo != RAIZ && registro->tipo != CATEGORIA && registro->tipo != ATIVO)) {
+            return NULL;
+        }
+        if((i == 0) != (registro->pai < 0) || registro->pai >= i || registro->num_filhos < 0 ||
+           (registro->num_filhos > 0 && (registro->primeiro_filho <= i ||
+            (long long) registro->primeiro_filho + registro->num_filhos > num_nos))) {
+            return NULL;
+        }
+        for(int k = 0; k < registro->num_filhos; k++) {
+            if(registros[registro->primeiro_filho + k].pai != i) {
+                return NULL;
+            }
+        }
+        soma_filhos += registro->num_filhos;
+    }
+    if(soma_filhos != num_nos - 1) {
+        return NULL;
+    }
+
+    Arvore* arvore = criar_arvore(num_nos);
+    No** nos = (No**) malloc(num_nos * sizeof(No*));
+    int reavaliada = 0;
+
+    for(int i = 0; i < num_nos; i++) {
+        const NoSnapshot* registro = &registros[i];
+        No* no = arena_alocar_no(&arvore->arena);
+
+        memcpy(no->nome, registro->nome, 64);
+        no->nome[63] = '\0';
+        no->hash = registro->hash;
+        no->tipo = registro->tipo;
+        no->percentual_alvo = registro->percentual_alvo;
+        no->valor_investido = registro->valor_investido;
+        no->valor_total = registro->valor_total;
+        no->pai = registro->pai >= 0 ? nos[registro->pai] : NULL;
+        no->num_filhos = 0;
+        no->cap_filhos = 0;
+        no->filhos = NULL;
+        no->alerta = -1;
+        no->id_preco = -1;
+        no->quantidade = 0.0;
+
+        // posicao cotada: um ticker que ja esta na tabela vale pelo preco de agora
+        if(registro->cotado) {
+            int existia = precos_buscar(no->nome) >= 0;
+            vincular_posicao(arvore, no, registro->quantidade);
+            if(existia) {
+                no->valor_investido = llround(no->quantidade * tabela_precos.precos[no->id_preco]);
+                reavaliada = 1;
+            }
+        }
+
+        if(registro->num_filhos > 0) {
+            int cap = 1 << arena_classe(registro->num_filhos < 2 ? 2 : registro->num_filhos);
+            no->filhos = arena_alocar_filhos(&arvore->arena, cap);
+            no->cap_filhos = cap;
+        }
+
+        if(no->pai != NULL) {
+            no->pai->filhos[no->pai->num_filhos] = no;
+            no->pai->num_filhos++;
+        }
+
+        indice_inserir(&arvore->indice, no);
+        nos[i] = no;
+    }
+
+    arvore->raiz = nos[0];
+    free(nos);
+
+    arvore->valor_total = snapshot->cabecalho->valor_total;
+    arvore->totais_sujos = 0;
+    arvore->epoca_precos = tabela_precos.epoca;
+    if(reavaliada) {
+        arvore->totais_sujos = 1;
+        garantir_totais(arvore);
+    }
+
+    return arvore;
+}
+
+// Funcao para carregar uma carteira salva (NULL se o arquivo for invalido)
+Arvore* carregar_carteira(const char* caminho) {
+    SnapshotCarteira snapshot;
+    if(!abrir_snapshot(caminho, &snapshot)) {
+        return NULL;
+    }
+
+    Arvore* arvore = snapshot_para_arvore(&snapshot);
+    fechar_snapshot(&snapshot);
+
+    return arvore;
+}
+
+// ========================================
+// DIARIO: REAPLICACAO E CHECKPOINT
+// ========================================
+
+// Funcao para refazer uma operacao do diario na carteira (sem imprimir e sem gravar de novo)
+// Devolve 0 se a operacao nao se aplica mais (ativo ou categoria que nao existe)
+int diario_aplicar(Arvore** carteira, const RegistroDiario* registro) {
+    Arvore* arvore = *carteira;
+
+    if(registro->operacao == DIARIO_CRIAR) {
+        liberar_arvore(arvore);
+        *carteira = montar_carteira_perfil(registro->valor, registro->nome);
+        return 1;
+    }
+    if(registro->operacao == DIARIO_PRECO) {
+        atualizar_preco(registro->nome, registro->valor);
+        return 1;
+    }
+    if(arvore == NULL) {
+        return 0;
+    }
+
+    if(registro->operacao == DIARIO_APORTE) {
+        ResultadoAporte resultado = calcular_aporte(arvore, registro->valor, registro->modo);
+        int ok = resultado.erro == RELATORIO_OK;
+        liberar_resultado_aporte(&resultado);
+        return ok;
+    }
+
+    if(registro->operacao == DIARIO_ADICIONAR) {
+        No* categoria = buscar_no(arvore, registro->categoria);
+        if(categoria == NULL || categoria->tipo != CATEGORIA || buscar_no(arvore, registro->nome) != NULL) {
+            return 0;
+        }
+        No* ativo = criar_no(arvore, registro->nome, ATIVO, 0.0, registro->valor);
+        adicionar_filho(arvore, categoria, ativo);
+        propagar_delta(arvore, ativo, registro->valor);
+        return 1;
+    }
+
+    No* ativo = buscar_no(arvore, registro->nome);
+    if(ativo == NULL || ativo->tipo != ATIVO) {
+        return 0;
+    }
+
+    if(registro->operacao == DIARIO_ATUALIZAR) {
+        // como no feed: os totais sao refeitos uma vez so, na proxima leitura
+        definir_valor_no(ativo, registro->valor);
+        arvore->totais_sujos = 1;
+    } else if(registro->operacao == DIARIO_REMOVER) {
+        remover_no(arvore, ativo);
+    } else if(registro->operacao == DIARIO_POSICAO) {
+        definir_posicao(arvore, ativo, registro->quantidade);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Funcao para montar o caminho do snapshot de checkpoint (<diario>.snapshot)
+int caminho_snapshot_diario(const char* caminho, char* destino, size_t tamanho) {
+    return snprintf(destino, tamanho, "%s.snapshot", caminho) < (int) tamanho;
+}
+
+// Funcao para confirmar o que estiver pendente e fechar o diario
+void diario_fechar() {
+    #ifndef _WIN32
+    parar_confirmador_diario();
+    #endif
+    if(diario.fd >= 0) {
+        diario_confirmar();
+    }
+    #ifndef _WIN32
+    if(diario.fd >= 0) {
+        close(diario.fd);
+    }
+    #endif
+
+    free(diario.caminho);
+    free(diario.pendentes);
+    memset(&diario, 0, sizeof(diario));
+    diario.fd = -1;
+}
+
+// Funcao para abrir o diario: carrega o snapshot de checkpoint, reaplica as operacoes gravadas
+// depois dele e deixa o arquivo pronto para acrescentar (um fim rasgado por queda e cortado)
+// Devolve 0 se o diario ou o snapshot estiverem invalidos (nada e alterado na carteira)
+int diario_abrir(const char* caminho, Arvore** carteira, int grupo) {
+    #ifdef _WIN32
+    (void) caminho;
+    (void) carteira;
+    (void) grupo;
+    printf("\nO diario de operacoes nao esta disponivel no Windows\n");
+    return 0;
+    #else
+    // com o diario fechado a reaplicacao nao grava nada de novo
+    diario_fechar();
+
+    char caminho_snapshot[1024];
+    if(!caminho_snapshot_diario(caminho, caminho_snapshot, sizeof(caminho_snapshot))) {
+        printf("\nCaminho do diario muito longo: %s\n", caminho);
+        return 0;
+    }
+
+    // estado de partida: o snapshot de checkpoint, se existir
+    Arvore* arvore = NULL;
+    long long lsn_snapshot = 0;
+    struct stat info;
+    if(stat(caminho_snapshot, &info) == 0) {
+        SnapshotCarteira snapshot;
+        if(!abrir_snapshot(caminho_snapshot, &snapshot) || (arvore = snapshot_para_arvore(&snapshot)) == NULL) {
+            if(snapshot.base != NULL) {
+                fechar_snapshot(&snapshot);
+            }
+            printf("\nSnapshot do diario invalido: %s\n", caminho_snapshot);
+            return 0;
+        }
+        lsn_snapshot = snapshot.cabecalho->lsn;
+        fechar_snapshot(&snapshot);
+    }
+
+    // um arquivo que existe mas nao tem nem o cabecalho nao e tratado como diario novo
+    if(stat(caminho, &info) == 0 && info.st_size > 0 && (size_t) info.st_size < sizeof(CabecalhoDiario)) {
+        printf("\nDiario invalido: %s\n", caminho);
+        liberar_arvore(arvore);
+        return 0;
+    }
+
+    long long lsn = lsn_snapshot;
+    size_t tamanho_valido = 0;
+    long long descartados = 0;
+    long long reaplicados = 0;
+    long long ignorados = 0;
+    double inicio = agora_segundos();
+
+    void* base = NULL;
+    size_t tamanho = 0;
+    if(mapear_arquivo(caminho, sizeof(CabecalhoDiario), &base, &tamanho)) {
+        const CabecalhoDiario* cabecalho = (const CabecalhoDiario*) base;
+        if(memcmp(cabecalho->magico, DIARIO_MAGICO, 8) != 0 || cabecalho->versao != DIARIO_VERSAO ||
+           cabecalho->tamanho_registro != sizeof(RegistroDiario) || cabecalho->lsn_base > lsn_snapshot) {
+            printf("\nDiario invalido ou mais novo que o snapshot de checkpoint: %s\n", caminho);
+            desmapear_arquivo(base, tamanho);
+            liberar_arvore(arvore);
+            return 0;
+        }
+
+        // os registros valem ate o primeiro que nao confere (crc ou lsn fora de sequencia)
+        const RegistroDiario* registros = (const RegistroDiario*) ((const char*) base + sizeof(CabecalhoDiario));
+        long long num_registros = (tamanho - sizeof(CabecalhoDiario)) / sizeof(RegistroDiario);
+        long long esperado = cabecalho->lsn_base + 1;
+        long long i = 0;
+        for(; i < num_registros; i++) {
+            const RegistroDiario* registro = &registros[i];
+            if(registro->lsn != esperado || registro->crc != crc_registro_diario(registro)) {
+                break;
+            }
+            esperado++;
+
+            if(registro->lsn > lsn_snapshot) {
+                if(diario_aplicar(&arvore, registro)) {
+                    reaplicados++;
+                } else {
+                    ignorados++;
+                }
+                lsn = registro->lsn;
+            }
+        }
+
+        tamanho_valido = sizeof(CabecalhoDiario) + i * sizeof(RegistroDiario);
+        descartados = tamanho - tamanho_valido;
+        desmapear_arquivo(base, tamanho);
+        if(arvore != NULL) {
+            garantir_totais(arvore);
+        }
+    }
+    double segundos = agora_segundos() - inicio;
+
+    int fd = open(caminho, O_WRONLY | O_CREAT, 0644);
+    if(fd < 0) {
+        printf("\nNao foi possivel abrir o diario %s: %s\n", caminho, strerror(errno));
+        liberar_arvore(arvore);
+        return 0;
+    }
+
+    // diario novo: so o cabecalho, com a base no lsn do snapshot
+    if(tamanho_valido == 0) {
+        CabecalhoDiario cabecalho;
+        memset(&cabecalho, 0, sizeof(cabecalho));
+        memcpy(cabecalho.magico, DIARIO_MAGICO, 8);
+        cabecalho.versao = DIARIO_VERSAO;
+        cabecalho.tamanho_registro = sizeof(RegistroDiario);
+        cabecalho.lsn_base = lsn_snapshot;
+        if(write(fd, &cabecalho, sizeof(cabecalho)) != (ssize_t) sizeof(cabecalho)) {
+            printf("\nNao foi possivel gravar o diario %s\n", caminho);
+            close(fd);
+            liberar_arvore(arvore);
+            return 0;
+        }
+        tamanho_valido = sizeof(cabecalho);
+    }
+
+    if(ftruncate(fd, tamanho_valido) != 0 || lseek(fd, tamanho_valido, SEEK_SET) < 0 || fdatasync(fd) != 0) {
+        printf("\nNao foi possivel preparar o diario %s: %s\n", caminho, strerror(errno));
+        close(fd);
+        liberar_arvore(arvore);
+        return 0;
+    }
+
+    diario.fd = fd;
+    diario.caminho = (char*) malloc(strlen(caminho) + 1);
+    strcpy(diario.caminho, caminho);
+    diario.grupo = grupo < 1 ? 1 : grupo;
+    diario.pendentes = (RegistroDiario*) malloc(diario.grupo * sizeof(RegistroDiario));
+    diario.espera_ns = DIARIO_ESPERA_MS * 1000000LL;
+    diario.lsn = lsn;
+    diario.lsn_snapshot = lsn_snapshot;
+    diario.reaplicados = reaplicados;
+    diario.ignorados = ignorados;
+    diario.descartados = descartados;
+    diario.segundos_reaplicar = segundos;
+    iniciar_confirmador_diario();
+
+    liberar_arvore(*carteira);
+    *carteira = arvore;
+
+    return 1;
+    #endif
+}
+
+// Funcao para mostrar de onde a carteira foi recuperada ao abrir o diario
+void mostrar_abertura_diario() {
+    printf("Diario %s: snapshot no lsn %lld, %lld operacoes reaplicadas", diario.caminho, diario.lsn_snapshot,
+           diario.reaplicados);
+    if(diario.reaplicados > 0) {
+        printf(" em %.3f s (%.0f op/s)", diario.segundos_reaplicar,
+               diario.segundos_reaplicar > 0 ? diario.reaplicados / diario.segundos_reaplicar : 0.0);
+    }
+    if(diario.ignorados > 0) {
+        printf(", %lld ignoradas", diario.ignorados);
+    }
+    if(diario.descartados > 0) {
+        printf(", %lld bytes incompletos ou corrompidos descartados no fim", diario.descartados);
+    }
+    printf("\n");
+}
+
+// Funcao para fazer um checkpoint: grava a carteira no snapshot do diario (arquivo temporario,
+// fsync e rename) e so entao recomeca o diario vazio a partir do lsn do snapshot
+// Sem diario aberto nao faz nada; devolve 0 se falhar (o diario continua valendo)
+int diario_checkpoint(Arvore* carteira) {
+    if(diario.fd < 0) {
+        return 0;
+    }
+
+    #ifdef _WIN32
+    (void) carteira;
+    return 0;
+    #else
+    if(!diario_confirmar()) {
+        return 0;
+    }
+
+    char caminho_snapshot[1024];
+    char temporario[1040];
+    caminho_snapshot_diario(diario.caminho, caminho_snapshot, sizeof(caminho_snapshot));
+    snprintf(temporario, sizeof(temporario), "%s.tmp", caminho_snapshot);
+
+    if(carteira != NULL) {
+        // salvar_carteira grava o lsn atual no cabecalho
+        if(!salvar_carteira(carteira, temporario)) {
+            return 0;
+        }
+        int fd = open(temporario, O_RDONLY);
+        int ok = fd >= 0 && fsync(fd) == 0;
+        if(fd >= 0) {
+            close(fd);
+        }
+        if(!ok || rename(temporario, caminho_snapshot) != 0) {
+            unlink(temporario);
+            return 0;
+        }
+    } else {
+        unlink(caminho_snapshot);
+    }
+
+    CabecalhoDiario cabecalho;
+    memset(&cabecalho, 0, sizeof(cabecalho));
+    memcpy(cabecalho.magico, DIARIO_MAGICO, 8);
+    cabecalho.versao = DIARIO_VERSAO;
+    cabecalho.tamanho_registro = sizeof(RegistroDiario);
+    cabecalho.lsn_base = diario.lsn;
+
+    // uma queda aqui so deixa registros que o snapshot ja tem (a reaplicacao pula)
+    if(pwrite(diario.fd, &cabecalho, sizeof(cabecalho), 0) != (ssize_t) sizeof(cabecalho) ||
+       ftruncate(diario.fd, sizeof(cabecalho)) != 0 || lseek(diario.fd, sizeof(cabecalho), SEEK_SET) < 0 ||
+       fdatasync(diario.fd) != 0) {
+        fprintf(stderr, "Falha ao recomecar o diario %s: %s\n", diario.caminho, strerror(errno));
+        return 0;
+    }
+    return 1;
+    #endif
+}
+
+// ========================================
+// MOTOR DE CARTEIRAS (VARREDURA PARALELA)
+// ========================================
+
+#define VARREDURA_LOTE 64
+
+void motor_iniciar(MotorCarteiras* motor, int capacidade) {
+    if(capacidade < 16) {
+        capacidade = 16;
+    }
+
+    motor->carteiras = (Arvore**) malloc(capacidade * sizeof(Arvore*));
+    motor->quantidade = 0;
+    motor->capacidade = capacidade;
+}
+
+// Funcao para colocar uma carteira no motor (devolve o numero da conta)
+int motor_adicionar(MotorCarteiras* motor, Arvore* carteira) {
+    if(motor->quantidade == motor->capacidade) {
+        motor->capacidade = motor->capacidade * 2;
+        motor->carteiras = (Arvore**) realloc(motor->carteiras, motor->capacidade * sizeof(Arvore*));
+    }
+
+    motor->carteiras[motor->quantidade] = carteira;
+    motor->quantidade++;
+    return motor->quantidade - 1;
+}
+
+// Funcao para liberar o motor e todas as suas carteiras
+void motor_liberar(MotorCarteiras* motor) {
+    for(int i = 0; i < motor->quantidade; i++) {
+        liberar_arvore(motor->carteiras[i]);
+    }
+
+    free(motor->carteiras);
+    motor->carteiras = NULL;
+    motor->quantidade = 0;
+    motor->capacidade = 0;
+}
+
+// Faixa de contas de uma thread (as outras roubam metade do fim quando ficam sem trabalho)
+typedef struct FilaVarredura {
+    #ifndef _WIN32
+    pthread_mutex_t trava;
+    #endif
+    int inicio;
+    int fim;
+} FilaVarredura;
+
+typedef struct TrabalhadorVarredura {
+    MotorCarteiras* motor;
+    double tolerancia;
+    FilaVarredura* filas;
+    int num_filas;
+    int id;
+    ContaDesbalanceada* contas;
+    int num_contas;
+    int cap_contas;
+    DriftCategoria* drifts;
+    int num_drifts;
+    int cap_drifts;
+} TrabalhadorVarredura;
+
+void travar_fila(FilaVarredura* fila) {
+    #ifndef _WIN32
+    pthread_mutex_lock(&fila->trava);
+    #endif
+}
+
+void destravar_fila(FilaVarredura* fila) {
+    #ifndef _WIN32
+    pthread_mutex_unlock(&fila->trava);
+    #endif
+}
+
+// Funcao para pegar o proximo lote de contas (da propria fila ou roubando de outra)
+int pegar_lote_varredura(TrabalhadorVarredura* t, int* inicio, int* fim) {
+    FilaVarredura* minha = &t->filas[t->id];
+
+    for(int tentativa = 0; tentativa < t->num_filas; tentativa++) {
+        if(tentativa > 0) {
+            FilaVarredura* vitima = &t->filas[(t->id + tentativa) % t->num_filas];
+
+            travar_fila(vitima);
+            int restante = vitima->fim - vitima->inicio;
+            int roubo_inicio = 0;
+            int roubo_fim = 0;
+            if(restante > 0) {
+                int metade = (restante + 1) / 2;
+                roubo_fim = vitima->fim;
+                roubo_inicio = roubo_fim - metade;
+                vitima->fim = roubo_inicio;
+            }
+            destravar_fila(vitima);
+
+            if(restante <= 0) {
+                continue;
+            }
+
+            travar_fila(minha);
+            minha->inicio = roubo_inicio;
+            minha->fim = roubo_fim;
+            destravar_fila(minha);
+        }
+
+        travar_fila(minha);
+        int disponivel = minha->fim - minha->inicio;
+        if(disponivel > 0) {
+            int quantidade = disponivel < VARREDURA_LOTE ? disponivel : VARREDURA_LOTE;
+            *inicio = minha->inicio;
+            *fim = minha->inicio + quantidade;
+            minha->inicio += quantidade;
+            destravar_fila(minha);
+            return 1;
+        }
+        destravar_fila(minha);
+    }
+
+    return 0;
+}
+
+// Funcao para registrar uma categoria fora da tolerancia
+void registrar_drift(TrabalhadorVarredura* t, int conta, No* categoria, double percentual_atual, double diferenca) {
+    if(t->num_drifts == t->cap_drifts) {
+        t->cap_drifts = t->cap_drifts == 0 ? 256 : t->cap_drifts * 2;
+        t->drifts = (DriftCategoria*) realloc(t->drifts, t->cap_drifts * sizeof(DriftCategoria));
+    }
+
+    DriftCategoria* drift = &t->drifts[t->num_drifts];
+    drift->conta = conta;
+    drift->categoria = categoria;
+    drift->percentual_atual = percentual_atual;
+    drift->diferenca = diferenca;
+    t->num_drifts++;
+}
+
+// Funcao para registrar uma conta cujas categorias foram as ultimas registradas
+void registrar_conta(TrabalhadorVarredura* t, int conta, int primeiro_drift) {
+    if(t->num_contas == t->cap_contas) {
+        t->cap_contas = t->cap_contas == 0 ? 128 : t->cap_contas * 2;
+        t->contas = (ContaDesbalanceada*) realloc(t->contas, t->cap_contas * sizeof(ContaDesbalanceada));
+    }
+
+    ContaDesbalanceada* desbalanceada = &t->contas[t->num_contas];
+    desbalanceada->conta = conta;
+    desbalanceada->primeiro_drift = primeiro_drift;
+    desbalanceada->num_drifts = t->num_drifts - primeiro_drift;
+    t->num_contas++;
+}
+
+// Funcao para verificar um lote de contas (mesma regra do detectar_desbalanceamento)
+// as categorias do lote inteiro viram uma visao plana e passam por um kernel so
+void verificar_lote(TrabalhadorVarredura* t, VisaoPlana* visao, int inicio, int fim) {
+    visao->quantidade = 0;
+
+    for(int conta = inicio; conta < fim; conta++) {
+        Arvore* arvore = t->motor->carteiras[conta];
+        if(arvore == NULL || arvore->raiz == NULL) {
+            continue;
+        }
+
+        garantir_totais(arvore);
+        achatar_filhos(visao, arvore->raiz, conta);
+    }
+
+    kernel_drift(visao->valores, visao->totais, visao->alvos, visao->diferencas, visao->quantidade);
+
+    int conta_atual = -1;
+    int primeiro = 0;
+
+    for(int i = 0; i < visao->quantidade; i++) {
+        if(fabs(visao->diferencas[i]) <= t->tolerancia) {
+            continue;
+        }
+
+        if(visao->grupos[i] != conta_atual) {
+            if(conta_atual >= 0) {
+                registrar_conta(t, conta_atual, primeiro);
+            }
+            conta_atual = visao->grupos[i];
+            primeiro = t->num_drifts;
+        }
+
+        registrar_drift(t, conta_atual, visao->nos[i],
+                        visao->diferencas[i] + visao->alvos[i], visao->diferencas[i]);
+    }
+
+    if(conta_atual >= 0) {
+        registrar_conta(t, conta_atual, primeiro);
+    }
+}
+
+void* trabalhador_varredura(void* argumento) {
+    TrabalhadorVarredura* t = (TrabalhadorVarredura*) argumento;
+    int inicio, fim;
+
+    VisaoPlana visao;
+    visao_iniciar(&visao);
+
+    while(pegar_lote_varredura(t, &inicio, &fim)) {
+        verificar_lote(t, &visao, inicio, fim);
+    }
+
+    visao_liberar(&visao);
+    return NULL;
+}
+
+int comparar_contas(const void* a, const void* b) {
+    const ContaDesbalanceada* x = (const ContaDesbalanceada*) a;
+    const ContaDesbalanceada* y = (const ContaDesbalanceada*) b;
+    return (x->conta > y->conta) - (x->conta < y->conta);
+}
+
+// Funcao para achar o numero de nucleos da maquina
+int numero_de_nucleos() {
+    #ifdef _WIN32
+        return 1;
+    #else
+        long nucleos = sysconf(_SC_NPROCESSORS_ONLN);
+        return nucleos > 0 ? (int) nucleos : 1;
+    #endif
+}
+
+// Funcao para verificar o desbalanceamento de todas as contas do motor em paralelo
+// (num_threads <= 0 usa um por nucleo; nada e impresso)
+ResultadoVarredura varrer_desbalanceamento(MotorCarteiras* motor, double tolerancia, int num_threads) {
+    ResultadoVarredura resultado;
+    memset(&resultado, 0, sizeof(resultado));
+
+    double inicio = agora_segundos();
+
+    if(num_threads <= 0) {
+        num_threads = numero_de_nucleos();
+    }
+    #ifdef _WIN32
+    num_threads = 1;
+    #endif
+    if(num_threads > motor->quantidade / VARREDURA_LOTE + 1) {
+        num_threads = motor->quantidade / VARREDURA_LOTE + 1;
+    }
+
+    FilaVarredura* filas = (FilaVarredura*) malloc(num_threads * sizeof(FilaVarredura));
+    TrabalhadorVarredura* trabalhadores = (TrabalhadorVarredura*) calloc(num_threads, sizeof(TrabalhadorVarredura));
+
+    // divide as contas em faixas iguais; o roubo equilibra o resto
+    for(int i = 0; i < num_threads; i++) {
+        #ifndef _WIN32
+        pthread_mutex_init(&filas[i].trava, NULL);
+        #endif
+        filas[i].inicio = (int) ((long long) motor->quantidade * i / num_threads);
+        filas[i].fim = (int) ((long long) motor->quantidade * (i + 1) / num_threads);
+
+        trabalhadores[i].motor = motor;
+        trabalhadores[i].tolerancia = tolerancia;
+        trabalhadores[i].filas = filas;
+        trabalhadores[i].num_filas = num_threads;
+        trabalhadores[i].id = i;
+    }
+
+    #ifndef _WIN32
+    pthread_t* threads = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
+    for(int i = 1; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, trabalhador_varredura, &trabalhadores[i]);
+    }
+    trabalhador_varredura(&trabalhadores[0]);
+    for(int i = 1; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    #else
+    trabalhador_varredura(&trabalhadores[0]);
+    #endif
+
+    // junta os resultados de cada thread
+    for(int i = 0; i < num_threads; i++) {
+        resultado.num_contas += trabalhadores[i].num_contas;
+        resultado.num_drifts += trabalhadores[i].num_drifts;
+    }
+
+    resultado.contas = (ContaDesbalanceada*) malloc((resultado.num_contas + 1) * sizeof(ContaDesbalanceada));
+    resultado.drifts = (DriftCategoria*) malloc((resultado.num_drifts + 1) * sizeof(DriftCategoria));
+
+    int contas = 0;
+    int drifts = 0;
+    for(int i = 0; i < num_threads; i++) {
+        TrabalhadorVarredura* t = &trabalhadores[i];
+
+        // um trabalhador sem desvios nunca alocou o vetor dele
+        if(t->num_drifts > 0) {
+            memcpy(resultado.drifts + drifts, t->drifts, t->num_drifts * sizeof(DriftCategoria));
+        }
+        for(int j = 0; j < t->num_contas; j++) {
+            resultado.contas[contas] = t->contas[j];
+            resultado.contas[contas].primeiro_drift += drifts;
+            contas++;
+        }
+        drifts += t->num_drifts;
+
+        free(t->contas);
+        free(t->drifts);
+        #ifndef _WIN32
+        pthread_mutex_destroy(&filas[i].trava);
+        #endif
+    }
+
+    qsort(resultado.contas, resultado.num_contas, sizeof(ContaDesbalanceada), comparar_contas);
+
+    free(filas);
+    free(trabalhadores);
+
+    resultado.contas_verificadas = motor->quantidade;
+    resultado.threads = num_threads;
+    resultado.segundos = agora_segundos() - inicio;
+    return resultado;
+}
+
+void liberar_resultado_varredura(ResultadoVarredura* resultado) {
+    free(resultado->contas);
+    free(resultado->drifts);
+    resultado->contas = NULL;
+    resultado->drifts = NULL;
+}
+
+// Funcao para mostrar o resumo da varredura (e as primeiras contas desbalanceadas)
+void mostrar_resultado_varredura(const ResultadoVarredura* resultado, int max_contas) {
+    printf("\n========================================\n");
+    printf("VARREDURA DE DESBALANCEAMENTO\n");
+    printf("========================================\n");
+    printf("Contas verificadas: %d\n", resultado->contas_verificadas);
+    printf("Contas desbalanceadas: %d\n", resultado->num_contas);
+    printf("Threads: %d\n", resultado->threads);
+    printf("Tempo: %.3f s\n", resultado->segundos);
+    if(resultado->segundos > 0.0) {
+        printf("Vazao: %.0f contas/s\n", resultado->contas_verificadas / resultado->segundos);
+    }
+    printf("========================================\n");
+
+    for(int i = 0; i < resultado->num_contas && i < max_contas; i++) {
+        const ContaDesbalanceada* conta = &resultado->contas[i];
+        printf("Conta %d:", conta->conta);
+        for(int j = 0; j < conta->num_drifts; j++) {
+            const DriftCategoria* drift = &resultado->drifts[conta->primeiro_drift + j];
+            printf("  %s %+.1f%%", drift->categoria->nome, drift->diferenca);
+        }
+        printf("\n");
+    }
+}
+
+// Funcao para gerar contas de teste com valores variados (gerador deterministico)
+void gerar_contas_sinteticas(MotorCarteiras* motor, int quantidade) {
+    const char* perfis[3] = {"CONSERVADOR", "MODERADO", "ARROJADO"};
+    unsigned long long estado = 88172645463325252ULL;
+
+    for(int i = 0; i < quantidade; i++) {
+        estado = estado * 6364136223846793005ULL + 1442695040888963407ULL;
+        Centavos valor = reais_para_centavos(1000.0 + (double) ((estado >> 33) % 1000000));
+
+        Arvore* carteira = montar_carteira_perfil(valor, perfis[i % 3]);
+
+        for(int c = 0; c < carteira->raiz->num_filhos; c++) {
+            No* categoria = carteira->raiz->filhos[c];
+            for(int j = 0; j < categoria->num_filhos; j++) {
+                No* ativo = categoria->filhos[j];
+                estado = estado * 6364136223846793005ULL + 1442695040888963407ULL;
+                double fator = 0.85 + 0.30 * (double) ((estado >> 40) % 10000) / 10000.0;
+                alterar_valor_investido(carteira, ativo, llround(ativo->valor_investido * fator));
+            }
+        }
+
+        motor_adicionar(motor, carteira);
+    }
+}
+
+// ========================================
+// BENCHMARK
+// ========================================
+
+#define BENCH_REPETICOES 7
+#define BENCH_TEMPO_MINIMO 0.01
+#define BENCH_MAX_MEDICOES 256
+
+// Funcao para dizer qual versao dos kernels foi compilada
+const char* nome_kernels() {
+    #if defined(__AVX__)
+    return "avx";
+    #elif defined(__SSE2__)
+    return "sse2";
+    #elif defined(__aarch64__)
+    return "neon";
+    #else
+    return "escalar";
+    #endif
+}
+
+// Funcao para montar uma carteira sintetica com num_nos nos e ate profundidade niveis abaixo da raiz
+// (os nos sao criados em ordem de largura, todos com o mesmo numero de filhos; as folhas sao ativos)
+CarteiraSintetica gerar_carteira_sintetica(int num_nos, int profundidade) {
+    CarteiraSintetica sintetica;
+    sintetica.num_nos = num_nos;
+    sintetica.profundidade = profundidade;
+    sintetica.nos = (No**) malloc(num_nos * sizeof(No*));
+    sintetica.arvore = criar_arvore(num_nos);
+    sintetica.valores_iniciais = NULL;
+
+    // menor grau que cabe todos os nos em profundidade niveis
+    int grau = (int) pow(num_nos, 1.0 / profundidade);
+    if(grau < 2) {
+        grau = 2;
+    }
+    while(1) {
+        double cabem = 0.0;
+        double nivel = 1.0;
+        for(int i = 0; i < profundidade; i++) {
+            nivel = nivel * grau;
+            cabem = cabem + nivel;
+        }
+        if(cabem >= num_nos - 1) {
+            break;
+        }
+        grau++;
+    }
+
+    char nome[64];
+    Arvore* arvore = sintetica.arvore;
+    arvore->raiz = criar_no(arvore, "Carteira", RAIZ, 0.0, 0);
+    sintetica.nos[0] = arvore->raiz;
+
+    int pai = 0;
+    unsigned long long estado = 88172645463325252ULL;
+    for(int i = 1; i < num_nos; i++) {
+        if(sintetica.nos[pai]->num_filhos == grau) {
+            pai++;
+        }
+
+        estado = estado * 6364136223846793005ULL + 1442695040888963407ULL;
+        snprintf(nome, sizeof(nome), "N%d", i);
+        No* no = criar_no(arvore, nome, ATIVO, 0.0, 100000 + (Centavos) ((estado >> 33) % 10000000));
+
+        adicionar_filho(arvore, sintetica.nos[pai], no);
+        sintetica.nos[i] = no;
+    }
+
+    // nos internos viram categorias com a meta dividida igualmente entre os filhos
+    for(int i = 0; i < num_nos; i++) {
+        No* no = sintetica.nos[i];
+        if(no->num_filhos > 0 && no->tipo != RAIZ) {
+            no->tipo = CATEGORIA;
+            no->valor_investido = 0;
+        }
+        for(int j = 0; j < no->num_filhos; j++) {
+            no->filhos[j]->percentual_alvo = 100.0 / no->num_filhos;
+        }
+    }
+
+    arvore->totais_sujos = 1;
+    garantir_totais(arvore);
+
+    return sintetica;
+}
+
+// Funcao para voltar os valores da carteira sintetica para os da primeira chamada
+// (a primeira chamada so guarda os valores; serve para medir operacoes que mudam a carteira)
+void restaurar_carteira_sintetica(CarteiraSintetica* sintetica) {
+    if(sintetica->valores_iniciais == NULL) {
+        sintetica->valores_iniciais = (Centavos*) malloc(sintetica->num_nos * sizeof(Centavos));
+        for(int i = 0; i < sintetica->num_nos; i++) {
+            sintetica->valores_iniciais[i] = sintetica->nos[i]->valor_investido;
+        }
+        return;
+    }
+
+    for(int i = 0; i < sintetica->num_nos; i++) {
+        definir_valor_no(sintetica->nos[i], sintetica->valores_iniciais[i]);
+    }
+    sintetica->arvore->totais_sujos = 1;
+    garantir_totais(sintetica->arvore);
+}
+
+void liberar_carteira_sintetica(CarteiraSintetica* sintetica) {
+    liberar_arvore(sintetica->arvore);
+    free(sintetica->nos);
+    free(sintetica->valores_iniciais);
+}
+
+// Operacoes medidas (cada uma roda lote vezes e devolve quantas operacoes fez)
+long long bench_criar_no(CarteiraSintetica* sintetica, long long lote) {
+    for(long long i = 0; i < lote; i++) {
+        CarteiraSintetica nova = gerar_carteira_sintetica(sintetica->num_nos, sintetica->profundidade);
+        liberar_carteira_sintetica(&nova);
+    }
+    return lote * sintetica->num_nos;
+}
+
+long long bench_buscar_no(CarteiraSintetica* sintetica, long long lote) {
+    long long achados = 0;
+    unsigned int posicao = 0;
+    for(long long i = 0; i < lote; i++) {
+        posicao = (posicao + 40503u) % sintetica->num_nos;
+        achados += buscar_no(sintetica->arvore, sintetica->nos[posicao]->nome) != NULL;
+    }
+    return achados;
+}
+
+long long bench_calcular_total_no(CarteiraSintetica* sintetica, long long lote) {
+    for(long long i = 0; i < lote; i++) {
+        calcular_total_no(sintetica->arvore->raiz);
+    }
+    return lote;
+}
+
+long long bench_detectar(CarteiraSintetica* sintetica, long long lote) {
+    for(long long i = 0; i < lote; i++) {
+        ResultadoBalanceamento resultado = calcular_desbalanceamento(sintetica->arvore, 2.0);
+        liberar_resultado_balanceamento(&resultado);
+    }
+    return lote;
+}
+
+long long bench_sugerir(CarteiraSintetica* sintetica, long long lote) {
+    for(long long i = 0; i < lote; i++) {
+        PlanoRebalanceamento plano = planejar_rebalanceamento(sintetica->arvore, 2.0);
+        liberar_plano(&plano);
+    }
+    return lote;
+}
+
+// O aporte muda a carteira: medir_operacao restaura os valores antes de cada lote
+long long bench_aporte(CarteiraSintetica* sintetica, long long lote) {
+    for(long long i = 0; i < lote; i++) {
+        ResultadoAporte resultado = calcular_aporte(sintetica->arvore, 100000, APORTE_PROPORCIONAL);
+        liberar_resultado_aporte(&resultado);
+    }
+    return lote;
+}
+
+long long bench_aporte_nivelado(CarteiraSintetica* sintetica, long long lote) {
+    for(long long i = 0; i < lote; i++) {
+        ResultadoAporte resultado = calcular_aporte(sintetica->arvore, 100000, APORTE_NIVELADO);
+        liberar_resultado_aporte(&resultado);
+    }
+    return lote;
+}
+
+int comparar_double(const void* a, const void* b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+// Funcao para medir uma operacao: dobra o lote ate passar de BENCH_TEMPO_MINIMO (aquecimento)
+// e depois roda BENCH_REPETICOES vezes; com restaurar, a carteira volta para os valores do inicio
+// antes de cada lote (fora do tempo medido), assim todo lote mede a mesma carteira
+MedicaoBench medir_operacao(const char* nome, long long (*operacao)(CarteiraSintetica*, long long),
+                            CarteiraSintetica* sintetica, int restaurar) {
+    MedicaoBench medicao;
+    medicao.operacao = nome;
+    medicao.num_nos = sintetica->num_nos;
+    medicao.profundidade = sintetica->profundidade;
+    medicao.repeticoes = BENCH_REPETICOES;
+
+    if(restaurar) {
+        restaurar_carteira_sintetica(sintetica);
+    }
+
+    long long lote = 1;
+    while(1) {
+        if(restaurar) {
+            restaurar_carteira_sintetica(sintetica);
+        }
+        double inicio = agora_segundos();
+        operacao(sintetica, lote);
+        if(agora_segundos() - inicio >= BENCH_TEMPO_MINIMO || lote >= (1LL << 40)) {
+            break;
+        }
+        lote = lote * 2;
+    }
+
+    double ns_op[BENCH_REPETICOES];
+    long long alocacoes_antes = alocacoes_feitas;
+    long long total_ops = 0;
+
+    for(int r = 0; r < BENCH_REPETICOES; r++) {
+        if(restaurar) {
+            restaurar_carteira_sintetica(sintetica);
+        }
+        double inicio = agora_segundos();
+        long long ops = operacao(sintetica, lote);
+        double segundos = agora_segundos() - inicio;
+
+        ns_op[r] = segundos * 1e9 / (ops > 0 ? ops : 1);
+        total_ops += ops;
+    }
+
+    long long alocacoes = alocacoes_feitas - alocacoes_antes;
+
+    qsort(ns_op, BENCH_REPETICOES, sizeof(double), comparar_double);
+
+    medicao.lote = lote;
+    medicao.ns_op_mediana = ns_op[BENCH_REPETICOES / 2];
+    medicao.ns_op_minimo = ns_op[0];
+    medicao.ops_por_segundo = medicao.ns_op_mediana > 0.0 ? 1e9 / medicao.ns_op_mediana : 0.0;
+    // sem o contador compilado as alocacoes ficam de fora (-1)
+    medicao.alocacoes_op = !OTIMIZADOR_CONTAR_ALOCACOES ? -1.0 : total_ops > 0 ? (double) alocacoes / total_ops : 0.0;
+
+    return medicao;
+}
+
+// Funcao para rodar o benchmark em carteiras de 10 ate max_nos nos (devolve quantas medicoes fez)
+int rodar_benchmark(int max_nos, MedicaoBench* medicoes, int max_medicoes) {
+    int profundidades[3] = {2, 4, 6};
+    int quantidade = 0;
+
+    for(int num_nos = 10; num_nos <= max_nos && num_nos > 0; num_nos = num_nos * 10) {
+        for(int p = 0; p < 3; p++) {
+            if(quantidade + 7 > max_medicoes) {
+                return quantidade;
+            }
+
+            fprintf(stderr, "bench: %d nos, profundidade %d\n", num_nos, profundidades[p]);
+
+            CarteiraSintetica sintetica = gerar_carteira_sintetica(num_nos, profundidades[p]);
+
+            medicoes[quantidade++] = medir_operacao("criar_no", bench_criar_no, &sintetica, 0);
+            medicoes[quantidade++] = medir_operacao("buscar_no", bench_buscar_no, &sintetica, 0);
+            medicoes[quantidade++] = medir_operacao("calcular_total_no", bench_calcular_total_no, &sintetica, 0);
+            medicoes[quantidade++] = medir_operacao("calcular_desbalanceamento", bench_detectar, &sintetica, 0);
+            medicoes[quantidade++] = medir_operacao("planejar_rebalanceamento", bench_sugerir, &sintetica, 0);
+            medicoes[quantidade++] = medir_operacao("calcular_aporte", bench_aporte, &sintetica, 1);
+            medicoes[quantidade++] = medir_operacao("calcular_aporte_nivelado", bench_aporte_nivelado, &sintetica, 1);
+
+            liberar_carteira_sintetica(&sintetica);
+        }
+    }
+
+    return quantidade;
+}
+
+// Funcao para mostrar as medicoes (formato "texto", "csv" ou "json")
+void mostrar_benchmark(const MedicaoBench* medicoes, int quantidade, const char* formato) {
+    if(strcmp(formato, "csv") == 0) {
+        printf("operacao,nos,profundidade,repeticoes,lote,ns_op_mediana,ns_op_minimo,ops_por_segundo,alocacoes_op,kernels\n");
+        for(int i = 0; i < quantidade; i++) {
+            const MedicaoBench* m = &medicoes[i];
+            printf("%s,%d,%d,%d,%lld,%.2f,%.2f,%.1f,", m->operacao, m->num_nos, m->profundidade, m->repeticoes,
+                   m->lote, m->ns_op_mediana, m->ns_op_minimo, m->ops_por_segundo);
+            if(m->alocacoes_op >= 0.0) {
+                printf("%.4f", m->alocacoes_op);
+            }
+            printf(",%s\n", nome_kernels());
+        }
+        return;
+    }
+
+    if(strcmp(formato, "json") == 0) {
+        printf("{\n  \"kernels\": \"%s\",\n  \"medicoes\": [\n", nome_kernels());
+        for(int i = 0; i < quantidade; i++) {
+            const MedicaoBench* m = &medicoes[i];
+            printf("    {\"operacao\": \"%s\", \"nos\": %d, \"profundidade\": %d, \"repeticoes\": %d, \"lote\": %lld, "
+                   "\"ns_op_mediana\": %.2f, \"ns_op_minimo\": %.2f, \"ops_por_segundo\": %.1f, \"alocacoes_op\": ",
+                   m->operacao, m->num_nos, m->profundidade, m->repeticoes, m->lote,
+                   m->ns_op_mediana, m->ns_op_minimo, m->ops_por_segundo);
+            if(m->alocacoes_op >= 0.0) {
+                printf("%.4f}%s\n", m->alocacoes_op, i + 1 < quantidade ? "," : "");
+            } else {
+                printf("null}%s\n", i + 1 < quantidade ? "," : "");
+            }
+        }
+        printf("  ]\n}\n");
+        return;
+    }
+
+    printf("\n========================================\n");
+    printf("BENCHMARK (kernels: %s)\n", nome_kernels());
+    printf("========================================\n");
+    printf("%-26s %8s %5s %14s %14s %14s %10s\n",
+           "operacao", "nos", "prof", "ns/op (med)", "ns/op (min)", "ops/s", "alocs/op");
+    for(int i = 0; i < quantidade; i++) {
+        const MedicaoBench* m = &medicoes[i];
+        printf("%-26s %8d %5d %14.1f %14.1f %14.0f ",
+               m->operacao, m->num_nos, m->profundidade,
+               m->ns_op_mediana, m->ns_op_minimo, m->ops_por_segundo);
+        if(m->alocacoes_op >= 0.0) {
+            printf("%10.3f\n", m->alocacoes_op);
+        } else {
+            printf("%10s\n", "-");
+        }
+    }
+    printf("========================================\n");
+}
+
+// ========================================
+// SIMULACAO DE MONTE CARLO
+// ========================================
+
+#define MC_PI 3.14159265358979323846
+
+// Carteira achatada para a simulacao (um indice por ativo)
+typedef struct ModeloMonteCarlo {
+    int num_ativos;
+    int num_categorias;
+    int* categoria;
+    double* valor_inicial;
+    double* peso_alvo;
+    double* deriva;
+    double* choque;
+    double* peso_categoria;
+    double valor_total;
+} ModeloMonteCarlo;
+
+// Faixa de caminhos de uma thread
+typedef struct TrabalhadorMonteCarlo {
+    const ModeloMonteCarlo* modelo;
+    const ParametrosMonteCarlo* parametros;
+    ResultadoMonteCarlo* resultado;
+    int* rebalanceamentos;
+    int inicio;
+    int fim;
+} TrabalhadorMonteCarlo;
+
+// Funcao para preencher os parametros padrao (renda fixa: 10% a.a. com 3% de volatilidade; o resto: 12% e 25%)
+ParametrosMonteCarlo parametros_monte_carlo_padrao(Arvore* arvore) {
+    ParametrosMonteCarlo parametros;
+    parametros.caminhos = 10000;
+    parametros.anos = 10;
+    parametros.passos_por_ano = 252;
+    parametros.rebalancear_a_cada = 21;
+    parametros.tolerancia = 0.0;
+    parametros.correlacao = 0.3;
+    parametros.semente = 2025;
+    parametros.threads = 0;
+
+    int n = arvore != NULL && arvore->raiz != NULL ? arvore->raiz->num_filhos : 0;
+    parametros.num_categorias = n;
+    parametros.retornos = (double*) malloc((n + 1) * sizeof(double));
+    parametros.volatilidades = (double*) malloc((n + 1) * sizeof(double));
+
+    for(int i = 0; i < n; i++) {
+        if(strcmp(arvore->raiz->filhos[i]->nome, "Renda Fixa") == 0) {
+            parametros.retornos[i] = 0.10;
+            parametros.volatilidades[i] = 0.03;
+        } else {
+            parametros.retornos[i] = 0.12;
+            parametros.volatilidades[i] = 0.25;
+        }
+    }
+
+    return parametros;
+}
+
+void liberar_parametros_monte_carlo(ParametrosMonteCarlo* parametros) {
+    free(parametros->retornos);
+    free(parametros->volatilidades);
+    parametros->retornos = NULL;
+    parametros->volatilidades = NULL;
+}
+
+// Funcao para copiar os ativos de uma subarvore para o modelo (peso = meta acumulada desde a raiz)
+void achatar_ativos_modelo(ModeloMonteCarlo* modelo, No* no, int categoria, double peso) {
+    if(no->num_filhos == 0) {
+        int k = modelo->num_ativos;
+        modelo->categoria[k] = categoria;
+        modelo->valor_inicial[k] = centavos_para_reais(no->valor_total);
+        modelo->peso_alvo[k] = peso;
+        modelo->num_ativos++;
+        return;
+    }
+
+    // mesma regra do planejar_rebalanceamento: metas zeradas dividem o grupo em partes iguais
+    double soma_metas = 0.0;
+    for(int i = 0; i < no->num_filhos; i++) {
+        soma_metas += no->filhos[i]->percentual_alvo;
+    }
+
+    for(int i = 0; i < no->num_filhos; i++) {
+        double fracao = soma_metas > 0.0 ? no->filhos[i]->percentual_alvo / soma_metas : 1.0 / no->num_filhos;
+        achatar_ativos_modelo(modelo, no->filhos[i], no->pai == NULL ? i : categoria, peso * fracao);
+    }
+}
+
+// Funcao para montar o modelo da simulacao a partir da carteira
+ModeloMonteCarlo montar_modelo_monte_carlo(Arvore* arvore, const ParametrosMonteCarlo* parametros) {
+    ModeloMonteCarlo modelo;
+    memset(&modelo, 0, sizeof(modelo));
+
+    garantir_totais(arvore);
+
+    int capacidade = contar_nos(arvore->raiz);
+    modelo.categoria = (int*) malloc(capacidade * sizeof(int));
+    modelo.valor_inicial = (double*) malloc(capacidade * sizeof(double));
+    modelo.peso_alvo = (double*) malloc(capacidade * sizeof(double));
+    modelo.deriva = (double*) malloc(capacidade * sizeof(double));
+    modelo.choque = (double*) malloc(capacidade * sizeof(double));
+    modelo.num_categorias = arvore->raiz->num_filhos;
+    modelo.peso_categoria = (double*) calloc(modelo.num_categorias + 1, sizeof(double));
+
+    achatar_ativos_modelo(&modelo, arvore->raiz, 0, 1.0);
+
+    // passo de um dia no modelo log-normal: deriva = (mu - sigma^2 / 2) dt, choque = sigma raiz(dt)
+    double dt = 1.0 / parametros->passos_por_ano;
+    for(int i = 0; i < modelo.num_ativos; i++) {
+        int c = modelo.categoria[i];
+        double mu = c < parametros->num_categorias ? parametros->retornos[c] : 0.0;
+        double sigma = c < parametros->num_categorias ? parametros->volatilidades[c] : 0.0;
+
+        modelo.deriva[i] = (mu - 0.5 * sigma * sigma) * dt;
+        modelo.choque[i] = sigma * sqrt(dt);
+        modelo.peso_categoria[c] += modelo.peso_alvo[i];
+        modelo.valor_total += modelo.valor_inicial[i];
+    }
+
+    return modelo;
+}
+
+void liberar_modelo_monte_carlo(ModeloMonteCarlo* modelo) {
+    free(modelo->categoria);
+    free(modelo->valor_inicial);
+    free(modelo->peso_alvo);
+    free(modelo->deriva);
+    free(modelo->choque);
+    free(modelo->peso_categoria);
+}
+
+// Funcao para gerar 64 bits pseudo-aleatorios a partir de um contador (mistura do splitmix64)
+// O mesmo (semente, caminho, passo, indice) sempre da o mesmo numero, em qualquer thread
+unsigned long long misturar_contador(unsigned long long semente, int caminho, int passo, int indice) {
+    unsigned long long x = semente + (unsigned long long) caminho * 0x9E3779B97F4A7C15ULL
+                         + (((unsigned long long) passo << 32) | (unsigned int) indice) * 0xD1B54A32D192ED03ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x = x ^ (x >> 31);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Funcao para gerar quantidade normais padrao de um passo (Box-Muller: cada contador da duas)
+void gerar_normais(unsigned long long semente, int caminho, int passo, double* normais, int quantidade) {
+    for(int i = 0; i < quantidade; i += 2) {
+        unsigned long long bits = misturar_contador(semente, caminho, passo, i / 2);
+        double u1 = ((double) (bits >> 32) + 0.5) / 4294967296.0;
+        double u2 = ((double) (bits & 0xFFFFFFFFULL) + 0.5) / 4294967296.0;
+        double raio = sqrt(-2.0 * log(u1));
+
+        normais[i] = raio * cos(2.0 * MC_PI * u2);
+        normais[i + 1] = raio * sin(2.0 * MC_PI * u2);
+    }
+}
+
+// Funcao para calcular o total e o maior desvio das categorias (pontos percentuais)
+double maior_drift_modelo(const ModeloMonteCarlo* modelo, const double* valores, double* totais_categoria, double* total) {
+    memset(totais_categoria, 0, (modelo->num_categorias + 1) * sizeof(double));
+
+    double soma = 0.0;
+    for(int i = 0; i < modelo->num_ativos; i++) {
+        totais_categoria[modelo->categoria[i]] += valores[i];
+        soma += valores[i];
+    }
+    *total = soma;
+
+    double maior = 0.0;
+    for(int c = 0; c < modelo->num_categorias && soma > 0.0; c++) {
+        double drift = fabs(totais_categoria[c] / soma * 100.0 - modelo->peso_categoria[c] * 100.0);
+        if(drift > maior) {
+            maior = drift;
+        }
+    }
+    return maior;
+}
+
+// Funcao para simular os caminhos de uma faixa
+void* trabalhador_monte_carlo(void* argumento) {
+    TrabalhadorMonteCarlo* t = (TrabalhadorMonteCarlo*) argumento;
+    const ModeloMonteCarlo* modelo = t->modelo;
+    const ParametrosMonteCarlo* parametros = t->parametros;
+
+    int n = modelo->num_ativos;
+    int num_normais = (n + 2) & ~1;
+    int passos = parametros->anos * parametros->passos_por_ano;
+    double mercado = sqrt(parametros->correlacao);
+    double proprio = sqrt(1.0 - parametros->correlacao);
+
+    double* valores = (double*) malloc(n * sizeof(double));
+    double* acumulado = (double*) malloc(n * sizeof(double));
+    double* normais = (double*) malloc(num_normais * sizeof(double));
+    double* totais_categoria = (double*) malloc((modelo->num_categorias + 1) * sizeof(double));
+
+    for(int caminho = t->inicio; caminho < t->fim; caminho++) {
+        memcpy(valores, modelo->valor_inicial, n * sizeof(double));
+        memset(acumulado, 0, n * sizeof(double));
+        int rebalanceamentos = 0;
+        double total = 0.0;
+
+        for(int passo = 1; passo <= passos; passo++) {
+            gerar_normais(parametros->semente, caminho, passo, normais, num_normais);
+
+            // a ultima normal e o fator de mercado comum a todos os ativos;
+            // o log do retorno e acumulado e so vira valor nos pontos de rebalanceamento
+            double fator = mercado * normais[n];
+            for(int i = 0; i < n; i++) {
+                acumulado[i] += modelo->deriva[i] + modelo->choque[i] * (fator + proprio * normais[i]);
+            }
+
+            int ponto = parametros->rebalancear_a_cada > 0 && passo % parametros->rebalancear_a_cada == 0;
+            if(!ponto && passo < passos) {
+                continue;
+            }
+
+            for(int i = 0; i < n; i++) {
+                valores[i] *= exp(acumulado[i]);
+                acumulado[i] = 0.0;
+            }
+
+            if(passo == passos) {
+                break;
+            }
+
+            double drift = maior_drift_modelo(modelo, valores, totais_categoria, &total);
+            if(parametros->tolerancia <= 0.0 || drift > parametros->tolerancia) {
+                for(int i = 0; i < n; i++) {
+                    valores[i] = modelo->peso_alvo[i] * total;
+                }
+                rebalanceamentos++;
+            }
+        }
+
+        t->resultado->drifts_finais[caminho] = maior_drift_modelo(modelo, valores, totais_categoria, &total);
+        t->resultado->valores_finais[caminho] = total;
+        t->rebalanceamentos[caminho] = rebalanceamentos;
+    }
+
+    free(valores);
+    free(acumulado);
+    free(normais);
+    free(totais_categoria);
+    return NULL;
+}
+
+// Funcao para simular a carteira em varios caminhos de mercado em paralelo (nada e impresso)
+// O resultado nao depende do numero de threads: cada caminho tem sua propria sequencia de numeros
+ResultadoMonteCarlo simular_monte_carlo(Arvore* arvore, const ParametrosMonteCarlo* parametros) {
+    ResultadoMonteCarlo resultado;
+    memset(&resultado, 0, sizeof(resultado));
+
+    if(arvore == NULL || arvore->raiz == NULL || parametros->caminhos <= 0) {
+        return resultado;
+    }
+
+    double inicio = agora_segundos();
+
+    ModeloMonteCarlo modelo = montar_modelo_monte_carlo(arvore, parametros);
+
+    int num_threads = parametros->threads > 0 ? parametros->threads : numero_de_nucleos();
+    #ifdef _WIN32
+    num_threads = 1;
+    #endif
+    if(num_threads > parametros->caminhos) {
+        num_threads = parametros->caminhos;
+    }
+
+    resultado.caminhos = parametros->caminhos;
+    resultado.passos = parametros->anos * parametros->passos_por_ano;
+    resultado.threads = num_threads;
+    resultado.valor_inicial = modelo.valor_total;
+    resultado.valores_finais = (double*) malloc(parametros->caminhos * sizeof(double));
+    resultado.drifts_finais = (double*) malloc(parametros->caminhos * sizeof(double));
+    int* rebalanceamentos = (int*) malloc(parametros->caminhos * sizeof(int));
+
+    // os caminhos custam todos o mesmo: faixas iguais bastam
+    TrabalhadorMonteCarlo* trabalhadores = (TrabalhadorMonteCarlo*) malloc(num_threads * sizeof(TrabalhadorMonteCarlo));
+    for(int i = 0; i < num_threads; i++) {
+        trabalhadores[i].modelo = &modelo;
+        trabalhadores[i].parametros = parametros;
+        trabalhadores[i].resultado = &resultado;
+        trabalhadores[i].rebalanceamentos = rebalanceamentos;
+        trabalhadores[i].inicio = (int) ((long long) parametros->caminhos * i / num_threads);
+        trabalhadores[i].fim = (int) ((long long) parametros->caminhos * (i + 1) / num_threads);
+    }
+
+    #ifndef _WIN32
+    pthread_t* threads = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
+    for(int i = 1; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, trabalhador_monte_carlo, &trabalhadores[i]);
+    }
+    trabalhador_monte_carlo(&trabalhadores[0]);
+    for(int i = 1; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    #else
+    trabalhador_monte_carlo(&trabalhadores[0]);
+    #endif
+
+    long long soma_rebalanceamentos = 0;
+    for(int i = 0; i < parametros->caminhos; i++) {
+        soma_rebalanceamentos += rebalanceamentos[i];
+    }
+    resultado.media_rebalanceamentos = (double) soma_rebalanceamentos / parametros->caminhos;
+
+    qsort(resultado.valores_finais, resultado.caminhos, sizeof(double), comparar_double);
+    qsort(resultado.drifts_finais, resultado.caminhos, sizeof(double), comparar_double);
+
+    free(trabalhadores);
+    free(rebalanceamentos);
+    liberar_modelo_monte_carlo(&modelo);
+
+    resultado.segundos = agora_segundos() - inicio;
+    return resultado;
+}
+
+void liberar_resultado_monte_carlo(ResultadoMonteCarlo* resultado) {
+    free(resultado->valores_finais);
+    free(resultado->drifts_finais);
+    resultado->valores_finais = NULL;
+    resultado->drifts_finais = NULL;
+}
+
+// Funcao para pegar um percentil de um vetor ordenado (interpolacao linear)
+double percentil(const double* ordenados, int n, double p) {
+    if(n <= 0) {
+        return 0.0;
+    }
+
+    double posicao = p / 100.0 * (n - 1);
+    int i = (int) posicao;
+    if(i >= n - 1) {
+        return ordenados[n - 1];
+    }
+    return ordenados[i] + (posicao - i) * (ordenados[i + 1] - ordenados[i]);
+}
+
+void mostrar_resultado_monte_carlo(const ResultadoMonteCarlo* resultado) {
+    printf("\n========================================\n");
+    printf("SIMULACAO DE MONTE CARLO\n");
+    printf("========================================\n");
+    printf("Caminhos: %d\n", resultado->caminhos);
+    printf("Passos por caminho: %d\n", resultado->passos);
+    printf("Threads: %d\n", resultado->threads);
+    printf("Tempo: %.3f s\n", resultado->segundos);
+    if(resultado->segundos > 0.0) {
+        printf("Vazao: %.0f caminhos/s\n", resultado->caminhos / resultado->segundos);
+    }
+
+    if(resultado->caminhos == 0) {
+        printf("========================================\n");
+        return;
+    }
+
+    double soma = 0.0;
+    for(int i = 0; i < resultado->caminhos; i++) {
+        soma += resultado->valores_finais[i];
+    }
+
+    printf("\nValor inicial: R$ %.2f\n", resultado->valor_inicial);
+    printf("Valor final:\n");
+    printf("  Media: R$ %.2f\n", soma / resultado->caminhos);
+    printf("  P5:    R$ %.2f\n", percentil(resultado->valores_finais, resultado->caminhos, 5.0));
+    printf("  P25:   R$ %.2f\n", percentil(resultado->valores_finais, resultado->caminhos, 25.0));
+    printf("  P50:   R$ %.2f\n", percentil(resultado->valores_finais, resultado->caminhos, 50.0));
+    printf("  P75:   R$ %.2f\n", percentil(resultado->valores_finais, resultado->caminhos, 75.0));
+    printf("  P95:   R$ %.2f\n", percentil(resultado->valores_finais, resultado->caminhos, 95.0));
+
+    printf("\nMaior desvio das categorias no fim:\n");
+    printf("  P50: %.1f%%\n", percentil(resultado->drifts_finais, resultado->caminhos, 50.0));
+    printf("  P95: %.1f%%\n", percentil(resultado->drifts_finais, resultado->caminhos, 95.0));
+    printf("  Max: %.1f%%\n", resultado->drifts_finais[resultado->caminhos - 1]);
+
+    printf("\nRebalanceamentos por caminho (media): %.1f\n", resultado->media_rebalanceamentos);
+    printf("========================================\n");
+}
+
+// ========================================
+// BASE DE PRECOS E BACKTEST
+// ========================================
+
+// Funcao para achar onde comecam as series (depois do cabecalho, dos nomes e das datas, alinhado em 8)
+size_t deslocamento_series(unsigned int num_tickers, unsigned int num_dias) {
+    size_t deslocamento = sizeof(CabecalhoPrecos) + (size_t) num_tickers * 64 + (size_t) num_dias * sizeof(int);
+    return (deslocamento + 7) & ~(size_t) 7;
+}
+
+// Funcao para separar o proximo campo de uma linha de CSV (troca o separador por '\0')
+char* proximo_campo(char** cursor, char separador) {
+    char* campo = *cursor;
+    if(campo == NULL) {
+        return NULL;
+    }
+
+    char* fim = strchr(campo, separador);
+    if(fim != NULL) {
+        *fim = '\0';
+        *cursor = fim + 1;
+    } else {
+        *cursor = NULL;
+    }
+
+    while(*campo == ' ') campo++;
+    char* final = campo + strlen(campo);
+    while(final > campo && (final[-1] == ' ' || final[-1] == '\r' || final[-1] == '\n')) final--;
+    *final = '\0';
+
+    return campo;
+}
+
+// Funcao para converter um CSV largo (data,TICKER1,TICKER2,...) em uma base de precos colunar
+// Celulas vazias repetem o preco anterior (ou o primeiro conhecido); devolve o numero de dias (-1 = erro)
+int importar_precos_csv(const char* entrada, const char* saida) {
+    FILE* arquivo = strcmp(entrada, "-") == 0 ? stdin : fopen(entrada, "r");
+    if(arquivo == NULL) {
+        return -1;
+    }
+
+    char* linha = NULL;
+    size_t tamanho_linha = 0;
+    if(getline(&linha, &tamanho_linha, arquivo) < 0) {
+        free(linha);
+        if(arquivo != stdin) fclose(arquivo);
+        return -1;
+    }
+
+    // com ';' como separador o decimal pode vir com ','
+    char separador = strchr(linha, ';') != NULL ? ';' : ',';
+
+    int num_tickers = 0;
+    int capacidade_tickers = 16;
+    char (*nomes)[64] = malloc(capacidade_tickers * 64);
+
+    char* cursor = linha;
+    proximo_campo(&cursor, separador);
+    while(cursor != NULL) {
+        char* nome = proximo_campo(&cursor, separador);
+        if(num_tickers == capacidade_tickers) {
+            capacidade_tickers = capacidade_tickers * 2;
+            nomes = realloc(nomes, capacidade_tickers * 64);
+        }
+        memset(nomes[num_tickers], 0, 64);
+        strncpy(nomes[num_tickers], nome, 63);
+        num_tickers++;
+    }
+
+    // le linha por linha (uma linha por dia); depois transpoe para uma coluna por ticker
+    int num_dias = 0;
+    int capacidade_dias = 1024;
+    int* datas = (int*) malloc(capacidade_dias * sizeof(int));
+    double* linhas = (double*) malloc((size_t) capacidade_dias * num_tickers * sizeof(double));
+
+    while(getline(&linha, &tamanho_linha, arquivo) >= 0) {
+        cursor = linha;
+        char* data = proximo_campo(&cursor, separador);
+        if(data == NULL || *data == '\0') {
+            continue;
+        }
+
+        if(num_dias == capacidade_dias) {
+            capacidade_dias = capacidade_dias * 2;
+            datas = (int*) realloc(datas, capacidade_dias * sizeof(int));
+            linhas = (double*) realloc(linhas, (size_t) capacidade_dias * num_tickers * sizeof(double));
+        }
+
+        // 2024-01-31 e 20240131 viram o mesmo numero
+        int valor_data = 0;
+        for(char* c = data; *c != '\0'; c++) {
+            if(*c >= '0' && *c <= '9') {
+                valor_data = valor_data * 10 + (*c - '0');
+            }
+        }
+        datas[num_dias] = valor_data;
+
+        double* precos = linhas + (size_t) num_dias * num_tickers;
+        for(int t = 0; t < num_tickers; t++) {
+            char* campo = proximo_campo(&cursor, separador);
+            precos[t] = NAN;
+            if(campo != NULL && *campo != '\0') {
+                if(separador == ';') {
+                    char* virgula = strchr(campo, ',');
+                    if(virgula != NULL) *virgula = '.';
+                }
+                char* fim;
+                double preco = strtod(campo, &fim);
+                if(fim != campo && preco > 0.0) {
+                    precos[t] = preco;
+                }
+            }
+        }
+        num_dias++;
+    }
+
+    free(linha);
+    if(arquivo != stdin) {
+        fclose(arquivo);
+    }
+
+    size_t deslocamento = deslocamento_series(num_tickers, num_dias);
+    size_t tamanho = deslocamento + (size_t) num_tickers * num_dias * sizeof(double);
+    char* buffer = (char*) calloc(1, tamanho);
+
+    CabecalhoPrecos* cabecalho = (CabecalhoPrecos*) buffer;
+    memcpy(cabecalho->magico, PRECOS_MAGICO, 8);
+    cabecalho->versao = PRECOS_VERSAO;
+    cabecalho->num_tickers = num_tickers;
+    cabecalho->num_dias = num_dias;
+
+    memcpy(buffer + sizeof(CabecalhoPrecos), nomes, (size_t) num_tickers * 64);
+    memcpy(buffer + sizeof(CabecalhoPrecos) + (size_t) num_tickers * 64, datas, (size_t) num_dias * sizeof(int));
+
+    double* series = (double*) (buffer + deslocamento);
+    for(int t = 0; t < num_tickers; t++) {
+        double* serie = series + (size_t) t * num_dias;
+        double anterior = NAN;
+        for(int d = 0; d < num_dias; d++) {
+            double preco = linhas[(size_t) d * num_tickers + t];
+            serie[d] = isnan(preco) ? anterior : preco;
+            anterior = serie[d];
+        }
+
+        // antes do primeiro preco conhecido usa o proprio primeiro preco (ou 0 se nao houver nenhum)
+        int primeiro = 0;
+        while(primeiro < num_dias && isnan(serie[primeiro])) primeiro++;
+        for(int d = 0; d < primeiro; d++) {
+            serie[d] = primeiro < num_dias ? serie[primeiro] : 0.0;
+        }
+    }
+
+    free(nomes);
+    free(datas);
+    free(linhas);
+
+    FILE* destino = fopen(saida, "wb");
+    if(destino == NULL) {
+        free(buffer);
+        return -1;
+    }
+
+    int ok = fwrite(buffer, 1, tamanho, destino) == tamanho;
+    ok = (fclose(destino) == 0) && ok;
+    free(buffer);
+
+    return ok ? num_dias : -1;
+}
+
+void fechar_base_precos(BasePrecos* base) {
+    if(base->base == NULL) {
+        return;
+    }
+
+    desmapear_arquivo(base->base, base->tamanho);
+    base->base = NULL;
+}
+
+// Funcao para abrir uma base de precos (mapeada em memoria; as series sao lidas direto do arquivo)
+int abrir_base_precos(const char* caminho, BasePrecos* base) {
+    memset(base, 0, sizeof(*base));
+
+    void* dados;
+    size_t tamanho;
+    if(!mapear_arquivo(caminho, sizeof(CabecalhoPrecos), &dados, &tamanho)) {
+        return 0;
+    }
+
+    base->base = dados;
+    base->tamanho = tamanho;
+    base->cabecalho = (const CabecalhoPrecos*) dados;
+
+    const CabecalhoPrecos* cabecalho = base->cabecalho;
+    size_t deslocamento = deslocamento_series(cabecalho->num_tickers, cabecalho->num_dias);
+    if(memcmp(cabecalho->magico, PRECOS_MAGICO, 8) != 0 ||
+       cabecalho->versao != PRECOS_VERSAO ||
+       cabecalho->num_dias == 0 ||
+       tamanho != deslocamento + (size_t) cabecalho->num_tickers * cabecalho->num_dias * sizeof(double)) {
+        fechar_base_precos(base);
+        return 0;
+    }
+
+    const char* bytes = (const char*) dados;
+    base->nomes = (const char (*)[64]) (bytes + sizeof(CabecalhoPrecos));
+    base->datas = (const int*) (bytes + sizeof(CabecalhoPrecos) + (size_t) cabecalho->num_tickers * 64);
+    base->series = (const double*) (bytes + deslocamento);
+
+    return 1;
+}
+
+// Funcao para achar a serie de um ticker (NULL se a base nao tiver esse nome)
+const double* buscar_serie(const BasePrecos* base, const char* nome) {
+    for(unsigned int t = 0; t < base->cabecalho->num_tickers; t++) {
+        if(strncmp(base->nomes[t], nome, 64) == 0) {
+            return base->series + (size_t) t * base->cabecalho->num_dias;
+        }
+    }
+    return NULL;
+}
+
+// Funcao para juntar as folhas de uma subarvore
+void coletar_ativos(No* no, No** ativos, int* quantidade) {
+    if(no->num_filhos == 0) {
+        ativos[*quantidade] = no;
+        (*quantidade)++;
+        return;
+    }
+
+    for(int i = 0; i < no->num_filhos; i++) {
+        coletar_ativos(no->filhos[i], ativos, quantidade);
+    }
+}
+
+// Funcao para rodar um backtest de uma configuracao (nada e impresso)
+// Os ativos sem serie na base ficam com valor constante; o rebalanceamento e o mesmo do sugerir_rebalanceamento
+ResultadoBacktest rodar_backtest(const BasePrecos* base, const ConfigBacktest* config, Centavos valor_inicial) {
+    ResultadoBacktest resultado;
+    memset(&resultado, 0, sizeof(resultado));
+    resultado.config = *config;
+
+    Arvore* carteira = montar_carteira_perfil(valor_inicial, config->perfil);
+
+    No** ativos = (No**) malloc(contar_nos(carteira->raiz) * sizeof(No*));
+    int n = 0;
+    coletar_ativos(carteira->raiz, ativos, &n);
+
+    const double** series = (const double**) malloc(n * sizeof(const double*));
+    double* quantidades = (double*) malloc(n * sizeof(double));
+    double* valores = (double*) malloc(n * sizeof(double));
+
+    double total = 0.0;
+    for(int i = 0; i < n; i++) {
+        series[i] = buscar_serie(base, ativos[i]->nome);
+        if(series[i] != NULL && series[i][0] <= 0.0) {
+            series[i] = NULL;
+        }
+        valores[i] = (double) ativos[i]->valor_investido;
+        quantidades[i] = series[i] != NULL ? valores[i] / series[i][0] : 0.0;
+        total += valores[i];
+    }
+
+    int dias = base->cabecalho->num_dias;
+    double pico = total;
+    double anterior = total;
+    double soma_retornos = 0.0;
+    double soma_quadrados = 0.0;
+
+    resultado.valor_inicial = total / 100.0;
+
+    for(int dia = 1; dia < dias; dia++) {
+        // passo de streaming: cada ativo le so o preco do dia na sua coluna
+        total = 0.0;
+        for(int i = 0; i < n; i++) {
+            if(series[i] != NULL) {
+                valores[i] = quantidades[i] * series[i][dia];
+            }
+            total += valores[i];
+        }
+
+        double retorno = total > 0.0 && anterior > 0.0 ? log(total / anterior) : 0.0;
+        soma_retornos += retorno;
+        soma_quadrados += retorno * retorno;
+        anterior = total;
+
+        if(total > pico) {
+            pico = total;
+        } else if(pico > 0.0 && 1.0 - total / pico > resultado.maior_queda) {
+            resultado.maior_queda = 1.0 - total / pico;
+        }
+
+        int verificar = config->regra == BACKTEST_LIMITE ||
+                        (config->regra == BACKTEST_CALENDARIO && config->intervalo_dias > 0 && dia % config->intervalo_dias == 0);
+        if(!verificar || dia == dias - 1) {
+            continue;
+        }
+
+        for(int i = 0; i < n; i++) {
+            alterar_valor_investido(carteira, ativos[i], llround(valores[i]));
+        }
+
+        PlanoRebalanceamento plano = planejar_rebalanceamento(carteira,
+                                                              config->regra == BACKTEST_LIMITE ? config->tolerancia : 0.0);
+        if(plano.num_ordens > 0) {
+            aplicar_plano_rebalanceamento(carteira, &plano);
+            resultado.rebalanceamentos++;
+            resultado.giro += plano.total_vendas / 100.0;
+
+            anterior = 0.0;
+            for(int i = 0; i < n; i++) {
+                valores[i] = (double) ativos[i]->valor_investido;
+                if(series[i] != NULL) {
+                    quantidades[i] = valores[i] / series[i][dia];
+                }
+                anterior += valores[i];
+            }
+        }
+        liberar_plano(&plano);
+    }
+
+    resultado.valor_final = total / 100.0;
+    if(dias > 1 && resultado.valor_inicial > 0.0) {
+        double anos = (dias - 1) / 252.0;
+        double media = soma_retornos / (dias - 1);
+        double variancia = soma_quadrados / (dias - 1) - media * media;
+
+        resultado.retorno_anual = pow(resultado.valor_final / resultado.valor_inicial, 1.0 / anos) - 1.0;
+        resultado.volatilidade_anual = sqrt(variancia > 0.0 ? variancia : 0.0) * sqrt(252.0);
+    }
+
+    free(ativos);
+    free(series);
+    free(quantidades);
+    free(valores);
+    liberar_arvore(carteira);
+
+    return resultado;
+}
+
+// Fila compartilhada de configuracoes do backtest (cada thread pega a proxima livre)
+typedef struct TrabalhadorBacktest {
+    const BasePrecos* base;
+    const ConfigBacktest* configs;
+    ResultadoBacktest* resultados;
+    int quantidade;
+    int* proxima;
+    Centavos valor_inicial;
+} TrabalhadorBacktest;
+
+void* trabalhador_backtest(void* argumento) {
+    TrabalhadorBacktest* t = (TrabalhadorBacktest*) argumento;
+
+    while(1) {
+        int i = __atomic_fetch_add(t->proxima, 1, __ATOMIC_RELAXED);
+        if(i >= t->quantidade) {
+            break;
+        }
+        t->resultados[i] = rodar_backtest(t->base, &t->configs[i], t->valor_inicial);
+    }
+
+    return NULL;
+}
+
+// Funcao para rodar varias configuracoes de backtest em paralelo (resultados na mesma ordem das configs)
+void varrer_backtests(const BasePrecos* base, const ConfigBacktest* configs, int quantidade,
+                      Centavos valor_inicial, int num_threads, ResultadoBacktest* resultados) {
+    if(num_threads <= 0) {
+        num_threads = numero_de_nucleos();
+    }
+    #ifdef _WIN32
+    num_threads = 1;
+    #endif
+    if(num_threads > quantidade) {
+        num_threads = quantidade > 0 ? quantidade : 1;
+    }
+
+    int proxima = 0;
+    TrabalhadorBacktest trabalhador;
+    trabalhador.base = base;
+    trabalhador.configs = configs;
+    trabalhador.resultados = resultados;
+    trabalhador.quantidade = quantidade;
+    trabalhador.proxima = &proxima;
+    trabalhador.valor_inicial = valor_inicial;
+
+    #ifndef _WIN32
+    pthread_t* threads = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
+    for(int i = 1; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, trabalhador_backtest, &trabalhador);
+    }
+    trabalhador_backtest(&trabalhador);
+    for(int i = 1; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    #else
+    trabalhador_backtest(&trabalhador);
+    #endif
+}
+
+// Funcao para montar a varredura padrao: 3 perfis x (nunca, calendario e limites de tolerancia)
+int montar_configs_backtest(ConfigBacktest* configs) {
+    const char* perfis[3] = {"CONSERVADOR", "MODERADO", "ARROJADO"};
+    int intervalos[3] = {21, 63, 252};
+    double tolerancias[5] = {1.0, 2.0, 3.0, 5.0, 10.0};
+    int quantidade = 0;
+
+    for(int p = 0; p < 3; p++) {
+        configs[quantidade++] = (ConfigBacktest) {perfis[p], BACKTEST_NUNCA, 0.0, 0};
+        for(int i = 0; i < 3; i++) {
+            configs[quantidade++] = (ConfigBacktest) {perfis[p], BACKTEST_CALENDARIO, 0.0, intervalos[i]};
+        }
+        for(int i = 0; i < 5; i++) {
+            configs[quantidade++] = (ConfigBacktest) {perfis[p], BACKTEST_LIMITE, tolerancias[i], 0};
+        }
+    }
+
+    return quantidade;
+}
+
+void mostrar_resultados_backtest(const BasePrecos* base, const ResultadoBacktest* resultados, int quantidade, double segundos) {
+    const CabecalhoPrecos* cabecalho = base->cabecalho;
+
+    printf("\n========================================\n");
+    printf("BACKTEST\n");
+    printf("========================================\n");
+    printf("Base: %u tickers, %u dias (%d a %d)\n", cabecalho->num_tickers, cabecalho->num_dias,
+           base->datas[0], base->datas[cabecalho->num_dias - 1]);
+    printf("Configuracoes: %d\n", quantidade);
+    printf("Tempo: %.3f s\n", segundos);
+    printf("========================================\n");
+    printf("%-12s %-16s %14s %9s %9s %9s %6s %14s\n",
+           "perfil", "regra", "valor final", "ret a.a.", "vol a.a.", "queda", "rebal", "giro");
+
+    for(int i = 0; i < quantidade; i++) {
+        const ResultadoBacktest* r = &resultados[i];
+        char regra[32];
+        if(r->config.regra == BACKTEST_CALENDARIO) {
+            snprintf(regra, sizeof(regra), "a cada %d dias", r->config.intervalo_dias);
+        } else if(r->config.regra == BACKTEST_LIMITE) {
+            snprintf(regra, sizeof(regra), "limite %.1f%%", r->config.tolerancia);
+        } else {
+            snprintf(regra, sizeof(regra), "nunca");
+        }
+
+        printf("%-12s %-16s %14.2f %8.2f%% %8.2f%% %8.2f%% %6d %14.2f\n",
+               r->config.perfil, regra, r->valor_final, r->retorno_anual * 100.0,
+               r->volatilidade_anual * 100.0, r->maior_queda * 100.0, r->rebalanceamentos, r->giro);
+    }
+    printf("========================================\n");
+}
+
+// ========================================
+// VERSOES PUBLICADAS (LEITORES CONCORRENTES)
+// ========================================
+
+// Funcao para copiar os descendentes de um no para a versao (em pre-ordem)
+void copiar_descendentes_versao(VersaoCarteira* versao, No* no, int categoria) {
+    for(int i = 0; i < no->num_filhos; i++) {
+        No* filho = no->filhos[i];
+        NoVersao* copia = &versao->nos[versao->num_nos];
+
+        memcpy(copia->nome, filho->nome, sizeof(copia->nome));
+        copia->valor_investido = filho->valor_investido;
+        copia->tipo = filho->tipo;
+        copia->categoria = categoria;
+        versao->num_nos++;
+
+        copiar_descendentes_versao(versao, filho, categoria);
+    }
+}
+
+// Funcao para montar uma versao imutavel da carteira (um unico bloco de memoria)
+VersaoCarteira* montar_versao(Arvore* arvore) {
+    garantir_totais(arvore);
+
+    int num_categorias = arvore->raiz->num_filhos;
+    int num_nos = contar_nos(arvore->raiz) - 1 - num_categorias;
+
+    VersaoCarteira* versao = (VersaoCarteira*) malloc(sizeof(VersaoCarteira) +
+                                                      num_categorias * sizeof(CategoriaVersao) +
+                                                      num_nos * sizeof(NoVersao));
+    versao->numero = 0;
+    versao->epoca_retirada = 0;
+    versao->proxima_retirada = NULL;
+    versao->valor_total = arvore->valor_total;
+    versao->num_categorias = num_categorias;
+    versao->num_nos = 0;
+    versao->categorias = (CategoriaVersao*) (versao + 1);
+    versao->nos = (NoVersao*) (versao->categorias + num_categorias);
+
+    for(int i = 0; i < num_categorias; i++) {
+        No* categoria = arvore->raiz->filhos[i];
+        CategoriaVersao* copia = &versao->categorias[i];
+
+        memcpy(copia->nome, categoria->nome, sizeof(copia->nome));
+        copia->percentual_alvo = categoria->percentual_alvo;
+        copia->valor_investido = categoria->valor_investido;
+        copia->valor_total = categoria->valor_total;
+        copia->primeiro_no = versao->num_nos;
+
+        copiar_descendentes_versao(versao, categoria, i);
+        copia->num_nos = versao->num_nos - copia->primeiro_no;
+    }
+
+    return versao;
+}
+
+// Funcao para iniciar o publicador com a carteira atual como primeira versao
+void publicador_iniciar(PublicadorCarteira* publicador, Arvore* arvore) {
+    memset(publicador, 0, sizeof(*publicador));
+    publicador->epoca = 1;
+    publicador->atual = montar_versao(arvore);
+    publicador->atual->numero = 1;
+    publicador->publicadas = 1;
+}
+
+// Funcao para reservar a vaga de um leitor (-1 se nao houver mais vagas)
+int publicador_registrar_leitor(PublicadorCarteira* publicador) {
+    int leitor = __atomic_fetch_add(&publicador->num_leitores, 1, __ATOMIC_ACQ_REL);
+    if(leitor >= PUBLICADOR_MAX_LEITORES) {
+        __atomic_fetch_sub(&publicador->num_leitores, 1, __ATOMIC_ACQ_REL);
+        return -1;
+    }
+    return leitor;
+}
+
+// Funcao para comecar uma leitura: anuncia a epoca e pega a versao atual (sem travas e sem repetir)
+// A versao devolvida continua valida ate o leitor_sair do mesmo leitor
+const VersaoCarteira* leitor_entrar(PublicadorCarteira* publicador, int leitor) {
+    long long epoca = __atomic_load_n(&publicador->epoca, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&publicador->leitores[leitor].epoca, epoca, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&publicador->atual, __ATOMIC_SEQ_CST);
+}
+
+void leitor_sair(PublicadorCarteira* publicador, int leitor) {
+    __atomic_store_n(&publicador->leitores[leitor].epoca, 0, __ATOMIC_RELEASE);
+}
+
+// Funcao para liberar as versoes retiradas que nenhum leitor pode estar lendo
+// Uma versao retirada na epoca E pode estar com leitores que anunciaram epoca <= E
+void coletar_versoes(PublicadorCarteira* publicador) {
+    long long menor = LLONG_MAX;
+    int num_leitores = __atomic_load_n(&publicador->num_leitores, __ATOMIC_ACQUIRE);
+    if(num_leitores > PUBLICADOR_MAX_LEITORES) {
+        num_leitores = PUBLICADOR_MAX_LEITORES;
+    }
+
+    for(int i = 0; i < num_leitores; i++) {
+        long long epoca = __atomic_load_n(&publicador->leitores[i].epoca, __ATOMIC_SEQ_CST);
+        if(epoca != 0 && epoca < menor) {
+            menor = epoca;
+        }
+    }
+
+    VersaoCarteira** atual = &publicador->retiradas;
+    while(*atual != NULL) {
+        VersaoCarteira* versao = *atual;
+        if(versao->epoca_retirada < menor) {
+            *atual = versao->proxima_retirada;
+            free(versao);
+            publicador->num_retiradas--;
+            publicador->liberadas++;
+        } else {
+            atual = &versao->proxima_retirada;
+        }
+    }
+}
+
+// Funcao para publicar o estado atual da carteira (so um escritor; nunca espera pelos leitores)
+long long publicar_versao(PublicadorCarteira* publicador, Arvore* arvore) {
+    VersaoCarteira* nova = montar_versao(arvore);
+    nova->numero = publicador->publicadas + 1;
+
+    VersaoCarteira* antiga = __atomic_exchange_n(&publicador->atual, nova, __ATOMIC_SEQ_CST);
+    antiga->epoca_retirada = __atomic_fetch_add(&publicador->epoca, 1, __ATOMIC_SEQ_CST);
+    antiga->proxima_retirada = publicador->retiradas;
+    publicador->retiradas = antiga;
+    publicador->num_retiradas++;
+    publicador->publicadas++;
+
+    coletar_versoes(publicador);
+
+    return nova->numero;
+}
+
+// Funcao para liberar o publicador (nenhum leitor pode estar lendo)
+void publicador_liberar(PublicadorCarteira* publicador) {
+    while(publicador->retiradas != NULL) {
+        VersaoCarteira* proxima = publicador->retiradas->proxima_retirada;
+        free(publicador->retiradas);
+        publicador->retiradas = proxima;
+    }
+    free(publicador->atual);
+    publicador->atual = NULL;
+    publicador->num_retiradas = 0;
+}
+
+// Funcao para conferir se os totais de uma versao fecham (1 = consistente)
+int verificar_versao(const VersaoCarteira* versao) {
+    Centavos soma_categorias = 0;
+
+    for(int i = 0; i < versao->num_categorias; i++) {
+        const CategoriaVersao* categoria = &versao->categorias[i];
+        Centavos soma = categoria->valor_investido;
+        for(int j = 0; j < categoria->num_nos; j++) {
+            soma += versao->nos[categoria->primeiro_no + j].valor_investido;
+        }
+        if(soma != categoria->valor_total) {
+            return 0;
+        }
+        soma_categorias += categoria->valor_total;
+    }
+
+    return soma_categorias == versao->valor_total;
+}
+
+// Funcao para contar as categorias de uma versao fora da tolerancia (mesma regra do detectar_desbalanceamento)
+int drift_versao(const VersaoCarteira* versao, double tolerancia, double* maior_diferenca) {
+    int fora = 0;
+    double maior = 0.0;
+
+    for(int i = 0; i < versao->num_categorias; i++) {
+        const CategoriaVersao* categoria = &versao->categorias[i];
+        double atual = versao->valor_total > 0 ? (double) categoria->valor_total / versao->valor_total * 100.0 : 0.0;
+        double diferenca = fabs(atual - categoria->percentual_alvo);
+
+        if(diferenca > tolerancia) {
+            fora++;
+        }
+        if(diferenca > maior) {
+            maior = diferenca;
+        }
+    }
+
+    if(maior_diferenca != NULL) {
+        *maior_diferenca = maior;
+    }
+    return fora;
+}
+
+// Leitor da demonstracao: le versoes sem parar ate o escritor terminar
+typedef struct TrabalhadorLeitor {
+    PublicadorCarteira* publicador;
+    int leitor;
+    int* parar;
+    long long leituras;
+    long long inconsistentes;
+    long long versoes_diferentes;
+} TrabalhadorLeitor;
+
+void* trabalhador_leitor(void* argumento) {
+    TrabalhadorLeitor* t = (TrabalhadorLeitor*) argumento;
+    long long ultima = 0;
+
+    while(!__atomic_load_n(t->parar, __ATOMIC_ACQUIRE)) {
+        const VersaoCarteira* versao = leitor_entrar(t->publicador, t->leitor);
+
+        if(!verificar_versao(versao)) {
+            t->inconsistentes++;
+        }
+        drift_versao(versao, 2.0, NULL);
+        if(versao->numero != ultima) {
+            ultima = versao->numero;
+            t->versoes_diferentes++;
+        }
+
+        leitor_sair(t->publicador, t->leitor);
+        t->leituras++;
+    }
+
+    return NULL;
+}
+
+// Funcao para demonstrar um escritor de precos com varios leitores lendo versoes ao mesmo tempo
+void rodar_leitores_concorrentes(int num_ticks, int num_leitores, int num_nos) {
+    if(num_leitores < 1) {
+        num_leitores = 1;
+    }
+    if(num_leitores > PUBLICADOR_MAX_LEITORES) {
+        num_leitores = PUBLICADOR_MAX_LEITORES;
+    }
+    #ifdef _WIN32
+    num_leitores = 1;
+    #endif
+
+    CarteiraSintetica sintetica = gerar_carteira_sintetica(num_nos, 2);
+
+    // so as folhas recebem precos
+    No** ativos = (No**) malloc(sintetica.num_nos * sizeof(No*));
+    int num_ativos = 0;
+    for(int i = 0; i < sintetica.num_nos; i++) {
+        if(sintetica.nos[i]->num_filhos == 0) {
+            ativos[num_ativos++] = sintetica.nos[i];
+        }
+    }
+
+    PublicadorCarteira* publicador = (PublicadorCarteira*) calloc(1, sizeof(PublicadorCarteira));
+    publicador_iniciar(publicador, sintetica.arvore);
+
+    int parar = 0;
+    TrabalhadorLeitor* leitores = (TrabalhadorLeitor*) calloc(num_leitores, sizeof(TrabalhadorLeitor));
+    for(int i = 0; i < num_leitores; i++) {
+        leitores[i].publicador = publicador;
+        leitores[i].leitor = publicador_registrar_leitor(publicador);
+        leitores[i].parar = &parar;
+    }
+
+    #ifndef _WIN32
+    pthread_t* threads = (pthread_t*) malloc(num_leitores * sizeof(pthread_t));
+    for(int i = 0; i < num_leitores; i++) {
+        pthread_create(&threads[i], NULL, trabalhador_leitor, &leitores[i]);
+    }
+    #endif
+
+    // escritor: aplica os ticks em lotes e publica uma versao por lote
+    int lote = 64;
+    double inicio = agora_segundos();
+    for(int tick = 0; tick < num_ticks; tick++) {
+        unsigned long long bits = misturar_contador(20250101ULL, 0, tick, 0);
+        No* ativo = ativos[bits % num_ativos];
+        Centavos novo_valor = 100000 + (Centavos) ((bits >> 32) % 10000000);
+        alterar_valor_investido(sintetica.arvore, ativo, novo_valor);
+
+        if((tick + 1) % lote == 0 || tick == num_ticks - 1) {
+            publicar_versao(publicador, sintetica.arvore);
+        }
+    }
+    double segundos_escritor = agora_segundos() - inicio;
+
+    __atomic_store_n(&parar, 1, __ATOMIC_RELEASE);
+
+    #ifndef _WIN32
+    for(int i = 0; i < num_leitores; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    #else
+    trabalhador_leitor(&leitores[0]);
+    #endif
+    double segundos = agora_segundos() - inicio;
+
+    long long leituras = 0;
+    long long inconsistentes = 0;
+    long long versoes_vistas = 0;
+    for(int i = 0; i < num_leitores; i++) {
+        leituras += leitores[i].leituras;
+        inconsistentes += leitores[i].inconsistentes;
+        versoes_vistas += leitores[i].versoes_diferentes;
+    }
+
+    coletar_versoes(publicador);
+
+    printf("\n========================================\n");
+    printf("LEITORES CONCORRENTES\n");
+    printf("========================================\n");
+    printf("Carteira: %d nos (%d ativos)\n", sintetica.num_nos, num_ativos);
+    printf("Ticks: %d em lotes de %d (%.0f ticks/s no escritor)\n", num_ticks, lote,
+           segundos_escritor > 0 ? num_ticks / segundos_escritor : 0.0);
+    printf("Versoes publicadas: %lld (liberadas: %lld, ainda retidas: %d)\n",
+           publicador->publicadas, publicador->liberadas, publicador->num_retiradas);
+    printf("Leitores: %d\n", num_leitores);
+    printf("Leituras: %lld (%.0f leituras/s)\n", leituras, segundos > 0 ? leituras / segundos : 0.0);
+    printf("Versoes diferentes vistas por leitor (media): %.1f\n", (double) versoes_vistas / num_leitores);
+    printf("Leituras inconsistentes: %lld\n", inconsistentes);
+    printf("========================================\n");
+
+    publicador_liberar(publicador);
+    free(publicador);
+    free(leitores);
+    free(ativos);
+    liberar_carteira_sintetica(&sintetica);
+}
+
+// Limite de ticks da varredura completa na demonstracao dos alertas (ela custa O(n) por tick)
+#define ALERTAS_TICKS_VARREDURA 20000
+
+// Callback da demonstracao: so conta os avisos
+void contar_alerta(const AlertaDrift* alerta, void* contexto) {
+    (void) alerta;
+    (*(long long*) contexto)++;
+}
+
+// Funcao para varrer todos os nos e contar quantos trocaram de faixa (o jeito sem indice)
+// As metas efetivas nao mudam com os ticks: vem calculadas em metas
+long long varrer_estados_alerta(CarteiraSintetica* sintetica, double tolerancia, const double* metas, int* estados) {
+    long long trocas = 0;
+
+    for(int i = 1; i < sintetica->num_nos; i++) {
+        int estado = estado_alerta(sintetica->nos[i], metas[i], tolerancia);
+        if(estado != estados[i]) {
+            estados[i] = estado;
+            trocas++;
+        }
+    }
+
+    return trocas;
+}
+
+// Funcao para aplicar o tick numero tick da demonstracao
+void aplicar_tick_alertas(Arvore* arvore, No** ativos, int num_ativos, int tick) {
+    unsigned long long bits = misturar_contador(20251017ULL, 0, tick, 0);
+    No* ativo = ativos[bits % num_ativos];
+
+    alterar_valor_investido(arvore, ativo, 100000 + (Centavos) ((bits >> 32) % 10000000));
+}
+
+// Funcao para comparar o indice de alertas com a varredura completa depois de cada tick
+void rodar_demo_alertas(int num_ticks, int num_nos, double tolerancia) {
+    if(num_nos < 2) {
+        num_nos = 2;
+    }
+
+    CarteiraSintetica sintetica = gerar_carteira_sintetica(num_nos, 3);
+    No** ativos = (No**) malloc(sintetica.num_nos * sizeof(No*));
+    int* estados = (int*) malloc(sintetica.num_nos * sizeof(int));
+    double* metas = (double*) malloc(sintetica.num_nos * sizeof(double));
+    int num_ativos = 0;
+    for(int i = 0; i < sintetica.num_nos; i++) {
+        if(sintetica.nos[i]->num_filhos == 0) {
+            ativos[num_ativos++] = sintetica.nos[i];
+        }
+    }
+
+    int ticks_varredura = num_ticks < ALERTAS_TICKS_VARREDURA ? num_ticks : ALERTAS_TICKS_VARREDURA;
+
+    // com o indice: cada tick so olha o caminho ate a raiz e os topos dos heaps
+    long long avisos = 0;
+    long long avisos_no_limite = 0;
+    ligar_alertas(sintetica.arvore, tolerancia, contar_alerta, &avisos);
+    int fora_no_inicio = sintetica.arvore->alertas->fora_da_faixa;
+
+    double inicio = agora_segundos();
+    for(int tick = 0; tick < num_ticks; tick++) {
+        aplicar_tick_alertas(sintetica.arvore, ativos, num_ativos, tick);
+        if(tick + 1 == ticks_varredura) {
+            avisos_no_limite = avisos;
+        }
+    }
+    double segundos_indice = agora_segundos() - inicio;
+
+    // o estado avisado de cada no tem que ser o estado que a varredura encontra
+    int divergentes = 0;
+    const IndiceAlertas* indice = sintetica.arvore->alertas;
+    for(int i = 0; i < indice->num_entradas; i++) {
+        if(indice->entradas[i].estado != estado_alerta(indice->entradas[i].no, indice->entradas[i].meta, tolerancia)) {
+            divergentes++;
+        }
+    }
+    int fora_no_fim = indice->fora_da_faixa;
+    liberar_carteira_sintetica(&sintetica);
+
+    // sem o indice: a mesma sequencia de ticks com uma varredura completa depois de cada um
+    sintetica = gerar_carteira_sintetica(num_nos, 3);
+    num_ativos = 0;
+    for(int i = 0; i < sintetica.num_nos; i++) {
+        if(sintetica.nos[i]->num_filhos == 0) {
+            ativos[num_ativos++] = sintetica.nos[i];
+        }
+    }
+    estados[0] = ALERTA_DENTRO;
+    for(int i = 1; i < sintetica.num_nos; i++) {
+        metas[i] = meta_efetiva(sintetica.nos[i]);
+        estados[i] = estado_alerta(sintetica.nos[i], metas[i], tolerancia);
+    }
+
+    long long trocas = 0;
+    inicio = agora_segundos();
+    for(int tick = 0; tick < ticks_varredura; tick++) {
+        aplicar_tick_alertas(sintetica.arvore, ativos, num_ativos, tick);
+        trocas += varrer_estados_alerta(&sintetica, tolerancia, metas, estados);
+    }
+    double segundos_varredura = agora_segundos() - inicio;
+
+    printf("\n========================================\n");
+    printf("ALERTAS DE DESVIO\n");
+    printf("========================================\n");
+    printf("Carteira: %d nos (%d ativos), tolerancia %.2f pontos\n", sintetica.num_nos, num_ativos, tolerancia);
+    printf("Com indice: %d ticks (%.0f ticks/s), %lld alertas\n", num_ticks,
+           segundos_indice > 0 ? num_ticks / segundos_indice : 0.0, avisos);
+    printf("Nos fora da faixa: %d no inicio, %d no fim\n", fora_no_inicio, fora_no_fim);
+    printf("Varredura completa: %d ticks (%.0f ticks/s), %lld trocas de faixa\n", ticks_varredura,
+           segundos_varredura > 0 ? ticks_varredura / segundos_varredura : 0.0, trocas);
+    printf("Alertas conferem com a varredura: %s\n",
+           avisos_no_limite == trocas && divergentes == 0 ? "sim" : "NAO");
+    if(divergentes > 0) {
+        printf("Nos com estado divergente no fim: %d\n", divergentes);
+    }
+    printf("========================================\n");
+
+    free(estados);
+    free(metas);
+    free(ativos);
+    liberar_carteira_sintetica(&sintetica);
+}
+
+// Funcao para comparar a tabela de precos compartilhada com a atualizacao carteira por carteira
+// As duas colecoes comecam iguais (todos os ativos cotados a R$ 10,00) e recebem os mesmos ticks
+void rodar_precos_compartilhados(int num_carteiras, int num_ticks) {
+    if(num_carteiras < 1) {
+        num_carteiras = 1;
+    }
+
+    Arvore** compartilhadas = (Arvore**) malloc(num_carteiras * sizeof(Arvore*));
+    Arvore** separadas = (Arvore**) malloc(num_carteiras * sizeof(Arvore*));
+    const char* perfis[] = { "CONSERVADOR", "MODERADO", "ARROJADO" };
+    const char* tickers[] = { "Tesouro Selic", "CDB XP", "PETR4", "ITUB4" };
+    int num_tickers = 4;
+    double* quantidades = (double*) malloc((size_t) num_carteiras * num_tickers * sizeof(double));
+    int ids[4];
+
+    for(int c = 0; c < num_carteiras; c++) {
+        Centavos valor = 1000000 + (Centavos) c * 3700;
+        compartilhadas[c] = montar_carteira_perfil(valor, perfis[c % 3]);
+        separadas[c] = montar_carteira_perfil(valor, perfis[c % 3]);
+
+        for(int t = 0; t < num_tickers; t++) {
+            No* ativo = buscar_no(compartilhadas[c], tickers[t]);
+            quantidades[(size_t) c * num_tickers + t] = ativo->valor_investido / 1000.0;
+            definir_posicao(compartilhadas[c], ativo, ativo->valor_investido / 1000.0);
+        }
+    }
+    for(int t = 0; t < num_tickers; t++) {
+        ids[t] = precos_buscar(tickers[t]);
+        precos_atualizar(ids[t], 1000);
+    }
+
+    // tabela compartilhada: o tick so troca um preco
+    double inicio = agora_segundos();
+    for(int tick = 0; tick < num_ticks; tick++) {
+        unsigned long long bits = misturar_contador(20251017ULL, 1, tick, 0);
+        precos_atualizar(ids[bits % num_tickers], 500 + (Centavos) ((bits >> 32) % 1500));
+    }
+    double segundos_ticks = agora_segundos() - inicio;
+
+    // a reavaliacao acontece na leitura
+    inicio = agora_segundos();
+    Centavos soma_compartilhadas = 0;
+    for(int c = 0; c < num_carteiras; c++) {
+        garantir_totais(compartilhadas[c]);
+        soma_compartilhadas += compartilhadas[c]->valor_total;
+    }
+    double segundos_leitura = agora_segundos() - inicio;
+
+    // carteira por carteira: cada tick procura o ativo e propaga o valor novo em todas
+    inicio = agora_segundos();
+    for(int tick = 0; tick < num_ticks; tick++) {
+        unsigned long long bits = misturar_contador(20251017ULL, 1, tick, 0);
+        int t = bits % num_tickers;
+        Centavos preco = 500 + (Centavos) ((bits >> 32) % 1500);
+
+        for(int c = 0; c < num_carteiras; c++) {
+            No* ativo = buscar_no(separadas[c], tickers[t]);
+            alterar_valor_investido(separadas[c], ativo, llround(quantidades[(size_t) c * num_tickers + t] * preco));
+        }
+    }
+    double segundos_separadas = agora_segundos() - inicio;
+
+    Centavos soma_separadas = 0;
+    int diferentes = 0;
+    for(int c = 0; c < num_carteiras; c++) {
+        garantir_totais(separadas[c]);
+        soma_separadas += separadas[c]->valor_total;
+        diferentes += separadas[c]->valor_total != compartilhadas[c]->valor_total;
+    }
+
+    printf("\n========================================\n");
+    printf("TABELA DE PRECOS COMPARTILHADA\n");
+    printf("========================================\n");
+    printf("Carteiras: %d (%d tickers em comum)\n", num_carteiras, num_tickers);
+    printf("Ticks: %d\n", num_ticks);
+    printf("Tabela compartilhada: %.0f ticks/s; leitura de todas as carteiras: %.3f ms\n",
+           segundos_ticks > 0 ? num_ticks / segundos_ticks : 0.0, segundos_leitura * 1000.0);
+    printf("Carteira por carteira: %.0f ticks/s\n", segundos_separadas > 0 ? num_ticks / segundos_separadas : 0.0);
+    printf("Valor total das carteiras: R$ %.2f\n", centavos_para_reais(soma_compartilhadas));
+    printf("Totais conferem: %s\n", diferentes == 0 && soma_compartilhadas == soma_separadas ? "sim" : "NAO");
+    printf("========================================\n");
+
+    for(int c = 0; c < num_carteiras; c++) {
+        liberar_arvore(compartilhadas[c]);
+        liberar_arvore(separadas[c]);
+    }
+    free(compartilhadas);
+    free(separadas);
+    free(quantidades);
+}
+
+// Funcao para montar a carteira de um modelo do jeito antigo: criar_no e adicionar_filho no a no
+// (so para comparar com o instanciar_perfil; os valores saem com a mesma divisao)
+Arvore* montar_perfil_no_a_no(const ModeloPerfil* modelo, Centavos valor_inicial) {
+    Arvore* arvore = criar_arvore(modelo->num_nos);
+    No** nos = (No**) malloc(modelo->num_nos * sizeof(No*));
+    Centavos* totais = (Centavos*) malloc(modelo->num_nos * sizeof(Centavos));
+
+    for(int i = 0; i < modelo->num_nos; i++) {
+        const NoModelo* ligacao = &modelo->ligacoes[i];
+        const No* prototipo = &modelo->prototipos[i];
+
+        if(ligacao->pai < 0) {
+            totais[i] = valor_inicial;
+        } else {
+            Centavos base = totais[ligacao->pai];
+            totais[i] = llround(base * ligacao->fracao) - llround(base * ligacao->fracao_antes);
+        }
+
+        Centavos investido = ligacao->num_filhos == 0 && ligacao->pai >= 0 ? totais[i] : 0;
+        nos[i] = criar_no(arvore, prototipo->nome, prototipo->tipo, prototipo->percentual_alvo, investido);
+        if(ligacao->pai >= 0) {
+            adicionar_filho(arvore, nos[ligacao->pai], nos[i]);
+        }
+    }
+
+    arvore->raiz = nos[0];
+    garantir_totais(arvore);
+
+    free(totais);
+    free(nos);
+    return arvore;
+}
+
+// Funcao para conferir se duas carteiras tem os mesmos nos, na mesma ordem e com os mesmos valores
+int carteiras_iguais(No* a, No* b) {
+    if(strcmp(a->nome, b->nome) != 0 || a->tipo != b->tipo || a->percentual_alvo != b->percentual_alvo ||
+       a->valor_investido != b->valor_investido || a->valor_total != b->valor_total || a->num_filhos != b->num_filhos) {
+        return 0;
+    }
+    for(int i = 0; i < a->num_filhos; i++) {
+        if(!carteiras_iguais(a->filhos[i], b->filhos[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Funcao para medir a criacao de muitas contas de um perfil: copia do modelo contra no a no
+void rodar_instanciar_perfis(int num_contas, const char* perfil) {
+    const ModeloPerfil* modelo = buscar_perfil(perfil);
+    if(modelo == NULL) {
+        printf("Perfil desconhecido: %s\n", perfil);
+        return;
+    }
+
+    // cada conta tem um valor diferente e e liberada logo depois de criada
+    double inicio = agora_segundos();
+    Centavos soma_copia = 0;
+    for(int i = 0; i < num_contas; i++) {
+        Arvore* carteira = instanciar_perfil(modelo, 100000 + (Centavos) i * 37);
+        soma_copia += carteira->valor_total;
+        liberar_arvore(carteira);
+    }
+    double segundos_copia = agora_segundos() - inicio;
+
+    inicio = agora_segundos();
+    Centavos soma_no_a_no = 0;
+    for(int i = 0; i < num_contas; i++) {
+        Arvore* carteira = montar_perfil_no_a_no(modelo, 100000 + (Centavos) i * 37);
+        soma_no_a_no += carteira->valor_total;
+        liberar_arvore(carteira);
+    }
+    double segundos_no_a_no = agora_segundos() - inicio;
+
+    int iguais = soma_copia == soma_no_a_no;
+    for(int i = 0; i < num_contas && i < 1000 && iguais; i++) {
+        Arvore* copia = instanciar_perfil(modelo, 100000 + (Centavos) i * 37);
+        Arvore* no_a_no = montar_perfil_no_a_no(modelo, 100000 + (Centavos) i * 37);
+        iguais = carteiras_iguais(copia->raiz, no_a_no->raiz);
+        liberar_arvore(copia);
+        liberar_arvore(no_a_no);
+    }
+
+    printf("\n========================================\n");
+    printf("CRIACAO DE CONTAS POR PERFIL\n");
+    printf("========================================\n");
+    printf("Perfil: %s (%d nos por carteira)\n", modelo->nome, modelo->num_nos);
+    printf("Contas: %d\n", num_contas);
+    printf("Copia do modelo: %.0f carteiras/s\n", segundos_copia > 0 ? num_contas / segundos_copia : 0.0);
+    printf("No a no: %.0f carteiras/s\n", segundos_no_a_no > 0 ? num_contas / segundos_no_a_no : 0.0);
+    printf("Carteiras iguais: %s\n", iguais ? "sim" : "NAO");
+    printf("========================================\n");
+}
+
+// Ticks gravados com um fdatasync por tick no --reaplicar (so para comparar com o commit em grupo)
+#define DIARIO_TICKS_SEM_GRUPO 2000
+
+// Funcao para gravar ticks de mercado em um diario novo (a carteira fica em *carteira)
+// Devolve o tempo gasto nos ticks; confirmacoes = quantos fdatasync foram feitos
+double gravar_ticks_diario(const char* caminho, int num_ticks, int grupo, Arvore** carteira,
+                           long long* confirmacoes) {
+    *carteira = NULL;
+    if(!diario_abrir(caminho, carteira, grupo)) {
+        return -1.0;
+    }
+
+    Centavos valor_inicial = reais_para_centavos(1000000.0);
+    *carteira = montar_carteira_perfil(valor_inicial, "MODERADO");
+    diario_registrar(DIARIO_CRIAR, 0, valor_inicial, 0.0, "MODERADO", NULL);
+
+    No* ativos[64];
+    int num_ativos = 0;
+    No* raiz = (*carteira)->raiz;
+    for(int i = 0; i < raiz->num_filhos; i++) {
+        for(int j = 0; j < raiz->filhos[i]->num_filhos && num_ativos < 64; j++) {
+            ativos[num_ativos++] = raiz->filhos[i]->filhos[j];
+        }
+    }
+
+    double inicio = agora_segundos();
+    for(int tick = 0; tick < num_ticks; tick++) {
+        unsigned long long bits = misturar_contador(20250701ULL, 0, tick, 0);
+        No* ativo = ativos[bits % num_ativos];
+        Centavos novo_valor = 100000 + (Centavos) ((bits >> 32) % 10000000);
+
+        alterar_valor_investido(*carteira, ativo, novo_valor);
+        diario_registrar(DIARIO_ATUALIZAR, 0, novo_valor, 0.0, ativo->nome, NULL);
+    }
+    diario_confirmar();
+    double segundos = agora_segundos() - inicio;
+
+    *confirmacoes = diario.confirmacoes;
+    diario_fechar();
+    return segundos;
+}
+
+// Funcao para medir o diario: grava ticks com commit em grupo (e alguns com um fdatasync por tick,
+// para comparar), reabre o diario e confere se a reaplicacao chega na mesma carteira
+void rodar_demo_diario(int num_ticks, int grupo) {
+    #ifdef _WIN32
+    (void) num_ticks;
+    (void) grupo;
+    printf("\nO diario de operacoes nao esta disponivel no Windows\n");
+    #else
+    if(num_ticks < 1) {
+        num_ticks = 1;
+    }
+    if(grupo < 1) {
+        grupo = DIARIO_GRUPO;
+    }
+
+    char caminho[256];
+    snprintf(caminho, sizeof(caminho), "/tmp/otimizador-%d.diario", (int) getpid());
+    unlink(caminho);
+
+    Arvore* carteira = NULL;
+    long long confirmacoes = 0;
+    int ticks_sem_grupo = num_ticks < DIARIO_TICKS_SEM_GRUPO ? num_ticks : DIARIO_TICKS_SEM_GRUPO;
+    double segundos_sem_grupo = gravar_ticks_diario(caminho, ticks_sem_grupo, 1, &carteira, &confirmacoes);
+    liberar_arvore(carteira);
+    unlink(caminho);
+
+    double segundos = gravar_ticks_diario(caminho, num_ticks, grupo, &carteira, &confirmacoes);
+    if(segundos_sem_grupo < 0 || segundos < 0) {
+        printf("\nNao foi possivel gravar o diario em %s\n", caminho);
+        liberar_arvore(carteira);
+        unlink(caminho);
+        return;
+    }
+
+    Arvore* reaplicada = NULL;
+    int aberto = diario_abrir(caminho, &reaplicada, grupo);
+    long long reaplicados = diario.reaplicados;
+    double segundos_reaplicar = diario.segundos_reaplicar;
+    diario_fechar();
+    unlink(caminho);
+
+    garantir_totais(carteira);
+    int iguais = aberto && reaplicada != NULL && carteira->valor_total == reaplicada->valor_total &&
+                 carteiras_iguais(carteira->raiz, reaplicada->raiz);
+
+    printf("\n========================================\n");
+    printf("   DIARIO DE OPERACOES\n");
+    printf("========================================\n");
+    printf("Ticks: %d (grupo de ate %d registros ou %d ms)\n", num_ticks, grupo, DIARIO_ESPERA_MS);
+    printf("Um fdatasync por tick: %.0f ticks/s (%d ticks)\n",
+           segundos_sem_grupo > 0 ? ticks_sem_grupo / segundos_sem_grupo : 0.0, ticks_sem_grupo);
+    printf("Commit em grupo: %.0f ticks/s (%lld fdatasync)\n", segundos > 0 ? num_ticks / segundos : 0.0,
+           confirmacoes);
+    printf("Reaplicacao: %.0f op/s (%lld operacoes em %.3f s)\n",
+           segundos_reaplicar > 0 ? reaplicados / segundos_reaplicar : 0.0, reaplicados, segundos_reaplicar);
+    printf("Carteira reaplicada igual: %s\n", iguais ? "sim" : "NAO");
+    printf("========================================\n");
+
+    liberar_arvore(reaplicada);
+    liberar_arvore(carteira);
+    #endif
+}
+
+// ========================================
+// ROTATIVIDADE DE ATIVOS (REMOCAO E COMPACTACAO)
+// ========================================
+
+// Passadas completas medidas depois da rotatividade (totais refeitos e buscas de todos os ativos)
+#define ROTATIVIDADE_PASSADAS 20
+
+// Funcao para trocar ativos da carteira: tira um ativo sorteado e poe um novo no mesmo grupo
+// Sem remocao real o ativo so fica zerado na arvore, como o remover fazia antes
+double girar_ativos(Arvore* arvore, char (*nomes)[64], int num_ativos, int num_trocas, int remocao_real,
+                    int* compactacoes) {
+    char nome_pai[64];
+    unsigned long long estado = 2685821657736338717ULL;
+
+    double inicio = agora_segundos();
+    for(int troca = 0; troca < num_trocas; troca++) {
+        estado = estado * 6364136223846793005ULL + 1442695040888963407ULL;
+        int sorteado = (int) ((estado >> 33) % num_ativos);
+        Centavos valor = 100000 + (Centavos) ((estado >> 17) % 10000000);
+
+        No* ativo = buscar_no(arvore, nomes[sorteado]);
+        double meta = ativo->percentual_alvo;
+        strcpy(nome_pai, ativo->pai->nome);
+
+        if(remocao_real) {
+            // a compactacao pode mudar os nos de lugar: o pai e buscado de novo pelo nome
+            No* raiz = arvore->raiz;
+            remover_no(arvore, ativo);
+            *compactacoes += arvore->raiz != raiz;
+        } else {
+            alterar_valor_investido(arvore, ativo, 0);
+        }
+
+        snprintf(nomes[sorteado], sizeof(nomes[sorteado]), "R%d", troca);
+        No* novo = criar_no(arvore, nomes[sorteado], ATIVO, meta, valor);
+        adicionar_filho(arvore, buscar_no(arvore, nome_pai), novo);
+        propagar_delta(arvore, novo, valor);
+    }
+    return agora_segundos() - inicio;
+}
+
+// Funcao para encolher a carteira: tira a segunda metade dos ativos vivos (e devolve quantos sobram)
+// E aqui que os slots livres se acumulam e a remocao real compacta a arvore
+int encolher_carteira(Arvore* arvore, char (*nomes)[64], int num_ativos, int remocao_real, int* compactacoes) {
+    int sobram = num_ativos / 2;
+
+    for(int i = sobram; i < num_ativos; i++) {
+        No* ativo = buscar_no(arvore, nomes[i]);
+        if(remocao_real) {
+            No* raiz = arvore->raiz;
+            remover_no(arvore, ativo);
+            *compactacoes += arvore->raiz != raiz;
+        } else {
+            alterar_valor_investido(arvore, ativo, 0);
+        }
+    }
+    return sobram;
+}
+
+// Funcao para medir as passadas completas: totais refeitos do zero e busca de todos os ativos vivos
+void medir_passadas_rotatividade(Arvore* arvore, char (*nomes)[64], int num_ativos,
+                                 double* segundos_totais, double* segundos_buscas) {
+    double inicio = agora_segundos();
+    for(int passada = 0; passada < ROTATIVIDADE_PASSADAS; passada++) {
+        arvore->totais_sujos = 1;
+        garantir_totais(arvore);
+    }
+    *segundos_totais = agora_segundos() - inicio;
+
+    long long encontrados = 0;
+    inicio = agora_segundos();
+    for(int passada = 0; passada < ROTATIVIDADE_PASSADAS; passada++) {
+        for(int i = 0; i < num_ativos; i++) {
+            encontrados += buscar_no(arvore, nomes[i]) != NULL;
+        }
+    }
+    *segundos_buscas = agora_segundos() - inicio;
+
+    if(encontrados != (long long) ROTATIVIDADE_PASSADAS * num_ativos) {
+        printf("Ativos perdidos na busca: %lld\n", (long long) ROTATIVIDADE_PASSADAS * num_ativos - encontrados);
+    }
+}
+
+// Funcao para comparar a remocao logica (ativo zerado fica na arvore) com a remocao real
+// (no desligado, slot reaproveitado e arvore compactada) na mesma sequencia de trocas,
+// seguida da saida de metade dos ativos
+void rodar_rotatividade(int num_trocas, int num_nos) {
+    if(num_nos < 3) {
+        num_nos = 3;
+    }
+    if(num_trocas < 1) {
+        num_trocas = 1;
+    }
+
+    const char* modos[] = { "Remocao logica", "Remocao real" };
+    int nos_arvore[2];
+    int nos_arena[2];
+    int livres[2];
+    Centavos totais[2];
+    double segundos_trocas[2];
+    double segundos_totais[2];
+    double segundos_buscas[2];
+    int compactacoes[2] = { 0, 0 };
+    int num_ativos = 0;
+    int vivos = 0;
+
+    for(int modo = 0; modo < 2; modo++) {
+        CarteiraSintetica sintetica = gerar_carteira_sintetica(num_nos, 3);
+        Arvore* arvore = sintetica.arvore;
+
+        char (*nomes)[64] = malloc(sintetica.num_nos * sizeof(*nomes));
+        num_ativos = 0;
+        for(int i = 0; i < sintetica.num_nos; i++) {
+            if(sintetica.nos[i]->num_filhos == 0) {
+                strcpy(nomes[num_ativos++], sintetica.nos[i]->nome);
+            }
+        }
+
+        segundos_trocas[modo] = girar_ativos(arvore, nomes, num_ativos, num_trocas, modo, &compactacoes[modo]);
+        vivos = encolher_carteira(arvore, nomes, num_ativos, modo, &compactacoes[modo]);
+        medir_passadas_rotatividade(arvore, nomes, vivos, &segundos_totais[modo], &segundos_buscas[modo]);
+
+        int internos = 0;
+        nos_arvore[modo] = 0;
+        contar_nos_alerta(arvore->raiz, &nos_arvore[modo], &internos);
+        nos_arena[modo] = arvore->arena.nos_em_uso;
+        livres[modo] = arvore->arena.num_livres;
+        totais[modo] = arvore->valor_total;
+
+        free(nomes);
+        liberar_carteira_sintetica(&sintetica);
+    }
+
+    printf("\n========================================\n");
+    printf("   ROTATIVIDADE DE ATIVOS\n");
+    printf("========================================\n");
+    printf("Carteira: %d nos (%d ativos), %d trocas de ativo, depois ficam %d ativos\n", num_nos, num_ativos,
+           num_trocas, vivos);
+    for(int modo = 0; modo < 2; modo++) {
+        printf("%s: %.0f trocas/s, %d compactacoes\n", modos[modo],
+               segundos_trocas[modo] > 0 ? num_trocas / segundos_trocas[modo] : 0.0, compactacoes[modo]);
+        printf("  Nos na arvore: %d (%d na arena, %d slots livres, %.1f MB de nos)\n", nos_arvore[modo],
+               nos_arena[modo], livres[modo], (nos_arena[modo] + livres[modo]) * sizeof(No) / (1024.0 * 1024.0));
+        printf("  Totais refeitos: %.2f ms por passada; buscas: %.0f por segundo\n",
+               segundos_totais[modo] * 1000.0 / ROTATIVIDADE_PASSADAS,
+               segundos_buscas[modo] > 0 ? (double) ROTATIVIDADE_PASSADAS * vivos / segundos_buscas[modo] : 0.0);
+    }
+    printf("Valor total igual nos dois modos: %s\n", totais[0] == totais[1] ? "sim" : "NAO");
+    printf("========================================\n");
+}
+
+// ========================================
+// SERVICO LOCAL (SOCKET UNIX)
+// ========================================
+
+#ifndef _WIN32
+
+// Ligado pelo SIGINT/SIGTERM; o laco de eventos confere a cada volta
+volatile sig_atomic_t servico_sinal = 0;
+
+void servico_tratar_sinal(int sinal) {
+    (void) sinal;
+    servico_sinal = 1;
+}
+
+// Funcao para colocar um descritor em modo nao bloqueante
+int servico_nao_bloqueante(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Funcao para pegar a carteira de uma conta (NULL se a conta nao existe ou ja foi liberada)
+Arvore* servico_conta(Servico* servico, int conta) {
+    if(conta < 0 || conta >= servico->contas.quantidade) {
+        return NULL;
+    }
+    return servico->contas.carteiras[conta];
+}
+
+// Funcao para acrescentar bytes na saida de uma conexao (o envio acontece uma vez por lote)
+void servico_escrever(ConexaoServico* conexao, const void* dados, size_t tamanho) {
+    if(conexao->tamanho_saida + tamanho > conexao->capacidade_saida) {
+        size_t capacidade = conexao->capacidade_saida;
+        while(capacidade < conexao->tamanho_saida + tamanho) {
+            capacidade *= 2;
+        }
+        conexao->saida = (char*) realloc(conexao->saida, capacidade);
+        conexao->capacidade_saida = capacidade;
+    }
+
+    memcpy(conexao->saida + conexao->tamanho_saida, dados, tamanho);
+    conexao->tamanho_saida += tamanho;
+}
+
+// Funcao para executar um pedido e escrever a resposta na saida da conexao
+// Os itens (desvios ou ordens) vao direto para a saida; cabecalho e resposta sao preenchidos no fim
+void servico_executar(Servico* servico, ConexaoServico* conexao, const CabecalhoServico* cabecalho,
+                      const PedidoServico* pedido) {
+    CabecalhoServico volta = *cabecalho;
+    RespostaServico resposta;
+    memset(&resposta, 0, sizeof(resposta));
+    volta.situacao = SERVICO_OK;
+
+    size_t inicio = conexao->tamanho_saida;
+    servico_escrever(conexao, &volta, sizeof(volta));
+    servico_escrever(conexao, &resposta, sizeof(resposta));
+
+    Arvore* arvore = servico_conta(servico, cabecalho->conta);
+    int precisa_conta = cabecalho->operacao >= SERVICO_ATUALIZAR && cabecalho->operacao <= SERVICO_REBALANCEAR;
+    precisa_conta = precisa_conta || cabecalho->operacao == SERVICO_LIBERAR;
+
+    // os limites de valor comparam com o total de agora (precos podem ter mudado)
+    if(arvore != NULL) {
+        garantir_totais(arvore);
+    }
+
+    if(precisa_conta && arvore == NULL) {
+        volta.situacao = SERVICO_CONTA_INVALIDA;
+    }
+    else if(cabecalho->operacao == SERVICO_CRIAR) {
+        if(pedido->valor <= 0 || pedido->valor > SERVICO_VALOR_MAXIMO) {
+            volta.situacao = SERVICO_PEDIDO_INVALIDO;
+        } else {
+            arvore = montar_carteira_perfil(pedido->valor, pedido->nome[0] != '\0' ? pedido->nome : "MODERADO");
+            volta.conta = motor_adicionar(&servico->contas, arvore);
+            garantir_totais(arvore);
+            resposta.valor_total = arvore->valor_total;
+        }
+    }
+    else if(cabecalho->operacao == SERVICO_ATUALIZAR) {
+        No* ativo = buscar_no(arvore, pedido->nome);
+        if(ativo == NULL || ativo->tipo != ATIVO) {
+            volta.situacao = SERVICO_NAO_ENCONTRADO;
+        } else if(pedido->valor < 0 || pedido->valor > SERVICO_VALOR_MAXIMO ||
+                  arvore->valor_total - ativo->valor_investido > SERVICO_VALOR_MAXIMO - pedido->valor) {
+            volta.situacao = SERVICO_PEDIDO_INVALIDO;
+        } else {
+            alterar_valor_investido(arvore, ativo, pedido->valor);
+            garantir_totais(arvore);
+            resposta.valor_total = arvore->valor_total;
+        }
+    }
+    else if(cabecalho->operacao == SERVICO_APORTE &&
+            (pedido->valor <= 0 || pedido->valor > SERVICO_VALOR_MAXIMO - arvore->valor_total)) {
+        volta.situacao = SERVICO_PEDIDO_INVALIDO;
+    }
+    else if(cabecalho->operacao == SERVICO_APORTE) {
+        ResultadoAporte aporte = calcular_aporte(arvore, pedido->valor,
+                                                 pedido->modo == 1 ? APORTE_NIVELADO : APORTE_PROPORCIONAL);
+        if(aporte.erro != RELATORIO_OK) {
+            volta.situacao = SERVICO_PEDIDO_INVALIDO;
+        } else {
+            resposta.valor_total = aporte.valor_total_novo;
+            resposta.fora_da_tolerancia = aporte.depois.fora_da_tolerancia;
+        }
+        liberar_resultado_aporte(&aporte);
+    }
+    else if(cabecalho->operacao == SERVICO_DETECTAR) {
+        ResultadoBalanceamento resultado = calcular_desbalanceamento(arvore,
+                                                                     pedido->tolerancia > 0.0 ? pedido->tolerancia : 2.0);
+        if(resultado.erro != RELATORIO_OK) {
+            volta.situacao = SERVICO_PEDIDO_INVALIDO;
+        } else {
+            resposta.valor_total = resultado.valor_total;
+            resposta.fora_da_tolerancia = resultado.fora_da_tolerancia;
+            resposta.quantidade = resultado.num_categorias;
+            for(int i = 0; i < resultado.num_categorias; i++) {
+                DesvioServico desvio;
+                memcpy(desvio.nome, resultado.categorias[i].categoria->nome, sizeof(desvio.nome));
+                desvio.meta = resultado.categorias[i].meta;
+                desvio.atual = resultado.categorias[i].atual;
+                desvio.diferenca = resultado.categorias[i].diferenca;
+                servico_escrever(conexao, &desvio, sizeof(desvio));
+            }
+        }
+        liberar_resultado_balanceamento(&resultado);
+    }
+    else if(cabecalho->operacao == SERVICO_REBALANCEAR) {
+        // modo 1 executa as ordens; senao so devolve o plano
+        PlanoRebalanceamento plano = planejar_rebalanceamento(arvore,
+                                                              pedido->tolerancia > 0.0 ? pedido->tolerancia : 2.0);
+        resposta.quantidade = plano.num_ordens;
+        for(int i = 0; i < plano.num_ordens; i++) {
+            OrdemServico ordem;
+            memcpy(ordem.ativo, plano.ordens[i].ativo->nome, sizeof(ordem.ativo));
+            ordem.valor_atual = plano.ordens[i].valor_atual;
+            ordem.quantia = plano.ordens[i].quantia;
+            servico_escrever(conexao, &ordem, sizeof(ordem));
+        }
+        if(pedido->modo == 1) {
+            aplicar_plano_rebalanceamento(arvore, &plano);
+        }
+        garantir_totais(arvore);
+        resposta.valor_total = arvore->valor_total;
+        liberar_plano(&plano);
+    }
+    else if(cabecalho->operacao == SERVICO_PRECO) {
+        if(pedido->nome[0] == '\0' || pedido->valor <= 0 || pedido->valor > SERVICO_VALOR_MAXIMO) {
+            volta.situacao = SERVICO_PEDIDO_INVALIDO;
+        } else {
+            atualizar_preco(pedido->nome, pedido->valor);
+            resposta.valor_total = pedido->valor;
+        }
+    }
+    else if(cabecalho->operacao == SERVICO_LIBERAR) {
+        liberar_arvore(arvore);
+        servico->contas.carteiras[cabecalho->conta] = NULL;
+    }
+    else if(cabecalho->operacao == SERVICO_ENCERRAR) {
+        servico->encerrar = 1;
+    }
+    else {
+        volta.situacao = SERVICO_PEDIDO_INVALIDO;
+    }
+
+    // itens so valem com situacao OK (nenhum caminho de erro escreve itens)
+    if(volta.situacao != SERVICO_OK) {
+        resposta.quantidade = 0;
+    }
+    volta.tamanho = (unsigned int) (conexao->tamanho_saida - inicio - sizeof(volta));
+    memcpy(conexao->saida + inicio, &volta, sizeof(volta));
+    memcpy(conexao->saida + inicio + sizeof(volta), &resposta, sizeof(resposta));
+}
+
+// Funcao para mandar o que estiver pendente na saida (para quando o socket enche)
+// Devolve 0 se a conexao caiu
+int servico_enviar(ConexaoServico* conexao) {
+    while(conexao->enviado < conexao->tamanho_saida) {
+        ssize_t enviados = send(conexao->fd, conexao->saida + conexao->enviado,
+                                conexao->tamanho_saida - conexao->enviado, MSG_NOSIGNAL);
+        if(enviados > 0) {
+            conexao->enviado += enviados;
+        } else if(enviados < 0 && errno == EINTR) {
+            continue;
+        } else if(enviados < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 1;
+        } else {
+            return 0;
+        }
+    }
+
+    conexao->tamanho_saida = 0;
+    conexao->enviado = 0;
+    return 1;
+}
+
+// Funcao para ler tudo o que chegou e executar todos os pedidos completos como um lote
+// Devolve 0 se a conexao deve ser fechada (cliente saiu ou mandou um pedido invalido)
+int servico_ler(Servico* servico, ConexaoServico* conexao) {
+    int aberta = 1;
+    while(conexao->tamanho_entrada < SERVICO_BUFFER) {
+        ssize_t lidos = recv(conexao->fd, conexao->entrada + conexao->tamanho_entrada,
+                             SERVICO_BUFFER - conexao->tamanho_entrada, 0);
+        if(lidos > 0) {
+            conexao->tamanho_entrada += lidos;
+            continue;
+        }
+        if(lidos < 0 && errno == EINTR) {
+            continue;
+        }
+        if(lidos == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            aberta = 0;
+        }
+        break;
+    }
+
+    size_t usado = 0;
+    long long lote = 0;
+    while(conexao->tamanho_entrada - usado >= sizeof(CabecalhoServico)) {
+        CabecalhoServico cabecalho;
+        memcpy(&cabecalho, conexao->entrada + usado, sizeof(cabecalho));
+        if(cabecalho.tamanho > SERVICO_MAX_CORPO) {
+            aberta = 0;
+            break;
+        }
+        if(conexao->tamanho_entrada - usado - sizeof(cabecalho) < cabecalho.tamanho) {
+            break;
+        }
+
+        // corpo menor que o PedidoServico (clientes antigos) fica completado com zeros
+        PedidoServico pedido;
+        memset(&pedido, 0, sizeof(pedido));
+        memcpy(&pedido, conexao->entrada + usado + sizeof(cabecalho),
+               cabecalho.tamanho < sizeof(pedido) ? cabecalho.tamanho : sizeof(pedido));
+        pedido.nome[63] = '\0';
+
+        servico_executar(servico, conexao, &cabecalho, &pedido);
+        usado += sizeof(cabecalho) + cabecalho.tamanho;
+        lote++;
+    }
+
+    memmove(conexao->entrada, conexao->entrada + usado, conexao->tamanho_entrada - usado);
+    conexao->tamanho_entrada -= usado;
+
+    if(lote > 0) {
+        servico->pedidos += lote;
+        servico->lotes++;
+        if(lote > servico->maior_lote) {
+            servico->maior_lote = lote;
+        }
+    }
+
+    return servico_enviar(conexao) && aberta;
+}
+
+// Funcao para aceitar todos os clientes que estao esperando
+void servico_aceitar(Servico* servico) {
+    while(1) {
+        int fd = accept(servico->fd_escuta, NULL, NULL);
+        if(fd < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        if(servico->num_conexoes == SERVICO_MAX_CONEXOES || !servico_nao_bloqueante(fd)) {
+            close(fd);
+            continue;
+        }
+
+        ConexaoServico* conexao = (ConexaoServico*) calloc(1, sizeof(ConexaoServico));
+        conexao->fd = fd;
+        conexao->entrada = (char*) malloc(SERVICO_BUFFER);
+        conexao->capacidade_saida = SERVICO_BUFFER;
+        conexao->saida = (char*) malloc(conexao->capacidade_saida);
+        servico->conexoes[servico->num_conexoes++] = conexao;
+
+        #ifdef __linux__
+        if(servico->fd_epoll >= 0) {
+            struct epoll_event evento;
+            evento.events = EPOLLIN;
+            evento.data.ptr = conexao;
+            epoll_ctl(servico->fd_epoll, EPOLL_CTL_ADD, fd, &evento);
+        }
+        #endif
+    }
+}
+
+// Funcao para fechar uma conexao (a ultima da lista ocupa o lugar dela)
+void servico_fechar(Servico* servico, ConexaoServico* conexao) {
+    for(int i = 0; i < servico->num_conexoes; i++) {
+        if(servico->conexoes[i] == conexao) {
+            servico->conexoes[i] = servico->conexoes[--servico->num_conexoes];
+            break;
+        }
+    }
+
+    close(conexao->fd);
+    free(conexao->entrada);
+    free(conexao->saida);
+    free(conexao);
+}
+
+// Funcao para tratar um evento de uma conexao e atualizar o que ela espera
+void servico_atender(Servico* servico, ConexaoServico* conexao, int pode_ler, int pode_escrever, int erro) {
+    int aberta = !erro;
+    if(aberta && pode_escrever) {
+        aberta = servico_enviar(conexao);
+    }
+    if(aberta && pode_ler && conexao->tamanho_saida == 0) {
+        aberta = servico_ler(servico, conexao);
+    }
+
+    if(!aberta) {
+        servico_fechar(servico, conexao);
+        return;
+    }
+
+    #ifdef __linux__
+    if(servico->fd_epoll >= 0) {
+        struct epoll_event evento;
+        // com resposta pendente so a escrita (o cliente nao manda mais nada ate ler), senao a leitura
+        evento.events = conexao->tamanho_saida > 0 ? EPOLLOUT : EPOLLIN;
+        evento.data.ptr = conexao;
+        epoll_ctl(servico->fd_epoll, EPOLL_CTL_MOD, conexao->fd, &evento);
+    }
+    #endif
+}
+
+#ifdef __linux__
+// Laco de eventos com epoll (um ponteiro de conexao por evento; o socket de escuta tem ptr NULL)
+void servico_laco_epoll(Servico* servico) {
+    struct epoll_event eventos[64];
+    struct epoll_event evento;
+    evento.events = EPOLLIN;
+    evento.data.ptr = NULL;
+    epoll_ctl(servico->fd_epoll, EPOLL_CTL_ADD, servico->fd_escuta, &evento);
+
+    while(!servico->encerrar && !servico_sinal) {
+        int prontos = epoll_wait(servico->fd_epoll, eventos, 64, -1);
+        for(int i = 0; i < prontos && !servico->encerrar; i++) {
+            if(eventos[i].data.ptr == NULL) {
+                servico_aceitar(servico);
+                continue;
+            }
+            unsigned int bits = eventos[i].events;
+            servico_atender(servico, (ConexaoServico*) eventos[i].data.ptr, (bits & (EPOLLIN | EPOLLHUP)) != 0,
+                            (bits & EPOLLOUT) != 0, (bits & EPOLLERR) != 0);
+        }
+    }
+}
+#endif
+
+// Laco de eventos com poll (outros unix, ou ./Main --servico <socket> poll)
+void servico_laco_poll(Servico* servico) {
+    struct pollfd fds[SERVICO_MAX_CONEXOES + 1];
+    ConexaoServico* donos[SERVICO_MAX_CONEXOES + 1];
+
+    while(!servico->encerrar && !servico_sinal) {
+        int n = 0;
+        fds[n].fd = servico->fd_escuta;
+        fds[n].events = POLLIN;
+        donos[n++] = NULL;
+        for(int i = 0; i < servico->num_conexoes; i++) {
+            fds[n].fd = servico->conexoes[i]->fd;
+            fds[n].events = servico->conexoes[i]->tamanho_saida > 0 ? POLLOUT : POLLIN;
+            donos[n++] = servico->conexoes[i];
+        }
+
+        if(poll(fds, n, -1) <= 0) {
+            continue;
+        }
+
+        // as conexoes ficaram guardadas em donos: fechar uma no meio nao bagunca o resto
+        for(int i = 1; i < n && !servico->encerrar; i++) {
+            short bits = fds[i].revents;
+            if(bits == 0) {
+                continue;
+            }
+            servico_atender(servico, donos[i], (bits & (POLLIN | POLLHUP)) != 0, (bits & POLLOUT) != 0,
+                            (bits & (POLLERR | POLLNVAL)) != 0);
+        }
+        if(fds[0].revents & POLLIN) {
+            servico_aceitar(servico);
+        }
+    }
+}
+
+// Funcao para abrir o socket de escuta (um socket velho no mesmo caminho e apagado, outro arquivo nao)
+int servico_abrir_socket(const char* caminho) {
+    struct sockaddr_un endereco;
+    memset(&endereco, 0, sizeof(endereco));
+    endereco.sun_family = AF_UNIX;
+    if(strlen(caminho) >= sizeof(endereco.sun_path)) {
+        printf("\nCaminho do socket muito longo: %s\n", caminho);
+        return -1;
+    }
+    strcpy(endereco.sun_path, caminho);
+
+    struct stat info;
+    if(stat(caminho, &info) == 0) {
+        if(!S_ISSOCK(info.st_mode)) {
+            printf("\n%s ja existe e nao e um socket\n", caminho);
+            return -1;
+        }
+        unlink(caminho);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) {
+        printf("\nNao foi possivel criar o socket: %s\n", strerror(errno));
+        return -1;
+    }
+    if(bind(fd, (struct sockaddr*) &endereco, sizeof(endereco)) < 0 || listen(fd, 64) < 0
+       || !servico_nao_bloqueante(fd)) {
+        printf("\nNao foi possivel ouvir em %s: %s\n", caminho, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+#endif
+
+// Funcao para rodar o servico local ate receber SERVICO_ENCERRAR, SIGINT ou SIGTERM
+// Cada conta e uma carteira do motor; os pedidos que chegam juntos sao executados em lote
+// e as respostas saem em um unico send
+int rodar_servico(const char* caminho, int usar_poll) {
+    #ifdef _WIN32
+    (void) caminho;
+    (void) usar_poll;
+    printf("\nO servico local usa sockets Unix e nao esta disponivel no Windows\n");
+    return 1;
+    #else
+    Servico servico;
+    memset(&servico, 0, sizeof(servico));
+    servico.fd_epoll = -1;
+
+    servico.fd_escuta = servico_abrir_socket(caminho);
+    if(servico.fd_escuta < 0) {
+        return 1;
+    }
+
+    // sem SA_RESTART: o sinal acorda o epoll_wait/poll e o laco termina
+    struct sigaction acao;
+    memset(&acao, 0, sizeof(acao));
+    acao.sa_handler = servico_tratar_sinal;
+    sigemptyset(&acao.sa_mask);
+    sigaction(SIGINT, &acao, NULL);
+    sigaction(SIGTERM, &acao, NULL);
+
+    motor_iniciar(&servico.contas, 64);
+
+    #ifdef __linux__
+    if(!usar_poll) {
+        servico.fd_epoll = epoll_create1(0);
+    }
+    #endif
+
+    printf("Servico ouvindo em %s (%s)\n", caminho, servico.fd_epoll >= 0 ? "epoll" : "poll");
+    fflush(stdout);
+
+    double inicio = agora_segundos();
+    #ifdef __linux__
+    if(servico.fd_epoll >= 0) {
+        servico_laco_epoll(&servico);
+    } else {
+        servico_laco_poll(&servico);
+    }
+    #else
+    servico_laco_poll(&servico);
+    #endif
+    double segundos = agora_segundos() - inicio;
+
+    // a resposta do SERVICO_ENCERRAR sai antes de fechar
+    while(servico.num_conexoes > 0) {
+        servico_enviar(servico.conexoes[0]);
+        servico_fechar(&servico, servico.conexoes[0]);
+    }
+    if(servico.fd_epoll >= 0) {
+        close(servico.fd_epoll);
+    }
+    close(servico.fd_escuta);
+    unlink(caminho);
+
+    printf("\n========================================\n");
+    printf("   SERVICO ENCERRADO\n");
+    printf("========================================\n");
+    printf("Contas abertas: %d\n", servico.contas.quantidade);
+    printf("Pedidos: %lld em %lld lotes\n", servico.pedidos, servico.lotes);
+    printf("Pedidos por lote: %.1f (maior lote: %lld)\n",
+           servico.lotes > 0 ? (double) servico.pedidos / servico.lotes : 0.0, servico.maior_lote);
+    printf("Tempo: %.3f s\n", segundos);
+    printf("========================================\n");
+
+    motor_liberar(&servico.contas);
+    liberar_tabela_precos();
+    return 0;
+    #endif
+}
+
+#ifndef _WIN32
+
+// Funcao para mandar um buffer inteiro pelo socket (o cliente usa socket bloqueante)
+int cliente_enviar_tudo(int fd, const char* dados, size_t tamanho) {
+    while(tamanho > 0) {
+        ssize_t enviados = send(fd, dados, tamanho, MSG_NOSIGNAL);
+        if(enviados < 0 && errno == EINTR) {
+            continue;
+        }
+        if(enviados <= 0) {
+            return 0;
+        }
+        dados += enviados;
+        tamanho -= enviados;
+    }
+    return 1;
+}
+
+// Funcao para escrever um pedido em destino; devolve quantos bytes ocupou
+size_t cliente_montar_pedido(char* destino, unsigned int id, int operacao, int conta, Centavos valor,
+                             double tolerancia, int modo, const char* nome) {
+    CabecalhoServico cabecalho;
+    PedidoServico pedido;
+    memset(&cabecalho, 0, sizeof(cabecalho));
+    memset(&pedido, 0, sizeof(pedido));
+
+    cabecalho.tamanho = sizeof(pedido);
+    cabecalho.id = id;
+    cabecalho.operacao = (unsigned short) operacao;
+    cabecalho.conta = conta;
+    pedido.valor = valor;
+    pedido.tolerancia = tolerancia;
+    pedido.modo = modo;
+    if(nome != NULL) {
+        strncpy(pedido.nome, nome, 63);
+    }
+
+    memcpy(destino, &cabecalho, sizeof(cabecalho));
+    memcpy(destino + sizeof(cabecalho), &pedido, sizeof(pedido));
+    return sizeof(cabecalho) + sizeof(pedido);
+}
+
+// Funcao para pegar a proxima resposta (os itens sao pulados)
+// Devolve 1 com a resposta, 0 se nao ha resposta completa e bloquear == 0, ou -1 se a conexao caiu
+int cliente_receber(ClienteServico* cliente, int bloquear, CabecalhoServico* cabecalho, RespostaServico* resposta) {
+    while(1) {
+        size_t disponivel = cliente->fim - cliente->inicio;
+        if(disponivel >= sizeof(CabecalhoServico)) {
+            memcpy(cabecalho, cliente->entrada + cliente->inicio, sizeof(CabecalhoServico));
+            size_t total = sizeof(CabecalhoServico) + cabecalho->tamanho;
+            if(total > SERVICO_BUFFER) {
+                return -1;
+            }
+            if(disponivel >= total) {
+                memset(resposta, 0, sizeof(RespostaServico));
+                memcpy(resposta, cliente->entrada + cliente->inicio + sizeof(CabecalhoServico),
+                       cabecalho->tamanho < sizeof(RespostaServico) ? cabecalho->tamanho : sizeof(RespostaServico));
+                cliente->inicio += total;
+                return 1;
+            }
+        }
+        if(!bloquear) {
+            return 0;
+        }
+
+        // resposta incompleta vai para o comeco do buffer antes de ler mais
+        memmove(cliente->entrada, cliente->entrada + cliente->inicio, disponivel);
+        cliente->inicio = 0;
+        cliente->fim = disponivel;
+
+        ssize_t lidos = recv(cliente->fd, cliente->entrada + cliente->fim, SERVICO_BUFFER - cliente->fim, 0);
+        if(lidos < 0 && errno == EINTR) {
+            continue;
+        }
+        if(lidos <= 0) {
+            return -1;
+        }
+        cliente->fim += lidos;
+    }
+}
+
+#endif
+
+// Funcao para medir o servico de fora: abre as contas e manda uma mistura de deteccoes,
+// atualizacoes e planos de rebalanceamento com ate janela pedidos em voo (pipeline)
+void rodar_cliente_servico(const char* caminho, int num_pedidos, int num_contas, int janela, int encerrar) {
+    #ifdef _WIN32
+    (void) caminho;
+    (void) num_pedidos;
+    (void) num_contas;
+    (void) janela;
+    (void) encerrar;
+    printf("\nO servico local usa sockets Unix e nao esta disponivel no Windows\n");
+    #else
+    if(num_pedidos < 0) {
+        num_pedidos = 0;
+    }
+    if(num_contas < 1) {
+        num_contas = 1;
+    }
+    if(janela < 1) {
+        janela = 1;
+    }
+    if(janela > 1024) {
+        janela = 1024;
+    }
 
-        printf("* %s (%.0f%%): + R$ %.2f\n",
-               renda_fixa->nome, renda_fixa->percentual_alvo, valor_rf);
-        printf("  Novo total: R$ %.2f -> R$ %.2f\n\n",
-               renda_fixa->valor_total, renda_fixa->valor_total + valor_rf);
+    struct sockaddr_un endereco;
+    memset(&endereco, 0, sizeof(endereco));
+    endereco.sun_family = AF_UNIX;
+    strncpy(endereco.sun_path, caminho, sizeof(endereco.sun_path) - 1);
 
-        if(renda_fixa->esquerda != NULL && renda_fixa->esquerda->tipo == ATIVO) {
-            renda_fixa->esquerda->valor_investido += valor_rf / 2;
-        }
-        if(renda_fixa->direita != NULL && renda_fixa->direita->tipo == ATIVO) {
-            renda_fixa->direita->valor_investido += valor_rf / 2;
+    ClienteServico cliente;
+    memset(&cliente, 0, sizeof(cliente));
+    cliente.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(cliente.fd < 0 || connect(cliente.fd, (struct sockaddr*) &endereco, sizeof(endereco)) < 0) {
+        printf("\nNao foi possivel conectar em %s: %s\n", caminho, strerror(errno));
+        if(cliente.fd >= 0) {
+            close(cliente.fd);
         }
+        return;
     }
+    cliente.entrada = (char*) malloc(SERVICO_BUFFER);
 
-    if(arvore->raiz->direita != NULL) {
-        No* acoes = arvore->raiz->direita;
-        float valor_rv = valor_aporte * (acoes->percentual_alvo / 100.0);
+    char* lote = (char*) malloc(janela * (sizeof(CabecalhoServico) + sizeof(PedidoServico)));
+    int* contas = (int*) malloc(num_contas * sizeof(int));
+    long long* envio = (long long*) malloc((num_pedidos + 1) * sizeof(long long));
+    double* latencias = (double*) malloc((num_pedidos + 1) * sizeof(double));
+    const char* perfis[3] = {"CONSERVADOR", "MODERADO", "ARROJADO"};
+    CabecalhoServico cabecalho;
+    RespostaServico resposta;
+    int erros = 0;
+    int caiu = 0;
 
-        printf("* %s (%.0f%%): + R$ %.2f\n",
-               acoes->nome, acoes->percentual_alvo, valor_rv);
-        printf("  Novo total: R$ %.2f -> R$ %.2f\n\n",
-               acoes->valor_total, acoes->valor_total + valor_rv);
-
-        if(acoes->esquerda != NULL && acoes->esquerda->tipo == ATIVO) {
-            acoes->esquerda->valor_investido += valor_rv / 2;
+    // contas abertas em lotes do tamanho da janela
+    for(int i = 0; i < num_contas && !caiu; i += janela) {
+        int n = num_contas - i < janela ? num_contas - i : janela;
+        size_t tamanho = 0;
+        for(int j = 0; j < n; j++) {
+            tamanho += cliente_montar_pedido(lote + tamanho, i + j, SERVICO_CRIAR, 0,
+                                             1000000 + (Centavos) ((i + j) % 1000) * 10000, 0.0, 0, perfis[(i + j) % 3]);
         }
-        if(acoes->direita != NULL && acoes->direita->tipo == ATIVO) {
-            acoes->direita->valor_investido += valor_rv / 2;
+        caiu = !cliente_enviar_tudo(cliente.fd, lote, tamanho);
+        for(int j = 0; j < n && !caiu; j++) {
+            caiu = cliente_receber(&cliente, 1, &cabecalho, &resposta) < 0;
+            if(!caiu && cabecalho.id < (unsigned int) num_contas) {
+                contas[cabecalho.id] = cabecalho.conta;
+                erros += cabecalho.situacao != SERVICO_OK;
+            }
         }
     }
 
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
-
-    printf("========================================\n");
-    printf("Novo valor total da carteira: R$ %.2f\n", arvore->valor_total);
-    printf("Carteira atualizada com aporte!\n");
-    printf("========================================\n");
-}
-
-void atualizar_valores_mercado(Arvore* arvore, char* nome_ativo, float novo_valor) {
-    if(arvore == NULL || arvore->raiz == NULL) {
-        printf("\nCarteira vazia!\n");
-        return;
-    }
-
-    No* ativo = buscar_no(arvore->raiz, nome_ativo);
+    // janela deslizante: completa a janela, envia de uma vez e consome as respostas que ja chegaram
+    int enviados = 0;
+    int recebidos = 0;
+    double inicio = agora_segundos();
+    while(recebidos < num_pedidos && !caiu) {
+        size_t tamanho = 0;
+        int primeiro = enviados;
+        while(enviados < num_pedidos && enviados - recebidos < janela) {
+            int i = enviados++;
+            unsigned long long bits = misturar_contador(20250601ULL, 0, i, 0);
+            int conta = contas[bits % num_contas];
 
-    if(ativo == NULL) {
-        printf("\nAtivo nao encontrado!\n");
-        return;
-    }
+            if(i % 4 == 3) {
+                tamanho += cliente_montar_pedido(lote + tamanho, i, SERVICO_ATUALIZAR, conta,
+                                                 100000 + (Centavos) ((bits >> 32) % 1000000), 0.0, 0, "PETR4");
+            } else if(i % 16 == 14) {
+                tamanho += cliente_montar_pedido(lote + tamanho, i, SERVICO_REBALANCEAR, conta, 0, 2.0, 0, NULL);
+            } else {
+                tamanho += cliente_montar_pedido(lote + tamanho, i, SERVICO_DETECTAR, conta, 0, 2.0, 0, NULL);
+            }
+        }
+        if(tamanho > 0) {
+            long long agora = agora_ns();
+            for(int i = primeiro; i < enviados; i++) {
+                envio[i] = agora;
+            }
+            caiu = !cliente_enviar_tudo(cliente.fd, lote, tamanho);
+        }
 
-    if(ativo->tipo != ATIVO) {
-        printf("\nNao e um ativo!\n");
-        return;
+        int bloquear = 1;
+        while(!caiu && recebidos < enviados) {
+            int situacao = cliente_receber(&cliente, bloquear, &cabecalho, &resposta);
+            if(situacao <= 0) {
+                caiu = situacao < 0;
+                break;
+            }
+            if(cabecalho.id < (unsigned int) num_pedidos) {
+                latencias[recebidos] = (agora_ns() - envio[cabecalho.id]) / 1000.0;
+            }
+            erros += cabecalho.situacao != SERVICO_OK;
+            recebidos++;
+            bloquear = 0;
+        }
     }
+    double segundos = agora_segundos() - inicio;
 
-    float valor_anterior = ativo->valor_investido;
-    float variacao = 0.0;
-    if(valor_anterior != 0.0) {
-        variacao = ((novo_valor - valor_anterior) / valor_anterior) * 100.0;
+    if(encerrar && !caiu) {
+        size_t tamanho = cliente_montar_pedido(lote, 0, SERVICO_ENCERRAR, 0, 0, 0.0, 0, NULL);
+        if(cliente_enviar_tudo(cliente.fd, lote, tamanho)) {
+            cliente_receber(&cliente, 1, &cabecalho, &resposta);
+        }
     }
+    close(cliente.fd);
 
-    ativo->valor_investido = novo_valor;
-
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
+    qsort(latencias, recebidos, sizeof(double), comparar_double);
 
     printf("\n========================================\n");
-    printf("ATUALIZACAO DE MERCADO\n");
+    printf("   CLIENTE DO SERVICO LOCAL\n");
     printf("========================================\n");
-    printf("Ativo: %s\n", nome_ativo);
-    printf("Valor anterior: R$ %.2f\n", valor_anterior);
-    printf("Novo valor: R$ %.2f\n", novo_valor);
-    printf("Variacao: %+.2f%%\n", variacao);
+    printf("Contas: %d\n", num_contas);
+    printf("Pedidos: %d de %d (janela de %d)\n", recebidos, num_pedidos, janela);
+    printf("Erros: %d%s\n", erros, caiu ? " (conexao caiu)" : "");
+    printf("Tempo: %.3f s\n", segundos);
+    printf("Vazao: %.0f pedidos/s\n", segundos > 0 ? recebidos / segundos : 0.0);
+    printf("Latencia p50: %.1f us\n", percentil(latencias, recebidos, 50.0));
+    printf("Latencia p99: %.1f us\n", percentil(latencias, recebidos, 99.0));
+    printf("Latencia maxima: %.1f us\n", recebidos > 0 ? latencias[recebidos - 1] : 0.0);
     printf("========================================\n");
-    printf("\nDica: Use detectar_desbalanceamento() para verificar.\n");
+
+    free(latencias);
+    free(envio);
+    free(contas);
+    free(lote);
+    free(cliente.entrada);
+    #endif
 }
 
 // ========================================
@@ -515,7 +7591,7 @@ void pausar() {
 
 void menu_principal(Arvore** carteira) {
     int opcao;
-    float valor;
+    double valor;
     char nome[64];
     int escolha;
 
@@ -533,6 +7609,10 @@ void menu_principal(Arvore** carteira) {
         printf("6. Detectar desbalanceamento\n");
         printf("7. Sugerir rebalanceamento\n");
         printf("8. Simular aporte\n");
+        printf("9. Adicionar ativo\n");
+        printf("10. Salvar carteira\n");
+        printf("11. Carregar carteira\n");
+        printf("12. Estatisticas\n");
         printf("0. Sair\n");
         printf("========================================\n");
         printf("Escolha uma opcao: ");
@@ -546,7 +7626,7 @@ void menu_principal(Arvore** carteira) {
             }
 
             printf("\nQual o valor inicial da carteira? R$ ");
-            scanf("%f", &valor);
+            scanf("%lf", &valor);
 
             printf("\nEscolha o perfil da carteira:\n");
             printf("1. CONSERVADOR (70%% Renda Fixa, 30%% Acoes)\n");
@@ -555,16 +7635,18 @@ void menu_principal(Arvore** carteira) {
             printf("Opcao: ");
             scanf("%d", &escolha);
 
+            ESTATISTICA_INICIO(inicio);
             if(escolha == 1) {
-                *carteira = criar_carteira_perfil(valor, "CONSERVADOR");
+                *carteira = criar_carteira_perfil(reais_para_centavos(valor), "CONSERVADOR");
             } else if(escolha == 2) {
-                *carteira = criar_carteira_perfil(valor, "MODERADO");
+                *carteira = criar_carteira_perfil(reais_para_centavos(valor), "MODERADO");
             } else if(escolha == 3) {
-                *carteira = criar_carteira_perfil(valor, "ARROJADO");
+                *carteira = criar_carteira_perfil(reais_para_centavos(valor), "ARROJADO");
             } else {
                 printf("\nOpcao invalida! Usando MODERADO...\n");
-                *carteira = criar_carteira_perfil(valor, "MODERADO");
+                *carteira = criar_carteira_perfil(reais_para_centavos(valor), "MODERADO");
             }
+            ESTATISTICA_FIM(OPERACAO_CRIAR, inicio);
 
             pausar();
         }
@@ -572,7 +7654,9 @@ void menu_principal(Arvore** carteira) {
             if(*carteira == NULL) {
                 printf("\nCrie uma carteira primeiro! (opcao 1)\n");
             } else {
+                ESTATISTICA_INICIO(inicio);
                 atualizar_percentuais(*carteira);
+                ESTATISTICA_FIM(OPERACAO_PERCENTUAIS, inicio);
             }
             pausar();
         }
@@ -586,6 +7670,7 @@ void menu_principal(Arvore** carteira) {
                 printf("Opcao: ");
                 scanf("%d", &escolha);
 
+                ESTATISTICA_INICIO(inicio);
                 if(escolha == 1) {
                     listar_ativos(*carteira, "Renda Fixa");
                 } else if(escolha == 2) {
@@ -593,6 +7678,7 @@ void menu_principal(Arvore** carteira) {
                 } else {
                     printf("\nOpcao invalida!\n");
                 }
+                ESTATISTICA_FIM(OPERACAO_LISTAR, inicio);
             }
             pausar();
         }
@@ -603,8 +7689,10 @@ void menu_principal(Arvore** carteira) {
                 printf("\nNome do ativo (ex: PETR4, ITUB4, Tesouro Selic, CDB XP): ");
                 scanf("%s", nome);
                 printf("Novo valor do ativo: R$ ");
-                scanf("%f", &valor);
-                atualizar_valores_mercado(*carteira, nome, valor);
+                scanf("%lf", &valor);
+                ESTATISTICA_INICIO(inicio);
+                atualizar_valores_mercado(*carteira, nome, reais_para_centavos(valor));
+                ESTATISTICA_FIM(OPERACAO_ATUALIZAR, inicio);
             }
             pausar();
         }
@@ -614,7 +7702,9 @@ void menu_principal(Arvore** carteira) {
             } else {
                 printf("\nNome do ativo a remover: ");
                 scanf("%s", nome);
+                ESTATISTICA_INICIO(inicio);
                 remover_ativo(*carteira, nome);
+                ESTATISTICA_FIM(OPERACAO_REMOVER, inicio);
             }
             pausar();
         }
@@ -622,7 +7712,9 @@ void menu_principal(Arvore** carteira) {
             if(*carteira == NULL) {
                 printf("\nCrie uma carteira primeiro! (opcao 1)\n");
             } else {
+                ESTATISTICA_INICIO(inicio);
                 detectar_desbalanceamento(*carteira);
+                ESTATISTICA_FIM(OPERACAO_DETECTAR, inicio);
             }
             pausar();
         }
@@ -630,7 +7722,9 @@ void menu_principal(Arvore** carteira) {
             if(*carteira == NULL) {
                 printf("\nCrie uma carteira primeiro! (opcao 1)\n");
             } else {
+                ESTATISTICA_INICIO(inicio);
                 sugerir_rebalanceamento(*carteira);
+                ESTATISTICA_FIM(OPERACAO_REBALANCEAR, inicio);
             }
             pausar();
         }
@@ -639,8 +7733,86 @@ void menu_principal(Arvore** carteira) {
                 printf("\nCrie uma carteira primeiro! (opcao 1)\n");
             } else {
                 printf("\nQual o valor do aporte? R$ ");
-                scanf("%f", &valor);
-                simular_aporte(*carteira, valor);
+                scanf("%lf", &valor);
+                printf("\nComo distribuir o aporte?\n");
+                printf("1. Proporcional as metas\n");
+                printf("2. Primeiro o que esta mais abaixo da meta (evita vendas)\n");
+                printf("Opcao: ");
+                scanf("%d", &escolha);
+                ESTATISTICA_INICIO(inicio);
+                simular_aporte(*carteira, reais_para_centavos(valor),
+                               escolha == 2 ? APORTE_NIVELADO : APORTE_PROPORCIONAL);
+                ESTATISTICA_FIM(OPERACAO_APORTE, inicio);
+            }
+            pausar();
+        }
+        else if(opcao == 9) {
+            if(*carteira == NULL) {
+                printf("\nCrie uma carteira primeiro! (opcao 1)\n");
+            } else {
+                printf("\nEm qual categoria?\n");
+                printf("1. Renda Fixa\n");
+                printf("2. Acoes\n");
+                printf("Opcao: ");
+                scanf("%d", &escolha);
+                printf("Nome do novo ativo: ");
+                scanf("%s", nome);
+                printf("Valor investido: R$ ");
+                scanf("%lf", &valor);
+
+                ESTATISTICA_INICIO(inicio);
+                if(escolha == 1) {
+                    adicionar_ativo(*carteira, "Renda Fixa", nome, reais_para_centavos(valor));
+                } else if(escolha == 2) {
+                    adicionar_ativo(*carteira, "Acoes", nome, reais_para_centavos(valor));
+                } else {
+                    printf("\nOpcao invalida!\n");
+                }
+                ESTATISTICA_FIM(OPERACAO_ADICIONAR, inicio);
+            }
+            pausar();
+        }
+        else if(opcao == 10) {
+            if(*carteira == NULL) {
+                printf("\nCrie uma carteira primeiro! (opcao 1)\n");
+            } else {
+                printf("\nNome do arquivo: ");
+                scanf("%s", nome);
+                ESTATISTICA_INICIO(inicio);
+                if(salvar_carteira(*carteira, nome)) {
+                    printf("Carteira salva com sucesso!\n");
+                } else {
+                    printf("Nao foi possivel salvar a carteira!\n");
+                }
+                ESTATISTICA_FIM(OPERACAO_SALVAR, inicio);
+            }
+            pausar();
+        }
+        else if(opcao == 11) {
+            printf("\nNome do arquivo: ");
+            scanf("%s", nome);
+
+            ESTATISTICA_INICIO(inicio);
+            Arvore* carregada = carregar_carteira(nome);
+            ESTATISTICA_FIM(OPERACAO_CARREGAR, inicio);
+            if(carregada == NULL) {
+                printf("Arquivo invalido ou inexistente!\n");
+            } else {
+                if(*carteira != NULL) {
+                    liberar_arvore(*carteira);
+                }
+                *carteira = carregada;
+                diario_checkpoint(carregada);
+                printf("Carteira carregada! Valor total: R$ %.2f\n", centavos_para_reais(carregada->valor_total));
+            }
+            pausar();
+        }
+        else if(opcao == 12) {
+            if(!estatisticas.ativas) {
+                estatisticas.ativas = 1;
+                printf("\nEstatisticas ligadas! Elas aparecem aqui a partir das proximas operacoes.\n");
+            } else {
+                mostrar_estatisticas();
             }
             pausar();
         }
@@ -660,16 +7832,556 @@ void menu_principal(Arvore** carteira) {
     }
 }
 
+// ========================================
+// MODO SCRIPT (SEM MENU)
+// ========================================
+
+// Funcao para separar o proximo argumento de um comando (separados por ';')
+char* proximo_argumento(char** cursor) {
+    char* inicio = *cursor;
+    if(inicio == NULL) {
+        return NULL;
+    }
+
+    while(*inicio == ' ') inicio++;
+
+    char* separador = strchr(inicio, ';');
+    if(separador != NULL) {
+        *separador = '\0';
+        *cursor = separador + 1;
+    } else {
+        *cursor = NULL;
+    }
+
+    char* fim = inicio + strlen(inicio);
+    while(fim > inicio && fim[-1] == ' ') fim--;
+    *fim = '\0';
+
+    return inicio;
+}
+
+// Callback dos alertas no modo script (o contexto e o relatorio do script)
+void alerta_para_relatorio(const AlertaDrift* alerta, void* contexto) {
+    formatar_alerta((Relatorio*) contexto, alerta);
+}
+
+// Funcao para executar um script de comandos (arquivo ou stdin), sem limpar tela nem pausar
+// Comandos: criar VALOR;PERFIL | percentuais | listar CATEGORIA | atualizar ATIVO;VALOR
+//           remover ATIVO | adicionar CATEGORIA;ATIVO;VALOR | detectar | rebalancear
+//           aporte VALOR | feed ARQUIVO | salvar ARQUIVO | carregar ARQUIVO | formato texto|csv|json
+//           estatisticas [zerar] | alertas TOLERANCIA | alertas desligar
+//           posicao ATIVO;QUANTIDADE | preco TICKER;VALOR | perfis ARQUIVO
+// As analises vao para um relatorio no formato atual, escrito de uma vez antes de qualquer outra saida
+int executar_script(Arvore** carteira, FILE* entrada, int formato) {
+    char linha[512];
+    int numero = 0;
+    int erros = 0;
+
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, formato);
+
+    // a medicao de um comando so fecha antes de ler a proxima linha (os comandos saem por varios continue)
+    int operacao = -1;
+    long long inicio = 0;
+
+    while(1) {
+        if(operacao >= 0) {
+            ESTATISTICA_FIM(operacao, inicio);
+            operacao = -1;
+        }
+
+        if(fgets(linha, sizeof(linha), entrada) == NULL) {
+            break;
+        }
+        numero++;
+
+        linha[strcspn(linha, "\r\n")] = '\0';
+
+        char* comando = linha;
+        while(*comando == ' ' || *comando == '\t') comando++;
+        if(*comando == '\0' || *comando == '#') {
+            continue;
+        }
+
+        char* cursor = strchr(comando, ' ');
+        if(cursor != NULL) {
+            *cursor = '\0';
+            cursor++;
+        }
+
+        char* arg1 = proximo_argumento(&cursor);
+        char* arg2 = proximo_argumento(&cursor);
+        char* arg3 = proximo_argumento(&cursor);
+        Centavos valor;
+
+        int analise = strcmp(comando, "percentuais") == 0 || strcmp(comando, "listar") == 0 ||
+                      strcmp(comando, "detectar") == 0 || strcmp(comando, "rebalancear") == 0 ||
+                      strcmp(comando, "aporte") == 0 || strcmp(comando, "estatisticas") == 0;
+        if(!analise || relatorio.tamanho >= (1 << 20)) {
+            relatorio_escrever(&relatorio, stdout);
+        }
+
+        operacao = operacao_por_nome(comando);
+        inicio = operacao >= 0 && estatisticas.ativas ? agora_ns() : 0;
+
+        if(strcmp(comando, "estatisticas") == 0) {
+            if(arg1 != NULL && strcmp(arg1, "zerar") == 0) {
+                zerar_estatisticas();
+            } else {
+                formatar_estatisticas(&relatorio);
+            }
+            continue;
+        }
+
+        if(strcmp(comando, "formato") == 0) {
+            int novo = arg1 != NULL ? formato_relatorio(arg1) : -1;
+            if(novo < 0) {
+                fprintf(stderr, "Linha %d: uso: formato texto|csv|json\n", numero);
+                erros++;
+            } else {
+                relatorio.formato = novo;
+            }
+            continue;
+        }
+
+        if(strcmp(comando, "criar") == 0) {
+            if(arg1 == NULL || !ler_valor_feed(arg1, arg1 + strlen(arg1), &valor) || valor < 0) {
+                fprintf(stderr, "Linha %d: uso: criar VALOR;PERFIL\n", numero);
+                erros++;
+                continue;
+            }
+            if(*carteira != NULL) {
+                liberar_arvore(*carteira);
+            }
+            *carteira = criar_carteira_perfil(valor, arg2 != NULL ? arg2 : "MODERADO");
+            continue;
+        }
+
+        if(strcmp(comando, "carregar") == 0 && arg1 != NULL) {
+            Arvore* carregada = carregar_carteira(arg1);
+            if(carregada == NULL) {
+                fprintf(stderr, "Linha %d: snapshot invalido: %s\n", numero, arg1);
+                erros++;
+                continue;
+            }
+            if(*carteira != NULL) {
+                liberar_arvore(*carteira);
+            }
+            *carteira = carregada;
+            // com o diario aberto a carteira carregada vira o novo ponto de partida
+            diario_checkpoint(carregada);
+            printf("Carteira carregada! Valor total: R$ %.2f\n", centavos_para_reais(carregada->valor_total));
+            continue;
+        }
+
+        // grava a carteira no snapshot do diario e recomeca o diario vazio
+        if(strcmp(comando, "checkpoint") == 0) {
+            if(diario.fd < 0) {
+                fprintf(stderr, "Linha %d: checkpoint precisa do diario aberto (--diario ARQUIVO)\n", numero);
+                erros++;
+            } else if(diario_checkpoint(*carteira)) {
+                printf("Checkpoint no lsn %lld\n", diario.lsn);
+            } else {
+                fprintf(stderr, "Linha %d: nao foi possivel fazer o checkpoint\n", numero);
+                erros++;
+            }
+            continue;
+        }
+
+        if(strcmp(comando, "perfis") == 0) {
+            int quantidade = arg1 != NULL ? carregar_perfis(arg1) : -1;
+            if(quantidade < 0) {
+                fprintf(stderr, "Linha %d: uso: perfis ARQUIVO (arquivo valido)\n", numero);
+                erros++;
+            } else {
+                printf("Perfis carregados: %d\n", quantidade);
+            }
+            continue;
+        }
+
+        // o preco vai para a tabela compartilhada: as carteiras se reavaliam quando forem lidas
+        if(strcmp(comando, "preco") == 0) {
+            if(arg2 == NULL || !ler_valor_feed(arg2, arg2 + strlen(arg2), &valor) || valor < 0) {
+                fprintf(stderr, "Linha %d: uso: preco TICKER;VALOR\n", numero);
+                erros++;
+                continue;
+            }
+            atualizar_preco(arg1, valor);
+            printf("Preco de %s: R$ %.2f\n", arg1, centavos_para_reais(valor));
+            continue;
+        }
+
+        if(*carteira == NULL) {
+            fprintf(stderr, "Linha %d: crie uma carteira primeiro (criar VALOR;PERFIL)\n", numero);
+            erros++;
+            continue;
+        }
+
+        if(strcmp(comando, "percentuais") == 0) {
+            ResultadoBalanceamento resultado = calcular_percentuais(*carteira);
+            formatar_percentuais(&relatorio, &resultado);
+            liberar_resultado_balanceamento(&resultado);
+        }
+        else if(strcmp(comando, "listar") == 0 && arg1 != NULL) {
+            ResultadoListagem resultado = calcular_listagem(*carteira, arg1);
+            formatar_listagem(&relatorio, &resultado);
+            liberar_resultado_listagem(&resultado);
+        }
+        else if(strcmp(comando, "atualizar") == 0 && arg2 != NULL &&
+                ler_valor_feed(arg2, arg2 + strlen(arg2), &valor) && valor >= 0) {
+            atualizar_valores_mercado(*carteira, arg1, valor);
+        }
+        else if(strcmp(comando, "remover") == 0 && arg1 != NULL) {
+            remover_ativo(*carteira, arg1);
+        }
+        else if(strcmp(comando, "posicao") == 0 && arg2 != NULL) {
+            definir_posicao_ativo(*carteira, arg1, atof(arg2));
+        }
+        else if(strcmp(comando, "adicionar") == 0 && arg3 != NULL &&
+                ler_valor_feed(arg3, arg3 + strlen(arg3), &valor) && valor >= 0) {
+            adicionar_ativo(*carteira, arg1, arg2, valor);
+        }
+        else if(strcmp(comando, "detectar") == 0) {
+            ResultadoBalanceamento resultado = calcular_desbalanceamento(*carteira, 2.0);
+            formatar_desbalanceamento(&relatorio, &resultado);
+            liberar_resultado_balanceamento(&resultado);
+        }
+        else if(strcmp(comando, "rebalancear") == 0) {
+            ResultadoRebalanceamento resultado = calcular_rebalanceamento(*carteira, 2.0);
+            formatar_rebalanceamento(&relatorio, &resultado);
+            liberar_resultado_rebalanceamento(&resultado);
+        }
+        else if(strcmp(comando, "aporte") == 0 && arg1 != NULL &&
+                ler_valor_feed(arg1, arg1 + strlen(arg1), &valor)) {
+            int modo = arg2 != NULL && strcmp(arg2, "nivelar") == 0 ? APORTE_NIVELADO : APORTE_PROPORCIONAL;
+            ResultadoAporte resultado = calcular_aporte(*carteira, valor, modo);
+            if(resultado.erro == RELATORIO_OK) {
+                diario_registrar(DIARIO_APORTE, modo, valor, 0.0, NULL, NULL);
+            }
+            formatar_aporte(&relatorio, &resultado);
+            liberar_resultado_aporte(&resultado);
+        }
+        else if(strcmp(comando, "salvar") == 0 && arg1 != NULL) {
+            if(salvar_carteira(*carteira, arg1)) {
+                printf("Carteira salva em %s\n", arg1);
+            } else {
+                fprintf(stderr, "Linha %d: nao foi possivel salvar em %s\n", numero, arg1);
+                erros++;
+            }
+        }
+        else if(strcmp(comando, "montecarlo") == 0) {
+            ParametrosMonteCarlo parametros = parametros_monte_carlo_padrao(*carteira);
+            if(arg1 != NULL) {
+                parametros.caminhos = atoi(arg1);
+            }
+            if(arg2 != NULL) {
+                parametros.anos = atoi(arg2);
+            }
+            if(arg3 != NULL) {
+                parametros.rebalancear_a_cada = atoi(arg3);
+            }
+
+            ResultadoMonteCarlo resultado = simular_monte_carlo(*carteira, &parametros);
+            mostrar_resultado_monte_carlo(&resultado);
+
+            liberar_resultado_monte_carlo(&resultado);
+            liberar_parametros_monte_carlo(&parametros);
+        }
+        else if(strcmp(comando, "alertas") == 0 && arg1 != NULL) {
+            // os alertas entram no relatorio, na ordem em que os nos trocam de faixa
+            if(strcmp(arg1, "desligar") == 0) {
+                desligar_alertas(*carteira);
+                printf("Alertas desligados.\n");
+            } else if(atof(arg1) > 0.0) {
+                ligar_alertas(*carteira, atof(arg1), alerta_para_relatorio, &relatorio);
+                printf("Alertas ligados (tolerancia %.2f pontos, %d nos fora da faixa)\n",
+                       atof(arg1), (*carteira)->alertas->fora_da_faixa);
+            } else {
+                fprintf(stderr, "Linha %d: uso: alertas TOLERANCIA | alertas desligar\n", numero);
+                erros++;
+            }
+        }
+        else if(strcmp(comando, "feed") == 0 && arg1 != NULL) {
+            ResumoFeed resumo = ler_feed_precos(*carteira, arg1);
+            if(resumo.invalidas < 0) {
+                fprintf(stderr, "Linha %d: nao foi possivel abrir o feed %s\n", numero, arg1);
+                erros++;
+            } else {
+                mostrar_resumo_feed(*carteira, &resumo);
+            }
+        }
+        else {
+            fprintf(stderr, "Linha %d: comando invalido: %s\n", numero, comando);
+            erros++;
+        }
+    }
+
+    // o callback aponta para o relatorio, que acaba aqui
+    if(*carteira != NULL) {
+        desligar_alertas(*carteira);
+    }
+
+    relatorio_escrever(&relatorio, stdout);
+    relatorio_liberar(&relatorio);
+
+    return erros;
+}
+
 // ========================================
 // MAIN
 // ========================================
 
-int main() {
+int main(int argc, char* argv[]) {
     setlocale(LC_ALL, "Portuguese");
 
     Arvore* carteira = NULL;
 
+    // ./Main --stats <outros argumentos>: liga as estatisticas e mostra tudo no stderr ao sair
+    if(argc >= 2 && strcmp(argv[1], "--stats") == 0) {
+        estatisticas.ativas = 1;
+        atexit(mostrar_estatisticas_saida);
+        argv++;
+        argc--;
+    }
+
+    // os perfis ficam prontos antes de qualquer thread (o backtest monta carteiras em paralelo)
+    carregar_perfis_padrao();
+
+    // ./Main --perfis <arquivo> <outros argumentos>: le perfis de um arquivo de configuracao
+    if(argc >= 3 && strcmp(argv[1], "--perfis") == 0) {
+        if(carregar_perfis(argv[2]) < 0) {
+            return 1;
+        }
+        argv += 2;
+        argc -= 2;
+    }
+
+    // ./Main --diario <arquivo> <outros argumentos>: recupera a carteira do diario e grava nele cada mudanca
+    // (vale para o menu e o modo script)
+    const char* caminho_diario = NULL;
+    if(argc >= 3 && strcmp(argv[1], "--diario") == 0) {
+        caminho_diario = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+
+    // ./Main --feed <arquivo|-> [valor_inicial] [perfil]
+    if(argc >= 3 && strcmp(argv[1], "--feed") == 0) {
+        Centavos valor = reais_para_centavos(argc >= 4 ? atof(argv[3]) : 10000.0);
+        const char* perfil = argc >= 5 ? argv[4] : "MODERADO";
+
+        carteira = criar_carteira_perfil(valor, perfil);
+
+        ESTATISTICA_INICIO(inicio);
+        ResumoFeed resumo = ler_feed_precos(carteira, argv[2]);
+        ESTATISTICA_FIM(OPERACAO_FEED, inicio);
+
+        if(resumo.invalidas < 0) {
+            printf("\nNao foi possivel abrir o feed: %s\n", argv[2]);
+            liberar_arvore(carteira);
+            return 1;
+        }
+
+        mostrar_resumo_feed(carteira, &resumo);
+        liberar_arvore(carteira);
+        return 0;
+    }
+
+    // ./Main --varredura <contas> [tolerancia] [threads]
+    if(argc >= 3 && strcmp(argv[1], "--varredura") == 0) {
+        int quantidade = atoi(argv[2]);
+        double tolerancia = argc >= 4 ? atof(argv[3]) : 2.0;
+        int threads = argc >= 5 ? atoi(argv[4]) : 0;
+
+        MotorCarteiras motor;
+        motor_iniciar(&motor, quantidade);
+        gerar_contas_sinteticas(&motor, quantidade);
+
+        ResultadoVarredura resultado = varrer_desbalanceamento(&motor, tolerancia, threads);
+        mostrar_resultado_varredura(&resultado, 10);
+
+        liberar_resultado_varredura(&resultado);
+        motor_liberar(&motor);
+        return 0;
+    }
+
+    // ./Main --monte-carlo <caminhos> [anos] [perfil] [threads]
+    if(argc >= 3 && strcmp(argv[1], "--monte-carlo") == 0) {
+        carteira = criar_carteira_perfil(reais_para_centavos(100000.0), argc >= 5 ? argv[4] : "MODERADO");
+
+        ParametrosMonteCarlo parametros = parametros_monte_carlo_padrao(carteira);
+        parametros.caminhos = atoi(argv[2]);
+        if(argc >= 4) {
+            parametros.anos = atoi(argv[3]);
+        }
+        if(argc >= 6) {
+            parametros.threads = atoi(argv[5]);
+        }
+
+        ResultadoMonteCarlo resultado = simular_monte_carlo(carteira, &parametros);
+        mostrar_resultado_monte_carlo(&resultado);
+
+        liberar_resultado_monte_carlo(&resultado);
+        liberar_parametros_monte_carlo(&parametros);
+        liberar_arvore(carteira);
+        return 0;
+    }
+
+    // ./Main --importar-precos <precos.csv|-> <base.precos>
+    if(argc >= 4 && strcmp(argv[1], "--importar-precos") == 0) {
+        int dias = importar_precos_csv(argv[2], argv[3]);
+        if(dias < 0) {
+            printf("\nNao foi possivel importar %s para %s\n", argv[2], argv[3]);
+            return 1;
+        }
+        printf("\nBase de precos gravada em %s (%d dias)\n", argv[3], dias);
+        return 0;
+    }
+
+    // ./Main --backtest <base.precos> [valor_inicial] [threads]
+    if(argc >= 3 && strcmp(argv[1], "--backtest") == 0) {
+        BasePrecos base;
+        if(!abrir_base_precos(argv[2], &base)) {
+            printf("\nBase de precos invalida ou inexistente: %s\n", argv[2]);
+            return 1;
+        }
+
+        Centavos valor = reais_para_centavos(argc >= 4 ? atof(argv[3]) : 100000.0);
+        int threads = argc >= 5 ? atoi(argv[4]) : 0;
+
+        ConfigBacktest configs[32];
+        int quantidade = montar_configs_backtest(configs);
+        ResultadoBacktest resultados[32];
+
+        double inicio = agora_segundos();
+        varrer_backtests(&base, configs, quantidade, valor, threads, resultados);
+        mostrar_resultados_backtest(&base, resultados, quantidade, agora_segundos() - inicio);
+
+        fechar_base_precos(&base);
+        return 0;
+    }
+
+    // ./Main --concorrencia <ticks> [leitores] [nos]
+    if(argc >= 3 && strcmp(argv[1], "--concorrencia") == 0) {
+        int ticks = atoi(argv[2]);
+        int leitores = argc >= 4 ? atoi(argv[3]) : numero_de_nucleos();
+        int nos = argc >= 5 ? atoi(argv[4]) : 1000;
+
+        rodar_leitores_concorrentes(ticks, leitores, nos);
+        return 0;
+    }
+
+    // ./Main --instanciar <contas> [perfil]
+    if(argc >= 3 && strcmp(argv[1], "--instanciar") == 0) {
+        rodar_instanciar_perfis(atoi(argv[2]), argc >= 4 ? argv[3] : "MODERADO");
+        return 0;
+    }
+
+    // ./Main --precos <carteiras> [ticks]
+    if(argc >= 3 && strcmp(argv[1], "--precos") == 0) {
+        int carteiras = atoi(argv[2]);
+        int ticks = argc >= 4 ? atoi(argv[3]) : 10000;
+
+        rodar_precos_compartilhados(carteiras, ticks);
+        liberar_tabela_precos();
+        return 0;
+    }
+
+    // ./Main --alertas <ticks> [nos] [tolerancia]
+    if(argc >= 3 && strcmp(argv[1], "--alertas") == 0) {
+        int ticks = atoi(argv[2]);
+        int nos = argc >= 4 ? atoi(argv[3]) : 10000;
+        double tolerancia = argc >= 5 ? atof(argv[4]) : 2.0;
+
+        rodar_demo_alertas(ticks, nos, tolerancia > 0.0 ? tolerancia : 2.0);
+        return 0;
+    }
+
+    // ./Main --rotatividade <trocas> [nos]
+    if(argc >= 3 && strcmp(argv[1], "--rotatividade") == 0) {
+        rodar_rotatividade(atoi(argv[2]), argc >= 4 ? atoi(argv[3]) : 100000);
+        return 0;
+    }
+
+    // ./Main --servico <socket> [epoll|poll]
+    if(argc >= 3 && strcmp(argv[1], "--servico") == 0) {
+        return rodar_servico(argv[2], argc >= 4 && strcmp(argv[3], "poll") == 0);
+    }
+
+    // ./Main --cliente <socket> <pedidos> [contas] [janela] [encerrar]
+    if(argc >= 4 && strcmp(argv[1], "--cliente") == 0) {
+        int contas = argc >= 5 ? atoi(argv[4]) : 100;
+        int janela = argc >= 6 ? atoi(argv[5]) : 32;
+        int encerrar = argc >= 7 && strcmp(argv[6], "encerrar") == 0;
+
+        rodar_cliente_servico(argv[2], atoi(argv[3]), contas, janela, encerrar);
+        return 0;
+    }
+
+    // ./Main --reaplicar <ticks> [grupo]
+    if(argc >= 3 && strcmp(argv[1], "--reaplicar") == 0) {
+        rodar_demo_diario(atoi(argv[2]), argc >= 4 ? atoi(argv[3]) : DIARIO_GRUPO);
+        return 0;
+    }
+
+    // ./Main --bench [max_nos] [texto|csv|json]
+    if(argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+        int max_nos = argc >= 3 ? atoi(argv[2]) : 1000000;
+        const char* formato = argc >= 4 ? argv[3] : "texto";
+
+        MedicaoBench* medicoes = (MedicaoBench*) malloc(BENCH_MAX_MEDICOES * sizeof(MedicaoBench));
+        int quantidade = rodar_benchmark(max_nos, medicoes, BENCH_MAX_MEDICOES);
+        mostrar_benchmark(medicoes, quantidade, formato);
+
+        free(medicoes);
+        return 0;
+    }
+
+    // ./Main --script <arquivo|-> [texto|csv|json]
+    if(argc >= 3 && strcmp(argv[1], "--script") == 0) {
+        int formato = argc >= 4 ? formato_relatorio(argv[3]) : FORMATO_TEXTO;
+        if(formato < 0) {
+            fprintf(stderr, "Formato invalido: %s (use texto, csv ou json)\n", argv[3]);
+            return 1;
+        }
+
+        FILE* entrada = strcmp(argv[2], "-") == 0 ? stdin : fopen(argv[2], "r");
+        if(entrada == NULL) {
+            fprintf(stderr, "Nao foi possivel abrir o script: %s\n", argv[2]);
+            return 1;
+        }
+
+        // saida toda bufferizada: o resultado sai em blocos grandes no fim
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+        if(caminho_diario != NULL) {
+            if(!diario_abrir(caminho_diario, &carteira, DIARIO_GRUPO)) {
+                return 1;
+            }
+            mostrar_abertura_diario();
+        }
+
+        int erros = executar_script(&carteira, entrada, formato);
+
+        if(entrada != stdin) {
+            fclose(entrada);
+        }
+        diario_fechar();
+        liberar_arvore(carteira);
+        fflush(stdout);
+        return erros > 0 ? 1 : 0;
+    }
+
+    // no menu cada operacao ja vai para o disco (grupo de 1): o usuario pode parar em qualquer tela
+    if(caminho_diario != NULL) {
+        if(!diario_abrir(caminho_diario, &carteira, 1)) {
+            return 1;
+        }
+        mostrar_abertura_diario();
+    }
+
     menu_principal(&carteira);
+    diario_fechar();
 
     return 0;
 }
\ No newline at end of file
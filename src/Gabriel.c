@@ -3,272 +3,539 @@
 #include <string.h>
 #include <math.h>
 
-// parte do gabriel - arvore binaria
-
-#define ATIVO 2
-#define CATEGORIA 1
-#define RAIZ 0
-
-typedef struct No {
-    char nome[64];
-    int tipo;
-    float percentual_alvo;
-    float valor_investido;
-    float valor_total;
-    struct No* esquerda;
-    struct No* direita;
-} No;
-
-typedef struct Arvore {
-    No* raiz;
-    float valor_total;
-} Arvore;
+// parte do gabriel - arvore n-aria
+
+#include "../struct.h"
 
 // funcoes auxiliares (declaracoes)
-float calcular_total_no(No* no);
-No* buscar_no(No* raiz, const char* nome);
+Centavos calcular_total_no(No* no);
+No* buscar_no(Arvore* arvore, const char* nome);
+No* indice_buscar(const IndiceNomes* indice, const char* nome);
+void alterar_valor_investido(Arvore* arvore, No* no, Centavos novo_valor);
+void definir_valor_no(No* no, Centavos novo_valor);
+double centavos_para_reais(Centavos valor);
+void garantir_totais(Arvore* arvore);
+void visao_iniciar(VisaoPlana* visao);
+void achatar_filhos(VisaoPlana* visao, No* pai, int grupo);
+void visao_liberar(VisaoPlana* visao);
+void kernel_drift(const double* valores, const double* totais, const double* alvos, double* diferencas, int n);
+int kernel_contar_fora(const double* diferencas, double tolerancia, int n);
+int no_investivel(const No* no);
+int filhos_investiveis(No* pai, No** filhos, Centavos* fora);
+PlanoRebalanceamento planejar_rebalanceamento(Arvore* arvore, double tolerancia);
+PlanoRebalanceamento planejar_aporte_nivelado(Arvore* arvore, Centavos valor_aporte);
+void aplicar_plano_rebalanceamento(Arvore* arvore, const PlanoRebalanceamento* plano);
+void liberar_plano(PlanoRebalanceamento* plano);
+void relatorio_iniciar(Relatorio* relatorio, int formato);
+void relatorio_printf(Relatorio* relatorio, const char* formato, ...);
+void relatorio_json_texto(Relatorio* relatorio, const char* texto);
+void relatorio_csv_texto(Relatorio* relatorio, const char* texto);
+void relatorio_escrever(Relatorio* relatorio, FILE* saida);
+void relatorio_liberar(Relatorio* relatorio);
+void formatar_erro_relatorio(Relatorio* relatorio, const char* nome, int erro);
+void formatar_situacao_categorias(Relatorio* relatorio, const char* nome, const ResultadoBalanceamento* resultado);
+void liberar_resultado_balanceamento(ResultadoBalanceamento* resultado);
+IndiceAlertas* criar_indice_alertas(Arvore* arvore, double tolerancia, CallbackAlerta callback, void* contexto,
+                                    const IndiceAlertas* anterior);
+void liberar_indice_alertas(IndiceAlertas* indice);
+void diario_registrar(int operacao, int modo, Centavos valor, double quantidade, const char* nome,
+                      const char* categoria);
 
 // Funcao para calcular total (recursiva)
-float calcular_total_no(No* no) {
+Centavos calcular_total_no(No* no) {
     if(no == NULL) {
-        return 0.0;
+        return 0;
     }
 
-    if(no->esquerda == NULL && no->direita == NULL) {
+    if(no->num_filhos == 0) {
         no->valor_total = no->valor_investido;
         return no->valor_total;
     }
 
-    float soma = 0.0;
-    soma = soma + calcular_total_no(no->esquerda);
-    soma = soma + calcular_total_no(no->direita);
+    Centavos soma = 0;
+    for(int i = 0; i < no->num_filhos; i++) {
+        soma = soma + calcular_total_no(no->filhos[i]);
+    }
     soma = soma + no->valor_investido;
 
     no->valor_total = soma;
     return soma;
 }
 
-// Funcao para buscar no (recursiva)
-No* buscar_no(No* raiz, const char* nome) {
-    if(raiz == NULL) {
+// Funcao para buscar no (pelo indice de nomes da arvore)
+No* buscar_no(Arvore* arvore, const char* nome) {
+    if(arvore == NULL) {
         return NULL;
     }
 
-    if(strcmp(raiz->nome, nome) == 0) {
-        return raiz;
-    }
+    return indice_buscar(&arvore->indice, nome);
+}
+
+// Funcao para comparar cada categoria com a meta usando os kernels (nada e impresso)
+ResultadoBalanceamento calcular_desbalanceamento(Arvore* arvore, double tolerancia) {
+    ResultadoBalanceamento resultado;
+    memset(&resultado, 0, sizeof(resultado));
+    resultado.tolerancia = tolerancia;
 
-    No* resultado = buscar_no(raiz->esquerda, nome);
-    if(resultado != NULL) {
+    if(arvore == NULL || arvore->raiz == NULL) {
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
         return resultado;
     }
 
-    return buscar_no(raiz->direita, nome);
+    garantir_totais(arvore);
+
+    VisaoPlana visao;
+    visao_iniciar(&visao);
+    achatar_filhos(&visao, arvore->raiz, 0);
+    kernel_drift(visao.valores, visao.totais, visao.alvos, visao.diferencas, visao.quantidade);
+
+    resultado.valor_total = arvore->valor_total;
+    resultado.fora_da_tolerancia = kernel_contar_fora(visao.diferencas, tolerancia, visao.quantidade);
+    resultado.num_categorias = visao.quantidade;
+    resultado.categorias = (SituacaoCategoria*) malloc((visao.quantidade + 1) * sizeof(SituacaoCategoria));
+
+    for(int i = 0; i < visao.quantidade; i++) {
+        SituacaoCategoria* s = &resultado.categorias[i];
+        s->categoria = visao.nos[i];
+        s->meta = visao.alvos[i];
+        s->diferenca = visao.diferencas[i];
+        s->atual = s->diferenca + s->meta;
+        s->valor = visao.nos[i]->valor_total;
+    }
+
+    visao_liberar(&visao);
+
+    return resultado;
 }
 
-// Funcao para detectar desbalanceamento
-void detectar_desbalanceamento(Arvore* arvore) {
-    if(arvore == NULL || arvore->raiz == NULL) {
-        printf("\nCarteira vazia!\n");
+// Funcao para escrever a analise de balanceamento no relatorio
+void formatar_desbalanceamento(Relatorio* relatorio, const ResultadoBalanceamento* resultado) {
+    if(relatorio->formato != FORMATO_TEXTO) {
+        formatar_situacao_categorias(relatorio, "desbalanceamento", resultado);
         return;
     }
 
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
-
-    printf("\n========================================\n");
-    printf("ANALISE DE BALANCEAMENTO\n");
-    printf("========================================\n");
+    if(resultado->erro != RELATORIO_OK) {
+        relatorio_printf(relatorio, "\nCarteira vazia!\n");
+        return;
+    }
 
-    int desbalanceado = 0;
-    float tolerancia = 2.0;
+    relatorio_printf(relatorio, "\n========================================\n");
+    relatorio_printf(relatorio, "ANALISE DE BALANCEAMENTO\n");
+    relatorio_printf(relatorio, "========================================\n");
 
-    // verificar renda fixa (esquerda)
-    if(arvore->raiz->esquerda != NULL) {
-        No* renda_fixa = arvore->raiz->esquerda;
-        float percentual_atual = (renda_fixa->valor_total / arvore->valor_total) * 100.0;
-        float diferenca = percentual_atual - renda_fixa->percentual_alvo;
+    for(int i = 0; i < resultado->num_categorias; i++) {
+        const SituacaoCategoria* s = &resultado->categorias[i];
 
-        printf("\n%s:\n", renda_fixa->nome);
-        printf("  Meta:  %.1f%%\n", renda_fixa->percentual_alvo);
-        printf("  Atual: %.1f%%\n", percentual_atual);
-        printf("  Diferenca: %+.1f%%\n", diferenca);
+        relatorio_printf(relatorio, "\n%s:\n", s->categoria->nome);
+        relatorio_printf(relatorio, "  Meta:  %.1f%%\n", s->meta);
+        relatorio_printf(relatorio, "  Atual: %.1f%%\n", s->atual);
+        relatorio_printf(relatorio, "  Diferenca: %+.1f%%\n", s->diferenca);
 
-        if(fabs(diferenca) > tolerancia) {
-            if(diferenca > 0) {
-                printf("    ACIMA do alvo (sobra %.1f%%)\n", diferenca);
+        if(fabs(s->diferenca) > resultado->tolerancia) {
+            if(s->diferenca > 0) {
+                relatorio_printf(relatorio, "    ACIMA do alvo (sobra %.1f%%)\n", s->diferenca);
             } else {
-                printf("    ABAIXO do alvo (falta %.1f%%)\n", -diferenca);
+                relatorio_printf(relatorio, "    ABAIXO do alvo (falta %.1f%%)\n", -s->diferenca);
             }
-            desbalanceado = 1;
         } else {
-            printf("   Dentro do alvo\n");
+            relatorio_printf(relatorio, "   Dentro do alvo\n");
         }
     }
 
-    // verificar acoes (direita)
-    if(arvore->raiz->direita != NULL) {
-        No* acoes = arvore->raiz->direita;
-        float percentual_atual = (acoes->valor_total / arvore->valor_total) * 100.0;
-        float diferenca = percentual_atual - acoes->percentual_alvo;
-
-        printf("\n%s:\n", acoes->nome);
-        printf("  Meta:  %.1f%%\n", acoes->percentual_alvo);
-        printf("  Atual: %.1f%%\n", percentual_atual);
-        printf("  Diferenca: %+.1f%%\n", diferenca);
-
-        if(fabs(diferenca) > tolerancia) {
-            if(diferenca > 0) {
-                printf("    ACIMA do alvo (sobra %.1f%%)\n", diferenca);
-            } else {
-                printf("    ABAIXO do alvo (falta %.1f%%)\n", -diferenca);
+    // categorias sem ativos ficam fora da conta, como no rebalanceamento e no aporte
+    if(resultado->num_categorias > 0) {
+        const No* raiz = resultado->categorias[0].categoria->pai;
+        for(int i = 0; i < raiz->num_filhos; i++) {
+            if(!no_investivel(raiz->filhos[i])) {
+                relatorio_printf(relatorio, "\n%s:\n   Sem ativos: nada a negociar\n", raiz->filhos[i]->nome);
             }
-            desbalanceado = 1;
-        } else {
-            printf("   Dentro do alvo\n");
         }
     }
 
-    printf("\n========================================\n");
-    if(desbalanceado) {
-        printf("CARTEIRA DESBALANCEADA\n");
-        printf("Sugestao: Use a opcao para ver como rebalancear\n");
+    relatorio_printf(relatorio, "\n========================================\n");
+    if(resultado->fora_da_tolerancia > 0) {
+        relatorio_printf(relatorio, "CARTEIRA DESBALANCEADA\n");
+        relatorio_printf(relatorio, "Sugestao: Use a opcao para ver como rebalancear\n");
     } else {
-        printf("CARTEIRA BALANCEADA\n");
+        relatorio_printf(relatorio, "CARTEIRA BALANCEADA\n");
     }
-    printf("========================================\n");
+    relatorio_printf(relatorio, "========================================\n");
 }
 
-// Funcao para sugerir rebalanceamento
-void sugerir_rebalanceamento(Arvore* arvore) {
+// Funcao para detectar desbalanceamento
+void detectar_desbalanceamento(Arvore* arvore) {
+    ResultadoBalanceamento resultado = calcular_desbalanceamento(arvore, 2.0);
+
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_desbalanceamento(&relatorio, &resultado);
+    relatorio_escrever(&relatorio, stdout);
+
+    relatorio_liberar(&relatorio);
+    liberar_resultado_balanceamento(&resultado);
+}
+
+// Funcao para calcular as ordens de rebalanceamento da carteira (nada e impresso)
+ResultadoRebalanceamento calcular_rebalanceamento(Arvore* arvore, double tolerancia) {
+    ResultadoRebalanceamento resultado;
+    memset(&resultado, 0, sizeof(resultado));
+    resultado.tolerancia = tolerancia;
+
     if(arvore == NULL || arvore->raiz == NULL) {
-        printf("\nCarteira vazia!\n");
-        return;
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
     }
 
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
+    resultado.plano = planejar_rebalanceamento(arvore, tolerancia);
 
-    printf("\n========================================\n");
-    printf("SUGESTOES DE REBALANCEAMENTO\n");
-    printf("========================================\n");
+    return resultado;
+}
 
-    float tolerancia = 2.0;
-    int precisa_rebalancear = 0;
+// Funcao para escrever as ordens de rebalanceamento no relatorio
+void formatar_rebalanceamento(Relatorio* relatorio, const ResultadoRebalanceamento* resultado) {
+    const PlanoRebalanceamento* plano = &resultado->plano;
+
+    if(relatorio->formato == FORMATO_TEXTO) {
+        if(resultado->erro != RELATORIO_OK) {
+            relatorio_printf(relatorio, "\nCarteira vazia!\n");
+            return;
+        }
 
-    printf("\nAcoes necessarias:\n\n");
+        relatorio_printf(relatorio, "\n========================================\n");
+        relatorio_printf(relatorio, "SUGESTOES DE REBALANCEAMENTO\n");
+        relatorio_printf(relatorio, "========================================\n");
+        relatorio_printf(relatorio, "\nAcoes necessarias:\n\n");
 
-    // verificar renda fixa (esquerda)
-    if(arvore->raiz->esquerda != NULL) {
-        No* renda_fixa = arvore->raiz->esquerda;
-        float valor_alvo = arvore->valor_total * (renda_fixa->percentual_alvo / 100.0);
-        float diferenca = renda_fixa->valor_total - valor_alvo;
+        for(int i = 0; i < plano->num_ordens; i++) {
+            const OrdemRebalanceamento* ordem = &plano->ordens[i];
+            const char* categoria = ordem->ativo->pai != NULL ? ordem->ativo->pai->nome : "";
 
-        if(diferenca > (arvore->valor_total * tolerancia / 100.0)) {
-            printf("* VENDER R$ %.2f de %s\n", diferenca, renda_fixa->nome);
-            precisa_rebalancear = 1;
-        } else if(diferenca < -(arvore->valor_total * tolerancia / 100.0)) {
-            printf("* COMPRAR R$ %.2f em %s\n", -diferenca, renda_fixa->nome);
-            precisa_rebalancear = 1;
+            if(ordem->quantia < 0) {
+                relatorio_printf(relatorio, "* VENDER R$ %.2f de %s (%s)\n",
+                                 centavos_para_reais(-ordem->quantia), ordem->ativo->nome, categoria);
+            } else {
+                relatorio_printf(relatorio, "* COMPRAR R$ %.2f em %s (%s)\n",
+                                 centavos_para_reais(ordem->quantia), ordem->ativo->nome, categoria);
+            }
+        }
+
+        if(plano->num_ordens == 0) {
+            relatorio_printf(relatorio, "Carteira ja esta balanceada!\n");
+        } else {
+            relatorio_printf(relatorio, "\nTotal a comprar: R$ %.2f\n", centavos_para_reais(plano->total_compras));
+            relatorio_printf(relatorio, "Total a vender: R$ %.2f\n", centavos_para_reais(plano->total_vendas));
         }
+
+        relatorio_printf(relatorio, "\n========================================\n");
+        return;
     }
 
-    // verificar acoes (direita)
-    if(arvore->raiz->direita != NULL) {
-        No* acoes = arvore->raiz->direita;
-        float valor_alvo = arvore->valor_total * (acoes->percentual_alvo / 100.0);
-        float diferenca = acoes->valor_total - valor_alvo;
+    if(resultado->erro != RELATORIO_OK) {
+        formatar_erro_relatorio(relatorio, "rebalanceamento", resultado->erro);
+        return;
+    }
 
-        if(diferenca > (arvore->valor_total * tolerancia / 100.0)) {
-            printf("* VENDER R$ %.2f de %s\n", diferenca, acoes->nome);
-            precisa_rebalancear = 1;
-        } else if(diferenca < -(arvore->valor_total * tolerancia / 100.0)) {
-            printf("* COMPRAR R$ %.2f em %s\n", -diferenca, acoes->nome);
-            precisa_rebalancear = 1;
+    if(relatorio->formato == FORMATO_CSV) {
+        relatorio_printf(relatorio, "ativo,categoria,operacao,valor_atual,valor_novo,quantia\n");
+        for(int i = 0; i < plano->num_ordens; i++) {
+            const OrdemRebalanceamento* ordem = &plano->ordens[i];
+            relatorio_csv_texto(relatorio, ordem->ativo->nome);
+            relatorio_printf(relatorio, ",");
+            relatorio_csv_texto(relatorio, ordem->ativo->pai != NULL ? ordem->ativo->pai->nome : "");
+            relatorio_printf(relatorio, ",%s,%.2f,%.2f,%.2f\n", ordem->quantia < 0 ? "vender" : "comprar",
+                             centavos_para_reais(ordem->valor_atual), centavos_para_reais(ordem->valor_novo),
+                             centavos_para_reais(ordem->quantia));
         }
+        return;
     }
 
-    if(!precisa_rebalancear) {
-        printf("Carteira ja esta balanceada!\n");
+    relatorio_printf(relatorio, "{\"relatorio\":\"rebalanceamento\",\"tolerancia\":%.4f,\"total_compras\":%.2f,\"total_vendas\":%.2f,\"ordens\":[",
+                     resultado->tolerancia, centavos_para_reais(plano->total_compras), centavos_para_reais(plano->total_vendas));
+    for(int i = 0; i < plano->num_ordens; i++) {
+        const OrdemRebalanceamento* ordem = &plano->ordens[i];
+        relatorio_printf(relatorio, "%s{\"ativo\":", i > 0 ? "," : "");
+        relatorio_json_texto(relatorio, ordem->ativo->nome);
+        relatorio_printf(relatorio, ",\"categoria\":");
+        relatorio_json_texto(relatorio, ordem->ativo->pai != NULL ? ordem->ativo->pai->nome : "");
+        relatorio_printf(relatorio, ",\"valor_atual\":%.2f,\"valor_novo\":%.2f,\"quantia\":%.2f}",
+                         centavos_para_reais(ordem->valor_atual), centavos_para_reais(ordem->valor_novo),
+                         centavos_para_reais(ordem->quantia));
     }
+    relatorio_printf(relatorio, "]}\n");
+}
 
-    printf("\n========================================\n");
+void liberar_resultado_rebalanceamento(ResultadoRebalanceamento* resultado) {
+    liberar_plano(&resultado->plano);
 }
 
-// Funcao para simular aporte
-void simular_aporte(Arvore* arvore, float valor_aporte) {
+// Funcao para sugerir rebalanceamento
+void sugerir_rebalanceamento(Arvore* arvore) {
+    ResultadoRebalanceamento resultado = calcular_rebalanceamento(arvore, 2.0);
+
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_rebalanceamento(&relatorio, &resultado);
+    relatorio_escrever(&relatorio, stdout);
+
+    relatorio_liberar(&relatorio);
+    liberar_resultado_rebalanceamento(&resultado);
+}
+
+// Funcao para dividir uma quantia em partes iguais entre os filhos investiveis de um grupo
+// (subcategorias dividem a parte delas do mesmo jeito; os centavos que sobram vao para os primeiros)
+// Devolve quantos ativos receberam alguma coisa
+int distribuir_aporte_igual(Arvore* arvore, No* grupo, Centavos quantia) {
+    No** filhos = (No**) malloc(grupo->num_filhos * sizeof(No*));
+    Centavos fora;
+    int n = filhos_investiveis(grupo, filhos, &fora);
+    int ativos_com_aporte = 0;
+
+    for(int i = 0; i < n; i++) {
+        No* filho = filhos[i];
+        Centavos parte = quantia / n + (i < quantia % n ? 1 : 0);
+        if(filho->tipo == ATIVO) {
+            alterar_valor_investido(arvore, filho, filho->valor_investido + parte);
+            if(parte > 0) {
+                ativos_com_aporte++;
+            }
+        } else {
+            ativos_com_aporte += distribuir_aporte_igual(arvore, filho, parte);
+        }
+    }
+
+    free(filhos);
+    return ativos_com_aporte;
+}
+
+// Funcao para aplicar um aporte na carteira e guardar o que cada categoria recebeu (nada e impresso)
+ResultadoAporte calcular_aporte(Arvore* arvore, Centavos valor_aporte, int modo) {
+    ResultadoAporte resultado;
+    memset(&resultado, 0, sizeof(resultado));
+    resultado.modo = modo;
+    resultado.valor_aporte = valor_aporte;
+
     if(arvore == NULL || arvore->raiz == NULL) {
-        printf("\nCarteira vazia!\n");
-        return;
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
     }
 
     if(valor_aporte <= 0) {
-        printf("\nValor de aporte invalido!\n");
-        return;
+        resultado.erro = RELATORIO_VALOR_INVALIDO;
+        return resultado;
     }
 
-    printf("\n========================================\n");
-    printf("SIMULACAO DE APORTE\n");
-    printf("========================================\n");
-    printf("Valor do aporte: R$ %.2f\n\n", valor_aporte);
+    // so recebem as categorias com algum ativo; as metas das outras sao divididas entre elas
+    // (sem nenhuma, o dinheiro nao teria para onde ir)
+    double soma_metas = 0.0;
+    int recebem = 0;
+    int ultima = -1;
+    for(int i = 0; i < arvore->raiz->num_filhos; i++) {
+        No* categoria = arvore->raiz->filhos[i];
+        if(no_investivel(categoria)) {
+            soma_metas += categoria->percentual_alvo;
+            recebem++;
+            ultima = i;
+        }
+    }
+
+    if(recebem == 0) {
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
+    }
+
+    garantir_totais(arvore);
 
-    printf("Distribuicao proporcional:\n\n");
+    resultado.num_categorias = arvore->raiz->num_filhos;
+    resultado.categorias = (AporteCategoria*) malloc((resultado.num_categorias + 1) * sizeof(AporteCategoria));
 
-    // distribuir para renda fixa (esquerda)
-    if(arvore->raiz->esquerda != NULL) {
-        No* renda_fixa = arvore->raiz->esquerda;
-        float valor_rf = valor_aporte * (renda_fixa->percentual_alvo / 100.0);
+    if(modo == APORTE_NIVELADO) {
+        // guarda os totais das categorias para saber quanto cada uma recebeu
+        for(int i = 0; i < arvore->raiz->num_filhos; i++) {
+            resultado.categorias[i].categoria = arvore->raiz->filhos[i];
+            resultado.categorias[i].antes = arvore->raiz->filhos[i]->valor_total;
+        }
 
-        printf("* %s (%.0f%%): + R$ %.2f\n",
-               renda_fixa->nome, renda_fixa->percentual_alvo, valor_rf);
-        printf("  Novo total: R$ %.2f -> R$ %.2f\n\n",
-               renda_fixa->valor_total, renda_fixa->valor_total + valor_rf);
+        PlanoRebalanceamento plano = planejar_aporte_nivelado(arvore, valor_aporte);
+        aplicar_plano_rebalanceamento(arvore, &plano);
 
-        // dividir entre os ativos da categoria
-        if(renda_fixa->esquerda != NULL && renda_fixa->esquerda->tipo == ATIVO) {
-            renda_fixa->esquerda->valor_investido += valor_rf / 2;
+        for(int i = 0; i < arvore->raiz->num_filhos; i++) {
+            resultado.categorias[i].recebido = arvore->raiz->filhos[i]->valor_total - resultado.categorias[i].antes;
         }
-        if(renda_fixa->direita != NULL && renda_fixa->direita->tipo == ATIVO) {
-            renda_fixa->direita->valor_investido += valor_rf / 2;
+        resultado.ativos_com_aporte = plano.num_ordens;
+
+        liberar_plano(&plano);
+    } else {
+        // arredonda o percentual acumulado, assim a soma das partes fecha com o aporte
+        // (metas todas zero: as categorias com ativos recebem partes iguais)
+        double percentual_acumulado = 0.0;
+        Centavos distribuido = 0;
+
+        for(int i = 0; i < arvore->raiz->num_filhos; i++) {
+            No* categoria = arvore->raiz->filhos[i];
+
+            resultado.categorias[i].categoria = categoria;
+            resultado.categorias[i].antes = categoria->valor_total;
+            resultado.categorias[i].recebido = 0;
+            if(!no_investivel(categoria)) {
+                continue;
+            }
+
+            percentual_acumulado += soma_metas > 0.0 ? categoria->percentual_alvo / soma_metas : 1.0 / recebem;
+            Centavos valor_categoria = i == ultima ? valor_aporte - distribuido :
+                                       llround(valor_aporte * percentual_acumulado) - distribuido;
+            distribuido += valor_categoria;
+            resultado.categorias[i].recebido = valor_categoria;
+
+            // divide em partes iguais; um ativo direto na raiz recebe a parte inteira
+            if(categoria->tipo == ATIVO) {
+                alterar_valor_investido(arvore, categoria, categoria->valor_investido + valor_categoria);
+                resultado.ativos_com_aporte += valor_categoria > 0;
+            } else {
+                resultado.ativos_com_aporte += distribuir_aporte_igual(arvore, categoria, valor_categoria);
+            }
         }
     }
 
-    // distribuir para acoes (direita)
-    if(arvore->raiz->direita != NULL) {
-        No* acoes = arvore->raiz->direita;
-        float valor_rv = valor_aporte * (acoes->percentual_alvo / 100.0);
+    // desvio que sobra depois do aporte e se ainda sera preciso vender
+    resultado.depois = calcular_desbalanceamento(arvore, 2.0);
+
+    PlanoRebalanceamento pendente = planejar_rebalanceamento(arvore, 2.0);
+    resultado.ordens_pendentes = pendente.num_ordens;
+    resultado.vendas_pendentes = pendente.total_vendas;
+    liberar_plano(&pendente);
 
-        printf("* %s (%.0f%%): + R$ %.2f\n",
-               acoes->nome, acoes->percentual_alvo, valor_rv);
-        printf("  Novo total: R$ %.2f -> R$ %.2f\n\n",
-               acoes->valor_total, acoes->valor_total + valor_rv);
+    resultado.valor_total_novo = arvore->valor_total;
+
+    return resultado;
+}
 
-        // dividir entre os ativos da categoria
-        if(acoes->esquerda != NULL && acoes->esquerda->tipo == ATIVO) {
-            acoes->esquerda->valor_investido += valor_rv / 2;
+// Funcao para escrever a simulacao de aporte no relatorio
+void formatar_aporte(Relatorio* relatorio, const ResultadoAporte* resultado) {
+    if(relatorio->formato == FORMATO_TEXTO) {
+        if(resultado->erro == RELATORIO_CARTEIRA_VAZIA) {
+            relatorio_printf(relatorio, "\nCarteira vazia!\n");
+            return;
         }
-        if(acoes->direita != NULL && acoes->direita->tipo == ATIVO) {
-            acoes->direita->valor_investido += valor_rv / 2;
+        if(resultado->erro == RELATORIO_VALOR_INVALIDO) {
+            relatorio_printf(relatorio, "\nValor de aporte invalido!\n");
+            return;
         }
+
+        relatorio_printf(relatorio, "\n========================================\n");
+        relatorio_printf(relatorio, "SIMULACAO DE APORTE\n");
+        relatorio_printf(relatorio, "========================================\n");
+        relatorio_printf(relatorio, "Valor do aporte: R$ %.2f\n\n", centavos_para_reais(resultado->valor_aporte));
+
+        if(resultado->modo == APORTE_NIVELADO) {
+            relatorio_printf(relatorio, "Distribuicao por nivelamento (primeiro o que esta mais abaixo da meta):\n\n");
+        } else {
+            relatorio_printf(relatorio, "Distribuicao proporcional:\n\n");
+        }
+
+        for(int i = 0; i < resultado->num_categorias; i++) {
+            const AporteCategoria* c = &resultado->categorias[i];
+            if(!no_investivel(c->categoria)) {
+                relatorio_printf(relatorio, "* %s (%.0f%%): sem ativos, nada a receber\n\n",
+                                 c->categoria->nome, c->categoria->percentual_alvo);
+                continue;
+            }
+            relatorio_printf(relatorio, "* %s (%.0f%%): + R$ %.2f\n",
+                             c->categoria->nome, c->categoria->percentual_alvo, centavos_para_reais(c->recebido));
+            relatorio_printf(relatorio, "  Novo total: R$ %.2f -> R$ %.2f\n\n",
+                             centavos_para_reais(c->antes), centavos_para_reais(c->antes + c->recebido));
+        }
+
+        if(resultado->modo == APORTE_NIVELADO) {
+            relatorio_printf(relatorio, "Ativos que receberam aporte: %d\n\n", resultado->ativos_com_aporte);
+        }
+
+        relatorio_printf(relatorio, "Desvio depois do aporte:\n");
+        for(int i = 0; i < resultado->depois.num_categorias; i++) {
+            relatorio_printf(relatorio, "  %s: %+.1f%%\n",
+                             resultado->depois.categorias[i].categoria->nome, resultado->depois.categorias[i].diferenca);
+        }
+
+        if(resultado->ordens_pendentes == 0) {
+            relatorio_printf(relatorio, "Carteira dentro da tolerancia: nenhuma venda necessaria\n\n");
+        } else {
+            relatorio_printf(relatorio, "Ainda fora da tolerancia: %d ordens de rebalanceamento (R$ %.2f em vendas)\n\n",
+                             resultado->ordens_pendentes, centavos_para_reais(resultado->vendas_pendentes));
+        }
+
+        relatorio_printf(relatorio, "========================================\n");
+        relatorio_printf(relatorio, "Novo valor total da carteira: R$ %.2f\n", centavos_para_reais(resultado->valor_total_novo));
+        relatorio_printf(relatorio, "Carteira atualizada com aporte!\n");
+        relatorio_printf(relatorio, "========================================\n");
+        return;
     }
 
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
+    if(resultado->erro != RELATORIO_OK) {
+        formatar_erro_relatorio(relatorio, "aporte", resultado->erro);
+        return;
+    }
 
-    printf("========================================\n");
-    printf("Novo valor total da carteira: R$ %.2f\n", arvore->valor_total);
-    printf("Carteira atualizada com aporte!\n");
-    printf("========================================\n");
+    const char* modo = resultado->modo == APORTE_NIVELADO ? "nivelado" : "proporcional";
+
+    if(relatorio->formato == FORMATO_CSV) {
+        relatorio_printf(relatorio, "categoria,modo,meta,antes,recebido,depois,diferenca_depois\n");
+        for(int i = 0; i < resultado->num_categorias; i++) {
+            const AporteCategoria* c = &resultado->categorias[i];
+            relatorio_csv_texto(relatorio, c->categoria->nome);
+            relatorio_printf(relatorio, ",%s,%.4f,%.2f,%.2f,%.2f,%.4f\n", modo, c->categoria->percentual_alvo,
+                             centavos_para_reais(c->antes), centavos_para_reais(c->recebido),
+                             centavos_para_reais(c->antes + c->recebido), resultado->depois.categorias[i].diferenca);
+        }
+        return;
+    }
+
+    relatorio_printf(relatorio, "{\"relatorio\":\"aporte\",\"modo\":\"%s\",\"valor_aporte\":%.2f,\"ativos_com_aporte\":%d,"
+                     "\"ordens_pendentes\":%d,\"vendas_pendentes\":%.2f,\"valor_total\":%.2f,\"categorias\":[",
+                     modo, centavos_para_reais(resultado->valor_aporte), resultado->ativos_com_aporte,
+                     resultado->ordens_pendentes, centavos_para_reais(resultado->vendas_pendentes),
+                     centavos_para_reais(resultado->valor_total_novo));
+    for(int i = 0; i < resultado->num_categorias; i++) {
+        const AporteCategoria* c = &resultado->categorias[i];
+        relatorio_printf(relatorio, "%s{\"nome\":", i > 0 ? "," : "");
+        relatorio_json_texto(relatorio, c->categoria->nome);
+        relatorio_printf(relatorio, ",\"meta\":%.4f,\"antes\":%.2f,\"recebido\":%.2f,\"diferenca_depois\":%.4f}",
+                         c->categoria->percentual_alvo, centavos_para_reais(c->antes), centavos_para_reais(c->recebido),
+                         resultado->depois.categorias[i].diferenca);
+    }
+    relatorio_printf(relatorio, "]}\n");
+}
+
+void liberar_resultado_aporte(ResultadoAporte* resultado) {
+    free(resultado->categorias);
+    resultado->categorias = NULL;
+    resultado->num_categorias = 0;
+    liberar_resultado_balanceamento(&resultado->depois);
+}
+
+// Funcao para simular aporte
+void simular_aporte(Arvore* arvore, Centavos valor_aporte, int modo) {
+    ResultadoAporte resultado = calcular_aporte(arvore, valor_aporte, modo);
+    if(resultado.erro == RELATORIO_OK) {
+        diario_registrar(DIARIO_APORTE, modo, valor_aporte, 0.0, NULL, NULL);
+    }
+
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_aporte(&relatorio, &resultado);
+    relatorio_escrever(&relatorio, stdout);
+
+    relatorio_liberar(&relatorio);
+    liberar_resultado_aporte(&resultado);
 }
 
 // Funcao para atualizar valores de mercado
-void atualizar_valores_mercado(Arvore* arvore, char* nome_ativo, float novo_valor) {
+void atualizar_valores_mercado(Arvore* arvore, char* nome_ativo, Centavos novo_valor) {
     if(arvore == NULL || arvore->raiz == NULL) {
         printf("\nCarteira vazia!\n");
         return;
     }
 
-    No* ativo = buscar_no(arvore->raiz, nome_ativo);
+    No* ativo = buscar_no(arvore, nome_ativo);
 
     if(ativo == NULL) {
         printf("\nAtivo nao encontrado!\n");
@@ -280,24 +547,107 @@ void atualizar_valores_mercado(Arvore* arvore, char* nome_ativo, float novo_valo
         return;
     }
 
-    float valor_anterior = ativo->valor_investido;
-    float variacao = 0.0;
-    if(valor_anterior != 0.0) {
-        variacao = ((novo_valor - valor_anterior) / valor_anterior) * 100.0;
+    Centavos valor_anterior = ativo->valor_investido;
+    double variacao = 0.0;
+    if(valor_anterior != 0) {
+        variacao = ((double) (novo_valor - valor_anterior) / valor_anterior) * 100.0;
     }
 
-    ativo->valor_investido = novo_valor;
-
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
+    alterar_valor_investido(arvore, ativo, novo_valor);
+    diario_registrar(DIARIO_ATUALIZAR, 0, novo_valor, 0.0, ativo->nome, NULL);
 
     printf("\n========================================\n");
     printf("ATUALIZACAO DE MERCADO\n");
     printf("========================================\n");
     printf("Ativo: %s\n", nome_ativo);
-    printf("Valor anterior: R$ %.2f\n", valor_anterior);
-    printf("Novo valor: R$ %.2f\n", novo_valor);
+    printf("Valor anterior: R$ %.2f\n", centavos_para_reais(valor_anterior));
+    printf("Novo valor: R$ %.2f\n", centavos_para_reais(novo_valor));
     printf("Variacao: %+.2f%%\n", variacao);
     printf("========================================\n");
     printf("\nDica: Use detectar_desbalanceamento() para verificar.\n");
-}
\ No newline at end of file
+}
+
+// Funcao para aplicar varias atualizacoes de mercado de uma vez (sem imprimir)
+ResumoLoteMercado atualizar_valores_mercado_lote(Arvore* arvore, const AtualizacaoMercado* atualizacoes, int quantidade) {
+    ResumoLoteMercado resumo;
+    memset(&resumo, 0, sizeof(resumo));
+
+    if(arvore == NULL || arvore->raiz == NULL) {
+        resumo.nao_encontradas = quantidade;
+        return resumo;
+    }
+
+    garantir_totais(arvore);
+    resumo.valor_total_anterior = arvore->valor_total;
+
+    for(int i = 0; i < quantidade; i++) {
+        No* ativo = buscar_no(arvore, atualizacoes[i].nome_ativo);
+
+        if(ativo == NULL || ativo->tipo != ATIVO) {
+            resumo.nao_encontradas++;
+            continue;
+        }
+
+        Centavos valor_anterior = ativo->valor_investido;
+        Centavos novo_valor = atualizacoes[i].novo_valor;
+        double variacao = 0.0;
+        if(valor_anterior != 0) {
+            variacao = ((double) (novo_valor - valor_anterior) / valor_anterior) * 100.0;
+        }
+
+        if(resumo.maior_alta == NULL || variacao > resumo.variacao_maior_alta) {
+            resumo.maior_alta = ativo;
+            resumo.variacao_maior_alta = variacao;
+        }
+        if(resumo.maior_baixa == NULL || variacao < resumo.variacao_maior_baixa) {
+            resumo.maior_baixa = ativo;
+            resumo.variacao_maior_baixa = variacao;
+        }
+
+        // os totais sao refeitos uma vez so no fim do lote
+        definir_valor_no(ativo, novo_valor);
+        diario_registrar(DIARIO_ATUALIZAR, 0, novo_valor, 0.0, ativo->nome, NULL);
+        resumo.aplicadas++;
+    }
+
+    if(resumo.aplicadas > 0) {
+        arvore->totais_sujos = 1;
+        garantir_totais(arvore);
+    }
+
+    resumo.valor_total_novo = arvore->valor_total;
+    if(resumo.valor_total_anterior != 0) {
+        resumo.variacao_total = ((double) (resumo.valor_total_novo - resumo.valor_total_anterior) / resumo.valor_total_anterior) * 100.0;
+    }
+
+    return resumo;
+}
+
+// Funcao para desligar os alertas de desvio
+void desligar_alertas(Arvore* arvore) {
+    if(arvore == NULL || arvore->alertas == NULL) {
+        return;
+    }
+
+    IndiceAlertas* indice = arvore->alertas;
+    for(int i = 0; i < indice->num_entradas; i++) {
+        indice->entradas[i].no->alerta = -1;
+    }
+
+    liberar_indice_alertas(indice);
+    arvore->alertas = NULL;
+}
+
+// Funcao para ligar os alertas de desvio (o callback e chamado quando um no entra ou sai da faixa)
+// O callback nao pode mexer na carteira; se os alertas ja estavam ligados, a tolerancia e o callback sao trocados
+void ligar_alertas(Arvore* arvore, double tolerancia, CallbackAlerta callback, void* contexto) {
+    if(arvore == NULL) {
+        return;
+    }
+
+    desligar_alertas(arvore);
+    if(arvore->raiz != NULL) {
+        garantir_totais(arvore);
+    }
+    arvore->alertas = criar_indice_alertas(arvore, tolerancia, callback, contexto, NULL);
+}
@@ -3,153 +3,1279 @@
 #include <string.h>
 #include <math.h>
 
-// parte do luis - arvore binaria
-
-#define ATIVO 2
-#define CATEGORIA 1
-#define RAIZ 0
-
-typedef struct No {
-    char nome[64];
-    int tipo;
-    float percentual_alvo;
-    float valor_investido;
-    float valor_total;
-    struct No* esquerda;
-    struct No* direita;
-} No;
-
-typedef struct Arvore {
-    No* raiz;
-    float valor_total;
-} Arvore;
-
-// Funcao para criar um no novo
-No* criar_no(const char* nome, int tipo, float percentual_alvo, float valor_investido) {
-    No* novo = (No*) malloc(sizeof(No));
-
-    // copiar o nome
+// parte do luis - arvore n-aria
+
+#include "../struct.h"
+
+// declaracoes do escritor de relatorios
+void relatorio_iniciar(Relatorio* relatorio, int formato);
+void relatorio_printf(Relatorio* relatorio, const char* formato, ...);
+void relatorio_json_texto(Relatorio* relatorio, const char* texto);
+void relatorio_csv_texto(Relatorio* relatorio, const char* texto);
+void relatorio_escrever(Relatorio* relatorio, FILE* saida);
+void relatorio_liberar(Relatorio* relatorio);
+void formatar_erro_relatorio(Relatorio* relatorio, const char* nome, int erro);
+
+// declaracoes do indice de alertas
+void alertas_no_mudou(IndiceAlertas* indice, No* no);
+void contar_nos_alerta(const No* no, int* nos, int* internos);
+void reconstruir_indice_alertas(Arvore* arvore);
+void liberar_indice_alertas(IndiceAlertas* indice);
+
+// declaracoes do diario de operacoes
+void diario_registrar(int operacao, int modo, Centavos valor, double quantidade, const char* nome,
+                      const char* categoria);
+
+// Marcador de slot removido no indice
+static No indice_lapide;
+#define INDICE_LAPIDE (&indice_lapide)
+
+// Funcao para calcular o hash de um nome (FNV-1a)
+unsigned int hash_nome(const char* nome) {
+    unsigned int hash = 2166136261u;
+
+    while(*nome != '\0') {
+        hash = hash ^ (unsigned char) *nome;
+        hash = hash * 16777619u;
+        nome++;
+    }
+
+    return hash;
+}
+
+// Funcao para calcular o hash dos primeiros tamanho caracteres de um nome
+unsigned int hash_nome_n(const char* nome, int tamanho) {
+    unsigned int hash = 2166136261u;
+
+    for(int i = 0; i < tamanho; i++) {
+        hash = hash ^ (unsigned char) nome[i];
+        hash = hash * 16777619u;
+    }
+
+    return hash;
+}
+
+// Funcao para iniciar o indice de nomes
+void indice_iniciar(IndiceNomes* indice, int capacidade) {
+    int cap = 16;
+    while(cap < capacidade * 2) {
+        cap = cap * 2;
+    }
+
+    indice->slots = (No**) calloc(cap, sizeof(No*));
+    indice->capacidade = cap;
+    indice->quantidade = 0;
+    indice->ocupados = 0;
+}
+
+// Funcao para buscar um no no indice por um nome que nao termina em '\0'
+No* indice_buscar_n(const IndiceNomes* indice, const char* nome, int tamanho) {
+    if(indice->slots == NULL || tamanho > 63) {
+        return NULL;
+    }
+
+    unsigned int hash = hash_nome_n(nome, tamanho);
+    unsigned int mascara = indice->capacidade - 1;
+    unsigned int i = hash & mascara;
+    long long visitados = 1;
+
+    ESTATISTICA_SOMAR(buscas, 1);
+
+    while(indice->slots[i] != NULL) {
+        No* no = indice->slots[i];
+        if(no != INDICE_LAPIDE && no->hash == hash &&
+           memcmp(no->nome, nome, tamanho) == 0 && no->nome[tamanho] == '\0') {
+            ESTATISTICA_SOMAR(slots_visitados, visitados);
+            ESTATISTICA_SOMAR(buscas_encontradas, 1);
+            return no;
+        }
+        i = (i + 1) & mascara;
+        visitados++;
+    }
+
+    ESTATISTICA_SOMAR(slots_visitados, visitados);
+    return NULL;
+}
+
+// Funcao para buscar um no no indice
+No* indice_buscar(const IndiceNomes* indice, const char* nome) {
+    return indice_buscar_n(indice, nome, strlen(nome));
+}
+
+// Funcao para redimensionar o indice (descarta as lapides)
+void indice_redimensionar(IndiceNomes* indice, int nova_capacidade) {
+    No** antigos = indice->slots;
+    int capacidade_antiga = indice->capacidade;
+
+    indice->slots = (No**) calloc(nova_capacidade, sizeof(No*));
+    indice->capacidade = nova_capacidade;
+    indice->ocupados = indice->quantidade;
+
+    unsigned int mascara = nova_capacidade - 1;
+    for(int j = 0; j < capacidade_antiga; j++) {
+        No* no = antigos[j];
+        if(no == NULL || no == INDICE_LAPIDE) {
+            continue;
+        }
+
+        unsigned int i = no->hash & mascara;
+        while(indice->slots[i] != NULL) {
+            i = (i + 1) & mascara;
+        }
+        indice->slots[i] = no;
+    }
+
+    free(antigos);
+}
+
+// Funcao para inserir um no no indice (nomes repetidos mantem o primeiro)
+void indice_inserir(IndiceNomes* indice, No* no) {
+    if((indice->ocupados + 1) * 4 > indice->capacidade * 3) {
+        int nova_capacidade = indice->capacidade;
+        if((indice->quantidade + 1) * 2 > indice->capacidade) {
+            nova_capacidade = indice->capacidade * 2;
+        }
+        indice_redimensionar(indice, nova_capacidade);
+    }
+
+    unsigned int mascara = indice->capacidade - 1;
+    unsigned int i = no->hash & mascara;
+    int lapide = -1;
+
+    while(indice->slots[i] != NULL) {
+        No* atual = indice->slots[i];
+        if(atual == INDICE_LAPIDE) {
+            if(lapide < 0) {
+                lapide = i;
+            }
+        } else if(atual->hash == no->hash && strcmp(atual->nome, no->nome) == 0) {
+            return;
+        }
+        i = (i + 1) & mascara;
+    }
+
+    if(lapide >= 0) {
+        indice->slots[lapide] = no;
+    } else {
+        indice->slots[i] = no;
+        indice->ocupados++;
+    }
+    indice->quantidade++;
+}
+
+// Funcao para remover um no do indice
+void indice_remover(IndiceNomes* indice, No* no) {
+    if(indice->slots == NULL) {
+        return;
+    }
+
+    unsigned int mascara = indice->capacidade - 1;
+    unsigned int i = no->hash & mascara;
+
+    while(indice->slots[i] != NULL) {
+        if(indice->slots[i] == no) {
+            indice->slots[i] = INDICE_LAPIDE;
+            indice->quantidade--;
+            return;
+        }
+        i = (i + 1) & mascara;
+    }
+}
+
+void indice_liberar(IndiceNomes* indice) {
+    free(indice->slots);
+    indice->slots = NULL;
+    indice->capacidade = 0;
+    indice->quantidade = 0;
+    indice->ocupados = 0;
+}
+
+// Tabela de precos do processo (compartilhada por todas as carteiras)
+TabelaPrecos tabela_precos;
+
+// Funcao para buscar o id de um ticker na tabela de precos (-1 se nao existir)
+int precos_buscar(const char* ticker) {
+    if(tabela_precos.slots == NULL) {
+        return -1;
+    }
+
+    unsigned int hash = hash_nome(ticker);
+    unsigned int mascara = tabela_precos.capacidade_slots - 1;
+    unsigned int i = hash & mascara;
+
+    while(tabela_precos.slots[i] != 0) {
+        int id = tabela_precos.slots[i] - 1;
+        if(tabela_precos.hashes[id] == hash && strcmp(tabela_precos.tickers[id], ticker) == 0) {
+            return id;
+        }
+        i = (i + 1) & mascara;
+    }
+
+    return -1;
+}
+
+// Funcao para dobrar os slots da tabela de precos (os slots guardam id + 1; 0 = vazio)
+void precos_redimensionar_slots(int nova_capacidade) {
+    free(tabela_precos.slots);
+    tabela_precos.slots = (int*) calloc(nova_capacidade, sizeof(int));
+    tabela_precos.capacidade_slots = nova_capacidade;
+
+    unsigned int mascara = nova_capacidade - 1;
+    for(int id = 0; id < tabela_precos.quantidade; id++) {
+        unsigned int i = tabela_precos.hashes[id] & mascara;
+        while(tabela_precos.slots[i] != 0) {
+            i = (i + 1) & mascara;
+        }
+        tabela_precos.slots[i] = id + 1;
+    }
+}
+
+// Funcao para registrar um ticker com um preco inicial (se ja existir, so devolve o id)
+// O registro nao muda a epoca: so mudancas de preco fazem as carteiras se reavaliarem
+int precos_registrar(const char* ticker, Centavos preco) {
+    int id = precos_buscar(ticker);
+    if(id >= 0) {
+        return id;
+    }
+
+    if(tabela_precos.quantidade == tabela_precos.capacidade) {
+        int nova = tabela_precos.capacidade == 0 ? 64 : tabela_precos.capacidade * 2;
+        tabela_precos.tickers = (char (*)[64]) realloc(tabela_precos.tickers, nova * sizeof(*tabela_precos.tickers));
+        tabela_precos.hashes = (unsigned int*) realloc(tabela_precos.hashes, nova * sizeof(unsigned int));
+        tabela_precos.precos = (Centavos*) realloc(tabela_precos.precos, nova * sizeof(Centavos));
+        tabela_precos.epocas = (unsigned long long*) realloc(tabela_precos.epocas, nova * sizeof(unsigned long long));
+        tabela_precos.capacidade = nova;
+    }
+    if((tabela_precos.quantidade + 1) * 2 > tabela_precos.capacidade_slots) {
+        precos_redimensionar_slots(tabela_precos.capacidade_slots == 0 ? 128 : tabela_precos.capacidade_slots * 2);
+    }
+
+    id = tabela_precos.quantidade++;
+    strncpy(tabela_precos.tickers[id], ticker, 63);
+    tabela_precos.tickers[id][63] = '\0';
+    tabela_precos.hashes[id] = hash_nome(tabela_precos.tickers[id]);
+    tabela_precos.precos[id] = preco;
+    tabela_precos.epocas[id] = 0;
+
+    unsigned int mascara = tabela_precos.capacidade_slots - 1;
+    unsigned int i = tabela_precos.hashes[id] & mascara;
+    while(tabela_precos.slots[i] != 0) {
+        i = (i + 1) & mascara;
+    }
+    tabela_precos.slots[i] = id + 1;
+
+    return id;
+}
+
+// Funcao para trocar o preco de um ticker: O(1), nenhuma carteira e tocada aqui
+void precos_atualizar(int id, Centavos preco) {
+    if(tabela_precos.precos[id] == preco) {
+        return;
+    }
+
+    tabela_precos.precos[id] = preco;
+    tabela_precos.epoca++;
+    tabela_precos.epocas[id] = tabela_precos.epoca;
+}
+
+// Funcao para trocar o preco de um ticker pelo nome (registra se ainda nao existir)
+int atualizar_preco(const char* ticker, Centavos preco) {
+    int id = precos_buscar(ticker);
+    if(id < 0) {
+        id = precos_registrar(ticker, preco);
+    } else {
+        precos_atualizar(id, preco);
+    }
+
+    diario_registrar(DIARIO_PRECO, 0, preco, 0.0, ticker, NULL);
+    return id;
+}
+
+void liberar_tabela_precos() {
+    free(tabela_precos.tickers);
+    free(tabela_precos.hashes);
+    free(tabela_precos.precos);
+    free(tabela_precos.epocas);
+    free(tabela_precos.slots);
+    memset(&tabela_precos, 0, sizeof(tabela_precos));
+}
+
+// Funcao para iniciar a arena (capacidade_nos pre-dimensiona o primeiro bloco)
+void arena_iniciar(ArenaNos* arena, int capacidade_nos) {
+    arena->blocos_nos = NULL;
+    arena->blocos_filhos = NULL;
+    arena->nos_livres = NULL;
+    for(int i = 0; i < ARENA_CLASSES; i++) {
+        arena->filhos_livres[i] = NULL;
+    }
+    arena->nos_em_uso = 0;
+    arena->num_livres = 0;
+
+    if(capacidade_nos > 0) {
+        BlocoNos* bloco = (BlocoNos*) malloc(sizeof(BlocoNos) + capacidade_nos * sizeof(No));
+        bloco->proximo = NULL;
+        bloco->capacidade = capacidade_nos;
+        bloco->usados = 0;
+        arena->blocos_nos = bloco;
+
+        int ponteiros = capacidade_nos * 2;
+        BlocoFilhos* filhos = (BlocoFilhos*) malloc(sizeof(BlocoFilhos) + ponteiros * sizeof(No*));
+        filhos->proximo = NULL;
+        filhos->capacidade = ponteiros;
+        filhos->usados = 0;
+        arena->blocos_filhos = filhos;
+    }
+}
+
+// Funcao para pegar um no da arena (reaproveita nos devolvidos)
+No* arena_alocar_no(ArenaNos* arena) {
+    arena->nos_em_uso++;
+
+    if(arena->nos_livres != NULL) {
+        No* no = arena->nos_livres;
+        arena->nos_livres = no->pai;
+        arena->num_livres--;
+        return no;
+    }
+
+    BlocoNos* bloco = arena->blocos_nos;
+    if(bloco == NULL || bloco->usados == bloco->capacidade) {
+        int capacidade = bloco == NULL ? 64 : bloco->capacidade * 2;
+        BlocoNos* novo = (BlocoNos*) malloc(sizeof(BlocoNos) + capacidade * sizeof(No));
+        novo->proximo = bloco;
+        novo->capacidade = capacidade;
+        novo->usados = 0;
+        arena->blocos_nos = novo;
+        bloco = novo;
+    }
+
+    No* no = &bloco->nos[bloco->usados];
+    bloco->usados++;
+    return no;
+}
+
+// Funcao para pegar quantidade nos contiguos da arena (sem passar pela lista de livres)
+No* arena_alocar_nos(ArenaNos* arena, int quantidade) {
+    BlocoNos* bloco = arena->blocos_nos;
+    if(bloco == NULL || bloco->capacidade - bloco->usados < quantidade) {
+        int capacidade = bloco == NULL ? 64 : bloco->capacidade * 2;
+        while(capacidade < quantidade) {
+            capacidade = capacidade * 2;
+        }
+
+        BlocoNos* novo = (BlocoNos*) malloc(sizeof(BlocoNos) + capacidade * sizeof(No));
+        novo->proximo = bloco;
+        novo->capacidade = capacidade;
+        novo->usados = 0;
+        arena->blocos_nos = novo;
+        bloco = novo;
+    }
+
+    No* nos = &bloco->nos[bloco->usados];
+    bloco->usados += quantidade;
+    arena->nos_em_uso += quantidade;
+    return nos;
+}
+
+// Funcao para devolver um no para a arena (o slot e reaproveitado)
+void arena_devolver_no(ArenaNos* arena, No* no) {
+    no->pai = arena->nos_livres;
+    arena->nos_livres = no;
+    arena->nos_em_uso--;
+    arena->num_livres++;
+}
+
+// Funcao para achar a classe de tamanho de um vetor de filhos (capacidade = 2^classe)
+int arena_classe(int capacidade) {
+    int classe = 0;
+    while((1 << classe) < capacidade) {
+        classe++;
+    }
+    return classe;
+}
+
+// Funcao para pegar um vetor de filhos da arena (capacidade potencia de 2)
+No** arena_alocar_filhos(ArenaNos* arena, int capacidade) {
+    int classe = arena_classe(capacidade);
+
+    if(arena->filhos_livres[classe] != NULL) {
+        No** vetor = arena->filhos_livres[classe];
+        arena->filhos_livres[classe] = (No**) vetor[0];
+        return vetor;
+    }
+
+    BlocoFilhos* bloco = arena->blocos_filhos;
+    if(bloco == NULL || bloco->capacidade - bloco->usados < capacidade) {
+        int tamanho = bloco == NULL ? 256 : bloco->capacidade * 2;
+        while(tamanho < capacidade) {
+            tamanho = tamanho * 2;
+        }
+
+        BlocoFilhos* novo = (BlocoFilhos*) malloc(sizeof(BlocoFilhos) + tamanho * sizeof(No*));
+        novo->proximo = bloco;
+        novo->capacidade = tamanho;
+        novo->usados = 0;
+        arena->blocos_filhos = novo;
+        bloco = novo;
+    }
+
+    No** vetor = &bloco->ponteiros[bloco->usados];
+    bloco->usados += capacidade;
+    return vetor;
+}
+
+// Funcao para devolver um vetor de filhos para a lista da sua classe
+void arena_devolver_filhos(ArenaNos* arena, No** vetor, int capacidade) {
+    if(vetor == NULL) {
+        return;
+    }
+
+    int classe = arena_classe(capacidade);
+    vetor[0] = (No*) arena->filhos_livres[classe];
+    arena->filhos_livres[classe] = vetor;
+}
+
+// Funcao para liberar todos os blocos da arena de uma vez
+void arena_liberar(ArenaNos* arena) {
+    while(arena->blocos_nos != NULL) {
+        BlocoNos* proximo = arena->blocos_nos->proximo;
+        free(arena->blocos_nos);
+        arena->blocos_nos = proximo;
+    }
+
+    while(arena->blocos_filhos != NULL) {
+        BlocoFilhos* proximo = arena->blocos_filhos->proximo;
+        free(arena->blocos_filhos);
+        arena->blocos_filhos = proximo;
+    }
+
+    arena->nos_livres = NULL;
+    for(int i = 0; i < ARENA_CLASSES; i++) {
+        arena->filhos_livres[i] = NULL;
+    }
+    arena->nos_em_uso = 0;
+    arena->num_livres = 0;
+}
+
+// Funcao para criar uma arvore vazia (capacidade_nos = numero esperado de nos, 0 se nao souber)
+Arvore* criar_arvore(int capacidade_nos) {
+    Arvore* arvore = (Arvore*) malloc(sizeof(Arvore));
+
+    arvore->raiz = NULL;
+    arvore->valor_total = 0.0;
+    arvore->totais_sujos = 1;
+    indice_iniciar(&arvore->indice, capacidade_nos);
+    arena_iniciar(&arvore->arena, capacidade_nos);
+    arvore->alertas = NULL;
+    arvore->cotados = NULL;
+    arvore->num_cotados = 0;
+    arvore->cap_cotados = 0;
+    arvore->epoca_precos = 0;
+
+    return arvore;
+}
+
+// Funcao para criar um no novo (alocado na arena e registrado no indice da arvore)
+No* criar_no(Arvore* arvore, const char* nome, int tipo, double percentual_alvo, Centavos valor_investido) {
+    long long alocacoes_antes = estatisticas.ativas ? alocacoes_feitas : 0;
+    No* novo = arena_alocar_no(&arvore->arena);
+
     strncpy(novo->nome, nome, 63);
     novo->nome[63] = '\0';
+    novo->hash = hash_nome(novo->nome);
 
     novo->tipo = tipo;
     novo->percentual_alvo = percentual_alvo;
     novo->valor_investido = valor_investido;
-    novo->valor_total = 0.0;
-    novo->esquerda = NULL;
-    novo->direita = NULL;
+    novo->valor_total = 0;
+    novo->pai = NULL;
+    novo->filhos = NULL;
+    novo->num_filhos = 0;
+    novo->cap_filhos = 0;
+    novo->alerta = -1;
+    novo->id_preco = -1;
+    novo->quantidade = 0.0;
+
+    indice_inserir(&arvore->indice, novo);
+
+    ESTATISTICA_SOMAR(nos_criados, 1);
+    ESTATISTICA_SOMAR(alocacoes_criar_no, alocacoes_feitas - alocacoes_antes);
 
     return novo;
 }
 
-// Funcao para buscar um no pelo nome (recursivo)
-No* buscar_no(No* raiz, const char* nome) {
-    if(raiz == NULL) {
+// Funcao para buscar um no pelo nome (pelo indice, sem percorrer a arvore)
+No* buscar_no(Arvore* arvore, const char* nome) {
+    if(arvore == NULL) {
         return NULL;
     }
 
-    // verificar se e o no atual
-    if(strcmp(raiz->nome, nome) == 0) {
-        return raiz;
-    }
+    return indice_buscar(&arvore->indice, nome);
+}
 
-    // procurar na esquerda
-    No* resultado = buscar_no(raiz->esquerda, nome);
-    if(resultado != NULL) {
-        return resultado;
+// Funcao para adicionar um filho no fim do vetor de filhos
+void adicionar_filho(Arvore* arvore, No* pai, No* filho) {
+    if(pai->num_filhos == pai->cap_filhos) {
+        int nova_cap = pai->cap_filhos == 0 ? 2 : pai->cap_filhos * 2;
+        No** novos = arena_alocar_filhos(&arvore->arena, nova_cap);
+
+        if(pai->num_filhos > 0) {
+            memcpy(novos, pai->filhos, pai->num_filhos * sizeof(No*));
+        }
+        arena_devolver_filhos(&arvore->arena, pai->filhos, pai->cap_filhos);
+
+        pai->filhos = novos;
+        pai->cap_filhos = nova_cap;
     }
 
-    // procurar na direita
-    return buscar_no(raiz->direita, nome);
+    pai->filhos[pai->num_filhos] = filho;
+    pai->num_filhos++;
+    filho->pai = pai;
+
+    // a estrutura mudou: o indice de alertas e refeito (o novo filho ainda nao esta nos totais)
+    if(arvore->alertas != NULL) {
+        reconstruir_indice_alertas(arvore);
+    }
 }
 
 // Funcao para calcular o total de um no (recursivo)
-float calcular_total_no(No* no) {
+Centavos calcular_total_no(No* no) {
     if(no == NULL) {
-        return 0.0;
+        return 0;
     }
 
-    // se nao tem filhos, retorna o valor investido
-    if(no->esquerda == NULL && no->direita == NULL) {
+    if(no->num_filhos == 0) {
         no->valor_total = no->valor_investido;
         return no->valor_total;
     }
 
-    // se tem filhos, soma todos
-    float soma = 0.0;
-    soma = soma + calcular_total_no(no->esquerda);
-    soma = soma + calcular_total_no(no->direita);
-
-    // adiciona o valor proprio tambem
+    Centavos soma = 0;
+    for(int i = 0; i < no->num_filhos; i++) {
+        soma = soma + calcular_total_no(no->filhos[i]);
+    }
     soma = soma + no->valor_investido;
-    no->valor_total = soma;
 
+    no->valor_total = soma;
     return soma;
 }
 
-// Funcao para criar carteira por perfil
-Arvore* criar_carteira_perfil(float valor_inicial, const char* perfil) {
-    // alocar memoria para a arvore
-    Arvore* carteira = (Arvore*) malloc(sizeof(Arvore));
+// Funcao para somar uma variacao no no e em todos os seus ancestrais
+void propagar_delta(Arvore* arvore, No* no, Centavos delta) {
+    if(arvore->totais_sujos) {
+        return;
+    }
+
+    No* origem = no;
+    while(no != NULL) {
+        no->valor_total += delta;
+        no = no->pai;
+    }
+
+    arvore->valor_total += delta;
+
+    if(arvore->alertas != NULL) {
+        alertas_no_mudou(arvore->alertas, origem);
+    }
+}
+
+// Funcao para trocar o valor de um no sem mexer nos totais
+// (numa posicao cotada o valor novo vira quantidade: comprar R$ X e comprar X / preco cotas)
+void definir_valor_no(No* no, Centavos novo_valor) {
+    if(no->id_preco >= 0) {
+        Centavos preco = tabela_precos.precos[no->id_preco];
+        no->quantidade = preco > 0 ? (double) novo_valor / preco : 0.0;
+    }
+
+    no->valor_investido = novo_valor;
+}
+
+// Funcao para trocar o valor investido de um no sem recalcular a arvore toda
+void alterar_valor_investido(Arvore* arvore, No* no, Centavos novo_valor) {
+    Centavos delta = novo_valor - no->valor_investido;
+
+    definir_valor_no(no, novo_valor);
+    propagar_delta(arvore, no, delta);
+}
+
+// Funcao para reavaliar as posicoes cotadas cujo preco mudou desde a ultima leitura
+// Custo: O(posicoes cotadas da carteira), pago so quando a carteira e lida
+void reavaliar_posicoes(Arvore* arvore) {
+    for(int i = 0; i < arvore->num_cotados; i++) {
+        No* no = arvore->cotados[i];
+        if(tabela_precos.epocas[no->id_preco] <= arvore->epoca_precos) {
+            continue;
+        }
+
+        Centavos novo_valor = llround(no->quantidade * tabela_precos.precos[no->id_preco]);
+        Centavos delta = novo_valor - no->valor_investido;
+
+        no->valor_investido = novo_valor;
+        propagar_delta(arvore, no, delta);
+    }
+
+    arvore->epoca_precos = tabela_precos.epoca;
+}
+
+// Funcao para ligar um no a tabela de precos pelo nome dele, sem mexer no valor
+// (se o ticker ainda nao existir, ele entra com o preco que faz quantidade * preco = valor atual)
+void vincular_posicao(Arvore* arvore, No* no, double quantidade) {
+    if(no->id_preco < 0) {
+        if(arvore->num_cotados == arvore->cap_cotados) {
+            arvore->cap_cotados = arvore->cap_cotados == 0 ? 16 : arvore->cap_cotados * 2;
+            arvore->cotados = (No**) realloc(arvore->cotados, arvore->cap_cotados * sizeof(No*));
+        }
+        arvore->cotados[arvore->num_cotados++] = no;
+    }
+
+    Centavos preco = quantidade > 0.0 ? llround(no->valor_investido / quantidade) : 0;
+    no->id_preco = precos_registrar(no->nome, preco);
+    no->quantidade = quantidade;
+}
+
+// Funcao para tirar um no da lista de posicoes cotadas da carteira (o ticker continua na tabela)
+void desvincular_posicao(Arvore* arvore, No* no) {
+    for(int i = 0; i < arvore->num_cotados; i++) {
+        if(arvore->cotados[i] == no) {
+            arvore->cotados[i] = arvore->cotados[--arvore->num_cotados];
+            break;
+        }
+    }
+
+    no->id_preco = -1;
+    no->quantidade = 0.0;
+}
+
+// Funcao para transformar um ativo em posicao cotada: quantidade cotas do ticker com o nome dele
+void definir_posicao(Arvore* arvore, No* no, double quantidade) {
+    int novo_ticker = precos_buscar(no->nome) < 0;
+
+    vincular_posicao(arvore, no, quantidade);
+    if(!novo_ticker) {
+        Centavos novo_valor = llround(quantidade * tabela_precos.precos[no->id_preco]);
+        Centavos delta = novo_valor - no->valor_investido;
+
+        no->valor_investido = novo_valor;
+        propagar_delta(arvore, no, delta);
+    }
+}
+
+// Funcao para garantir os totais (so recalcula tudo se estiverem sujos)
+void garantir_totais(Arvore* arvore) {
+    // precos que mudaram desde a ultima leitura (com os totais limpos, so o caminho de cada posicao muda)
+    if(arvore->num_cotados > 0 && arvore->epoca_precos != tabela_precos.epoca) {
+        reavaliar_posicoes(arvore);
+    }
+
+    if(!arvore->totais_sujos) {
+        return;
+    }
+
+    ESTATISTICA_INICIO(inicio);
+    calcular_total_no(arvore->raiz);
+    arvore->valor_total = arvore->raiz->valor_total;
+    arvore->totais_sujos = 0;
+
+    ESTATISTICA_SOMAR(passes_total, 1);
+    ESTATISTICA_SOMAR(nos_somados, arvore->arena.nos_em_uso);
+    ESTATISTICA_SOMAR(ns_total, agora_ns() - inicio);
+
+    // os totais mudaram sem passar pelo indice: refaz e avisa o que mudou
+    if(arvore->alertas != NULL) {
+        reconstruir_indice_alertas(arvore);
+    }
+}
+
+// Funcao para converter reais em centavos (arredonda para o centavo mais proximo)
+Centavos reais_para_centavos(double reais) {
+    return llround(reais * 100.0);
+}
+
+// Funcao para converter centavos em reais (so para mostrar e para calcular percentuais)
+double centavos_para_reais(Centavos centavos) {
+    return centavos / 100.0;
+}
+
+// Perfis conhecidos: os padrao entram na primeira busca, os de arquivo substituem os de mesmo nome
+CatalogoPerfis catalogo_perfis;
+
+// Perfis padrao no mesmo formato do arquivo de configuracao
+// [perfil NOME] abre um perfil; categoria NOME;PESO e ativo NOME[;PESO] (o ativo fica na ultima categoria)
+// Sem peso os ativos dividem a categoria em partes iguais e ficam sem meta propria
+const char* perfis_padrao =
+    "[perfil CONSERVADOR]\n"
+    "categoria Renda Fixa;70\n" "ativo Tesouro Selic\n" "ativo CDB XP\n"
+    "categoria Acoes;30\n" "ativo PETR4\n" "ativo ITUB4\n"
+    "[perfil MODERADO]\n"
+    "categoria Renda Fixa;50\n" "ativo Tesouro Selic\n" "ativo CDB XP\n"
+    "categoria Acoes;50\n" "ativo PETR4\n" "ativo ITUB4\n"
+    "[perfil ARROJADO]\n"
+    "categoria Renda Fixa;30\n" "ativo Tesouro Selic\n" "ativo CDB XP\n"
+    "categoria Acoes;70\n" "ativo PETR4\n" "ativo ITUB4\n";
+
+// Funcao para preencher um no de modelo (o resto dos campos fica como o criar_no deixaria)
+void preencher_prototipo(No* no, const char* nome, int tipo, double percentual_alvo) {
+    memset(no, 0, sizeof(No));
+    strncpy(no->nome, nome, 63);
+    no->nome[63] = '\0';
+    no->hash = hash_nome(no->nome);
+    no->tipo = tipo;
+    no->percentual_alvo = percentual_alvo;
+    no->alerta = -1;
+    no->id_preco = -1;
+}
+
+// Funcao para montar o layout plano de um perfil a partir das linhas lidas
+// Devolve NULL se estiver tudo certo, ou a mensagem de erro (e em linha_erro a linha do item culpado;
+// erros do perfil inteiro deixam linha_erro como veio, a linha do [perfil NOME])
+const char* montar_modelo_perfil(ModeloPerfil* modelo, const char* nome, const ItemPerfil* itens, int num_itens,
+                                 int* linha_erro) {
+    int num_categorias = 0;
+    double peso_categorias = 0.0;
+
+    if(num_itens == 0 || itens[0].tipo != CATEGORIA) {
+        if(num_itens > 0) {
+            *linha_erro = itens[0].linha;
+        }
+        return "o perfil precisa comecar com uma categoria";
+    }
+    for(int i = 0; i < num_itens; i++) {
+        for(int j = 0; j < i; j++) {
+            if(strcmp(itens[i].nome, itens[j].nome) == 0) {
+                *linha_erro = itens[i].linha;
+                return "nome repetido no perfil";
+            }
+        }
+        if(itens[i].tipo == CATEGORIA) {
+            num_categorias++;
+            peso_categorias += itens[i].peso;
+        }
+    }
+    if(!(peso_categorias > 0.0)) {
+        return "a soma dos pesos das categorias tem que ser positiva";
+    }
+
+    strncpy(modelo->nome, nome, 63);
+    modelo->nome[63] = '\0';
+    modelo->num_nos = 1 + num_itens;
+    modelo->prototipos = (No*) malloc(modelo->num_nos * sizeof(No));
+    modelo->ligacoes = (NoModelo*) calloc(modelo->num_nos, sizeof(NoModelo));
+
+    preencher_prototipo(&modelo->prototipos[0], "Carteira", RAIZ, 0.0);
+    modelo->ligacoes[0].pai = -1;
+    modelo->ligacoes[0].primeiro_filho = 1;
+    modelo->ligacoes[0].num_filhos = num_categorias;
+    modelo->ligacoes[0].fracao = 1.0;
+
+    // em largura: primeiro as categorias, depois os ativos de cada categoria em sequencia
+    int categoria = 0;
+    int proximo_ativo = 1 + num_categorias;
+    double acumulado_categorias = 0.0;
+
+    for(int i = 0; i < num_itens; i++) {
+        if(itens[i].tipo != CATEGORIA) {
+            continue;
+        }
 
-    // criar no raiz
-    carteira->raiz = criar_no("Carteira", RAIZ, 0.0, 0.0);
+        int fim = i + 1;
+        int com_peso = 0;
+        double peso_ativos = 0.0;
+        while(fim < num_itens && itens[fim].tipo == ATIVO) {
+            com_peso += itens[fim].tem_peso;
+            peso_ativos += itens[fim].tem_peso ? itens[fim].peso : 1.0;
+            fim++;
+        }
+        int num_ativos = fim - i - 1;
+        if(com_peso != 0 && com_peso != num_ativos) {
+            // a culpa e do primeiro ativo que nao segue o primeiro da categoria
+            int j = i + 2;
+            while(itens[j].tem_peso == itens[i + 1].tem_peso) j++;
+            *linha_erro = itens[j].linha;
+            free(modelo->prototipos);
+            free(modelo->ligacoes);
+            return "os ativos de uma categoria tem que ter todos peso ou nenhum";
+        }
+        if(num_ativos > 0 && !(peso_ativos > 0.0)) {
+            *linha_erro = itens[i].linha;
+            free(modelo->prototipos);
+            free(modelo->ligacoes);
+            return "a soma dos pesos dos ativos de uma categoria tem que ser positiva";
+        }
+
+        int c = 1 + categoria;
+        preencher_prototipo(&modelo->prototipos[c], itens[i].nome, CATEGORIA, itens[i].peso / peso_categorias * 100.0);
+        modelo->ligacoes[c].pai = 0;
+        modelo->ligacoes[c].primeiro_filho = proximo_ativo;
+        modelo->ligacoes[c].num_filhos = num_ativos;
+        modelo->ligacoes[c].fracao_antes = acumulado_categorias / peso_categorias;
+        acumulado_categorias += itens[i].peso;
+        modelo->ligacoes[c].fracao = acumulado_categorias / peso_categorias;
+
+        double acumulado_ativos = 0.0;
+        for(int j = i + 1; j < fim; j++) {
+            int a = proximo_ativo++;
+            double peso = itens[j].tem_peso ? itens[j].peso : 1.0;
+            preencher_prototipo(&modelo->prototipos[a], itens[j].nome, ATIVO,
+                                itens[j].tem_peso ? peso / peso_ativos * 100.0 : 0.0);
+            modelo->ligacoes[a].pai = c;
+            modelo->ligacoes[a].primeiro_filho = 0;
+            modelo->ligacoes[a].num_filhos = 0;
+            modelo->ligacoes[a].fracao_antes = acumulado_ativos / peso_ativos;
+            acumulado_ativos += peso;
+            modelo->ligacoes[a].fracao = acumulado_ativos / peso_ativos;
+        }
+
+        categoria++;
+    }
+
+    return NULL;
+}
+
+void liberar_modelo_perfil(ModeloPerfil* modelo) {
+    free(modelo->prototipos);
+    free(modelo->ligacoes);
+    modelo->prototipos = NULL;
+    modelo->ligacoes = NULL;
+    modelo->num_nos = 0;
+}
+
+// Funcao para guardar um modelo no catalogo (substitui o de mesmo nome)
+void catalogo_adicionar(const ModeloPerfil* modelo) {
+    for(int i = 0; i < catalogo_perfis.quantidade; i++) {
+        if(strcmp(catalogo_perfis.perfis[i].nome, modelo->nome) == 0) {
+            liberar_modelo_perfil(&catalogo_perfis.perfis[i]);
+            catalogo_perfis.perfis[i] = *modelo;
+            return;
+        }
+    }
+
+    if(catalogo_perfis.quantidade == catalogo_perfis.capacidade) {
+        catalogo_perfis.capacidade = catalogo_perfis.capacidade == 0 ? 8 : catalogo_perfis.capacidade * 2;
+        catalogo_perfis.perfis = (ModeloPerfil*) realloc(catalogo_perfis.perfis, catalogo_perfis.capacidade * sizeof(ModeloPerfil));
+    }
+    catalogo_perfis.perfis[catalogo_perfis.quantidade++] = *modelo;
+}
+
+// Funcao para ler perfis de um texto no formato do arquivo de configuracao
+// Se alguma linha estiver errada nenhum perfil e guardado; devolve quantos perfis entraram (-1 = erro)
+int carregar_perfis_texto(const char* texto, const char* origem) {
+    ModeloPerfil* lidos = NULL;
+    int num_lidos = 0;
+    ItemPerfil* itens = NULL;
+    int num_itens = 0;
+    int cap_itens = 0;
+    char perfil[64] = "";
+    char linha[256];
+    int numero = 0;
+    int linha_perfil = 0;
+    const char* erro = NULL;
+    const char* p = texto;
+
+    while(erro == NULL) {
+        int fim_do_texto = *p == '\0';
+
+        // um perfil termina no proximo [perfil] ou no fim do texto
+        int novo_perfil = 0;
+        if(!fim_do_texto) {
+            const char* fim_linha = strchr(p, '\n');
+            size_t tamanho = fim_linha != NULL ? (size_t) (fim_linha - p) : strlen(p);
+            numero++;
+            if(tamanho >= sizeof(linha)) {
+                erro = "linha muito longa";
+                break;
+            }
+            memcpy(linha, p, tamanho);
+            linha[tamanho] = '\0';
+            p = fim_linha != NULL ? fim_linha + 1 : p + tamanho;
+
+            linha[strcspn(linha, "\r")] = '\0';
+            char* conteudo = linha;
+            while(*conteudo == ' ' || *conteudo == '\t') conteudo++;
+            char* fim = conteudo + strlen(conteudo);
+            while(fim > conteudo && (fim[-1] == ' ' || fim[-1] == '\t')) fim--;
+            *fim = '\0';
+
+            if(*conteudo == '\0' || *conteudo == '#') {
+                continue;
+            }
+
+            if(strncmp(conteudo, "[perfil ", 8) == 0 && fim[-1] == ']') {
+                novo_perfil = 1;
+                fim[-1] = '\0';
+                char* nome = conteudo + 8;
+                while(*nome == ' ') nome++;
+                if(*nome == '\0' || strlen(nome) > 63) {
+                    erro = "nome de perfil invalido";
+                    break;
+                }
+                // o perfil anterior e fechado abaixo; o nome novo so entra depois
+                memmove(linha, nome, strlen(nome) + 1);
+            } else {
+                int tipo;
+                char* resto;
+                if(strncmp(conteudo, "categoria ", 10) == 0) {
+                    tipo = CATEGORIA;
+                    resto = conteudo + 10;
+                } else if(strncmp(conteudo, "ativo ", 6) == 0) {
+                    tipo = ATIVO;
+                    resto = conteudo + 6;
+                } else {
+                    erro = "esperava [perfil NOME], categoria NOME;PESO ou ativo NOME[;PESO]";
+                    break;
+                }
+                if(perfil[0] == '\0') {
+                    erro = "categoria ou ativo antes do primeiro [perfil NOME]";
+                    break;
+                }
+
+                while(*resto == ' ') resto++;
+                char* separador = strchr(resto, ';');
+                double peso = 0.0;
+                int tem_peso = separador != NULL;
+                if(tem_peso) {
+                    char* fim_peso;
+                    *separador = '\0';
+                    peso = strtod(separador + 1, &fim_peso);
+                    if(fim_peso == separador + 1 || *fim_peso != '\0' || peso < 0.0) {
+                        erro = "peso invalido";
+                        break;
+                    }
+                    char* fim_nome = separador;
+                    while(fim_nome > resto && fim_nome[-1] == ' ') fim_nome--;
+                    *fim_nome = '\0';
+                }
+                if(tipo == CATEGORIA && !tem_peso) {
+                    erro = "categoria sem peso (categoria NOME;PESO)";
+                    break;
+                }
+                if(*resto == '\0' || strlen(resto) > 63) {
+                    erro = "nome invalido";
+                    break;
+                }
+
+                if(num_itens == cap_itens) {
+                    cap_itens = cap_itens == 0 ? 16 : cap_itens * 2;
+                    itens = (ItemPerfil*) realloc(itens, cap_itens * sizeof(ItemPerfil));
+                }
+                itens[num_itens].tipo = tipo;
+                strcpy(itens[num_itens].nome, resto);
+                itens[num_itens].peso = peso;
+                itens[num_itens].tem_peso = tem_peso;
+                itens[num_itens].linha = numero;
+                num_itens++;
+                continue;
+            }
+        }
+
+        if(perfil[0] != '\0') {
+            lidos = (ModeloPerfil*) realloc(lidos, (num_lidos + 1) * sizeof(ModeloPerfil));
+            // o erro de montagem aponta a linha do item culpado, nao a que fechou o perfil
+            int linha_erro = linha_perfil;
+            erro = montar_modelo_perfil(&lidos[num_lidos], perfil, itens, num_itens, &linha_erro);
+            if(erro != NULL) {
+                numero = linha_erro;
+                break;
+            }
+            num_lidos++;
+        }
+
+        if(fim_do_texto) {
+            break;
+        }
+        if(novo_perfil) {
+            strcpy(perfil, linha);
+            linha_perfil = numero;
+            num_itens = 0;
+        }
+    }
+
+    free(itens);
+
+    if(erro != NULL) {
+        fprintf(stderr, "Perfis (%s): linha %d: %s\n", origem, numero, erro);
+        for(int i = 0; i < num_lidos; i++) {
+            liberar_modelo_perfil(&lidos[i]);
+        }
+        free(lidos);
+        return -1;
+    }
+
+    for(int i = 0; i < num_lidos; i++) {
+        catalogo_adicionar(&lidos[i]);
+    }
+    free(lidos);
+
+    return num_lidos;
+}
+
+// Funcao para garantir os perfis padrao no catalogo (chamada antes de qualquer thread)
+void carregar_perfis_padrao() {
+    if(catalogo_perfis.quantidade == 0) {
+        carregar_perfis_texto(perfis_padrao, "padrao");
+    }
+}
+
+// Funcao para ler um arquivo de perfis (devolve quantos perfis entraram, -1 = erro)
+int carregar_perfis(const char* caminho) {
+    FILE* arquivo = fopen(caminho, "rb");
+    if(arquivo == NULL) {
+        fprintf(stderr, "Perfis: nao foi possivel abrir %s\n", caminho);
+        return -1;
+    }
+
+    // le em blocos ate o fim: funciona tambem com pipes e /dev/stdin, que nao tem tamanho
+    size_t capacidade = 4096;
+    size_t tamanho = 0;
+    char* texto = (char*) malloc(capacidade);
+    size_t lidos;
+    while((lidos = fread(texto + tamanho, 1, capacidade - tamanho - 1, arquivo)) > 0) {
+        tamanho += lidos;
+        if(tamanho + 1 == capacidade) {
+            capacidade *= 2;
+            texto = (char*) realloc(texto, capacidade);
+        }
+    }
+    texto[tamanho] = '\0';
+
+    if(ferror(arquivo)) {
+        fprintf(stderr, "Perfis: erro ao ler %s\n", caminho);
+        fclose(arquivo);
+        free(texto);
+        return -1;
+    }
+    fclose(arquivo);
+
+    carregar_perfis_padrao();
+    int quantidade = carregar_perfis_texto(texto, caminho);
+    free(texto);
+
+    return quantidade;
+}
+
+// Funcao para buscar um perfil pelo nome (NULL se nao existir)
+const ModeloPerfil* buscar_perfil(const char* nome) {
+    carregar_perfis_padrao();
+
+    for(int i = 0; i < catalogo_perfis.quantidade; i++) {
+        if(strcmp(catalogo_perfis.perfis[i].nome, nome) == 0) {
+            return &catalogo_perfis.perfis[i];
+        }
+    }
+    return NULL;
+}
+
+// Funcao para criar uma carteira a partir de um modelo: uma copia dos nos e a divisao do valor
+// (sem imprimir nada e sem alocar no a no; os totais ja saem prontos)
+Arvore* instanciar_perfil(const ModeloPerfil* modelo, Centavos valor_inicial) {
+    Arvore* arvore = criar_arvore(modelo->num_nos);
+    No* nos = arena_alocar_nos(&arvore->arena, modelo->num_nos);
+
+    memcpy(nos, modelo->prototipos, modelo->num_nos * sizeof(No));
+
+    for(int i = 0; i < modelo->num_nos; i++) {
+        const NoModelo* ligacao = &modelo->ligacoes[i];
+        No* no = &nos[i];
 
-    // definir percentuais baseado no perfil
-    float perc_rf, perc_rv;
+        if(ligacao->pai < 0) {
+            no->valor_total = valor_inicial;
+        } else {
+            no->pai = &nos[ligacao->pai];
+            Centavos base = no->pai->valor_total;
+            no->valor_total = llround(base * ligacao->fracao) - llround(base * ligacao->fracao_antes);
+        }
+
+        if(ligacao->num_filhos > 0) {
+            int cap = 1 << arena_classe(ligacao->num_filhos < 2 ? 2 : ligacao->num_filhos);
+            no->filhos = arena_alocar_filhos(&arvore->arena, cap);
+            no->cap_filhos = cap;
+            no->num_filhos = ligacao->num_filhos;
+            for(int j = 0; j < ligacao->num_filhos; j++) {
+                no->filhos[j] = &nos[ligacao->primeiro_filho + j];
+            }
+        } else if(ligacao->pai >= 0) {
+            no->valor_investido = no->valor_total;
+        }
 
+        indice_inserir(&arvore->indice, no);
+    }
+
+    arvore->raiz = &nos[0];
+    arvore->valor_total = valor_inicial;
+    arvore->totais_sujos = 0;
+
+    ESTATISTICA_SOMAR(nos_criados, modelo->num_nos);
+
+    return arvore;
+}
+
+// Funcao para montar a carteira de um perfil (sem imprimir nada; perfil desconhecido vira MODERADO)
+Arvore* montar_carteira_perfil(Centavos valor_inicial, const char* perfil) {
+    const ModeloPerfil* modelo = buscar_perfil(perfil);
+    if(modelo == NULL) {
+        modelo = buscar_perfil("MODERADO");
+    }
+
+    return instanciar_perfil(modelo, valor_inicial);
+}
+
+// Funcao para criar carteira por perfil
+Arvore* criar_carteira_perfil(Centavos valor_inicial, const char* perfil) {
     if(strcmp(perfil, "CONSERVADOR") == 0) {
-        perc_rf = 70.0;
-        perc_rv = 30.0;
         printf("\nCriando carteira CONSERVADORA...\n");
     }
     else if(strcmp(perfil, "MODERADO") == 0) {
-        perc_rf = 50.0;
-        perc_rv = 50.0;
         printf("\nCriando carteira MODERADA...\n");
     }
     else if(strcmp(perfil, "ARROJADO") == 0) {
-        perc_rf = 30.0;
-        perc_rv = 70.0;
         printf("\nCriando carteira ARROJADA...\n");
     }
+    else if(buscar_perfil(perfil) != NULL) {
+        printf("\nCriando carteira %s...\n", perfil);
+    }
     else {
-        perc_rf = 50.0;
-        perc_rv = 50.0;
         printf("\nPerfil desconhecido. Usando MODERADO...\n");
     }
 
-    // criar as categorias
-    No* renda_fixa = criar_no("Renda Fixa", CATEGORIA, perc_rf, 0.0);
-    No* acoes = criar_no("Acoes", CATEGORIA, perc_rv, 0.0);
+    Arvore* carteira = montar_carteira_perfil(valor_inicial, perfil);
+    diario_registrar(DIARIO_CRIAR, 0, valor_inicial, 0.0, perfil, NULL);
 
-    // adicionar categorias na raiz (RF esquerda, Acoes direita)
-    carteira->raiz->esquerda = renda_fixa;
-    carteira->raiz->direita = acoes;
+    printf("Carteira criada! Valor total: R$ %.2f\n", centavos_para_reais(carteira->valor_total));
 
-    // calcular valores de cada categoria
-    float valor_rf = valor_inicial * (perc_rf / 100.0);
-    float valor_rv = valor_inicial * (perc_rv / 100.0);
+    return carteira;
+}
 
-    // criar ativos de renda fixa (dividir em 2)
-    No* tesouro = criar_no("Tesouro Selic", ATIVO, 0.0, valor_rf / 2);
-    No* cdb = criar_no("CDB XP", ATIVO, 0.0, valor_rf / 2);
-    renda_fixa->esquerda = tesouro;
-    renda_fixa->direita = cdb;
+// Funcao para devolver uma subarvore para a arena (os slots sao reaproveitados)
+void liberar_no(Arvore* arvore, No* no) {
+    if(no == NULL) return;
 
-    // criar ativos de acoes (dividir em 2)
-    No* petr4 = criar_no("PETR4", ATIVO, 0.0, valor_rv / 2);
-    No* itub4 = criar_no("ITUB4", ATIVO, 0.0, valor_rv / 2);
-    acoes->esquerda = petr4;
-    acoes->direita = itub4;
+    for(int i = 0; i < no->num_filhos; i++) {
+        liberar_no(arvore, no->filhos[i]);
+    }
 
-    // calcular total
-    calcular_total_no(carteira->raiz);
-    carteira->valor_total = carteira->raiz->valor_total;
+    if(no->id_preco >= 0) {
+        desvincular_posicao(arvore, no);
+    }
+    indice_remover(&arvore->indice, no);
+    arena_devolver_filhos(&arvore->arena, no->filhos, no->cap_filhos);
+    arena_devolver_no(&arvore->arena, no);
+}
 
-    printf("Carteira criada! Valor total: R$ %.2f\n", carteira->valor_total);
+// Funcao para tirar um filho do vetor do pai (os irmaos seguintes andam uma posicao)
+void desligar_filho(No* pai, No* filho) {
+    for(int i = 0; i < pai->num_filhos; i++) {
+        if(pai->filhos[i] == filho) {
+            memmove(&pai->filhos[i], &pai->filhos[i + 1], (pai->num_filhos - i - 1) * sizeof(No*));
+            pai->num_filhos--;
+            break;
+        }
+    }
 
-    return carteira;
+    filho->pai = NULL;
+}
+
+// Funcao para compactar a arvore: os nos vivos sao copiados para um bloco so, em ordem de largura
+// (irmaos contiguos, como no snapshot), com vetores de filhos justos e um indice de nomes sem lapides
+// Os alertas e as posicoes cotadas passam a apontar para as copias; ponteiros No* guardados fora
+// da arvore deixam de valer
+void compactar_arvore(Arvore* arvore) {
+    if(arvore->raiz == NULL) {
+        return;
+    }
+
+    int num_nos = 0;
+    int internos = 0;
+    contar_nos_alerta(arvore->raiz, &num_nos, &internos);
+
+    ArenaNos arena;
+    IndiceNomes indice;
+    arena_iniciar(&arena, num_nos);
+    indice_iniciar(&indice, num_nos);
+    No* novos = arena_alocar_nos(&arena, num_nos);
+    No** antigos = (No**) malloc(num_nos * sizeof(No*));
+    int* primeiro_filho = (int*) malloc(num_nos * sizeof(int));
+    IndiceAlertas* alertas = arvore->alertas;
+
+    // primeira passada: copia em largura (a fila e o proprio vetor de nos antigos)
+    int fim = 1;
+    antigos[0] = arvore->raiz;
+    arvore->num_cotados = 0;
+    for(int i = 0; i < num_nos; i++) {
+        No* antigo = antigos[i];
+        No* novo = &novos[i];
+
+        *novo = *antigo;
+        novo->filhos = NULL;
+        novo->cap_filhos = 0;
+        primeiro_filho[i] = fim;
+        for(int j = 0; j < antigo->num_filhos; j++) {
+            antigos[fim++] = antigo->filhos[j];
+        }
+
+        indice_inserir(&indice, novo);
+        if(novo->id_preco >= 0) {
+            arvore->cotados[arvore->num_cotados++] = novo;
+        }
+        if(alertas != NULL && novo->alerta >= 0) {
+            alertas->entradas[novo->alerta].no = novo;
+        }
+    }
+
+    // segunda passada: liga pais e filhos nas copias
+    novos[0].pai = NULL;
+    for(int i = 0; i < num_nos; i++) {
+        No* novo = &novos[i];
+        if(novo->num_filhos == 0) {
+            continue;
+        }
+
+        int cap = 1 << arena_classe(novo->num_filhos < 2 ? 2 : novo->num_filhos);
+        novo->filhos = arena_alocar_filhos(&arena, cap);
+        novo->cap_filhos = cap;
+        for(int j = 0; j < novo->num_filhos; j++) {
+            novo->filhos[j] = &novos[primeiro_filho[i] + j];
+            novo->filhos[j]->pai = novo;
+        }
+
+        if(alertas != NULL) {
+            alertas->grupos[alertas->entradas[novo->filhos[0]->alerta].grupo].pai = novo;
+        }
+    }
+
+    free(primeiro_filho);
+    free(antigos);
+
+    arena_liberar(&arvore->arena);
+    indice_liberar(&arvore->indice);
+    arvore->arena = arena;
+    arvore->indice = indice;
+    arvore->raiz = &novos[0];
+}
+
+// Funcao para tirar um no (e a subarvore dele) da carteira de verdade: sai do vetor do pai,
+// do indice e das posicoes cotadas, e os slots voltam para a arena para o proximo criar_no
+// Com muitos slots livres a arvore e compactada (ponteiros No* de fora deixam de valer)
+void remover_no(Arvore* arvore, No* no) {
+    No* pai = no->pai;
+    if(pai == NULL) {
+        return;
+    }
+
+    // o indice de alertas ainda tem o no: fica desligado ate ser refeito sem ele
+    IndiceAlertas* alertas = arvore->alertas;
+    arvore->alertas = NULL;
+
+    desligar_filho(pai, no);
+    propagar_delta(arvore, pai, -no->valor_total);
+    liberar_no(arvore, no);
+
+    arvore->alertas = alertas;
+    if(alertas != NULL) {
+        reconstruir_indice_alertas(arvore);
+    }
+
+    ArenaNos* arena = &arvore->arena;
+    if(arena->num_livres >= COMPACTAR_MINIMO_LIVRES && arena->num_livres * COMPACTAR_PROPORCAO >= arena->nos_em_uso) {
+        compactar_arvore(arvore);
+    }
 }
 
 // Funcao para remover um ativo
@@ -159,8 +1285,7 @@ void remover_ativo(Arvore* arvore, const char* nome) {
         return;
     }
 
-    // buscar o ativo
-    No* ativo = buscar_no(arvore->raiz, nome);
+    No* ativo = buscar_no(arvore, nome);
 
     if(ativo == NULL) {
         printf("Ativo nao encontrado!\n");
@@ -172,128 +1297,313 @@ void remover_ativo(Arvore* arvore, const char* nome) {
         return;
     }
 
-    // simplificado: apenas zera o valor
-    ativo->valor_investido = 0.0;
-
-    // recalcular totais
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
+    // o no (e o nome dele) volta para a arena: o diario recebe uma copia do nome
+    char removido[64];
+    memcpy(removido, ativo->nome, sizeof(removido));
+    remover_no(arvore, ativo);
+    diario_registrar(DIARIO_REMOVER, 0, 0, 0.0, removido, NULL);
 
     printf("Ativo removido com sucesso!\n");
 }
 
-// Funcao para atualizar percentuais e mostrar status
-void atualizar_percentuais(Arvore* arvore) {
+// Funcao para adicionar um ativo em uma categoria
+void adicionar_ativo(Arvore* arvore, const char* nome_categoria, const char* nome, Centavos valor) {
     if(arvore == NULL || arvore->raiz == NULL) {
         printf("Carteira vazia!\n");
         return;
     }
 
-    // recalcular totais
-    calcular_total_no(arvore->raiz);
-    arvore->valor_total = arvore->raiz->valor_total;
+    No* categoria = buscar_no(arvore, nome_categoria);
 
-    printf("\n=== PERCENTUAIS DA CARTEIRA ===\n");
-    printf("Valor total: R$ %.2f\n\n", arvore->valor_total);
+    if(categoria == NULL) {
+        printf("Categoria nao encontrada!\n");
+        return;
+    }
 
-    // mostrar renda fixa (esquerda)
-    if(arvore->raiz->esquerda != NULL) {
-        No* rf = arvore->raiz->esquerda;
-        float percentual_atual = (rf->valor_total / arvore->valor_total) * 100.0;
+    if(categoria->tipo != CATEGORIA) {
+        printf("Nao e uma categoria!\n");
+        return;
+    }
 
-        printf("%s:\n", rf->nome);
-        printf("  Meta: %.1f%%\n", rf->percentual_alvo);
-        printf("  Atual: %.1f%%\n", percentual_atual);
-        printf("  Valor: R$ %.2f\n", rf->valor_total);
+    if(buscar_no(arvore, nome) != NULL) {
+        printf("Ja existe um ativo com esse nome!\n");
+        return;
+    }
 
-        float diferenca = percentual_atual - rf->percentual_alvo;
-        if(diferenca > 1.0) {
-            printf("  Status: Acima do alvo (+%.1f%%)\n", diferenca);
-        } else if(diferenca < -1.0) {
-            printf("  Status: Abaixo do alvo (%.1f%%)\n", diferenca);
-        } else {
-            printf("  Status: OK\n");
+    No* ativo = criar_no(arvore, nome, ATIVO, 0.0, valor);
+    adicionar_filho(arvore, categoria, ativo);
+    propagar_delta(arvore, ativo, valor);
+    diario_registrar(DIARIO_ADICIONAR, 0, valor, 0.0, ativo->nome, categoria->nome);
+
+    printf("Ativo adicionado com sucesso!\n");
+}
+
+// Funcao para transformar um ativo em posicao cotada (quantidade cotas ao preco da tabela compartilhada)
+void definir_posicao_ativo(Arvore* arvore, const char* nome, double quantidade) {
+    if(arvore == NULL || arvore->raiz == NULL) {
+        printf("Carteira vazia!\n");
+        return;
+    }
+
+    No* ativo = buscar_no(arvore, nome);
+
+    if(ativo == NULL) {
+        printf("Ativo nao encontrado!\n");
+        return;
+    }
+
+    if(ativo->tipo != ATIVO) {
+        printf("Nao e um ativo!\n");
+        return;
+    }
+
+    if(!(quantidade > 0.0)) {
+        printf("Quantidade invalida!\n");
+        return;
+    }
+
+    definir_posicao(arvore, ativo, quantidade);
+    diario_registrar(DIARIO_POSICAO, 0, 0, quantidade, ativo->nome, NULL);
+
+    printf("Posicao de %s: %.4f cotas a R$ %.2f = R$ %.2f\n", ativo->nome, ativo->quantidade,
+           centavos_para_reais(tabela_precos.precos[ativo->id_preco]), centavos_para_reais(ativo->valor_investido));
+}
+
+// Funcao para escrever a situacao das categorias em CSV ou JSON (percentuais e desbalanceamento)
+void formatar_situacao_categorias(Relatorio* relatorio, const char* nome, const ResultadoBalanceamento* resultado) {
+    if(resultado->erro != RELATORIO_OK) {
+        formatar_erro_relatorio(relatorio, nome, resultado->erro);
+        return;
+    }
+
+    if(relatorio->formato == FORMATO_CSV) {
+        relatorio_printf(relatorio, "categoria,meta,atual,diferenca,valor,fora_da_tolerancia\n");
+        for(int i = 0; i < resultado->num_categorias; i++) {
+            const SituacaoCategoria* s = &resultado->categorias[i];
+            relatorio_csv_texto(relatorio, s->categoria->nome);
+            relatorio_printf(relatorio, ",%.4f,%.4f,%.4f,%.2f,%d\n", s->meta, s->atual, s->diferenca,
+                             centavos_para_reais(s->valor), fabs(s->diferenca) > resultado->tolerancia);
         }
-        printf("\n");
+        return;
+    }
+
+    relatorio_printf(relatorio, "{\"relatorio\":\"%s\",\"valor_total\":%.2f,\"tolerancia\":%.4f,\"fora_da_tolerancia\":%d,\"categorias\":[",
+                     nome, centavos_para_reais(resultado->valor_total), resultado->tolerancia, resultado->fora_da_tolerancia);
+    for(int i = 0; i < resultado->num_categorias; i++) {
+        const SituacaoCategoria* s = &resultado->categorias[i];
+        relatorio_printf(relatorio, "%s{\"nome\":", i > 0 ? "," : "");
+        relatorio_json_texto(relatorio, s->categoria->nome);
+        relatorio_printf(relatorio, ",\"meta\":%.4f,\"atual\":%.4f,\"diferenca\":%.4f,\"valor\":%.2f}",
+                         s->meta, s->atual, s->diferenca, centavos_para_reais(s->valor));
     }
+    relatorio_printf(relatorio, "]}\n");
+}
+
+void liberar_resultado_balanceamento(ResultadoBalanceamento* resultado) {
+    free(resultado->categorias);
+    resultado->categorias = NULL;
+    resultado->num_categorias = 0;
+}
 
-    // mostrar acoes (direita)
-    if(arvore->raiz->direita != NULL) {
-        No* acoes = arvore->raiz->direita;
-        float percentual_atual = (acoes->valor_total / arvore->valor_total) * 100.0;
+// Funcao para calcular os percentuais das categorias da carteira (nada e impresso)
+ResultadoBalanceamento calcular_percentuais(Arvore* arvore) {
+    ResultadoBalanceamento resultado;
+    memset(&resultado, 0, sizeof(resultado));
+    resultado.tolerancia = 1.0;
 
-        printf("%s:\n", acoes->nome);
-        printf("  Meta: %.1f%%\n", acoes->percentual_alvo);
-        printf("  Atual: %.1f%%\n", percentual_atual);
-        printf("  Valor: R$ %.2f\n", acoes->valor_total);
+    if(arvore == NULL || arvore->raiz == NULL) {
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
+    }
 
-        float diferenca = percentual_atual - acoes->percentual_alvo;
-        if(diferenca > 1.0) {
-            printf("  Status: Acima do alvo (+%.1f%%)\n", diferenca);
-        } else if(diferenca < -1.0) {
-            printf("  Status: Abaixo do alvo (%.1f%%)\n", diferenca);
+    garantir_totais(arvore);
+
+    resultado.valor_total = arvore->valor_total;
+    resultado.num_categorias = arvore->raiz->num_filhos;
+    resultado.categorias = (SituacaoCategoria*) malloc((resultado.num_categorias + 1) * sizeof(SituacaoCategoria));
+
+    for(int i = 0; i < arvore->raiz->num_filhos; i++) {
+        No* categoria = arvore->raiz->filhos[i];
+        SituacaoCategoria* s = &resultado.categorias[i];
+
+        s->categoria = categoria;
+        s->meta = categoria->percentual_alvo;
+        s->atual = ((double) categoria->valor_total / arvore->valor_total) * 100.0;
+        s->diferenca = s->atual - s->meta;
+        s->valor = categoria->valor_total;
+
+        if(fabs(s->diferenca) > resultado.tolerancia) {
+            resultado.fora_da_tolerancia++;
+        }
+    }
+
+    return resultado;
+}
+
+// Funcao para escrever os percentuais no relatorio
+void formatar_percentuais(Relatorio* relatorio, const ResultadoBalanceamento* resultado) {
+    if(relatorio->formato != FORMATO_TEXTO) {
+        formatar_situacao_categorias(relatorio, "percentuais", resultado);
+        return;
+    }
+
+    if(resultado->erro != RELATORIO_OK) {
+        relatorio_printf(relatorio, "Carteira vazia!\n");
+        return;
+    }
+
+    relatorio_printf(relatorio, "\n=== PERCENTUAIS DA CARTEIRA ===\n");
+    relatorio_printf(relatorio, "Valor total: R$ %.2f\n\n", centavos_para_reais(resultado->valor_total));
+
+    for(int i = 0; i < resultado->num_categorias; i++) {
+        const SituacaoCategoria* s = &resultado->categorias[i];
+
+        relatorio_printf(relatorio, "%s:\n", s->categoria->nome);
+        relatorio_printf(relatorio, "  Meta: %.1f%%\n", s->meta);
+        relatorio_printf(relatorio, "  Atual: %.1f%%\n", s->atual);
+        relatorio_printf(relatorio, "  Valor: R$ %.2f\n", centavos_para_reais(s->valor));
+
+        if(s->diferenca > resultado->tolerancia) {
+            relatorio_printf(relatorio, "  Status: Acima do alvo (+%.1f%%)\n", s->diferenca);
+        } else if(s->diferenca < -resultado->tolerancia) {
+            relatorio_printf(relatorio, "  Status: Abaixo do alvo (%.1f%%)\n", s->diferenca);
         } else {
-            printf("  Status: OK\n");
+            relatorio_printf(relatorio, "  Status: OK\n");
         }
-        printf("\n");
+        relatorio_printf(relatorio, "\n");
     }
 }
 
-// Funcao para listar ativos de uma categoria
-void listar_ativos(Arvore* arvore, const char* nome_categoria) {
+// Funcao para atualizar percentuais e mostrar status
+void atualizar_percentuais(Arvore* arvore) {
+    ResultadoBalanceamento resultado = calcular_percentuais(arvore);
+
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_percentuais(&relatorio, &resultado);
+    relatorio_escrever(&relatorio, stdout);
+
+    relatorio_liberar(&relatorio);
+    liberar_resultado_balanceamento(&resultado);
+}
+
+// Funcao para juntar os ativos de uma categoria (nada e impresso)
+ResultadoListagem calcular_listagem(Arvore* arvore, const char* nome_categoria) {
+    ResultadoListagem resultado;
+    memset(&resultado, 0, sizeof(resultado));
+
     if(arvore == NULL || arvore->raiz == NULL) {
-        printf("Carteira vazia!\n");
-        return;
+        resultado.erro = RELATORIO_CARTEIRA_VAZIA;
+        return resultado;
     }
 
-    No* categoria = buscar_no(arvore->raiz, nome_categoria);
+    No* categoria = buscar_no(arvore, nome_categoria);
 
     if(categoria == NULL) {
-        printf("Categoria nao encontrada!\n");
-        return;
+        resultado.erro = RELATORIO_NAO_ENCONTRADO;
+        return resultado;
     }
 
     if(categoria->tipo != CATEGORIA) {
-        printf("Nao e uma categoria!\n");
-        return;
+        resultado.erro = RELATORIO_NAO_E_CATEGORIA;
+        return resultado;
     }
 
-    printf("\n=== ATIVOS EM %s ===\n", categoria->nome);
+    garantir_totais(arvore);
+
+    resultado.categoria = categoria;
+    resultado.num_ativos = categoria->num_filhos;
+    resultado.ativos = (No**) malloc((categoria->num_filhos + 1) * sizeof(No*));
+    memcpy(resultado.ativos, categoria->filhos, categoria->num_filhos * sizeof(No*));
+    resultado.total = categoria->valor_total;
+
+    return resultado;
+}
+
+// Funcao para escrever a lista de ativos no relatorio
+void formatar_listagem(Relatorio* relatorio, const ResultadoListagem* resultado) {
+    if(relatorio->formato == FORMATO_TEXTO) {
+        if(resultado->erro == RELATORIO_CARTEIRA_VAZIA) {
+            relatorio_printf(relatorio, "Carteira vazia!\n");
+            return;
+        }
+        if(resultado->erro == RELATORIO_NAO_ENCONTRADO) {
+            relatorio_printf(relatorio, "Categoria nao encontrada!\n");
+            return;
+        }
+        if(resultado->erro == RELATORIO_NAO_E_CATEGORIA) {
+            relatorio_printf(relatorio, "Nao e uma categoria!\n");
+            return;
+        }
+
+        relatorio_printf(relatorio, "\n=== ATIVOS EM %s ===\n", resultado->categoria->nome);
+
+        for(int i = 0; i < resultado->num_ativos; i++) {
+            No* ativo = resultado->ativos[i];
+            relatorio_printf(relatorio, "%d. %s - R$ %.2f\n", i + 1, ativo->nome, centavos_para_reais(ativo->valor_investido));
+        }
 
-    int count = 0;
+        if(resultado->num_ativos == 0) {
+            relatorio_printf(relatorio, "Nenhum ativo nesta categoria.\n");
+        }
+
+        relatorio_printf(relatorio, "Total: R$ %.2f\n", centavos_para_reais(resultado->total));
+        return;
+    }
 
-    // listar ativo da esquerda
-    if(categoria->esquerda != NULL) {
-        count++;
-        printf("%d. %s - R$ %.2f\n", count, categoria->esquerda->nome, categoria->esquerda->valor_investido);
+    if(resultado->erro != RELATORIO_OK) {
+        formatar_erro_relatorio(relatorio, "ativos", resultado->erro);
+        return;
     }
 
-    // listar ativo da direita
-    if(categoria->direita != NULL) {
-        count++;
-        printf("%d. %s - R$ %.2f\n", count, categoria->direita->nome, categoria->direita->valor_investido);
+    if(relatorio->formato == FORMATO_CSV) {
+        relatorio_printf(relatorio, "categoria,ativo,valor\n");
+        for(int i = 0; i < resultado->num_ativos; i++) {
+            relatorio_csv_texto(relatorio, resultado->categoria->nome);
+            relatorio_printf(relatorio, ",");
+            relatorio_csv_texto(relatorio, resultado->ativos[i]->nome);
+            relatorio_printf(relatorio, ",%.2f\n", centavos_para_reais(resultado->ativos[i]->valor_investido));
+        }
+        return;
     }
 
-    if(count == 0) {
-        printf("Nenhum ativo nesta categoria.\n");
+    relatorio_printf(relatorio, "{\"relatorio\":\"ativos\",\"categoria\":");
+    relatorio_json_texto(relatorio, resultado->categoria->nome);
+    relatorio_printf(relatorio, ",\"total\":%.2f,\"ativos\":[", centavos_para_reais(resultado->total));
+    for(int i = 0; i < resultado->num_ativos; i++) {
+        relatorio_printf(relatorio, "%s{\"nome\":", i > 0 ? "," : "");
+        relatorio_json_texto(relatorio, resultado->ativos[i]->nome);
+        relatorio_printf(relatorio, ",\"valor\":%.2f}", centavos_para_reais(resultado->ativos[i]->valor_investido));
     }
+    relatorio_printf(relatorio, "]}\n");
+}
 
-    printf("Total: R$ %.2f\n", categoria->valor_total);
+void liberar_resultado_listagem(ResultadoListagem* resultado) {
+    free(resultado->ativos);
+    resultado->ativos = NULL;
+    resultado->num_ativos = 0;
 }
 
-// Funcao para liberar memoria
-void liberar_no(No* no) {
-    if(no == NULL) return;
+// Funcao para listar ativos de uma categoria
+void listar_ativos(Arvore* arvore, const char* nome_categoria) {
+    ResultadoListagem resultado = calcular_listagem(arvore, nome_categoria);
 
-    liberar_no(no->esquerda);
-    liberar_no(no->direita);
+    Relatorio relatorio;
+    relatorio_iniciar(&relatorio, FORMATO_TEXTO);
+    formatar_listagem(&relatorio, &resultado);
+    relatorio_escrever(&relatorio, stdout);
 
-    free(no);
+    relatorio_liberar(&relatorio);
+    liberar_resultado_listagem(&resultado);
 }
 
+// Funcao para liberar memoria (a arena solta todos os nos de uma vez)
 void liberar_arvore(Arvore* arvore) {
     if(arvore == NULL) return;
 
-    liberar_no(arvore->raiz);
+    liberar_indice_alertas(arvore->alertas);
+    free(arvore->cotados);
+    arena_liberar(&arvore->arena);
+    indice_liberar(&arvore->indice);
     free(arvore);
 }
\ No newline at end of file
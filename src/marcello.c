@@ -4,21 +4,32 @@
 
 // parte do marcello - menu interativo
 
+#include "../struct.h"
+
 // declaracoes das funcoes do Luis
-typedef struct No No;
-typedef struct Arvore Arvore;
 
-Arvore* criar_carteira_perfil(float valor_inicial, const char* perfil);
+Arvore* criar_carteira_perfil(Centavos valor_inicial, const char* perfil);
 void atualizar_percentuais(Arvore* arvore);
 void listar_ativos(Arvore* arvore, const char* nome_categoria);
 void remover_ativo(Arvore* arvore, const char* nome);
+void adicionar_ativo(Arvore* arvore, const char* nome_categoria, const char* nome, Centavos valor);
 void liberar_arvore(Arvore* arvore);
+int salvar_carteira(Arvore* arvore, const char* caminho);
+Arvore* carregar_carteira(const char* caminho);
+Centavos reais_para_centavos(double valor);
+double centavos_para_reais(Centavos valor);
 
 // declaracoes das funcoes do Gabriel
 void detectar_desbalanceamento(Arvore* arvore);
 void sugerir_rebalanceamento(Arvore* arvore);
-void simular_aporte(Arvore* arvore, float valor_aporte);
-void atualizar_valores_mercado(Arvore* arvore, char* nome_ativo, float novo_valor);
+void simular_aporte(Arvore* arvore, Centavos valor_aporte, int modo);
+void atualizar_valores_mercado(Arvore* arvore, char* nome_ativo, Centavos novo_valor);
+
+// declaracoes das estatisticas
+void mostrar_estatisticas();
+
+// declaracoes do diario de operacoes
+int diario_checkpoint(Arvore* carteira);
 
 // funcoes auxiliares do menu
 void limpar_tela() {
@@ -38,7 +49,7 @@ void pausar() {
 // funcao principal do menu
 void menu_principal(Arvore** carteira) {
     int opcao;
-    float valor;
+    double valor;
     char nome[64];
     int escolha;
 
@@ -56,6 +67,10 @@ void menu_principal(Arvore** carteira) {
         printf("6. Detectar desbalanceamento\n");
         printf("7. Sugerir rebalanceamento\n");
         printf("8. Simular aporte\n");
+        printf("9. Adicionar ativo\n");
+        printf("10. Salvar carteira\n");
+        printf("11. Carregar carteira\n");
+        printf("12. Estatisticas\n");
         printf("0. Sair\n");
         printf("========================================\n");
         printf("Escolha uma opcao: ");
@@ -70,7 +85,7 @@ void menu_principal(Arvore** carteira) {
             }
 
             printf("\nQual o valor inicial da carteira? R$ ");
-            scanf("%f", &valor);
+            scanf("%lf", &valor);
 
             printf("\nEscolha o perfil da carteira:\n");
             printf("1. CONSERVADOR (70%% Renda Fixa, 30%% Acoes)\n");
@@ -79,16 +94,18 @@ void menu_principal(Arvore** carteira) {
             printf("Opcao: ");
             scanf("%d", &escolha);
 
+            ESTATISTICA_INICIO(inicio);
             if(escolha == 1) {
-                *carteira = criar_carteira_perfil(valor, "CONSERVADOR");
+                *carteira = criar_carteira_perfil(reais_para_centavos(valor), "CONSERVADOR");
             } else if(escolha == 2) {
-                *carteira = criar_carteira_perfil(valor, "MODERADO");
+                *carteira = criar_carteira_perfil(reais_para_centavos(valor), "MODERADO");
             } else if(escolha == 3) {
-                *carteira = criar_carteira_perfil(valor, "ARROJADO");
+                *carteira = criar_carteira_perfil(reais_para_centavos(valor), "ARROJADO");
             } else {
                 printf("\nOpcao invalida! Usando MODERADO...\n");
-                *carteira = criar_carteira_perfil(valor, "MODERADO");
+                *carteira = criar_carteira_perfil(reais_para_centavos(valor), "MODERADO");
             }
+            ESTATISTICA_FIM(OPERACAO_CRIAR, inicio);
 
             pausar();
         }
@@ -97,7 +114,9 @@ void menu_principal(Arvore** carteira) {
             if(*carteira == NULL) {
                 printf("\nCrie uma carteira primeiro! (opcao 1)\n");
             } else {
+                ESTATISTICA_INICIO(inicio);
                 atualizar_percentuais(*carteira);
+                ESTATISTICA_FIM(OPERACAO_PERCENTUAIS, inicio);
             }
             pausar();
         }
@@ -112,6 +131,7 @@ void menu_principal(Arvore** carteira) {
                 printf("Opcao: ");
                 scanf("%d", &escolha);
 
+                ESTATISTICA_INICIO(inicio);
                 if(escolha == 1) {
                     listar_ativos(*carteira, "Renda Fixa");
                 } else if(escolha == 2) {
@@ -119,6 +139,7 @@ void menu_principal(Arvore** carteira) {
                 } else {
                     printf("\nOpcao invalida!\n");
                 }
+                ESTATISTICA_FIM(OPERACAO_LISTAR, inicio);
             }
             pausar();
         }
@@ -130,8 +151,10 @@ void menu_principal(Arvore** carteira) {
                 printf("\nNome do ativo (ex: PETR4, ITUB4, Tesouro Selic, CDB XP): ");
                 scanf("%s", nome);
                 printf("Novo valor do ativo: R$ ");
-                scanf("%f", &valor);
-                atualizar_valores_mercado(*carteira, nome, valor);
+                scanf("%lf", &valor);
+                ESTATISTICA_INICIO(inicio);
+                atualizar_valores_mercado(*carteira, nome, reais_para_centavos(valor));
+                ESTATISTICA_FIM(OPERACAO_ATUALIZAR, inicio);
             }
             pausar();
         }
@@ -142,7 +165,9 @@ void menu_principal(Arvore** carteira) {
             } else {
                 printf("\nNome do ativo a remover: ");
                 scanf("%s", nome);
+                ESTATISTICA_INICIO(inicio);
                 remover_ativo(*carteira, nome);
+                ESTATISTICA_FIM(OPERACAO_REMOVER, inicio);
             }
             pausar();
         }
@@ -151,7 +176,9 @@ void menu_principal(Arvore** carteira) {
             if(*carteira == NULL) {
                 printf("\nCrie uma carteira primeiro! (opcao 1)\n");
             } else {
+                ESTATISTICA_INICIO(inicio);
                 detectar_desbalanceamento(*carteira);
+                ESTATISTICA_FIM(OPERACAO_DETECTAR, inicio);
             }
             pausar();
         }
@@ -160,7 +187,9 @@ void menu_principal(Arvore** carteira) {
             if(*carteira == NULL) {
                 printf("\nCrie uma carteira primeiro! (opcao 1)\n");
             } else {
+                ESTATISTICA_INICIO(inicio);
                 sugerir_rebalanceamento(*carteira);
+                ESTATISTICA_FIM(OPERACAO_REBALANCEAR, inicio);
             }
             pausar();
         }
@@ -170,8 +199,90 @@ void menu_principal(Arvore** carteira) {
                 printf("\nCrie uma carteira primeiro! (opcao 1)\n");
             } else {
                 printf("\nQual o valor do aporte? R$ ");
-                scanf("%f", &valor);
-                simular_aporte(*carteira, valor);
+                scanf("%lf", &valor);
+                printf("\nComo distribuir o aporte?\n");
+                printf("1. Proporcional as metas\n");
+                printf("2. Primeiro o que esta mais abaixo da meta (evita vendas)\n");
+                printf("Opcao: ");
+                scanf("%d", &escolha);
+                ESTATISTICA_INICIO(inicio);
+                simular_aporte(*carteira, reais_para_centavos(valor),
+                               escolha == 2 ? APORTE_NIVELADO : APORTE_PROPORCIONAL);
+                ESTATISTICA_FIM(OPERACAO_APORTE, inicio);
+            }
+            pausar();
+        }
+        else if(opcao == 9) {
+            // adicionar ativo em uma categoria
+            if(*carteira == NULL) {
+                printf("\nCrie uma carteira primeiro! (opcao 1)\n");
+            } else {
+                printf("\nEm qual categoria?\n");
+                printf("1. Renda Fixa\n");
+                printf("2. Acoes\n");
+                printf("Opcao: ");
+                scanf("%d", &escolha);
+                printf("Nome do novo ativo: ");
+                scanf("%s", nome);
+                printf("Valor investido: R$ ");
+                scanf("%lf", &valor);
+
+                ESTATISTICA_INICIO(inicio);
+                if(escolha == 1) {
+                    adicionar_ativo(*carteira, "Renda Fixa", nome, reais_para_centavos(valor));
+                } else if(escolha == 2) {
+                    adicionar_ativo(*carteira, "Acoes", nome, reais_para_centavos(valor));
+                } else {
+                    printf("\nOpcao invalida!\n");
+                }
+                ESTATISTICA_FIM(OPERACAO_ADICIONAR, inicio);
+            }
+            pausar();
+        }
+        else if(opcao == 10) {
+            // salvar a carteira em arquivo binario
+            if(*carteira == NULL) {
+                printf("\nCrie uma carteira primeiro! (opcao 1)\n");
+            } else {
+                printf("\nNome do arquivo: ");
+                scanf("%s", nome);
+                ESTATISTICA_INICIO(inicio);
+                if(salvar_carteira(*carteira, nome)) {
+                    printf("Carteira salva com sucesso!\n");
+                } else {
+                    printf("Nao foi possivel salvar a carteira!\n");
+                }
+                ESTATISTICA_FIM(OPERACAO_SALVAR, inicio);
+            }
+            pausar();
+        }
+        else if(opcao == 11) {
+            // carregar uma carteira salva
+            printf("\nNome do arquivo: ");
+            scanf("%s", nome);
+
+            ESTATISTICA_INICIO(inicio);
+            Arvore* carregada = carregar_carteira(nome);
+            ESTATISTICA_FIM(OPERACAO_CARREGAR, inicio);
+            if(carregada == NULL) {
+                printf("Arquivo invalido ou inexistente!\n");
+            } else {
+                if(*carteira != NULL) {
+                    liberar_arvore(*carteira);
+                }
+                *carteira = carregada;
+                diario_checkpoint(carregada);
+                printf("Carteira carregada! Valor total: R$ %.2f\n", centavos_para_reais(carregada->valor_total));
+            }
+            pausar();
+        }
+        else if(opcao == 12) {
+            // estatisticas (liga a coleta se estiver desligada)
+            if(!estatisticas.ativas) {
+                estatisticas.ativas = 1;
+                printf("\nEstatisticas ligadas! Elas aparecem aqui a partir das proximas operacoes.\n");
+            } else {
+                mostrar_estatisticas();
             }
             pausar();
         }
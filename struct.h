@@ -6,20 +6,777 @@
 #define CATEGORIA 1
 #define RAIZ 0
 
+// Modos de distribuir um aporte
+#define APORTE_PROPORCIONAL 0
+#define APORTE_NIVELADO 1
+
+// Dinheiro em centavos (inteiro de 64 bits: as somas sao exatas)
+typedef long long Centavos;
+
 // Structs
 typedef struct No {
     char nome[64];
+    unsigned int hash;
     int tipo;
-    float percentual_alvo;
-    float valor_investido;
-    float valor_total;
-    struct No* esquerda;
-    struct No* direita;
+    double percentual_alvo;
+    Centavos valor_investido;
+    Centavos valor_total;
+    struct No* pai;
+    struct No** filhos;
+    int num_filhos;
+    int cap_filhos;
+    int alerta;
+    int id_preco;
+    double quantidade;
 } No;
 
+// Bloco de nos da arena (os nos ficam contiguos no bloco)
+typedef struct BlocoNos {
+    struct BlocoNos* proximo;
+    int capacidade;
+    int usados;
+    No nos[];
+} BlocoNos;
+
+// Bloco de vetores de filhos da arena
+typedef struct BlocoFilhos {
+    struct BlocoFilhos* proximo;
+    int capacidade;
+    int usados;
+    No* ponteiros[];
+} BlocoFilhos;
+
+#define ARENA_CLASSES 32
+
+// Arena de nos e vetores de filhos de uma arvore
+typedef struct ArenaNos {
+    BlocoNos* blocos_nos;
+    BlocoFilhos* blocos_filhos;
+    No* nos_livres;
+    No** filhos_livres[ARENA_CLASSES];
+    int nos_em_uso;
+    int num_livres;
+} ArenaNos;
+
+// Compactacao depois de remocoes: so quando sobram pelo menos COMPACTAR_MINIMO_LIVRES slots
+// livres e eles passam de 1 para cada COMPACTAR_PROPORCAO nos em uso
+#define COMPACTAR_MINIMO_LIVRES 64
+#define COMPACTAR_PROPORCAO 4
+
+// Indice de nomes (tabela hash com enderecamento aberto)
+typedef struct IndiceNomes {
+    No** slots;
+    int capacidade;
+    int quantidade;
+    int ocupados;
+} IndiceNomes;
+
+// Tabela de precos compartilhada por todas as carteiras do processo (um preco por ticker)
+// Cada mudanca de preco ganha uma epoca nova; epocas[id] e a epoca da ultima mudanca do ticker id
+typedef struct TabelaPrecos {
+    char (*tickers)[64];
+    unsigned int* hashes;
+    Centavos* precos;
+    unsigned long long* epocas;
+    int quantidade;
+    int capacidade;
+    int* slots;
+    int capacidade_slots;
+    unsigned long long epoca;
+} TabelaPrecos;
+
+extern TabelaPrecos tabela_precos;
+
+// Posicoes cotadas (id_preco >= 0): valor_investido = quantidade * preco do ticker (nome do no)
+// A carteira so e reavaliada quando e lida depois de uma epoca nova (epoca_precos ficou para tras)
 typedef struct Arvore {
     No* raiz;
-    float valor_total;
+    Centavos valor_total;
+    int totais_sujos;
+    IndiceNomes indice;
+    ArenaNos arena;
+    struct IndiceAlertas* alertas;
+    No** cotados;
+    int num_cotados;
+    int cap_cotados;
+    unsigned long long epoca_precos;
 } Arvore;
 
+// Ligacoes e divisao do valor de um no de modelo (ordem de largura: os filhos de cada no ficam contiguos)
+// O no fica com llround(total_pai * fracao) - llround(total_pai * fracao_antes) do total do pai
+typedef struct NoModelo {
+    int pai;
+    int primeiro_filho;
+    int num_filhos;
+    double fracao_antes;
+    double fracao;
+} NoModelo;
+
+// Modelo de perfil: nos prontos para uma copia so (nome, hash, tipo e meta ja preenchidos)
+typedef struct ModeloPerfil {
+    char nome[64];
+    int num_nos;
+    No* prototipos;
+    NoModelo* ligacoes;
+} ModeloPerfil;
+
+// Linha de um perfil enquanto o arquivo de configuracao e lido (categoria ou ativo)
+// linha = numero da linha no arquivo, para as mensagens de erro
+typedef struct ItemPerfil {
+    int tipo;
+    char nome[64];
+    double peso;
+    int tem_peso;
+    int linha;
+} ItemPerfil;
+
+// Perfis conhecidos (os tres padrao e os lidos de arquivos de configuracao)
+typedef struct CatalogoPerfis {
+    ModeloPerfil* perfis;
+    int quantidade;
+    int capacidade;
+} CatalogoPerfis;
+
+// Situacao de um no em relacao a faixa meta +- tolerancia
+#define ALERTA_DENTRO 0
+#define ALERTA_ACIMA 1
+#define ALERTA_ABAIXO 2
+
+// Alerta disparado quando um no entra ou sai da faixa
+typedef struct AlertaDrift {
+    No* no;
+    int estado_anterior;
+    int estado;
+    double percentual_atual;
+    double meta;
+    double diferenca;
+} AlertaDrift;
+
+typedef void (*CallbackAlerta)(const AlertaDrift* alerta, void* contexto);
+
+// Heap indexado de entradas (maximo = 1: maior chave no topo)
+typedef struct HeapAlerta {
+    int* itens;
+    int quantidade;
+    int maximo;
+    int lado;
+} HeapAlerta;
+
+// Entrada de um no (menos a raiz) no grupo dos filhos do seu pai
+// No grupo de total T o no esta acima se chave_acima > T e abaixo se chave_abaixo < T
+// acima/abaixo dizem em qual heap a entrada esta; estado e o ultimo estado avisado no callback
+// meta e a meta efetiva do no no grupo (a mesma que o planejador usa)
+typedef struct EntradaAlerta {
+    No* no;
+    double meta;
+    double chave_acima;
+    double chave_abaixo;
+    int acima;
+    int abaixo;
+    int estado;
+    int grupo;
+    int pos_acima;
+    int pos_abaixo;
+    int pendente;
+} EntradaAlerta;
+
+// Filhos de um no: dentro/acima pelo lado de cima e dentro/abaixo pelo lado de baixo
+typedef struct GrupoAlerta {
+    No* pai;
+    HeapAlerta dentro_acima;
+    HeapAlerta acima;
+    HeapAlerta dentro_abaixo;
+    HeapAlerta abaixo;
+} GrupoAlerta;
+
+typedef struct IndiceAlertas {
+    double tolerancia;
+    CallbackAlerta callback;
+    void* contexto;
+    EntradaAlerta* entradas;
+    int num_entradas;
+    GrupoAlerta* grupos;
+    int num_grupos;
+    int* memoria_heaps;
+    int* pendentes;
+    int num_pendentes;
+    int fora_da_faixa;
+    long long alertas_disparados;
+} IndiceAlertas;
+
+// Visao plana de um conjunto de nos (vetores contiguos para os kernels)
+// totais[i] e o total do pai de nos[i]; grupos[i] diz de qual conta veio a linha
+typedef struct VisaoPlana {
+    int quantidade;
+    int capacidade;
+    No** nos;
+    int* grupos;
+    double* valores;
+    double* totais;
+    double* alvos;
+    double* diferencas;
+} VisaoPlana;
+
+// Ordem de compra (quantia > 0) ou venda (quantia < 0) de um ativo
+typedef struct OrdemRebalanceamento {
+    No* ativo;
+    Centavos valor_atual;
+    Centavos valor_novo;
+    Centavos quantia;
+} OrdemRebalanceamento;
+
+// Lista de ordens que leva a carteira de volta para dentro da tolerancia
+typedef struct PlanoRebalanceamento {
+    OrdemRebalanceamento* ordens;
+    int num_ordens;
+    int capacidade;
+    Centavos total_compras;
+    Centavos total_vendas;
+} PlanoRebalanceamento;
+
+// Desvio de uma posicao em relacao ao seu alvo (ordenado no nivelamento)
+typedef struct DesvioPosicao {
+    Centavos desvio;
+    int indice;
+} DesvioPosicao;
+
+// Formatos de saida dos relatorios
+#define FORMATO_TEXTO 0
+#define FORMATO_CSV 1
+#define FORMATO_JSON 2
+
+// Erros devolvidos nos resultados das analises
+#define RELATORIO_OK 0
+#define RELATORIO_CARTEIRA_VAZIA 1
+#define RELATORIO_NAO_ENCONTRADO 2
+#define RELATORIO_NAO_E_CATEGORIA 3
+#define RELATORIO_VALOR_INVALIDO 4
+
+// Buffer de saida: os relatorios sao montados aqui e escritos de uma vez
+typedef struct Relatorio {
+    char* texto;
+    size_t tamanho;
+    size_t capacidade;
+    int formato;
+} Relatorio;
+
+// Situacao de uma categoria em relacao a meta (percentuais em pontos percentuais)
+typedef struct SituacaoCategoria {
+    No* categoria;
+    double meta;
+    double atual;
+    double diferenca;
+    Centavos valor;
+} SituacaoCategoria;
+
+// Resultado de atualizar_percentuais e detectar_desbalanceamento
+typedef struct ResultadoBalanceamento {
+    int erro;
+    Centavos valor_total;
+    double tolerancia;
+    int fora_da_tolerancia;
+    SituacaoCategoria* categorias;
+    int num_categorias;
+} ResultadoBalanceamento;
+
+// Resultado de listar_ativos
+typedef struct ResultadoListagem {
+    int erro;
+    No* categoria;
+    No** ativos;
+    int num_ativos;
+    Centavos total;
+} ResultadoListagem;
+
+// Resultado de sugerir_rebalanceamento
+typedef struct ResultadoRebalanceamento {
+    int erro;
+    double tolerancia;
+    PlanoRebalanceamento plano;
+} ResultadoRebalanceamento;
+
+// Quanto uma categoria recebeu de um aporte
+typedef struct AporteCategoria {
+    No* categoria;
+    Centavos antes;
+    Centavos recebido;
+} AporteCategoria;
+
+// Resultado de simular_aporte (depois = situacao das categorias com o aporte ja aplicado)
+typedef struct ResultadoAporte {
+    int erro;
+    int modo;
+    Centavos valor_aporte;
+    AporteCategoria* categorias;
+    int num_categorias;
+    int ativos_com_aporte;
+    ResultadoBalanceamento depois;
+    int ordens_pendentes;
+    Centavos vendas_pendentes;
+    Centavos valor_total_novo;
+} ResultadoAporte;
+
+// Atualizacao de preco de um ativo (usada no lote de mercado)
+typedef struct AtualizacaoMercado {
+    const char* nome_ativo;
+    Centavos novo_valor;
+} AtualizacaoMercado;
+
+// Resumo de um lote de atualizacoes de mercado
+typedef struct ResumoLoteMercado {
+    int aplicadas;
+    int nao_encontradas;
+    Centavos valor_total_anterior;
+    Centavos valor_total_novo;
+    double variacao_total;
+    No* maior_alta;
+    double variacao_maior_alta;
+    No* maior_baixa;
+    double variacao_maior_baixa;
+} ResumoLoteMercado;
+
+// Resumo da leitura de um feed de precos
+typedef struct ResumoFeed {
+    long linhas;
+    long ticks;
+    long nao_encontrados;
+    long invalidas;
+    double segundos;
+} ResumoFeed;
+
+// Snapshot binario da carteira (formato nativo, pode ser mapeado direto com mmap)
+#define SNAPSHOT_MAGICO "OTCART01"
+#define SNAPSHOT_VERSAO 4
+
+// lsn = ultima operacao do diario que ja esta no snapshot (0 sem diario)
+typedef struct CabecalhoSnapshot {
+    char magico[8];
+    unsigned int versao;
+    unsigned int num_nos;
+    Centavos valor_total;
+    long long lsn;
+} CabecalhoSnapshot;
+
+// No gravado em ordem de largura: os filhos de cada no ficam contiguos
+typedef struct NoSnapshot {
+    char nome[64];
+    Centavos valor_investido;
+    Centavos valor_total;
+    double percentual_alvo;
+    unsigned int hash;
+    int tipo;
+    int pai;
+    int primeiro_filho;
+    int num_filhos;
+    int cotado;
+    double quantidade;
+} NoSnapshot;
+
+typedef struct SnapshotCarteira {
+    void* base;
+    size_t tamanho;
+    const CabecalhoSnapshot* cabecalho;
+    const NoSnapshot* nos;
+} SnapshotCarteira;
+
+// Diario de operacoes (write-ahead): cada mudanca na carteira vira um registro de tamanho fixo
+#define DIARIO_MAGICO "OTDIAR01"
+#define DIARIO_VERSAO 1
+
+#define DIARIO_CRIAR 1
+#define DIARIO_ATUALIZAR 2
+#define DIARIO_REMOVER 3
+#define DIARIO_ADICIONAR 4
+#define DIARIO_APORTE 5
+#define DIARIO_POSICAO 6
+#define DIARIO_PRECO 7
+
+// Commit em grupo: os registros vao para o disco (um fdatasync) quando o grupo enche
+// ou quando o mais antigo ja esperou DIARIO_ESPERA_MS
+#define DIARIO_GRUPO 256
+#define DIARIO_ESPERA_MS 2
+
+// lsn_base = ultimo lsn que ja esta no snapshot quando o diario foi (re)iniciado
+typedef struct CabecalhoDiario {
+    char magico[8];
+    unsigned int versao;
+    unsigned int tamanho_registro;
+    long long lsn_base;
+} CabecalhoDiario;
+
+// crc = CRC-32C de todos os campos depois dele; um registro rasgado por queda nao confere
+typedef struct RegistroDiario {
+    unsigned int crc;
+    int operacao;
+    long long lsn;
+    Centavos valor;
+    double quantidade;
+    int modo;
+    int reservado;
+    char nome[64];
+    char categoria[64];
+} RegistroDiario;
+
+typedef struct Diario {
+    int fd;
+    char* caminho;
+    RegistroDiario* pendentes;
+    int num_pendentes;
+    int grupo;
+    long long espera_ns;
+    long long primeiro_pendente_ns;
+    long long lsn;
+    long long registros;
+    long long confirmacoes;
+    long long lsn_snapshot;
+    long long reaplicados;
+    long long ignorados;
+    long long descartados;
+    double segundos_reaplicar;
+} Diario;
+
+extern Diario diario;
+
+// Colecao de carteiras (uma por conta de cliente)
+typedef struct MotorCarteiras {
+    Arvore** carteiras;
+    int quantidade;
+    int capacidade;
+} MotorCarteiras;
+
+// Categoria fora da tolerancia em uma conta
+typedef struct DriftCategoria {
+    int conta;
+    No* categoria;
+    double percentual_atual;
+    double diferenca;
+} DriftCategoria;
+
+// Conta desbalanceada (suas categorias ficam em drifts[primeiro_drift..])
+typedef struct ContaDesbalanceada {
+    int conta;
+    int primeiro_drift;
+    int num_drifts;
+} ContaDesbalanceada;
+
+typedef struct ResultadoVarredura {
+    ContaDesbalanceada* contas;
+    int num_contas;
+    DriftCategoria* drifts;
+    int num_drifts;
+    int contas_verificadas;
+    int threads;
+    double segundos;
+} ResultadoVarredura;
+
+// Parametros da simulacao de Monte Carlo (retornos e volatilidades anuais por categoria da raiz)
+typedef struct ParametrosMonteCarlo {
+    int caminhos;
+    int anos;
+    int passos_por_ano;
+    int rebalancear_a_cada;
+    double tolerancia;
+    double correlacao;
+    unsigned long long semente;
+    int threads;
+    int num_categorias;
+    double* retornos;
+    double* volatilidades;
+} ParametrosMonteCarlo;
+
+// Resultado da simulacao (valores_finais e drifts_finais ordenados, um por caminho)
+typedef struct ResultadoMonteCarlo {
+    int caminhos;
+    int passos;
+    int threads;
+    double valor_inicial;
+    double* valores_finais;
+    double* drifts_finais;
+    double media_rebalanceamentos;
+    double segundos;
+} ResultadoMonteCarlo;
+
+// Base de precos colunar (arquivo mapeado: datas e depois uma serie contigua por ticker)
+#define PRECOS_MAGICO "OTPREC01"
+#define PRECOS_VERSAO 1
+
+typedef struct CabecalhoPrecos {
+    char magico[8];
+    unsigned int versao;
+    unsigned int num_tickers;
+    unsigned int num_dias;
+    unsigned int reservado;
+} CabecalhoPrecos;
+
+typedef struct BasePrecos {
+    void* base;
+    size_t tamanho;
+    const CabecalhoPrecos* cabecalho;
+    const char (*nomes)[64];
+    const int* datas;
+    const double* series;
+} BasePrecos;
+
+// Regras de rebalanceamento do backtest
+#define BACKTEST_NUNCA 0
+#define BACKTEST_LIMITE 1
+#define BACKTEST_CALENDARIO 2
+
+typedef struct ConfigBacktest {
+    const char* perfil;
+    int regra;
+    double tolerancia;
+    int intervalo_dias;
+} ConfigBacktest;
+
+typedef struct ResultadoBacktest {
+    ConfigBacktest config;
+    double valor_inicial;
+    double valor_final;
+    double retorno_anual;
+    double volatilidade_anual;
+    double maior_queda;
+    int rebalanceamentos;
+    double giro;
+} ResultadoBacktest;
+
+// Versao imutavel dos totais da carteira: o escritor publica, os leitores so leem
+// Cada categoria da raiz guarda seus descendentes em nos[primeiro_no..primeiro_no + num_nos)
+typedef struct CategoriaVersao {
+    char nome[64];
+    double percentual_alvo;
+    Centavos valor_investido;
+    Centavos valor_total;
+    int primeiro_no;
+    int num_nos;
+} CategoriaVersao;
+
+typedef struct NoVersao {
+    char nome[64];
+    Centavos valor_investido;
+    int tipo;
+    int categoria;
+} NoVersao;
+
+typedef struct VersaoCarteira {
+    long long numero;
+    long long epoca_retirada;
+    struct VersaoCarteira* proxima_retirada;
+    Centavos valor_total;
+    int num_categorias;
+    int num_nos;
+    CategoriaVersao* categorias;
+    NoVersao* nos;
+} VersaoCarteira;
+
+// Epoca anunciada por um leitor (0 = fora de uma leitura); uma linha de cache por leitor
+#define PUBLICADOR_MAX_LEITORES 64
+
+typedef struct EpocaLeitor {
+    long long epoca;
+    char preenchimento[56];
+} EpocaLeitor;
+
+// Publicacao estilo RCU: um escritor troca a versao atual com uma troca atomica e as versoes
+// antigas so sao liberadas quando nenhum leitor que possa estar com elas continua lendo
+typedef struct PublicadorCarteira {
+    VersaoCarteira* atual;
+    long long epoca;
+    int num_leitores;
+    EpocaLeitor leitores[PUBLICADOR_MAX_LEITORES];
+    VersaoCarteira* retiradas;
+    int num_retiradas;
+    long long publicadas;
+    long long liberadas;
+} PublicadorCarteira;
+
+// Servico local: operacoes do protocolo binario (cabecalho fixo + corpo)
+#define SERVICO_CRIAR 1
+#define SERVICO_ATUALIZAR 2
+#define SERVICO_APORTE 3
+#define SERVICO_DETECTAR 4
+#define SERVICO_REBALANCEAR 5
+#define SERVICO_PRECO 6
+#define SERVICO_LIBERAR 7
+#define SERVICO_ENCERRAR 8
+
+// Situacao devolvida no cabecalho da resposta
+#define SERVICO_OK 0
+#define SERVICO_CONTA_INVALIDA 1
+#define SERVICO_NAO_ENCONTRADO 2
+#define SERVICO_PEDIDO_INVALIDO 3
+
+// Maior corpo aceito em um pedido e tamanho dos buffers de cada conexao
+#define SERVICO_MAX_CORPO 4096
+#define SERVICO_BUFFER (64 * 1024)
+#define SERVICO_MAX_CONEXOES 256
+
+// Maior valor (em centavos) que uma carteira do servico pode somar: R$ 10 trilhoes
+// Mantem totais, planos e aportes bem longe do limite de Centavos
+#define SERVICO_VALOR_MAXIMO 1000000000000000LL
+
+// Cabecalho de pedidos e respostas (16 bytes, na ordem de bytes da maquina: o servico e local)
+// tamanho = bytes do corpo que vem logo depois; id volta igual na resposta (pedidos em pipeline)
+typedef struct CabecalhoServico {
+    unsigned int tamanho;
+    unsigned int id;
+    unsigned short operacao;
+    unsigned short situacao;
+    int conta;
+} CabecalhoServico;
+
+// Corpo de um pedido (campos que a operacao nao usa ficam zerados; corpo menor e completado com zeros)
+typedef struct PedidoServico {
+    Centavos valor;
+    double tolerancia;
+    int modo;
+    int reservado;
+    char nome[64];
+} PedidoServico;
+
+// Corpo de uma resposta, seguido de quantidade itens (DesvioServico ou OrdemServico)
+typedef struct RespostaServico {
+    Centavos valor_total;
+    int quantidade;
+    int fora_da_tolerancia;
+} RespostaServico;
+
+typedef struct DesvioServico {
+    char nome[64];
+    double meta;
+    double atual;
+    double diferenca;
+} DesvioServico;
+
+typedef struct OrdemServico {
+    char ativo[64];
+    Centavos valor_atual;
+    Centavos quantia;
+} OrdemServico;
+
+// Conexao de um cliente: o que chegou e ainda nao virou pedido, e o que falta enviar
+typedef struct ConexaoServico {
+    int fd;
+    char* entrada;
+    size_t tamanho_entrada;
+    char* saida;
+    size_t tamanho_saida;
+    size_t capacidade_saida;
+    size_t enviado;
+} ConexaoServico;
+
+typedef struct Servico {
+    int fd_escuta;
+    int fd_epoll;
+    MotorCarteiras contas;
+    ConexaoServico* conexoes[SERVICO_MAX_CONEXOES];
+    int num_conexoes;
+    long long pedidos;
+    long long lotes;
+    long long maior_lote;
+    int encerrar;
+} Servico;
+
+// Lado do cliente: respostas recebidas ficam entre inicio e fim ate serem consumidas
+typedef struct ClienteServico {
+    int fd;
+    char* entrada;
+    size_t inicio;
+    size_t fim;
+} ClienteServico;
+
+// Estatisticas internas (contadores, tempos e histogramas de latencia)
+// Compiladas por padrao; com -DOTIMIZADOR_ESTATISTICAS=0 os macros somem do codigo
+// Em tempo de execucao so contam quando estatisticas.ativas (./Main --stats ...)
+#ifndef OTIMIZADOR_ESTATISTICAS
+#define OTIMIZADOR_ESTATISTICAS 1
+#endif
+
+// Operacoes medidas no menu e no modo script (mesmos nomes dos comandos do script)
+#define OPERACAO_CRIAR 0
+#define OPERACAO_PERCENTUAIS 1
+#define OPERACAO_LISTAR 2
+#define OPERACAO_ATUALIZAR 3
+#define OPERACAO_REMOVER 4
+#define OPERACAO_ADICIONAR 5
+#define OPERACAO_DETECTAR 6
+#define OPERACAO_REBALANCEAR 7
+#define OPERACAO_APORTE 8
+#define OPERACAO_SALVAR 9
+#define OPERACAO_CARREGAR 10
+#define OPERACAO_FEED 11
+#define OPERACAO_MONTE_CARLO 12
+#define OPERACOES_MEDIDAS 13
+
+// Balde i do histograma: latencias entre 2^(i-1) e 2^i - 1 nanossegundos
+#define ESTATISTICAS_BALDES 40
+
+typedef struct HistogramaLatencia {
+    long long chamadas;
+    long long total_ns;
+    long long maximo_ns;
+    long long baldes[ESTATISTICAS_BALDES];
+} HistogramaLatencia;
+
+typedef struct EstatisticasOtimizador {
+    int ativas;
+    long long buscas;
+    long long buscas_encontradas;
+    long long slots_visitados;
+    long long passes_total;
+    long long nos_somados;
+    long long ns_total;
+    long long nos_criados;
+    long long alocacoes_criar_no;
+    HistogramaLatencia operacoes[OPERACOES_MEDIDAS];
+} EstatisticasOtimizador;
+
+extern EstatisticasOtimizador estatisticas;
+
+// Contador de alocacoes (alocacoes por operacao no --bench e por no criado nas estatisticas)
+// Desligado por padrao, sem custo nenhum no malloc; para contar, compile com
+// -DOTIMIZADOR_CONTAR_ALOCACOES=1 -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+// Cada thread conta as proprias alocacoes (sem disputa entre as threads)
+#ifndef OTIMIZADOR_CONTAR_ALOCACOES
+#define OTIMIZADOR_CONTAR_ALOCACOES 0
+#endif
+
+extern __thread long long alocacoes_feitas;
+long long agora_ns();
+void registrar_latencia(int operacao, long long ns);
+
+#if OTIMIZADOR_ESTATISTICAS
+#define ESTATISTICA_SOMAR(campo, quantia) \
+    do { if(estatisticas.ativas) __atomic_add_fetch(&estatisticas.campo, (quantia), __ATOMIC_RELAXED); } while(0)
+#define ESTATISTICA_INICIO(variavel) long long variavel = estatisticas.ativas ? agora_ns() : 0
+#define ESTATISTICA_FIM(operacao, variavel) \
+    do { if(estatisticas.ativas) registrar_latencia((operacao), agora_ns() - (variavel)); } while(0)
+#else
+#define ESTATISTICA_SOMAR(campo, quantia) do { (void) sizeof(quantia); } while(0)
+#define ESTATISTICA_INICIO(variavel) long long variavel = 0
+#define ESTATISTICA_FIM(operacao, variavel) do { (void) (variavel); } while(0)
+#endif
+
+// Carteira sintetica usada pelo benchmark (nos[] em ordem de largura, nos[0] = raiz)
+typedef struct CarteiraSintetica {
+    Arvore* arvore;
+    No** nos;
+    int num_nos;
+    int profundidade;
+    Centavos* valores_iniciais;
+} CarteiraSintetica;
+
+// Resultado da medicao de uma operacao do benchmark
+typedef struct MedicaoBench {
+    const char* operacao;
+    int num_nos;
+    int profundidade;
+    int repeticoes;
+    long long lote;
+    double ns_op_mediana;
+    double ns_op_minimo;
+    double ops_por_segundo;
+    double alocacoes_op;
+} MedicaoBench;
+
 #endif
\ No newline at end of file